@@ -2,11 +2,16 @@ QT = core widgets gui #gui is required for QFileIconProvider and plugininterface
 lessThan(QT_MAJOR_VERSION, 6) {
 	win*:QT += winextras
 }
+# QTextCodec, for content search in legacy code pages
+greaterThan(QT_MAJOR_VERSION, 5) {
+	QT += core5compat
+}
 
 CONFIG += staticlib
 CONFIG += strict_c++
 
 include(../global.pri)
+include(decompression.pri)
 
 contains(QT_ARCH, x86_64) {
 	ARCHITECTURE = x64
@@ -66,4 +71,5 @@ INCLUDEPATH += \
 	../cpputils \
 	../cpp-template-utils \
 	../thin_io/src \
+	../text-encoding-detector/text-encoding-detector/src \
 	../3rdparty
@@ -1,7 +1,7 @@
 TEMPLATE = subdirs
 
 SUBDIRS = fileoperations filesystemobject filesystemobject-high-level filecomparator panel filesearchengine
-SUBDIRS += qtutils cpputils cpp-template-utils test-utils thin_io
+SUBDIRS += qtutils cpputils cpp-template-utils test-utils thin_io text_encoding_detector
 
 # The automated GUI-component tests live with the UI sources but build and run with the test suite.
 SUBDIRS += gui-fileoperations
@@ -11,6 +11,7 @@ gui-fileoperations.depends = qtutils cpputils thin_io
 cpp-template-utils.subdir = ../../cpp-template-utils
 cpputils.subdir = ../../cpputils
 thin_io.subdir = ../../thin_io
+text_encoding_detector.subdir = ../../text-encoding-detector/text-encoding-detector
 
 qtutils.subdir = ../../qtutils
 qtutils.depends = cpputils
@@ -23,4 +24,4 @@ filesystemobject.depends = qtutils thin_io
 filesystemobject-high-level.depends = qtutils thin_io
 filecomparator.depends = cpputils test-utils thin_io
 panel.depends = cpputils test-utils thin_io
-filesearchengine.depends = cpputils test-utils thin_io
+filesearchengine.depends = cpputils test-utils thin_io text_encoding_detector
@@ -271,3 +271,21 @@ TEST_CASE("compareFolders: an aborted comparison says so", "[foldercomparison]")
 	CHECK(result.aborted);
 	CHECK(result.identicalFiles == 0);
 }
+
+TEST_CASE("compareFolders: excluded subtrees are left out on both sides", "[foldercomparison]")
+{
+	QTemporaryDir left, right;
+	REQUIRE(left.isValid());
+	REQUIRE(right.isValid());
+
+	writeFile(left.path() % "/same.bin", QByteArray(10, 's'));
+	writeFile(right.path() % "/same.bin", QByteArray(10, 's'));
+	writeFile(left.path() % "/.git/objects/left-only.bin", QByteArray(10, 'l'));
+	writeFile(right.path() % "/.git/objects/right-only.bin", QByteArray(10, 'r'));
+	writeFile(left.path() % "/build/out.o", QByteArray(10, 'o'));
+
+	const auto result = compareFolders(left.path(), right.path(), PairingMode::Exact, std::atomic<bool>{false}, {}, ScanExclusions{ { QSL(".git"), QSL("/build") } });
+
+	CHECK(result.differences.empty());
+	CHECK(result.identicalFiles == 1);
+}
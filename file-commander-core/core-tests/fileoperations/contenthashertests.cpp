@@ -0,0 +1,55 @@
+// The content hash of a verifying copy: XXH64 with seed 0, the same whichever pieces the stream is fed in.
+
+#include "fileoperations/ccontenthasher.h"
+
+#include "fileoperationtesthelpers.h"
+
+#include <algorithm>
+#include <string_view>
+
+namespace
+{
+
+uint64_t hashInPieces(const QByteArray& data, const int pieceSize)
+{
+	CContentHasher hasher;
+	for (int offset = 0; offset < data.size(); offset += pieceSize)
+		hasher.update(data.constData() + offset, static_cast<size_t>(std::min(pieceSize, static_cast<int>(data.size()) - offset)));
+	return hasher.digest();
+}
+
+} // namespace
+
+TEST_CASE("content hash: the reference XXH64 values", "[contenthasher]")
+{
+	const auto hashOf = [](const std::string_view text) {
+		CContentHasher hasher;
+		hasher.update(text.data(), text.size());
+		return hasher.digest();
+	};
+
+	CHECK(CContentHasher{}.digest() == 0xEF46DB3751D8E999ull);
+	CHECK(hashOf("abc") == 0x44BC2CF5AD770999ull);
+	CHECK(hashOf("Nobody inspects the spammish repetition") == 0xFBCEA83C8A378BF1ull); // Past a whole stripe
+}
+
+TEST_CASE("content hash: how the stream is split does not matter", "[contenthasher]")
+{
+	const QByteArray data = patternedContents(100'003);
+	const uint64_t whole = hashInPieces(data, data.size());
+	CHECK(hashInPieces(data, 1) == whole);
+	CHECK(hashInPieces(data, 31) == whole);
+	CHECK(hashInPieces(data, 32) == whole);
+	CHECK(hashInPieces(data, 4096) == whole);
+	CHECK(hashInPieces(patternedContents(100'002), 4096) != whole);
+}
+
+TEST_CASE("content hash: zeros fed by length hash like zeros fed as data", "[contenthasher]")
+{
+	const QByteArray zeros(200'001, '\0');
+	CContentHasher hasher;
+	hasher.update("head", 4);
+	hasher.updateZeros(static_cast<uint64_t>(zeros.size()));
+
+	CHECK(hasher.digest() == hashInPieces(QByteArray{ "head" } + zeros, 1000));
+}
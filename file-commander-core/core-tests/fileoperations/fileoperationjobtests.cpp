@@ -14,6 +14,7 @@ RESTORE_COMPILER_WARNINGS
 #include <errno.h>
 #endif
 
+#include <algorithm>
 #include <chrono>
 #include <thread>
 
@@ -745,3 +746,172 @@ TEST_CASE("job: concurrent independent jobs", "[fileoperationjob]")
 	CHECK(deleteDriver.summary()->completedItems == 4);
 	CHECK(entryAbsent(baseB % "/victim"));
 }
+
+TEST_CASE("job: a queued job waits for its turn on the device", "[fileoperationjob]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+
+	writeTestFile(base % "/src.bin", patternedContents(1000));
+	const auto request = transferRequest(TransferKind::Copy, { base % "/src.bin" }, DestinationIntent::ExactEntry, base % "/dest.bin");
+
+	CFileOperationQueue queue;
+	// Stands for another job on the same device that is already running
+	const CFileOperationQueue::JobId otherJob = queue.enqueue(CFileOperationQueue::devicesOf(request));
+	REQUIRE(!CFileOperationQueue::devicesOf(request).empty());
+
+	CFileOperationJob job{ request, 1024, 1, &queue };
+	JobDriver driver{ job };
+	job.start();
+
+	const auto reportedQueued = [&driver] {
+		return std::ranges::any_of(driver.events, [](const OperationEvent& event) {
+			const auto* progress = std::get_if<ProgressSnapshot>(&event);
+			return progress && progress->phase == OperationPhase::Queued;
+		});
+	};
+	REQUIRE(waitUntil([&] {
+		job.processEvents(driver);
+		return reportedQueued();
+	}));
+	REQUIRE(queue.queuedJobs().size() == 1);
+
+	SECTION("and runs once the device is free")
+	{
+		CHECK(job.prioritize()); // Already first; still waiting there
+		std::this_thread::sleep_for(20ms);
+		CHECK(job.status() == JobStatus::Running);
+		CHECK(entryAbsent(base % "/dest.bin"));
+
+		queue.remove(otherJob);
+		REQUIRE(driver.pumpToCompletion());
+		CHECK(driver.summary()->status == CompletionStatus::Completed);
+		CHECK(readFileContents(base % "/dest.bin") == patternedContents(1000));
+		CHECK(queue.queuedJobs().empty());
+		CHECK(!job.prioritize());
+	}
+
+	SECTION("moving up passes the job queued ahead of it")
+	{
+		const CFileOperationQueue::JobId jobAhead = queue.enqueue(CFileOperationQueue::devicesOf(request));
+		REQUIRE(queue.prioritize(jobAhead));
+		REQUIRE(queue.queuedJobs().front().id == jobAhead);
+
+		CHECK(job.moveUp());
+		REQUIRE(queue.queuedJobs().size() == 2);
+		CHECK(queue.queuedJobs().back().id == jobAhead);
+		CHECK(!job.moveUp()); // First already
+
+		queue.remove(otherJob);
+		REQUIRE(driver.pumpToCompletion());
+		CHECK(driver.summary()->status == CompletionStatus::Completed);
+		CHECK(!job.moveUp());
+		queue.remove(jobAhead);
+	}
+
+	SECTION("a pause holds it in the queue")
+	{
+		job.setPaused(true);
+		CHECK(queue.queuedJobs().front().held);
+		job.setPaused(false);
+		CHECK(!queue.queuedJobs().front().held);
+		queue.remove(otherJob);
+		REQUIRE(driver.pumpToCompletion());
+		CHECK(driver.summary()->status == CompletionStatus::Completed);
+	}
+
+	SECTION("cancellation ends the wait without touching anything")
+	{
+		job.cancel();
+		REQUIRE(driver.pumpToCompletion());
+		CHECK(driver.summary()->status == CompletionStatus::Cancelled);
+		CHECK(entryAbsent(base % "/dest.bin"));
+		CHECK(queue.queuedJobs().empty());
+		queue.remove(otherJob);
+	}
+}
+
+TEST_CASE("job: a delete does not wait behind a transfer on its device", "[fileoperationjob]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+
+	writeTestFile(base % "/victim.bin", patternedContents(1000));
+	const auto request = deleteRequest({ base % "/victim.bin" });
+
+	CFileOperationQueue queue;
+	// Stands for a long copy on the same device that is already running
+	const CFileOperationQueue::JobId otherJob = queue.enqueue(CFileOperationQueue::devicesOf(request));
+	REQUIRE(!CFileOperationQueue::devicesOf(request).empty());
+
+	CFileOperationJob job{ request, 1024, 1, &queue };
+	JobDriver driver{ job };
+	job.start();
+	REQUIRE(driver.pumpToCompletion());
+	CHECK(driver.summary()->status == CompletionStatus::Completed);
+	CHECK(entryAbsent(base % "/victim.bin"));
+	CHECK(queue.queuedJobs().empty());
+	queue.remove(otherJob);
+}
+
+TEST_CASE("job: a throughput limit paces the copy, and can be changed while it runs", "[fileoperationjob]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+
+	writeTestFile(base % "/src.bin", patternedContents(300'000));
+
+	CTransferThrottle shared;
+	CFileOperationJob job{ transferRequest(TransferKind::Copy, { base % "/src.bin" }, DestinationIntent::ExactEntry, base % "/dest.bin"), 16 * 1024, 1,
+		nullptr, PageCachePolicy::Automatic, &shared };
+	JobDriver driver{ job };
+	job.setTransferRateLimit(100'000); // Three seconds for the file
+	job.start();
+
+	const auto reportedLimit = [&driver](const uint64_t limit) {
+		return std::ranges::any_of(driver.events, [limit](const OperationEvent& event) {
+			const auto* progress = std::get_if<ProgressSnapshot>(&event);
+			return progress && progress->bytesPerSecondLimit == limit;
+		});
+	};
+	REQUIRE(waitUntil([&] {
+		job.processEvents(driver);
+		return reportedLimit(100'000);
+	}));
+	CHECK(entryAbsent(base % "/dest.bin"));
+
+	SECTION("lifting the limit lets it finish")
+	{
+		job.setTransferRateLimit(std::nullopt);
+		REQUIRE(driver.pumpToCompletion(2s));
+		CHECK(driver.summary()->status == CompletionStatus::Completed);
+		CHECK(readFileContents(base % "/dest.bin") == patternedContents(300'000));
+	}
+
+	SECTION("the shared limit holds it back, too, and is reported when it is the lower one")
+	{
+		shared.setLimit(50'000);
+		REQUIRE(waitUntil([&] {
+			job.processEvents(driver);
+			return reportedLimit(50'000);
+		}));
+		CHECK(entryAbsent(base % "/dest.bin"));
+
+		shared.setLimit(std::nullopt);
+		job.setTransferRateLimit(std::nullopt);
+		REQUIRE(driver.pumpToCompletion(2s));
+		CHECK(driver.summary()->status == CompletionStatus::Completed);
+	}
+
+	SECTION("cancellation ends the wait")
+	{
+		job.cancel();
+		REQUIRE(driver.pumpToCompletion(2s));
+		CHECK(driver.summary()->status == CompletionStatus::Cancelled);
+		CHECK(entryAbsent(base % "/dest.bin"));
+		CHECK(stagingFileCount(base) == 0);
+	}
+}
@@ -0,0 +1,196 @@
+// CFileOperationQueue: jobs on disjoint devices run side by side, jobs that share one take turns in queue order,
+// and the queued ones can be held, reordered and prioritized.
+
+#include "fileoperations/cfileoperationqueue.h"
+
+#include "fileoperationtesthelpers.h"
+
+DISABLE_COMPILER_WARNINGS
+#include <QTemporaryDir>
+RESTORE_COMPILER_WARNINGS
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using JobId = CFileOperationQueue::JobId;
+using namespace std::chrono_literals;
+
+namespace
+{
+
+[[nodiscard]] bool isRunning(CFileOperationQueue& queue, const JobId id)
+{
+	return queue.waitForTurn(id, [] { return true; });
+}
+
+[[nodiscard]] std::vector<JobId> queuedIds(const CFileOperationQueue& queue)
+{
+	std::vector<JobId> ids;
+	for (const CFileOperationQueue::QueuedJob& job : queue.queuedJobs())
+		ids.push_back(job.id);
+	return ids;
+}
+
+} // namespace
+
+TEST_CASE("queue: jobs on disjoint devices run side by side", "[fileoperationqueue]")
+{
+	CFileOperationQueue queue;
+	const JobId first = queue.enqueue({ 1, 2 });
+	const JobId second = queue.enqueue({ 3 });
+	const JobId unknownDevices = queue.enqueue({});
+
+	CHECK(isRunning(queue, first));
+	CHECK(isRunning(queue, second));
+	CHECK(isRunning(queue, unknownDevices));
+	CHECK(queue.queuedJobs().empty());
+}
+
+TEST_CASE("queue: jobs that share a device take turns in queue order", "[fileoperationqueue]")
+{
+	CFileOperationQueue queue;
+	const JobId first = queue.enqueue({ 1, 2 });
+	const JobId second = queue.enqueue({ 2, 3 });
+	const JobId third = queue.enqueue({ 3 }); // Device 3 is free, but the job ahead wants it
+	const JobId fourth = queue.enqueue({ 4 });
+
+	CHECK(isRunning(queue, first));
+	CHECK(!isRunning(queue, second));
+	CHECK(!isRunning(queue, third));
+	CHECK(isRunning(queue, fourth));
+	CHECK(queuedIds(queue) == std::vector{ second, third });
+
+	queue.remove(first);
+	CHECK(isRunning(queue, second));
+	CHECK(!isRunning(queue, third));
+
+	queue.remove(second);
+	CHECK(isRunning(queue, third));
+	CHECK(queue.queuedJobs().empty());
+}
+
+TEST_CASE("queue: a held job keeps its place but is passed over", "[fileoperationqueue]")
+{
+	CFileOperationQueue queue;
+	const JobId running = queue.enqueue({ 1 });
+	const JobId held = queue.enqueue({ 1 }, true);
+	const JobId next = queue.enqueue({ 1 });
+
+	queue.remove(running);
+	CHECK(!isRunning(queue, held));
+	CHECK(isRunning(queue, next));
+	CHECK(queuedIds(queue) == std::vector{ held });
+	CHECK(queue.queuedJobs().front().held);
+
+	CHECK(queue.setHeld(held, false));
+	CHECK(!isRunning(queue, held)); // Still behind the running one
+	queue.remove(next);
+	CHECK(isRunning(queue, held));
+	CHECK(!queue.setHeld(held, true)); // Only a queued job can be held
+}
+
+TEST_CASE("queue: queued jobs can be reordered", "[fileoperationqueue]")
+{
+	CFileOperationQueue queue;
+	const JobId running = queue.enqueue({ 1 });
+	const JobId a = queue.enqueue({ 1 });
+	const JobId b = queue.enqueue({ 1 });
+	const JobId c = queue.enqueue({ 1 });
+
+	CHECK(queue.prioritize(c));
+	CHECK(queuedIds(queue) == std::vector{ c, a, b });
+	CHECK(queue.moveJob(c, 100));
+	CHECK(queuedIds(queue) == std::vector{ a, b, c });
+	CHECK(queue.moveJob(b, 0));
+	CHECK(queuedIds(queue) == std::vector{ b, a, c });
+
+	CHECK(!queue.prioritize(running)); // Not queued any more
+	queue.remove(running);
+	CHECK(isRunning(queue, b));
+	CHECK(!queue.moveJob(b, 1));
+}
+
+TEST_CASE("queue: a waiting job is admitted, or stops waiting, from another thread", "[fileoperationqueue]")
+{
+	CFileOperationQueue queue;
+	const JobId running = queue.enqueue({ 1 });
+
+	SECTION("admitted when the running job leaves")
+	{
+		const JobId waiting = queue.enqueue({ 1 });
+		std::atomic<bool> reportedWaiting = false;
+		std::atomic<bool> admitted = false;
+		std::thread waiter{ [&] {
+			admitted = queue.waitForTurn(waiting, [] { return false; }, [&] { reportedWaiting = true; });
+		} };
+
+		std::this_thread::sleep_for(20ms);
+		CHECK(!admitted);
+		queue.remove(running);
+		waiter.join();
+		CHECK(admitted);
+		CHECK(reportedWaiting);
+	}
+
+	SECTION("stops waiting when told to")
+	{
+		const JobId waiting = queue.enqueue({ 1 });
+		std::atomic<bool> stop = false;
+		std::atomic<bool> admitted = true;
+		std::thread waiter{ [&] {
+			admitted = queue.waitForTurn(waiting, [&] { return stop.load(); });
+		} };
+
+		std::this_thread::sleep_for(20ms);
+		stop = true;
+		queue.wake();
+		waiter.join();
+		CHECK(!admitted);
+
+		queue.remove(waiting);
+		CHECK(queue.queuedJobs().empty());
+	}
+
+	SECTION("a job admitted right away does not report waiting")
+	{
+		queue.remove(running);
+		const JobId next = queue.enqueue({ 1 });
+		bool reportedWaiting = false;
+		CHECK(queue.waitForTurn(next, [] { return false; }, [&] { reportedWaiting = true; }));
+		CHECK(!reportedWaiting);
+	}
+}
+
+TEST_CASE("queue: the devices of a request", "[fileoperationqueue]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+	writeTestFile(base % "/a.bin", patternedContents(10));
+	writeTestFile(base % "/b.bin", patternedContents(10));
+
+	auto request = makeTransferRequest(TransferKind::Copy, { base % "/a.bin", base % "/b.bin" }, DestinationIntent::IntoDirectory, base % "/not yet");
+	REQUIRE(request.has_value());
+	const std::vector<uint64_t> devices = CFileOperationQueue::devicesOf(*request);
+	CHECK(devices.size() == 1); // One temporary directory, and a destination that will be created in it
+}
+
+#ifdef _WIN32
+TEST_CASE("queue: a network share is a device of its own", "[fileoperationqueue]")
+{
+	// Only the spelling is read: none of these has to exist
+	const auto devicesOfCopy = [](const QString& source, const QString& destination) {
+		auto request = makeTransferRequest(TransferKind::Copy, { source }, DestinationIntent::IntoDirectory, destination);
+		REQUIRE(request.has_value());
+		return CFileOperationQueue::devicesOf(*request);
+	};
+
+	const std::vector<uint64_t> sameShare = devicesOfCopy(QStringLiteral("//server/share/a.bin"), QStringLiteral("//SERVER/Share/dest"));
+	CHECK(sameShare.size() == 1);
+
+	const std::vector<uint64_t> twoShares = devicesOfCopy(QStringLiteral("//server/share/a.bin"), QStringLiteral("//server/other/dest"));
+	CHECK(twoShares.size() == 2);
+	CHECK(std::ranges::find(twoShares, sameShare.front()) != twoShares.end());
+}
+#endif
@@ -35,14 +35,19 @@ SOURCES += \
 	entrypathtests.cpp \
 	newnamechecktests.cpp \
 	filesystemmutatortests.cpp \
+	contenthashertests.cpp \
 	stagedfilecopytests.cpp \
+	transferchunksizertests.cpp \
 	destinationresolvertests.cpp \
 	sourcetreebuildertests.cpp \
+	transferjournaltests.cpp \
+	transferthrottletests.cpp \
 	transferexecutortests.cpp \
 	deleteexecutortests.cpp \
 	moveexecutortests.cpp \
 	crossvolumetests.cpp \
 	hostilenametests.cpp \
+	fileoperationqueuetests.cpp \
 	fileoperationjobtests.cpp \
 	inlinerenametests.cpp \
 	../../src/filesystemhelperfunctions.cpp \
@@ -26,6 +26,7 @@ RESTORE_COMPILER_WARNINGS
 #include <unistd.h>
 #endif
 
+#include <set>
 #include <stdint.h>
 #include <string>
 
@@ -85,19 +86,19 @@ inline constexpr uint64_t defaultTransferChunkSize = 64 * 1024;
 // One synchronous run of an operation, with the request validated on the way in. A case that has to interleave with
 // an operation already in flight builds the executor itself: releasing a barrier takes a second thread.
 inline OperationSummary runTransfer(OperationScript& script, const TransferKind kind, const QStringList& sources,
-	const DestinationIntent intent, const QString& destination, const uint64_t chunkSize = defaultTransferChunkSize)
+	const DestinationIntent intent, const QString& destination, const uint64_t chunkSize = defaultTransferChunkSize, const uint32_t fileCopyWorkers = 1)
 {
 	const auto request = makeTransferRequest(kind, sources, intent, destination);
 	REQUIRE(request.has_value());
 	auto context = makeScriptedContext(script, PrimaryProgressUnit::Bytes);
-	CTransferExecutor executor{ context, chunkSize };
+	CTransferExecutor executor{ context, chunkSize, fileCopyWorkers };
 	return executor.run(*request);
 }
 
 inline OperationSummary runCopy(OperationScript& script, const QStringList& sources, const DestinationIntent intent,
-	const QString& destination, const uint64_t chunkSize = defaultTransferChunkSize)
+	const QString& destination, const uint64_t chunkSize = defaultTransferChunkSize, const uint32_t fileCopyWorkers = 1)
 {
-	return runTransfer(script, TransferKind::Copy, sources, intent, destination, chunkSize);
+	return runTransfer(script, TransferKind::Copy, sources, intent, destination, chunkSize, fileCopyWorkers);
 }
 
 inline OperationSummary runMove(OperationScript& script, const QStringList& sources, const DestinationIntent intent,
@@ -207,10 +208,31 @@ inline void requireEqualTrees(const QString& expectedDir, const QString& actualD
 	FAIL(report);
 }
 
+// Unnamed (O_TMPFILE) staging files included: they have no entry to list, but this process's descriptors onto one
+// read as "<directory>/#<inode> (deleted)". A session holds more than one.
 inline int stagingFileCount(const QString& directory)
 {
-	return static_cast<int>(QDir{ directory }.entryList({ QStringLiteral(".file-commander-copy-*") },
+	int count = static_cast<int>(QDir{ directory }.entryList({ QStringLiteral(".file-commander-copy-*") },
 		QDir::Files | QDir::Hidden | QDir::System).size());
+
+#ifdef __linux__
+	const QString prefix = QFileInfo{ directory }.canonicalFilePath() % QStringLiteral("/#");
+	std::set<QString> unnamedFiles;
+	for (const QString& fd : QDir{ QStringLiteral("/proc/self/fd") }.entryList(QDir::AllEntries | QDir::System | QDir::NoDotAndDotDot))
+	{
+		char target[4096];
+		const ssize_t length = ::readlink(QFile::encodeName(QStringLiteral("/proc/self/fd/") % fd).constData(), target, sizeof(target));
+		if (length <= 0)
+			continue;
+
+		const QString targetPath = QFile::decodeName(QByteArray{ target, static_cast<qsizetype>(length) });
+		if (targetPath.startsWith(prefix) && !targetPath.mid(prefix.size()).contains('/') && targetPath.endsWith(QStringLiteral(" (deleted)")))
+			unnamedFiles.insert(targetPath);
+	}
+	count += static_cast<int>(unnamedFiles.size());
+#endif
+
+	return count;
 }
 
 inline bool setEntryTimes(const QString& path, const thin_io::entry_times& times)
@@ -1160,3 +1160,38 @@ TEST_CASE("createDirectories: forced faults at the final creation", "[mutator]")
 		CHECK(result.error().category == FileErrorCategory::PermissionDenied);
 	}
 }
+
+//
+// flushPublishedFiles
+//
+
+TEST_CASE("flushPublishedFiles: files in several directories, and a failure", "[mutator]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+	REQUIRE(QDir{}.mkpath(base % "/one"));
+	REQUIRE(QDir{}.mkpath(base % "/two"));
+	writeTestFile(base % "/one/a.bin", patternedContents(100));
+	writeTestFile(base % "/one/b.bin", patternedContents(200));
+	writeTestFile(base % "/two/c.bin", patternedContents(300));
+
+	CHECK(CFileSystemMutator::flushPublishedFiles({ ep(base % "/one/a.bin"), ep(base % "/one/b.bin"), ep(base % "/two/c.bin") }).has_value());
+	CHECK(readFileContents(base % "/one/b.bin") == patternedContents(200));
+
+	SECTION("a forced native failure classifies")
+	{
+		CFaultHookScope scope;
+#ifdef _WIN32
+		constexpr NativeErrorCode ioCode = ERROR_GEN_FAILURE;
+#else
+		constexpr NativeErrorCode ioCode = EIO;
+#endif
+		scope.forceNativeError(Point::FlushPublishedFiles_Native, ioCode);
+
+		const auto result = CFileSystemMutator::flushPublishedFiles({ ep(base % "/one/a.bin") });
+		REQUIRE(!result.has_value());
+		CHECK(result.error().category == FileErrorCategory::IoFailure);
+		CHECK(result.error().nativeCode == ioCode);
+	}
+}
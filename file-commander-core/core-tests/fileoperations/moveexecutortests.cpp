@@ -1,5 +1,5 @@
 // WP7: the recursive move executor - rename-first boundaries, the cross-device staged-copy fallback,
-// the pre-publication read-only policy, and the committed source-cleanup segment.
+// the pre-publication read-only policy, and the committed source-cleanup segment, run a flushed group at a time.
 
 #include "fileoperations/ctransferexecutor.h"
 #include "fileoperations/coperationexecutioncontext.h"
@@ -1002,6 +1002,123 @@ TEST_CASE("move executor: commit boundary and cancellation", "[moveexecutor]")
 	}
 }
 
+TEST_CASE("move executor: sources are removed a flushed group at a time", "[moveexecutor]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+
+	// A full group, and one more file
+	const size_t fileCount = CTransferExecutor::maxDurabilityGroupFiles + 1;
+	REQUIRE(QDir{}.mkpath(base % "/src"));
+	for (size_t i = 0; i < fileCount; ++i)
+		writeTestFile(base % "/src/" % QString::number(i) % ".bin", patternedContents(100));
+	REQUIRE(QDir{}.mkpath(base % "/dest"));
+
+	CFaultHookScope hooks;
+	hooks.forceNativeError(Point::RenameEntry_Native, crossDeviceCode);
+
+	OperationScript script;
+
+	SECTION("one flush per group instead of one per file")
+	{
+		const auto summary = runMove(script, { base % "/src" }, DestinationIntent::IntoDirectory, base % "/dest");
+
+		CHECK(summary.status == CompletionStatus::Completed);
+		CHECK(summary.completedItems == fileCount + 1);
+		CHECK(entryAbsent(base % "/src"));
+		CHECK(countTreeEntries(base % "/dest/src") == fileCount);
+		CHECK(hooks.arrivalCount(Point::FlushPublishedFiles_Native) == 2);
+		CHECK(hooks.arrivalCount(Point::StagedCopy_FlushStaging_Native) == 0);
+	}
+
+	SECTION("a failed flush removes no source of its group: Skip retains both entries of each")
+	{
+		hooks.forceNativeError(Point::FlushPublishedFiles_Native, ioFailureCode); // The full group's
+
+		script.decisions = { act(DecisionAction::Skip) };
+		const auto summary = runMove(script, { base % "/src" }, DestinationIntent::IntoDirectory, base % "/dest");
+
+		CHECK(summary.status == CompletionStatus::Failed);
+		CHECK(summary.failedItems == CTransferExecutor::maxDurabilityGroupFiles);
+		CHECK(summary.completedItems == 1); // The last file, in a group of its own
+		REQUIRE(!summary.representativeFailures.empty());
+		CHECK(summary.representativeFailures[0].failure.action == FailedAction::WriteDestination);
+		CHECK(countTreeEntries(base % "/src") == CTransferExecutor::maxDurabilityGroupFiles);
+		CHECK(countTreeEntries(base % "/dest/src") == fileCount); // Never rolled back
+
+		REQUIRE(script.seenRequests.size() == 1); // One prompt for the group
+		CHECK(script.seenRequests[0].issue.kind == IssueKind::ActionFailed);
+		CHECK(!script.seenRequests[0].remainingMatchingScopeAllowed);
+	}
+
+	SECTION("a published file gets its source's times only once its group is flushed")
+	{
+		constexpr int64_t sourceTimeSeconds = 1'500'000'000;
+		REQUIRE(setEntryTimes(base % "/src/0.bin", { .creation = {}, .last_access = {}, .last_write = thin_io::timestamp{ .seconds = sourceTimeSeconds } }));
+		REQUIRE(setEntryTimes(base % "/src/" % QString::number(fileCount - 1) % ".bin",
+			{ .creation = {}, .last_access = {}, .last_write = thin_io::timestamp{ .seconds = sourceTimeSeconds } }));
+		hooks.forceNativeError(Point::FlushPublishedFiles_Native, ioFailureCode); // The full group's
+
+		script.decisions = { act(DecisionAction::Skip) };
+		const auto summary = runMove(script, { base % "/src" }, DestinationIntent::IntoDirectory, base % "/dest");
+		CHECK(summary.status == CompletionStatus::Failed);
+
+		// Published but never flushed: it must not pass for a complete copy of its retained source
+		const auto unflushedTimes = getEntryTimes(base % "/dest/src/0.bin");
+		REQUIRE(unflushedTimes.has_value());
+		REQUIRE(unflushedTimes->last_write.has_value());
+		CHECK(unflushedTimes->last_write->seconds != sourceTimeSeconds);
+		CHECK(hooks.arrivalCount(Point::ApplyFileMetadata_Native) == 1); // Only the flushed group's file
+
+		const auto flushedTimes = getEntryTimes(base % "/dest/src/" % QString::number(fileCount - 1) % ".bin");
+		REQUIRE(flushedTimes.has_value());
+		REQUIRE(flushedTimes->last_write.has_value());
+		CHECK(flushedTimes->last_write->seconds == sourceTimeSeconds);
+	}
+
+	SECTION("failing to apply the times after the flush is a warning, and the source is still removed")
+	{
+		hooks.forceNativeError(Point::ApplyFileMetadata_Native, ioFailureCode);
+
+		const auto summary = runMove(script, { base % "/src" }, DestinationIntent::IntoDirectory, base % "/dest");
+
+		CHECK(summary.status == CompletionStatus::Completed);
+		CHECK(entryAbsent(base % "/src"));
+		CHECK(summary.warningCount == 1);
+		REQUIRE(summary.representativeWarnings.size() == 1);
+		CHECK(summary.representativeWarnings[0].failure.action == FailedAction::PreserveFileMetadata);
+	}
+
+	SECTION("Retry flushes the group again")
+	{
+		hooks.forceNativeError(Point::FlushPublishedFiles_Native, ioFailureCode);
+
+		script.decisions = { act(DecisionAction::Retry) };
+		const auto summary = runMove(script, { base % "/src" }, DestinationIntent::IntoDirectory, base % "/dest");
+
+		CHECK(summary.status == CompletionStatus::Completed);
+		CHECK(summary.completedItems == fileCount + 1);
+		CHECK(entryAbsent(base % "/src"));
+		CHECK(hooks.arrivalCount(Point::FlushPublishedFiles_Native) == 3);
+	}
+
+	SECTION("an authorized replacement still flushes its own file before publication")
+	{
+		REQUIRE(QDir{}.mkpath(base % "/dest/src"));
+		writeTestFile(base % "/dest/src/0.bin", QByteArray{ "OLD" });
+
+		script.decisions = { act(DecisionAction::Merge), act(DecisionAction::Replace) };
+		const auto summary = runMove(script, { base % "/src" }, DestinationIntent::IntoDirectory, base % "/dest");
+
+		CHECK(summary.status == CompletionStatus::Completed);
+		CHECK(entryAbsent(base % "/src"));
+		CHECK(readFileContents(base % "/dest/src/0.bin") == patternedContents(100));
+		CHECK(hooks.arrivalCount(Point::StagedCopy_FlushStaging_Native) == 1);
+		CHECK(hooks.arrivalCount(Point::FlushPublishedFiles_Native) == 2);
+	}
+}
+
 TEST_CASE("move executor: directory timestamps in the fallback", "[moveexecutor]")
 {
 	QTemporaryDir tempDir;
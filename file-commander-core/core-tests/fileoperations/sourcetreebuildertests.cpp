@@ -1,5 +1,5 @@
-// WP4: the immutable hierarchical source manifest - shapes and totals, operation-specific link handling,
-// ownership, cycle termination, scanning progress, and cancellation.
+// WP4: the immutable hierarchical source manifest - shapes and totals, name order across concurrent directory
+// scans, operation-specific link handling, ownership, cycle termination, scanning progress, and cancellation.
 
 #include "fileoperations/csourcetreebuilder.h"
 #include "fileoperations/coperationexecutioncontext.h"
@@ -11,9 +11,14 @@
 DISABLE_COMPILER_WARNINGS
 #include <QFile>
 #include <QStringBuilder>
+#include <QStringList>
 #include <QTemporaryDir>
 RESTORE_COMPILER_WARNINGS
 
+#include <algorithm>
+#include <mutex>
+#include <thread>
+
 #ifndef _WIN32
 #include <errno.h>
 #include <fcntl.h>
@@ -33,6 +38,8 @@ struct ScanScript
 	// Cancellation is requested through observable state, never by counting checkpoint calls (call order
 	// is an implementation detail): the build cancels at the first checkpoint where this holds.
 	std::function<bool()> cancelAtCheckpoint;
+	// The scanner threads pass the checkpoint too, while the build thread records progress
+	std::mutex mutex;
 };
 
 COperationExecutionContext scanContext(ScanScript& script)
@@ -40,13 +47,17 @@ COperationExecutionContext scanContext(ScanScript& script)
 	return COperationExecutionContext{
 		PrimaryProgressUnit::Bytes,
 		[&script] {
+			std::lock_guard lock{ script.mutex };
 			return !script.cancelAtCheckpoint || !script.cancelAtCheckpoint();
 		},
 		[](const DecisionRequest&) -> std::optional<Decision> {
 			FAIL("Scanning must never request a decision");
 			return {};
 		},
-		[&script](const ProgressSnapshot& snapshot) { script.progress.push_back(snapshot); }
+		[&script](const ProgressSnapshot& snapshot) {
+			std::lock_guard lock{ script.mutex };
+			script.progress.push_back(snapshot);
+		}
 	};
 }
 
@@ -78,6 +89,14 @@ const SourceNode* childNamed(const SourceNode& node, const QString& name)
 	return nullptr;
 }
 
+// Every path of the manifest, depth-first in the manifest's own child order
+void collectPaths(const SourceNode& node, QStringList& paths)
+{
+	paths.push_back(node.entry.path.value());
+	for (const SourceNode& child : node.children)
+		collectPaths(child, paths);
+}
+
 } // namespace
 
 TEST_CASE("source tree: shape and subtree totals", "[sourcetree]")
@@ -163,6 +182,40 @@ TEST_CASE("source tree: empty, deep, and wide directories", "[sourcetree]")
 	}
 }
 
+TEST_CASE("source tree: directories scanned concurrently still make one name-ordered manifest", "[sourcetree]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString rootPath = tempDir.path() % "/root";
+
+	// Created in reverse name order, so that a listing in creation order would not come out sorted by accident
+	constexpr int branchCount = 24;
+	constexpr int filesPerBranch = 10;
+	for (int branch = branchCount - 1; branch >= 0; --branch)
+	{
+		const QString branchPath = rootPath % "/branch" % QString::number(branch).rightJustified(2, QLatin1Char{ '0' });
+		REQUIRE(QDir{}.mkpath(branchPath % "/nested"));
+		for (int file = filesPerBranch - 1; file >= 0; --file)
+			writeTestFile(branchPath % "/file" % QString::number(file) % ".bin", QByteArray(file + 1, 'f'));
+		writeTestFile(branchPath % "/nested/leaf.bin", QByteArray(7, 'l'));
+	}
+
+	const SourceNode tree = buildTree(rootPath, SourceTreeBuildMode::MaterializingTransfer);
+	CHECK(tree.subtreeItems == 1 + branchCount * (1 + filesPerBranch + 2));
+	CHECK(tree.subtreeBytes == branchCount * (filesPerBranch * (filesPerBranch + 1) / 2 + 7));
+
+	QStringList paths;
+	collectPaths(tree, paths);
+	CHECK(std::is_sorted(paths.begin(), paths.end())); // Plain ASCII names: depth-first in name order is sorted as a whole
+
+	for (int build = 0; build < 5; ++build)
+	{
+		QStringList rebuiltPaths;
+		collectPaths(buildTree(rootPath, SourceTreeBuildMode::MaterializingTransfer), rebuiltPaths);
+		CHECK(rebuiltPaths == paths);
+	}
+}
+
 TEST_CASE("source tree: the traversal-depth limit is inclusive", "[sourcetree][limits]")
 {
 	QTemporaryDir tempDir;
@@ -591,6 +644,18 @@ TEST_CASE("source tree: scanning progress and cancellation", "[sourcetree]")
 		CHECK(std::holds_alternative<ScanCancelled>(result));
 	}
 
+	SECTION("a scanner passes the checkpoint before it lists a directory")
+	{
+		ScanScript script;
+		// Only the scanners see the job stopped, so only theirs can end the build
+		script.cancelAtCheckpoint = [buildThread{ std::this_thread::get_id() }] { return std::this_thread::get_id() != buildThread; };
+		auto context = scanContext(script);
+		const auto result = buildSourceTree(context, snapshotOf(base % "/root"), SourceTreeBuildMode::MaterializingTransfer);
+
+		CHECK(std::holds_alternative<ScanCancelled>(result));
+		CHECK(script.progress.size() == 1); // The root, discovered before its listing was requested
+	}
+
 	SECTION("cancellation is checked while processing a wide flat directory")
 	{
 		REQUIRE(QDir{}.mkpath(base % "/wide"));
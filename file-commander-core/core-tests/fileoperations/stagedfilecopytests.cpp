@@ -1,7 +1,9 @@
 // WP2: the staged file copy lifecycle - exclusive staging, chunked transfer, required metadata,
 // durability policy, atomic publication, and cleanup, with exact FailedAction attribution.
 
+#include "fileoperations/ccontenthasher.h"
 #include "fileoperations/cstagedfilecopy.h"
+#include "fileoperations/cstagedcopypipeline.h"
 #include "fileoperations/operationtesthooks.h"
 
 #include "fileoperationtesthelpers.h"
@@ -15,9 +17,13 @@ DISABLE_COMPILER_WARNINGS
 #include <QTemporaryDir>
 RESTORE_COMPILER_WARNINGS
 
+#include <algorithm>
+#include <vector>
+
 #ifndef _WIN32
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -141,6 +147,42 @@ TEST_CASE("staged copy: empty, one-chunk, and multi-chunk files", "[stagedcopy]"
 	CHECK(stagingFileCount(base) == 0);
 }
 
+TEST_CASE("staged copy: every chunk reports the backend that moved it", "[stagedcopy]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+
+	const QByteArray contents = patternedContents(300'000);
+	writeTestFile(base % "/source.bin", contents);
+
+	auto session = CStagedFileCopy::begin(ep(base % "/source.bin"), ep(base % "/dest.bin"));
+	REQUIRE(session.has_value());
+
+	std::vector<CopyBackend> backends;
+	for (;;)
+	{
+		const auto chunk = session->writeNext(64 * 1024);
+		REQUIRE(chunk.has_value());
+		CHECK(chunk->bytesWritten <= 64 * 1024); // Cloning and the kernel copy keep to the chunk size too
+		backends.push_back(chunk->backend);
+		if (chunk->readyToCommit)
+			break;
+	}
+
+	REQUIRE(session->commit(ReplacementMode::RequireAbsent, CommitDurability::NoFlush).has_value());
+	CHECK(readFileContents(base % "/dest.bin") == contents);
+	CHECK(backends.size() > 1);
+	// A backend is only ever given up for a slower one
+	CHECK(std::ranges::is_sorted(backends));
+#ifdef __linux__
+	// Within one directory - one filesystem - the kernel can always do at least the copying
+	CHECK(std::ranges::none_of(backends, [](const CopyBackend backend) { return backend == CopyBackend::MappedWrite; }));
+#else
+	CHECK(std::ranges::all_of(backends, [](const CopyBackend backend) { return backend == CopyBackend::MappedWrite; }));
+#endif
+}
+
 TEST_CASE("staged copy: the destination entry appears only at publication", "[stagedcopy]")
 {
 	QTemporaryDir tempDir;
@@ -207,6 +249,137 @@ TEST_CASE("staged copy: the source size is fixed at begin", "[stagedcopy]")
 	CHECK(stagingFileCount(base) == 0);
 }
 
+TEST_CASE("staged copy: the overlapped transfer reads ahead while it writes", "[stagedcopy]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+
+	// Twice the ring, so that the reader has to wait for the writer at least once
+	const QByteArray contents = patternedContents(static_cast<int>(2 * CStagedCopyPipeline::bufferCount * CStagedCopyPipeline::bufferSize + 12'345));
+	writeTestFile(base % "/source.bin", contents);
+
+	// Within one directory it would not be chosen by itself
+	auto session = CStagedFileCopy::begin(ep(base % "/source.bin"), ep(base % "/dest.bin"), CopyBackend::OverlappedWrite);
+	REQUIRE(session.has_value());
+
+	SECTION("every byte arrives, in chunks no larger than asked for")
+	{
+		for (const uint64_t chunkSize : { uint64_t{ 100'000 }, uint64_t{ 3 * 1024 * 1024 } })
+		{
+			const auto chunk = session->writeNext(chunkSize);
+			REQUIRE(chunk.has_value());
+			CHECK(chunk->bytesWritten <= chunkSize);
+			CHECK(chunk->backend == CopyBackend::OverlappedWrite);
+		}
+
+		for (;;)
+		{
+			const auto chunk = session->writeNext(512 * 1024);
+			REQUIRE(chunk.has_value());
+			CHECK(chunk->backend == CopyBackend::OverlappedWrite);
+			if (chunk->readyToCommit)
+				break;
+		}
+
+		REQUIRE(session->commit(ReplacementMode::RequireAbsent, CommitDurability::NoFlush).has_value());
+		CHECK(readFileContents(base % "/dest.bin") == contents);
+	}
+
+	SECTION("a source truncated afterwards fails once the reader gets to its new end")
+	{
+		REQUIRE(session->writeNext(4096).has_value());
+		// The reader is at most the ring ahead, so it has yet to read past here
+		REQUIRE(QFile{ base % "/source.bin" }.resize(2000));
+
+		std::expected<CopyChunkResult, FailureDetails> chunk;
+		do
+		{
+			chunk = session->writeNext(1024 * 1024);
+		} while (chunk.has_value() && !chunk->readyToCommit);
+
+		REQUIRE(!chunk.has_value());
+		CHECK(chunk.error().action == FailedAction::ReadSource);
+
+		REQUIRE(session->abort().has_value());
+		CHECK(entryAbsent(base % "/dest.bin"));
+	}
+
+	SECTION("an abort stops the reader midway")
+	{
+		REQUIRE(session->writeNext(64 * 1024).has_value());
+		REQUIRE(session->abort().has_value());
+		CHECK(entryAbsent(base % "/dest.bin"));
+		CHECK(readFileContents(base % "/source.bin") == contents);
+	}
+
+	CHECK(stagingFileCount(base) == 0);
+}
+
+#ifndef _WIN32
+TEST_CASE("staged copy: a sparse source keeps its holes", "[stagedcopy]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+
+	// Data at the start and in the middle; a hole between them and another one at the end
+	constexpr uint64_t fileSize = 64 * 1024 * 1024;
+	const QByteArray head = patternedContents(100'000), middle = patternedContents(300'000);
+	{
+		QFile file{ base % "/sparse.img" };
+		REQUIRE(file.open(QIODevice::WriteOnly));
+		REQUIRE(file.write(head) == head.size());
+		REQUIRE(file.seek(32 * 1024 * 1024));
+		REQUIRE(file.write(middle) == middle.size());
+		REQUIRE(file.resize(static_cast<qint64>(fileSize)));
+	}
+
+	const auto allocatedBytes = [](const QString& path) {
+		struct stat info;
+		REQUIRE(::stat(QFile::encodeName(path).constData(), &info) == 0);
+		return static_cast<uint64_t>(info.st_blocks) * 512;
+	};
+	if (allocatedBytes(base % "/sparse.img") >= fileSize)
+	{
+		WARN("The test volume does not keep holes: sparse copying is not exercised");
+		return;
+	}
+
+	CFaultHookScope hooks;
+	auto session = CStagedFileCopy::begin(ep(base % "/sparse.img"), ep(base % "/copy.img"));
+	REQUIRE(session.has_value());
+	CHECK(hooks.arrivalCount(Point::StagedCopy_PreallocateStaging_Native) == 0); // It would allocate the holes
+
+	uint64_t dataBytes = 0, holeBytes = 0;
+	for (;;)
+	{
+		const auto chunk = session->writeNext(1024 * 1024);
+		REQUIRE(chunk.has_value());
+		dataBytes += chunk->bytesWritten;
+		holeBytes += chunk->holeBytes;
+		if (chunk->readyToCommit)
+			break;
+	}
+	REQUIRE(session->commit(ReplacementMode::RequireAbsent, CommitDurability::NoFlush).has_value());
+
+	CHECK(dataBytes + holeBytes == fileSize);
+	CHECK(dataBytes >= static_cast<uint64_t>(head.size() + middle.size()));
+	CHECK(dataBytes < 4 * 1024 * 1024); // Whole filesystem blocks around the data, nothing more
+	CHECK(allocatedBytes(base % "/copy.img") < 8 * 1024 * 1024);
+	CHECK(readFileContents(base % "/copy.img") == readFileContents(base % "/sparse.img"));
+
+	// The holes are hashed as the zeros they read back as
+	auto verified = CStagedFileCopy::begin(ep(base % "/sparse.img"), ep(base % "/verified.img"), CopyBackend::Clone,
+		PageCachePolicy::KeepCached, CopyVerification::ReadBack);
+	REQUIRE(verified.has_value());
+	stageAll(*verified, 1024 * 1024);
+	REQUIRE(verified->commit(ReplacementMode::RequireAbsent, CommitDurability::NoFlush).has_value());
+	CHECK(verified->verifiedContentHash().has_value());
+	CHECK(stagingFileCount(base) == 0);
+}
+#endif
+
 TEST_CASE("staged copy: unique staging creation retries on a name collision", "[stagedcopy]")
 {
 	QTemporaryDir tempDir;
@@ -224,6 +397,58 @@ TEST_CASE("staged copy: unique staging creation retries on a name collision", "[
 	CHECK(stagingFileCount(base) == 0);
 }
 
+#ifdef __linux__
+TEST_CASE("staged copy: an unnamed staging file only ever gets the destination's name", "[stagedcopy]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+
+	const QByteArray contents = patternedContents(100'000);
+	writeTestFile(base % "/source.bin", contents);
+	const auto namedStagingFiles = [&base] {
+		return QDir{ base }.entryList({ QStringLiteral(".file-commander-copy-*") }, QDir::Files | QDir::Hidden | QDir::System).size();
+	};
+
+	SECTION("nothing is listed while it is staged, nor after it is abandoned")
+	{
+		{
+			auto session = CStagedFileCopy::begin(ep(base % "/source.bin"), ep(base % "/dest.bin"));
+			REQUIRE(session.has_value());
+			stageAll(*session, 64 * 1024);
+			CHECK(stagingFileCount(base) == 1);
+			CHECK(namedStagingFiles() == 0);
+		}
+
+		CHECK(stagingFileCount(base) == 0);
+		CHECK(entryAbsent(base % "/dest.bin"));
+	}
+
+	SECTION("publication links it in")
+	{
+		REQUIRE(copyFile(base % "/source.bin", base % "/dest.bin").has_value());
+		CHECK(readFileContents(base % "/dest.bin") == contents);
+	}
+
+	SECTION("where it is not supported, the staging file is a named one")
+	{
+		CFaultHookScope scope;
+		scope.forceNativeError(Point::StagedCopy_CreateStaging_Native, unsupportedCode);
+
+		auto session = CStagedFileCopy::begin(ep(base % "/source.bin"), ep(base % "/dest.bin"));
+		REQUIRE(session.has_value());
+		CHECK(scope.arrivalCount(Point::StagedCopy_CreateStaging_Native) == 2);
+		CHECK(namedStagingFiles() == 1);
+
+		stageAll(*session, 64 * 1024);
+		REQUIRE(session->commit(ReplacementMode::RequireAbsent, CommitDurability::NoFlush).has_value());
+		CHECK(readFileContents(base % "/dest.bin") == contents);
+	}
+
+	CHECK(namedStagingFiles() == 0);
+}
+#endif
+
 //
 // Failure exits and old-destination preservation
 //
@@ -407,6 +632,10 @@ TEST_CASE("staged copy: begin reports a failed staging cleanup separately", "[st
 	CFaultHookScope scope;
 	scope.forceNativeError(Point::StagedCopy_ResizeStaging_Native, diskFullCode);
 	scope.forceNativeError(Point::StagedCopy_RemoveStaging_Native, ioFailureCode);
+#ifdef __linux__
+	// Only a named staging file has a removal to fail, so the unnamed one is turned down as unsupported
+	scope.forceNativeError(Point::StagedCopy_CreateStaging_Native, unsupportedCode);
+#endif
 
 	const auto session = CStagedFileCopy::begin(ep(base % "/source.bin"), ep(base % "/dest.bin"));
 	REQUIRE(!session.has_value());
@@ -700,6 +929,211 @@ TEST_CASE("staged copy: the data flush runs exactly when the durability policy d
 	}
 }
 
+TEST_CASE("staged copy: a verifying session reads the copy back before publishing it", "[stagedcopy]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+
+	// Longer than a pipeline buffer, and not a whole number of them
+	const QByteArray contents = patternedContents(3 * static_cast<int>(CStagedCopyPipeline::bufferSize) + 1000);
+	writeTestFile(base % "/source.bin", contents);
+	CContentHasher sourceHasher;
+	sourceHasher.update(contents.constData(), static_cast<size_t>(contents.size()));
+
+	const auto verifiedCopy = [&](const CopyBackend firstBackend) {
+		CFaultHookScope scope;
+		auto session = CStagedFileCopy::begin(ep(base % "/source.bin"), ep(base % "/dest.bin"), firstBackend,
+			PageCachePolicy::KeepCached, CopyVerification::ReadBack);
+		REQUIRE(session.has_value());
+		for (;;)
+		{
+			const auto chunk = session->writeNext(256 * 1024);
+			REQUIRE(chunk.has_value());
+			CHECK(chunk->backend >= CopyBackend::OverlappedWrite); // The kernel-side ones never show the session the data
+			if (chunk->readyToCommit)
+				break;
+		}
+		REQUIRE(session->commit(ReplacementMode::RequireAbsent, CommitDurability::NoFlush).has_value());
+
+		CHECK(session->verifiedContentHash() == sourceHasher.digest());
+		CHECK(readFileContents(base % "/dest.bin") == contents);
+		CHECK(scope.arrivalCount(Point::StagedCopy_FlushStaging_Native) == 1); // Whatever the durability policy
+		CHECK(scope.arrivalCount(Point::StagedCopy_VerifyStaging_Native) == 1);
+	};
+
+	SECTION("cheapest backend first") { verifiedCopy(CopyBackend::Clone); }
+	SECTION("overlapped write") { verifiedCopy(CopyBackend::OverlappedWrite); }
+	SECTION("mapped write") { verifiedCopy(CopyBackend::MappedWrite); }
+
+	SECTION("a session that does not verify has no hash to report")
+	{
+		CFaultHookScope scope;
+		auto session = CStagedFileCopy::begin(ep(base % "/source.bin"), ep(base % "/dest.bin"));
+		REQUIRE(session.has_value());
+		stageAll(*session, 256 * 1024);
+		REQUIRE(session->commit(ReplacementMode::RequireAbsent, CommitDurability::NoFlush).has_value());
+		CHECK(!session->verifiedContentHash().has_value());
+		CHECK(scope.arrivalCount(Point::StagedCopy_VerifyStaging_Native) == 0);
+	}
+
+	SECTION("a failed verification publishes nothing")
+	{
+		const QByteArray oldContents{ "OLD DESTINATION" };
+		writeTestFile(base % "/dest.bin", oldContents);
+
+		CFaultHookScope scope;
+		scope.forceNativeError(Point::StagedCopy_VerifyStaging_Native, ioFailureCode);
+		auto session = CStagedFileCopy::begin(ep(base % "/source.bin"), ep(base % "/dest.bin"), CopyBackend::Clone,
+			PageCachePolicy::KeepCached, CopyVerification::ReadBack);
+		REQUIRE(session.has_value());
+		stageAll(*session, 256 * 1024);
+		const auto committed = session->commit(ReplacementMode::ReplaceExistingFile, CommitDurability::NoFlush);
+		REQUIRE(!committed.has_value());
+		CHECK(committed.error().action == FailedAction::VerifyDestination);
+		CHECK(committed.error().filesystemError.category == FileErrorCategory::IoFailure);
+		CHECK(!session->verifiedContentHash().has_value());
+		REQUIRE(session->abort().has_value());
+
+		CHECK(readFileContents(base % "/dest.bin") == oldContents);
+		CHECK(stagingFileCount(base) == 0);
+	}
+}
+
+TEST_CASE("staged copy: a suspended session resumes from its staging file", "[stagedcopy]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+
+	// Staged up to past one resume check length, so that the check covers a whole one
+	const QByteArray contents = patternedContents(4 * static_cast<int>(CStagedFileCopy::resumeCheckLength) + 1000);
+	writeTestFile(base % "/source.bin", contents);
+	const uint64_t sourceSize = static_cast<uint64_t>(contents.size());
+
+	auto session = CStagedFileCopy::begin(ep(base % "/source.bin"), ep(base % "/dest.bin"), CopyBackend::Clone,
+		PageCachePolicy::KeepCached, CopyVerification::None, StagingLifetime::Resumable);
+	REQUIRE(session.has_value());
+	uint64_t written = 0;
+	while (written < 2 * CStagedFileCopy::resumeCheckLength)
+	{
+		const auto chunk = session->writeNext(CStagedFileCopy::resumeCheckLength);
+		REQUIRE(chunk.has_value());
+		REQUIRE(!chunk->readyToCommit);
+		written += chunk->bytesWritten;
+	}
+
+	const CEntryPath stagingPath = session->stagingPath();
+	const auto suspended = session->suspend();
+	REQUIRE(suspended.has_value());
+	const uint64_t stagedBytes = *suspended;
+	CHECK(stagedBytes == written);
+	CHECK(stagingFileCount(base) == 1); // Left behind by name, for resume()
+	CHECK(entryAbsent(base % "/dest.bin"));
+
+	const auto resumedCopy = [&](const CopyVerification verification) {
+		auto resumed = CStagedFileCopy::resume(ep(base % "/source.bin"), ep(base % "/dest.bin"), stagingPath, sourceSize, stagedBytes,
+			CopyBackend::Clone, PageCachePolicy::KeepCached, verification);
+		REQUIRE(resumed.has_value());
+
+		const auto first = resumed->writeNext(256 * 1024);
+		REQUIRE(first.has_value());
+		CHECK(first->resumedBytes == stagedBytes); // Once, for progress
+		if (!first->readyToCommit)
+			stageAll(*resumed, 256 * 1024);
+		REQUIRE(resumed->commit(ReplacementMode::RequireAbsent, CommitDurability::NoFlush).has_value());
+
+		CHECK(readFileContents(base % "/dest.bin") == contents);
+		CHECK(stagingFileCount(base) == 0);
+		return resumed->verifiedContentHash();
+	};
+
+	SECTION("carries on where the suspended session stopped")
+	{
+		CHECK(!resumedCopy(CopyVerification::None).has_value());
+	}
+
+	SECTION("a verifying session hashes what was staged before, too")
+	{
+		CContentHasher sourceHasher;
+		sourceHasher.update(contents.constData(), static_cast<size_t>(contents.size()));
+		CHECK(resumedCopy(CopyVerification::ReadBack) == sourceHasher.digest());
+	}
+
+	SECTION("a source that changed where the copy stopped is copied afresh")
+	{
+		QByteArray changed = contents;
+		changed[static_cast<qsizetype>(stagedBytes) - 1] = static_cast<char>(~changed[static_cast<qsizetype>(stagedBytes) - 1]);
+		writeTestFile(base % "/source.bin", changed);
+
+		CHECK(!CStagedFileCopy::resume(ep(base % "/source.bin"), ep(base % "/dest.bin"), stagingPath, sourceSize, stagedBytes).has_value());
+		CHECK(stagingFileCount(base) == 0); // Of no use any more
+		CHECK(entryAbsent(base % "/dest.bin"));
+	}
+
+	SECTION("a source of another size is copied afresh")
+	{
+		writeTestFile(base % "/source.bin", contents + "more");
+		CHECK(!CStagedFileCopy::resume(ep(base % "/source.bin"), ep(base % "/dest.bin"), stagingPath, sourceSize, stagedBytes).has_value());
+		CHECK(stagingFileCount(base) == 0);
+	}
+}
+
+#ifdef __linux__
+TEST_CASE("staged copy: dropping behind leaves neither the source nor the copy cached", "[stagedcopy]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+
+	const QByteArray contents = patternedContents(8 * 1024 * 1024);
+	writeTestFile(base % "/source.bin", contents);
+	{
+		// Dirty pages can't be dropped, and the source is only read
+		const int fd = ::open(QFile::encodeName(base % "/source.bin").constData(), O_RDONLY | O_CLOEXEC);
+		REQUIRE(fd >= 0);
+		CHECK(::fdatasync(fd) == 0);
+		::close(fd);
+	}
+
+	const auto cachedFraction = [](const QString& path) {
+		const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+		REQUIRE(fd >= 0);
+		struct stat info;
+		REQUIRE(::fstat(fd, &info) == 0);
+		const auto length = static_cast<size_t>(info.st_size);
+		void* const mapping = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		REQUIRE(mapping != MAP_FAILED);
+
+		const auto pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+		std::vector<unsigned char> residency((length + pageSize - 1) / pageSize);
+		const bool queried = ::mincore(mapping, length, residency.data()) == 0;
+		::munmap(mapping, length);
+		REQUIRE(queried);
+		const auto cachedPages = std::ranges::count_if(residency, [](const unsigned char page) { return (page & 1) != 0; });
+		return static_cast<double>(cachedPages) / static_cast<double>(residency.size());
+	};
+
+	// Through user space, so that the data really passes through the cache
+	auto session = CStagedFileCopy::begin(ep(base % "/source.bin"), ep(base % "/dest.bin"), CopyBackend::MappedWrite, PageCachePolicy::DropBehind);
+	REQUIRE(session.has_value());
+	stageAll(*session, 1024 * 1024);
+	REQUIRE(session->commit(ReplacementMode::RequireAbsent, CommitDurability::FlushBeforePublish).has_value());
+
+	const double sourceCached = cachedFraction(base % "/source.bin");
+	const double copyCached = cachedFraction(base % "/dest.bin");
+	if (sourceCached == 1.0 && copyCached == 1.0)
+		WARN("The test volume keeps all file data in memory: dropping behind is not exercised");
+	else
+	{
+		CHECK(sourceCached < 0.5);
+		CHECK(copyCached < 0.5);
+	}
+	CHECK(readFileContents(base % "/dest.bin") == contents);
+}
+#endif
+
 //
 // Abort and destructor cleanup
 //
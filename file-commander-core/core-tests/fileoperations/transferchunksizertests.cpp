@@ -0,0 +1,108 @@
+// The adaptive chunk size: the largest chunk that still takes no longer than the target duration, within bounds,
+// learned per device pair and kept for later jobs.
+
+#include "fileoperations/ctransferchunksizer.h"
+
+#include "fileoperationtesthelpers.h"
+
+DISABLE_COMPILER_WARNINGS
+#include <QStringBuilder>
+#include <QTemporaryDir>
+RESTORE_COMPILER_WARNINGS
+
+#include <chrono>
+
+using namespace std::chrono_literals;
+using DevicePair = CTransferChunkSizer::DevicePair;
+
+namespace
+{
+
+// What is learned is process-wide, so every test case measures devices of its own that no real one will clash with
+constexpr uint64_t fakeDevice = 0xF11E'C0DE'0000'0000;
+
+// Reports chunks of whatever size the sizer picks at a steady rate, and returns the size it settles on.
+uint64_t settleAt(CTransferChunkSizer& sizer, const DevicePair& devices, const double bytesPerSecond)
+{
+	for (int i = 0; i < 50; ++i)
+	{
+		const uint64_t chunkSize = sizer.chunkSize(devices);
+		sizer.chunkTransferred(devices, chunkSize, std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<double>(static_cast<double>(chunkSize) / bytesPerSecond)));
+	}
+	return sizer.chunkSize(devices);
+}
+
+} // namespace
+
+TEST_CASE("chunk sizer: a chunk takes about the target duration at the measured rate", "[chunksizer]")
+{
+	CTransferChunkSizer sizer;
+	const DevicePair devices{ fakeDevice + 1, fakeDevice + 2 };
+	CHECK(sizer.chunkSize(devices) == CTransferChunkSizer::initialChunkSize);
+	CHECK(sizer.chunkSize(std::nullopt) == CTransferChunkSizer::initialChunkSize);
+
+	const double bytesPerSecond = 33.0 * 1024 * 1024;
+	const uint64_t chunkSize = settleAt(sizer, devices, bytesPerSecond);
+	CHECK(chunkSize % CTransferChunkSizer::chunkSizeGranularity == 0);
+	const double chunkDuration = static_cast<double>(chunkSize) / bytesPerSecond;
+	CHECK(chunkDuration > 0.05);
+	CHECK(chunkDuration <= std::chrono::duration<double>(CTransferChunkSizer::targetChunkDuration).count());
+}
+
+TEST_CASE("chunk sizer: the size stays within bounds", "[chunksizer]")
+{
+	CTransferChunkSizer sizer;
+
+	SECTION("a slow device")
+	{
+		CHECK(settleAt(sizer, { fakeDevice + 3, fakeDevice + 4 }, 64.0 * 1024) == CTransferChunkSizer::minChunkSize);
+	}
+
+	SECTION("a fast one")
+	{
+		CHECK(settleAt(sizer, { fakeDevice + 5, fakeDevice + 6 }, 1e12) == CTransferChunkSizer::maxChunkSize);
+	}
+}
+
+TEST_CASE("chunk sizer: too little data to tell a rate by teaches nothing", "[chunksizer]")
+{
+	CTransferChunkSizer sizer;
+	const DevicePair devices{ fakeDevice + 7, fakeDevice + 8 };
+
+	sizer.chunkTransferred(devices, CTransferChunkSizer::chunkSizeGranularity - 1, 1s);
+	sizer.chunkTransferred(devices, CTransferChunkSizer::initialChunkSize, 0s);
+	sizer.chunkTransferred(std::nullopt, CTransferChunkSizer::initialChunkSize, 1s);
+	CHECK(sizer.chunkSize(devices) == CTransferChunkSizer::initialChunkSize);
+}
+
+TEST_CASE("chunk sizer: a later job starts from what was learned for the same devices", "[chunksizer]")
+{
+	const DevicePair slowPair{ fakeDevice + 9, fakeDevice + 10 };
+	const DevicePair otherPair{ fakeDevice + 10, fakeDevice + 9 }; // The same devices the other way round
+	uint64_t learned = 0;
+	{
+		CTransferChunkSizer firstJob;
+		learned = settleAt(firstJob, slowPair, 1024.0 * 1024);
+		REQUIRE(learned < CTransferChunkSizer::initialChunkSize);
+	}
+
+	const CTransferChunkSizer laterJob;
+	CHECK(laterJob.chunkSize(slowPair) == learned);
+	CHECK(laterJob.chunkSize(otherPair) == CTransferChunkSizer::initialChunkSize);
+}
+
+TEST_CASE("chunk sizer: the devices of a source and of its copy's directory", "[chunksizer]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+	writeTestFile(base % "/a.bin", patternedContents(10));
+	REQUIRE(QDir{}.mkpath(base % "/dest"));
+
+	CTransferChunkSizer sizer;
+	const auto devices = sizer.devicePairOf(ep(base % "/a.bin"), ep(base % "/dest/a.bin"));
+	REQUIRE(devices.has_value());
+	CHECK(devices->source == devices->destination);
+	CHECK(sizer.devicePairOf(ep(base % "/a.bin"), ep(base % "/missing/a.bin")) == std::nullopt);
+}
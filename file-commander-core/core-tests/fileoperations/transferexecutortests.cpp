@@ -1,6 +1,7 @@
 // WP5: the recursive copy executor - the composed behavior of resolver, tree builder, staged copy,
 // context policy, outcome aggregation, accounting, timestamps, and progress.
 
+#include "fileoperations/ccontenthasher.h"
 #include "fileoperations/coperationexecutioncontext.h"
 #include "fileoperations/operationtesthooks.h"
 
@@ -22,6 +23,7 @@ RESTORE_COMPILER_WARNINGS
 
 #include <atomic>
 #include <chrono>
+#include <map>
 #include <thread>
 
 using OperationTestHooks::CFaultHookScope;
@@ -60,6 +62,7 @@ TEST_CASE("copy executor: files, trees, and multiple roots", "[executor]")
 		CHECK(summary.status == CompletionStatus::Completed);
 		CHECK(summary.completedItems == 1);
 		CHECK(summary.transferredBytes == 3000);
+		CHECK(summary.clonedBytes + summary.kernelCopiedBytes + summary.overlappedWriteBytes + summary.mappedWriteBytes == summary.transferredBytes);
 		CHECK(readFileContents(base % "/copied.bin") == contents);
 		CHECK(script.seenRequests.empty());
 	}
@@ -777,6 +780,277 @@ TEST_CASE("copy executor: a collision appearing at publication re-enters resolut
 	CHECK(readFileContents(base % "/copied.bin") == contents); // Published over the raced file
 }
 
+TEST_CASE("copy executor: adaptive chunk sizes change nothing but the speed", "[executor][chunksizer]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+
+	// Several chunks of the initial size, whatever the devices turn out to be
+	const QByteArray large = patternedContents(static_cast<int>(2 * CTransferChunkSizer::initialChunkSize + 12'345));
+	REQUIRE(QDir{}.mkpath(base % "/src"));
+	writeTestFile(base % "/src/large.bin", large);
+	writeTestFile(base % "/src/small.bin", patternedContents(1000));
+	writeTestFile(base % "/src/empty.bin", {});
+	REQUIRE(QDir{}.mkpath(base % "/dest"));
+
+	OperationScript script;
+	const auto summary = runCopy(script, { base % "/src" }, DestinationIntent::IntoDirectory, base % "/dest", adaptiveTransferChunkSize);
+
+	CHECK(summary.status == CompletionStatus::Completed);
+	CHECK(summary.completedItems == 4);
+	CHECK(summary.transferredBytes == static_cast<uint64_t>(large.size()) + 1000);
+	CHECK(script.seenRequests.empty());
+	requireEqualTrees(base % "/src", base % "/dest/src");
+}
+
+TEST_CASE("copy executor: a verifying copy lists what it verified in the manifest", "[executor][verification]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+
+	REQUIRE(QDir{}.mkpath(base % "/src/sub"));
+	writeTestFile(base % "/src/a.bin", patternedContents(1000));
+	writeTestFile(base % "/src/empty.bin", {});
+	writeTestFile(base % "/src/sub/large.bin", patternedContents(static_cast<int>(CTransferExecutor::maxPrefetchedFileSize) + 1));
+	REQUIRE(QDir{}.mkpath(base % "/dest"));
+
+	const auto runVerifiedCopy = [&](OperationScript& script, const QString& manifestPath, const uint32_t fileCopyWorkers) {
+		auto request = makeTransferRequest(TransferKind::Copy, { base % "/src" }, DestinationIntent::IntoDirectory, base % "/dest");
+		REQUIRE(request.has_value());
+		request->verification = CopyVerification::ReadBack;
+		request->verificationManifest = ep(manifestPath);
+		auto context = makeScriptedContext(script, PrimaryProgressUnit::Bytes);
+		return CTransferExecutor{ context, defaultTransferChunkSize, fileCopyWorkers }.run(*request);
+	};
+
+	// path -> hash
+	const auto readManifest = [](const QString& path) {
+		std::map<QString, uint64_t> entries;
+		for (const QByteArray& line : readFileContents(path).split('\n'))
+		{
+			if (line.isEmpty())
+				continue;
+			REQUIRE(line.size() > 18);
+			REQUIRE(line.mid(16, 2) == "  ");
+			bool isHex = false;
+			entries[QString::fromUtf8(line.mid(18))] = line.left(16).toULongLong(&isHex, 16);
+			REQUIRE(isHex);
+		}
+		return entries;
+	};
+	const auto hashOf = [](const QString& path) {
+		const QByteArray contents = readFileContents(path);
+		CContentHasher hasher;
+		hasher.update(contents.constData(), static_cast<size_t>(contents.size()));
+		return hasher.digest();
+	};
+
+	const auto checkEveryCopyListed = [&](const uint32_t workers) {
+		OperationScript script;
+		const auto summary = runVerifiedCopy(script, base % "/manifest.xxh64", workers);
+
+		CHECK(summary.status == CompletionStatus::Completed);
+		CHECK(summary.completedItems == 5);
+		CHECK(summary.warningCount == 0);
+		requireEqualTrees(base % "/src", base % "/dest/src");
+
+		const auto manifest = readManifest(base % "/manifest.xxh64");
+		CHECK(manifest.size() == 3);
+		for (const QString file : { "/dest/src/a.bin", "/dest/src/empty.bin", "/dest/src/sub/large.bin" })
+		{
+			REQUIRE(manifest.contains(base + file));
+			CHECK(manifest.at(base + file) == hashOf(base + file));
+		}
+	};
+
+	SECTION("every copy, with the hash of its contents") { checkEveryCopyListed(1); }
+	SECTION("the copies made ahead by the file-copy workers, too") { checkEveryCopyListed(4); }
+
+	SECTION("a copy that fails verification goes through the ActionFailed policy")
+	{
+		CFaultHookScope hooks;
+		hooks.forceNativeError(Point::StagedCopy_VerifyStaging_Native, ioFailureCode);
+
+		OperationScript script{ .decisions = { act(DecisionAction::Retry) } };
+		const auto summary = runVerifiedCopy(script, base % "/manifest.xxh64", 1);
+
+		CHECK(summary.status == CompletionStatus::Completed);
+		CHECK(summary.completedItems == 5);
+		REQUIRE(script.seenRequests.size() == 1);
+		CHECK(script.seenRequests[0].issue.kind == IssueKind::ActionFailed);
+		REQUIRE(script.seenRequests[0].issue.failure.has_value());
+		CHECK(script.seenRequests[0].issue.failure->action == FailedAction::VerifyDestination);
+		CHECK(hooks.arrivalCount(Point::StagedCopy_VerifyStaging_Native) == 4); // One file twice
+		CHECK(readManifest(base % "/manifest.xxh64").size() == 3);
+		CHECK(stagingFileCount(base % "/dest") == 0);
+	}
+
+	SECTION("a manifest that can't be written is a warning, not a failure")
+	{
+		OperationScript script;
+		const auto summary = runVerifiedCopy(script, base % "/no such folder/manifest.xxh64", 1);
+
+		CHECK(summary.status == CompletionStatus::Completed);
+		CHECK(summary.completedItems == 5);
+		REQUIRE(summary.warningCount == 1);
+		CHECK(summary.representativeWarnings[0].failure.action == FailedAction::WriteVerificationManifest);
+		requireEqualTrees(base % "/src", base % "/dest/src");
+	}
+}
+
+TEST_CASE("copy executor: a copy with a journal carries on where a cancelled run stopped", "[executor][journal]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+
+	REQUIRE(QDir{}.mkpath(base % "/src/sub"));
+	writeTestFile(base % "/src/a.bin", patternedContents(1000));
+	const int largeSize = static_cast<int>(CTransferJournal::resumableFileSize) + 1000;
+	writeTestFile(base % "/src/sub/large.bin", patternedContents(largeSize));
+	REQUIRE(QDir{}.mkpath(base % "/dest"));
+
+	const auto runJournaledCopy = [&](OperationScript& script) {
+		auto request = makeTransferRequest(TransferKind::Copy, { base % "/src" }, DestinationIntent::IntoDirectory, base % "/dest");
+		REQUIRE(request.has_value());
+		request->journalDirectory = ep(base % "/journals");
+		request->resumeLargeFiles = true;
+		auto context = makeScriptedContext(script, PrimaryProgressUnit::Bytes);
+		return CTransferExecutor{ context, defaultTransferChunkSize }.run(*request);
+	};
+
+	// Cancelled a quarter of the way into the large file
+	OperationScript cancelledScript;
+	cancelledScript.cancelAtCheckpoint = [&] {
+		return !cancelledScript.progress.empty() && cancelledScript.progress.back().currentEntryBytesProcessed > static_cast<uint64_t>(largeSize / 4);
+	};
+	const auto cancelled = runJournaledCopy(cancelledScript);
+	REQUIRE(cancelled.status == CompletionStatus::Cancelled);
+	CHECK(readFileContents(base % "/dest/src/a.bin") == patternedContents(1000));
+	CHECK(entryAbsent(base % "/dest/src/sub/large.bin"));
+	CHECK(stagingFileCount(base % "/dest/src/sub") == 1); // Suspended, not discarded
+	CHECK(countTreeEntries(base % "/journals") == 1);
+
+	SECTION("the same request again completes without re-resolving or re-copying what was done")
+	{
+		OperationScript script;
+		const auto summary = runJournaledCopy(script);
+
+		CHECK(summary.status == CompletionStatus::Completed);
+		CHECK(summary.completedItems == 4);
+		CHECK(summary.warningCount == 0);
+		CHECK(script.seenRequests.empty()); // The directories and a.bin are the earlier run's, not collisions
+		CHECK(summary.transferredBytes < static_cast<uint64_t>(largeSize) - static_cast<uint64_t>(largeSize / 4));
+		REQUIRE(!script.progress.empty());
+		CHECK(script.progress.back().bytesProcessed == static_cast<uint64_t>(largeSize) + 1000);
+
+		requireEqualTrees(base % "/src", base % "/dest/src");
+		CHECK(stagingFileCount(base % "/dest/src/sub") == 0);
+		CHECK(countTreeEntries(base % "/journals") == 0); // Nothing left to resume
+	}
+
+	SECTION("a large file changed since is copied afresh")
+	{
+		QByteArray changed = patternedContents(largeSize);
+		for (char& byte : changed)
+			byte = static_cast<char>(~byte);
+		writeTestFile(base % "/src/sub/large.bin", changed);
+
+		OperationScript script;
+		const auto summary = runJournaledCopy(script);
+
+		CHECK(summary.status == CompletionStatus::Completed);
+		CHECK(script.seenRequests.empty());
+		CHECK(readFileContents(base % "/dest/src/sub/large.bin") == changed);
+		CHECK(stagingFileCount(base % "/dest/src/sub") == 0);
+	}
+
+	SECTION("a published file that is gone since is copied again")
+	{
+		REQUIRE(QFile::remove(base % "/dest/src/a.bin"));
+
+		OperationScript script;
+		const auto summary = runJournaledCopy(script);
+
+		CHECK(summary.status == CompletionStatus::Completed);
+		CHECK(script.seenRequests.empty());
+		requireEqualTrees(base % "/src", base % "/dest/src");
+	}
+
+	SECTION("a published file edited since without a change of size is not taken for copied")
+	{
+		QByteArray edited = patternedContents(1000);
+		edited[0] = static_cast<char>(~edited[0]);
+		writeTestFile(base % "/src/a.bin", edited);
+		REQUIRE(setEntryTimes(base % "/src/a.bin", { .creation = {}, .last_access = {}, .last_write = thin_io::timestamp{ .seconds = 1'600'000'000 } }));
+
+		OperationScript script;
+		script.decisions = { act(DecisionAction::Replace) };
+		const auto summary = runJournaledCopy(script);
+
+		CHECK(summary.status == CompletionStatus::Completed);
+		REQUIRE(script.seenRequests.size() == 1); // An ordinary collision with the earlier copy
+		CHECK(script.seenRequests[0].issue.kind == IssueKind::FileReplacement);
+		CHECK(readFileContents(base % "/dest/src/a.bin") == edited);
+	}
+}
+
+TEST_CASE("copy executor: a journaled copy that does not resume large files leaves no staging file behind", "[executor][journal]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+
+	REQUIRE(QDir{}.mkpath(base % "/src"));
+	const int largeSize = static_cast<int>(CTransferJournal::resumableFileSize) + 1000;
+	writeTestFile(base % "/src/large.bin", patternedContents(largeSize));
+	REQUIRE(QDir{}.mkpath(base % "/dest"));
+
+	auto request = makeTransferRequest(TransferKind::Copy, { base % "/src" }, DestinationIntent::IntoDirectory, base % "/dest");
+	REQUIRE(request.has_value());
+	request->journalDirectory = ep(base % "/journals");
+
+	OperationScript script;
+	script.cancelAtCheckpoint = [&] {
+		return !script.progress.empty() && script.progress.back().currentEntryBytesProcessed > static_cast<uint64_t>(largeSize / 4);
+	};
+	auto context = makeScriptedContext(script, PrimaryProgressUnit::Bytes);
+	const auto summary = CTransferExecutor{ context, defaultTransferChunkSize }.run(*request);
+
+	REQUIRE(summary.status == CompletionStatus::Cancelled);
+	CHECK(entryAbsent(base % "/dest/src/large.bin"));
+	CHECK(stagingFileCount(base % "/dest/src") == 0);
+	CHECK(countTreeEntries(base % "/journals") == 1); // The directory it created is still worth carrying on with
+}
+
+TEST_CASE("copy executor: a journaled copy that runs to its end drops its journal, skips and all", "[executor][journal]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+
+	REQUIRE(QDir{}.mkpath(base % "/src"));
+	writeTestFile(base % "/src/a.bin", patternedContents(100));
+	REQUIRE(QDir{}.mkpath(base % "/dest/src"));
+	writeTestFile(base % "/dest/src/a.bin", patternedContents(50));
+
+	auto request = makeTransferRequest(TransferKind::Copy, { base % "/src" }, DestinationIntent::IntoDirectory, base % "/dest");
+	REQUIRE(request.has_value());
+	request->journalDirectory = ep(base % "/journals");
+
+	OperationScript script;
+	script.decisions = { act(DecisionAction::Skip) };
+	auto context = makeScriptedContext(script, PrimaryProgressUnit::Bytes);
+	const auto summary = CTransferExecutor{ context, defaultTransferChunkSize }.run(*request);
+
+	CHECK(summary.status != CompletionStatus::Cancelled);
+	CHECK(summary.skippedItems == 1);
+	CHECK(readFileContents(base % "/dest/src/a.bin") == patternedContents(50));
+	CHECK(countTreeEntries(base % "/journals") == 0);
+}
+
 TEST_CASE("copy executor: a source resized mid-transfer is copied at its captured size", "[executor]")
 {
 	QTemporaryDir tempDir;
@@ -1048,6 +1322,10 @@ TEST_CASE("copy executor: a failed staging cleanup is a warning, not a failure",
 	}
 	// Not a PermissionDenied-class code: that one the cleanup remediates (make writable, retry) and succeeds.
 	hooks.forceNativeError(Point::StagedCopy_RemoveStaging_Native, ioFailureCode);
+#ifdef __linux__
+	// Only a named staging file has a removal to fail, so the unnamed one is turned down as unsupported
+	hooks.forceNativeError(Point::StagedCopy_CreateStaging_Native, ENOSYS);
+#endif
 
 	OperationScript script{ .decisions = { act(DecisionAction::Skip) } };
 	const auto summary = runCopy(script, { base % "/a.bin" }, DestinationIntent::IntoDirectory, base % "/dest");
@@ -1188,6 +1466,98 @@ TEST_CASE("copy executor: cancellation", "[executor]")
 	}
 }
 
+TEST_CASE("copy executor: file-copy workers change nothing but the speed", "[executor][parallel]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+
+	constexpr uint32_t workers = 4;
+	REQUIRE(QDir{}.mkpath(base % "/src/sub"));
+	for (int i = 0; i < 40; ++i)
+		writeTestFile(base % "/src/" % QString::number(i) % ".bin", patternedContents(100 + i * 37));
+	writeTestFile(base % "/src/sub/inner.bin", patternedContents(5000));
+	// Larger than the workers take on: copied by the executor itself, in between theirs
+	writeTestFile(base % "/src/large.bin", patternedContents(static_cast<int>(CTransferExecutor::maxPrefetchedFileSize) + 1));
+	const size_t entries = countTreeEntries(base % "/src");
+	REQUIRE(QDir{}.mkpath(base % "/dest"));
+
+	SECTION("the copy and its summary are the same")
+	{
+		OperationScript script;
+		const auto summary = runCopy(script, { base % "/src" }, DestinationIntent::IntoDirectory, base % "/dest", defaultTransferChunkSize, workers);
+		CHECK(summary.status == CompletionStatus::Completed);
+		CHECK(summary.completedItems == entries + 1);
+		CHECK(summary.transferredBytes == summary.clonedBytes + summary.kernelCopiedBytes + summary.overlappedWriteBytes + summary.mappedWriteBytes);
+		CHECK(script.seenRequests.empty());
+		requireEqualTrees(base % "/src", base % "/dest/src");
+
+		// Accounted as the traversal gets to each file, so the processed counts never go back
+		for (size_t i = 1; i < script.progress.size(); ++i)
+		{
+			CHECK(script.progress[i].itemsProcessed >= script.progress[i - 1].itemsProcessed);
+			CHECK(script.progress[i].bytesProcessed >= script.progress[i - 1].bytesProcessed);
+		}
+	}
+
+	SECTION("collisions are prompted for in traversal order, as without the workers")
+	{
+		REQUIRE(QDir{}.mkpath(base % "/dest/src"));
+		for (const char* name : { "/dest/src/31.bin", "/dest/src/4.bin", "/dest/src/17.bin" })
+			writeTestFile(base % name, "occupied");
+
+		OperationScript script;
+		script.decisions = { act(DecisionAction::Merge), act(DecisionAction::Skip), act(DecisionAction::Skip), act(DecisionAction::Skip) };
+		const auto summary = runCopy(script, { base % "/src" }, DestinationIntent::IntoDirectory, base % "/dest", defaultTransferChunkSize, workers);
+		CHECK(summary.status == CompletionStatus::Completed);
+		CHECK(summary.skippedItems == 3);
+
+		OperationScript sequentialScript;
+		sequentialScript.decisions = script.decisions;
+		REQUIRE(QDir{ base % "/dest/src" }.removeRecursively());
+		REQUIRE(QDir{}.mkpath(base % "/dest/src"));
+		for (const char* name : { "/dest/src/31.bin", "/dest/src/4.bin", "/dest/src/17.bin" })
+			writeTestFile(base % name, "occupied");
+		REQUIRE(runCopy(sequentialScript, { base % "/src" }, DestinationIntent::IntoDirectory, base % "/dest").skippedItems == 3);
+
+		REQUIRE(script.seenRequests.size() == sequentialScript.seenRequests.size());
+		for (size_t i = 0; i < script.seenRequests.size(); ++i)
+			CHECK(script.seenRequests[i].issue.source.path == sequentialScript.seenRequests[i].issue.source.path);
+		CHECK(readFileContents(base % "/dest/src/4.bin") == "occupied");
+	}
+
+	SECTION("a worker's failure is prompted for by the executor, and a retry copies the file")
+	{
+		CFaultHookScope hooks;
+		hooks.forceNativeError(Point::StagedCopy_WriteStaging_Native, ioFailureCode);
+
+		OperationScript script;
+		script.decisions = { act(DecisionAction::Retry) };
+		const auto summary = runCopy(script, { base % "/src" }, DestinationIntent::IntoDirectory, base % "/dest", defaultTransferChunkSize, workers);
+		CHECK(summary.status == CompletionStatus::Completed);
+		REQUIRE(script.seenRequests.size() == 1);
+		CHECK(script.seenRequests[0].issue.kind == IssueKind::ActionFailed);
+		REQUIRE(script.seenRequests[0].issue.failure.has_value());
+		CHECK(script.seenRequests[0].issue.failure->action == FailedAction::WriteDestination);
+		requireEqualTrees(base % "/src", base % "/dest/src");
+		CHECK(stagingFileCount(base % "/dest/src") == 0);
+	}
+
+	SECTION("a cancellation still accounts for every file the workers have published")
+	{
+		OperationScript script;
+		script.cancelAtCheckpoint = [&] { return QDir{ base % "/dest/src" }.entryList(QDir::Files).size() >= 3; };
+		const auto summary = runCopy(script, { base % "/src" }, DestinationIntent::IntoDirectory, base % "/dest", defaultTransferChunkSize, workers);
+		CHECK(summary.status == CompletionStatus::Cancelled);
+		CHECK(stagingFileCount(base % "/dest/src") == 0);
+
+		// The created directory itself, and everything in it
+		CHECK(summary.completedItems == 1 + countTreeEntries(base % "/dest/src"));
+		for (const QString& name : QDir{ base % "/dest/src" }.entryList(QDir::Files))
+			CHECK(readFileContents(base % "/dest/src/" % name) == readFileContents(base % "/src/" % name));
+	}
+}
+
 TEST_CASE("copy executor: progress across scanning and working", "[executor]")
 {
 	QTemporaryDir tempDir;
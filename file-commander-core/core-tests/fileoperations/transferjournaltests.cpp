@@ -0,0 +1,201 @@
+// CTransferJournal: what one run of a copy request records is there for the next run of the same request, and only
+// for that one; a record torn by a crash is dropped, and so is a journal left for too long.
+
+#include "fileoperations/ctransferjournal.h"
+
+#include "fileoperationtesthelpers.h"
+
+DISABLE_COMPILER_WARNINGS
+#include <QDateTime>
+#include <QTemporaryDir>
+RESTORE_COMPILER_WARNINGS
+
+namespace
+{
+
+TransferRequest copyRequest(const QString& base, const QString& destination)
+{
+	auto request = makeTransferRequest(TransferKind::Copy, { base % "/src" }, DestinationIntent::IntoDirectory, base % destination);
+	REQUIRE(request.has_value());
+	return *request;
+}
+
+CTransferJournal::CopiedFile copiedFile(const QString& destination, const uint64_t size)
+{
+	return { ep(destination), size, thin_io::timestamp{ .seconds = 1'700'000'000, .nanoseconds = 123'456'789 },
+		thin_io::timestamp{ .seconds = 1'700'000'100, .nanoseconds = 5 } };
+}
+
+} // namespace
+
+TEST_CASE("journal: records survive reopening", "[transferjournal]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+	const TransferRequest request = copyRequest(base, "/dest");
+	// Tabs, line breaks and backslashes are names like any other
+#ifdef _WIN32
+	const QString awkwardName = QStringLiteral("a\tb\nc"); // A backslash is a separator there
+#else
+	const QString awkwardName = QStringLiteral("a\tb\nc\\d");
+#endif
+
+	{
+		auto journal = CTransferJournal::open(ep(base % "/journals"), request);
+		REQUIRE(journal.has_value());
+		REQUIRE(journal->recordDirectory(ep(base % "/src"), { ep(base % "/dest/src"), true }).has_value());
+		REQUIRE(journal->recordDirectory(ep(base % "/src/merged"), { ep(base % "/dest/src/merged"), false }).has_value());
+		REQUIRE(journal->recordCopiedFile(ep(base % "/src/" % awkwardName), copiedFile(base % "/dest/src/" % awkwardName, 1234)).has_value());
+		REQUIRE(journal->recordPartialFile(ep(base % "/src/large.bin"), { ep(base % "/dest/src/.staging.tmp"), 5000, 4096 }).has_value());
+		REQUIRE(journal->recordPartialFile(ep(base % "/src/other.bin"), { ep(base % "/dest/src/.other.tmp"), 5000, 4096 }).has_value());
+		REQUIRE(journal->forgetPartialFile(ep(base % "/src/other.bin")).has_value());
+		REQUIRE(journal->close().has_value());
+	}
+
+	auto journal = CTransferJournal::open(ep(base % "/journals"), request);
+	REQUIRE(journal.has_value());
+
+	const auto created = journal->directory(ep(base % "/src"));
+	REQUIRE(created.has_value());
+	CHECK(created->destination.value() == base % "/dest/src");
+	CHECK(created->operationCreated);
+	const auto merged = journal->directory(ep(base % "/src/merged"));
+	REQUIRE(merged.has_value());
+	CHECK(!merged->operationCreated);
+
+	const auto copied = journal->copiedFile(ep(base % "/src/" % awkwardName));
+	REQUIRE(copied.has_value());
+	CHECK(copied->destination.value() == base % "/dest/src/" % awkwardName);
+	CHECK(copied->size == 1234);
+	CHECK(copied->sourceLastWrite.seconds == 1'700'000'000);
+	CHECK(copied->sourceLastWrite.nanoseconds == 123'456'789);
+	CHECK(copied->destinationLastWrite.seconds == 1'700'000'100);
+	CHECK(copied->destinationLastWrite.nanoseconds == 5);
+
+	const auto partial = journal->partialFile(ep(base % "/src/large.bin"));
+	REQUIRE(partial.has_value());
+	CHECK(partial->stagingPath.value() == base % "/dest/src/.staging.tmp");
+	CHECK(partial->sourceSize == 5000);
+	CHECK(partial->stagedBytes == 4096);
+	CHECK(!journal->partialFile(ep(base % "/src/other.bin")).has_value());
+
+	// A copied file supersedes its partial record
+	REQUIRE(journal->recordCopiedFile(ep(base % "/src/large.bin"), copiedFile(base % "/dest/src/large.bin", 5000)).has_value());
+	CHECK(!journal->partialFile(ep(base % "/src/large.bin")).has_value());
+
+	CHECK(!journal->directory(ep(base % "/src/never")).has_value());
+	CHECK(!journal->copiedFile(ep(base % "/src/never")).has_value());
+
+	const QString path = journal->path().value();
+	REQUIRE(journal->remove().has_value());
+	CHECK(entryAbsent(path));
+}
+
+TEST_CASE("journal: another request has a journal of its own", "[transferjournal]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+
+	auto first = CTransferJournal::open(ep(base % "/journals"), copyRequest(base, "/dest"));
+	REQUIRE(first.has_value());
+	REQUIRE(first->recordDirectory(ep(base % "/src"), { ep(base % "/dest/src"), true }).has_value());
+	REQUIRE(first->close().has_value());
+
+	auto second = CTransferJournal::open(ep(base % "/journals"), copyRequest(base, "/elsewhere"));
+	REQUIRE(second.has_value());
+	CHECK(second->path().value() != first->path().value());
+	CHECK(!second->directory(ep(base % "/src")).has_value());
+	REQUIRE(second->close().has_value());
+	CHECK(countTreeEntries(base % "/journals") == 2);
+}
+
+TEST_CASE("journal: a record torn by a crash is dropped", "[transferjournal]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+	const TransferRequest request = copyRequest(base, "/dest");
+
+	QString path;
+	{
+		auto journal = CTransferJournal::open(ep(base % "/journals"), request);
+		REQUIRE(journal.has_value());
+		REQUIRE(journal->recordDirectory(ep(base % "/src"), { ep(base % "/dest/src"), true }).has_value());
+		path = journal->path().value();
+		REQUIRE(journal->close().has_value());
+	}
+
+	const QByteArray whole = readFileContents(path);
+	writeTestFile(path, whole + "file\t" + (base % "/src/a.bin").toUtf8() + "\t" + (base % "/dest/src/a.bin").toUtf8()); // No size or times, no line break
+
+	{
+		auto journal = CTransferJournal::open(ep(base % "/journals"), request);
+		REQUIRE(journal.has_value());
+		CHECK(journal->directory(ep(base % "/src")).has_value());
+		CHECK(!journal->copiedFile(ep(base % "/src/a.bin")).has_value());
+		CHECK(readFileContents(path) == whole); // Cut off, so that the next record starts on a line of its own
+
+		REQUIRE(journal->recordCopiedFile(ep(base % "/src/a.bin"), copiedFile(base % "/dest/src/a.bin", 10)).has_value());
+		REQUIRE(journal->close().has_value());
+	}
+
+	auto journal = CTransferJournal::open(ep(base % "/journals"), request);
+	REQUIRE(journal.has_value());
+	CHECK(journal->copiedFile(ep(base % "/src/a.bin")).has_value());
+
+	SECTION("a file that is not a journal is started afresh")
+	{
+		REQUIRE(journal->close().has_value());
+		writeTestFile(path, "something else entirely\n");
+		auto fresh = CTransferJournal::open(ep(base % "/journals"), request);
+		REQUIRE(fresh.has_value());
+		CHECK(!fresh->directory(ep(base % "/src")).has_value());
+		REQUIRE(fresh->close().has_value());
+	}
+}
+
+TEST_CASE("journal: a journal left for longer than maxAge goes with its staging files", "[transferjournal]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+	REQUIRE(QDir{}.mkpath(base % "/dest/src"));
+	writeTestFile(base % "/dest/src/.file-commander-copy-1.tmp", QByteArray(100, 's'));
+	writeTestFile(base % "/dest/src/not-a-staging-file.bin", QByteArray(100, 'u'));
+
+	QString path;
+	{
+		auto journal = CTransferJournal::open(ep(base % "/journals"), copyRequest(base, "/dest"));
+		REQUIRE(journal.has_value());
+		REQUIRE(journal->recordPartialFile(ep(base % "/src/large.bin"), { ep(base % "/dest/src/.file-commander-copy-1.tmp"), 5000, 100 }).has_value());
+		// Only ever a staging file is deleted, whatever the record says
+		REQUIRE(journal->recordPartialFile(ep(base % "/src/other.bin"), { ep(base % "/dest/src/not-a-staging-file.bin"), 5000, 100 }).has_value());
+		path = journal->path().value();
+		REQUIRE(journal->close().has_value());
+	}
+
+	SECTION("a recent journal is kept")
+	{
+		auto other = CTransferJournal::open(ep(base % "/journals"), copyRequest(base, "/elsewhere"));
+		REQUIRE(other.has_value());
+		REQUIRE(other->close().has_value());
+		CHECK(!entryAbsent(path));
+		CHECK(!entryAbsent(base % "/dest/src/.file-commander-copy-1.tmp"));
+	}
+
+	SECTION("an old one is dropped when any journal is opened next to it")
+	{
+		const auto longAgo = QDateTime::currentDateTime().addDays(-(CTransferJournal::maxAge.count() + 1)).toSecsSinceEpoch();
+		REQUIRE(setEntryTimes(path, { .creation = {}, .last_access = {}, .last_write = thin_io::timestamp{ .seconds = longAgo } }));
+
+		auto other = CTransferJournal::open(ep(base % "/journals"), copyRequest(base, "/elsewhere"));
+		REQUIRE(other.has_value());
+		REQUIRE(other->close().has_value());
+		CHECK(entryAbsent(path));
+		CHECK(entryAbsent(base % "/dest/src/.file-commander-copy-1.tmp"));
+		CHECK(readFileContents(base % "/dest/src/not-a-staging-file.bin") == QByteArray(100, 'u'));
+		CHECK(countTreeEntries(base % "/journals") == 1);
+	}
+}
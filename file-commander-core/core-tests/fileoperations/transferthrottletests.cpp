@@ -0,0 +1,168 @@
+// CTransferThrottle: a job's own limit and the shared one both hold its transfers back, either can be changed while a
+// transfer waits, a cancelled throttle lets go of it, a Background job is not held back by a Foreground one, and
+// its priority can be applied by the threads that do its I/O without passing the throttle.
+
+#include "fileoperations/ctransferthrottle.h"
+
+#include "fileoperationtesthelpers.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std::chrono_literals;
+
+namespace
+{
+
+// How long passing `bytes` in chunks of `chunk` takes; the first pass only starts the clock
+[[nodiscard]] std::chrono::milliseconds timePasses(CTransferThrottle& throttle, const uint64_t bytes, const uint64_t chunk)
+{
+	const auto start = std::chrono::steady_clock::now();
+	REQUIRE(throttle.pass(0));
+	for (uint64_t passed = 0; passed < bytes; passed += chunk)
+		REQUIRE(throttle.pass(chunk));
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+}
+
+} // namespace
+
+TEST_CASE("throttle: limits", "[transferthrottle]")
+{
+	CTransferThrottle shared;
+	CTransferThrottle throttle{ &shared };
+
+	SECTION("unlimited, nothing is held back")
+	{
+		CHECK(!throttle.effectiveLimit().has_value());
+		CHECK(!throttle.maxChunkSize().has_value());
+		CHECK(timePasses(throttle, 100 * 1024 * 1024, 1024 * 1024) < 100ms);
+	}
+
+	SECTION("the job's own limit")
+	{
+		throttle.setLimit(1'000'000);
+		CHECK(throttle.limit() == 1'000'000);
+		CHECK(throttle.effectiveLimit() == 1'000'000);
+		CHECK(!shared.limit().has_value());
+		// 300 ms at the limit; the lower bound is the one a broken throttle would miss
+		CHECK(timePasses(throttle, 300'000, 50'000) >= 250ms);
+	}
+
+	SECTION("the shared limit, and the lower of the two")
+	{
+		shared.setLimit(1'000'000);
+		CHECK(throttle.effectiveLimit() == 1'000'000);
+		CHECK(timePasses(throttle, 300'000, 50'000) >= 250ms);
+
+		throttle.setLimit(2'000'000);
+		CHECK(throttle.effectiveLimit() == 1'000'000);
+		throttle.setLimit(500'000);
+		CHECK(throttle.effectiveLimit() == 500'000);
+	}
+
+	SECTION("a limited chunk is no bigger than a burst")
+	{
+		throttle.setLimit(100 * 1024 * 1024);
+		CHECK(throttle.maxChunkSize() == 100 * 1024 * 1024 * CTransferThrottle::burstDuration.count() / 1000);
+		throttle.setLimit(1000);
+		CHECK(throttle.maxChunkSize() == CTransferThrottle::minBurstBytes);
+	}
+}
+
+TEST_CASE("throttle: a waiting transfer is let go", "[transferthrottle]")
+{
+	CTransferThrottle shared;
+	CTransferThrottle throttle{ &shared };
+	REQUIRE(throttle.pass(0));
+
+	std::atomic<bool> passed = false;
+	std::atomic<bool> result = false;
+	std::thread waiter;
+	const auto startWaiting = [&] {
+		// Ten minutes' worth of debt
+		waiter = std::thread{ [&] {
+			result = throttle.pass(600'000);
+			passed = true;
+		} };
+		std::this_thread::sleep_for(50ms);
+		REQUIRE(!passed);
+	};
+
+	SECTION("when its own limit is lifted")
+	{
+		throttle.setLimit(1000);
+		startWaiting();
+		throttle.setLimit(std::nullopt);
+		waiter.join();
+		CHECK(result);
+	}
+
+	SECTION("when the shared limit is lifted")
+	{
+		shared.setLimit(1000);
+		startWaiting();
+		shared.setLimit(std::nullopt);
+		waiter.join();
+		CHECK(result);
+	}
+
+	SECTION("when cancelled, waiting on its own limit")
+	{
+		throttle.setLimit(1000);
+		startWaiting();
+		throttle.cancel();
+		waiter.join();
+		CHECK(!result);
+		CHECK(!throttle.pass(0)); // For good
+	}
+
+	SECTION("when cancelled, waiting on the shared limit")
+	{
+		shared.setLimit(1000);
+		startWaiting();
+		throttle.cancel();
+		waiter.join();
+		CHECK(!result);
+	}
+}
+
+TEST_CASE("throttle: a Background job is not held back by a Foreground one", "[transferthrottle]")
+{
+	CTransferThrottle shared;
+	CTransferThrottle foreground{ &shared };
+	CTransferThrottle background{ &shared };
+	background.setPriority(TransferPriority::Background);
+	CHECK(background.priority() == TransferPriority::Background);
+
+	// Only its I/O priority is lowered; two jobs that would contend for a device never run at once in the first place
+	REQUIRE(foreground.pass(0));
+	CHECK(timePasses(background, 1024, 1024) < 100ms);
+}
+
+#ifdef __linux__
+TEST_CASE("throttle: a thread that doesn't pass the throttle can take on its priority", "[transferthrottle]")
+{
+	// ioprio_get() for the calling thread
+	const auto ioPriority = [] { return ::syscall(SYS_ioprio_get, 1, 0); };
+
+	// On a thread of its own, so that the thread-local cache starts from the default
+	long initial = 0, background = 0, restored = 0;
+	std::thread helper{ [&] {
+		initial = ioPriority();
+		CTransferThrottle::applyPriorityToThisThread(TransferPriority::Background);
+		background = ioPriority();
+		CTransferThrottle::applyPriorityToThisThread(TransferPriority::Foreground);
+		restored = ioPriority();
+	} };
+	helper.join();
+
+	CHECK(background == ((2 << 13) | 7)); // Best-effort, the lowest level
+	CHECK(restored == initial);
+}
+#endif
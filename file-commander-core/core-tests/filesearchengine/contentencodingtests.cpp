@@ -0,0 +1,61 @@
+#include "searchenginetesthelpers.h"
+#include "filesearchengine/ccontentencoding.h"
+
+using Kind = CContentEncoding::Kind;
+
+[[nodiscard]] static CContentEncoding detect(const QByteArray& data)
+{
+	return CContentEncoding::detect(reinterpret_cast<const std::byte*>(data.constData()), static_cast<size_t>(data.size()));
+}
+
+TEST_CASE("Content encoding - a byte order mark decides", "[search][contents][encoding]")
+{
+	CHECK(detect("\xEF\xBB\xBF" "text").kind() == Kind::Utf8);
+	CHECK(detect("\xFF\xFE" + utf16(QSL("text"), QSysInfo::LittleEndian)).kind() == Kind::Utf16LE);
+	CHECK(detect("\xFE\xFF" + utf16(QSL("text"), QSysInfo::BigEndian)).kind() == Kind::Utf16BE);
+	// Whatever follows the mark
+	CHECK(detect(QByteArray{ "\xFF\xFE\0\0\0\0", 6 }).kind() == Kind::Utf16LE);
+}
+
+TEST_CASE("Content encoding - UTF-16 without a byte order mark is told by where its NULs fall", "[search][contents][encoding]")
+{
+	const QString text = QSL("Plain Latin text, as in most logs and resource files\r\n");
+	CHECK(detect(utf16(text, QSysInfo::LittleEndian)).kind() == Kind::Utf16LE);
+	CHECK(detect(utf16(text, QSysInfo::BigEndian)).kind() == Kind::Utf16BE);
+	CHECK(detect(utf16(text, QSysInfo::LittleEndian)).codeUnitSize() == 2);
+}
+
+TEST_CASE("Content encoding - dense NULs mean binary data, a stray one does not", "[search][contents][encoding]")
+{
+	QByteArray binary{ 1024, '\0' };
+	binary.replace(0, 4, "\x7F" "ELF");
+	CHECK(detect(binary).kind() == Kind::Binary);
+
+	QByteArray text{ 1024, 'x' };
+	text[500] = '\0';
+	CHECK(detect(text).kind() == Kind::Utf8);
+}
+
+TEST_CASE("Content encoding - valid UTF-8 is UTF-8, even cut off mid-character by the end of the sample", "[search][contents][encoding]")
+{
+	const QByteArray text = QStringLiteral(u"Привет, мир").toUtf8();
+	CHECK(detect(text).kind() == Kind::Utf8);
+	CHECK(detect(text.first(3)).kind() == Kind::Utf8);
+
+	const QByteArray cutBySample = QByteArray(static_cast<qsizetype>(CContentEncoding::sampleSize) - 1, 'x') + text;
+	CHECK(detect(cutBySample).kind() == Kind::Utf8);
+}
+
+TEST_CASE("Content encoding - a legacy code page is decoded and encoded the way it was written", "[search][contents][encoding]")
+{
+	const QString text = QStringLiteral(u"Съешь же ещё этих мягких французских булок, да выпей чаю. Широкая электрификация южных губерний даст мощный толчок подъёму сельского хозяйства.");
+	const QByteArray data = inCodePage(text, "windows-1251");
+
+	const CContentEncoding encoding = detect(data);
+	REQUIRE(encoding.kind() == Kind::Legacy);
+	CHECK(encoding.decode(reinterpret_cast<const std::byte*>(data.constData()), static_cast<size_t>(data.size())) == text);
+	CHECK(encoding.encode(text) == data);
+	CHECK(encoding.encodedLength(text) == static_cast<size_t>(data.size()));
+	// No Cyrillic code page has these
+	CHECK(encoding.encode(QStringLiteral(u"漢字")).isEmpty());
+}
@@ -0,0 +1,202 @@
+#include "searchenginetesthelpers.h"
+
+DISABLE_COMPILER_WARNINGS
+#include <QDateTime>
+RESTORE_COMPILER_WARNINGS
+
+// Kept outside the searched tree, so that the index file itself is never indexed or searched.
+class IndexLocation
+{
+public:
+	IndexLocation() { REQUIRE(_dir.isValid()); }
+
+	[[nodiscard]] QString path() const { return _dir.path() + QSL("/contents.index"); }
+
+	[[nodiscard]] std::shared_ptr<const CContentIndex> build(const QStringList& roots) const
+	{
+		auto index = CContentIndex::build(path(), roots, std::atomic<bool>{false});
+		REQUIRE(index);
+		return index;
+	}
+
+private:
+	QTemporaryDir _dir;
+};
+
+// Rewrites a file's contents while keeping its size and modification time, which is exactly the change the index
+// cannot see. A search that does not report the file afterwards has not read it.
+static void replaceContentsBehindTheIndexesBack(const QString& path, const QByteArray& contents)
+{
+	const QDateTime modified = QFileInfo{ path }.lastModified();
+
+	QFile file{ path };
+	REQUIRE(file.size() == contents.size());
+	REQUIRE(file.open(QFile::ReadWrite));
+	REQUIRE(file.write(contents) == contents.size());
+	// Flushed first, or the write would land after the time is restored
+	REQUIRE(file.flush());
+	REQUIRE(file.setFileTime(modified, QFileDevice::FileModificationTime));
+}
+
+TEST_CASE("Content index - files the index rules out are not read", "[search][contents][index]")
+{
+	TempTree tree;
+	const QString hit = tree.makeFile(QSL("hit.txt"), "the needle is here");
+	const QString miss = tree.makeFile(QSL("miss.txt"), "nothing of interest");
+
+	IndexLocation location;
+	const auto index = location.build({ tree.path() });
+	CHECK(index->fileCount() == 2);
+
+	replaceContentsBehindTheIndexesBack(miss, "needles of interest");
+
+	const SearchResult withIndex = runSearch({ .roots = { tree.path() }, .contents = QSL("needle"), .contentsCaseSensitive = true, .contentIndex = index });
+	CHECK(withIndex.matched(hit));
+	CHECK_FALSE(withIndex.matched(miss));
+
+	const SearchResult withoutIndex = runSearch({ .roots = { tree.path() }, .contents = QSL("needle"), .contentsCaseSensitive = true });
+	CHECK(withoutIndex.matched(miss));
+}
+
+TEST_CASE("Content index - files changed or added since the build are read", "[search][contents][index]")
+{
+	TempTree tree;
+	const QString changed = tree.makeFile(QSL("changed.txt"), "nothing");
+
+	IndexLocation location;
+	const auto index = location.build({ tree.path() });
+
+	tree.makeFile(QSL("changed.txt"), "a longer file with a needle in it");
+	const QString added = tree.makeFile(QSL("sub/added.txt"), "another needle");
+
+	const SearchResult result = runSearch({ .roots = { tree.path() }, .contents = QSL("needle"), .contentsCaseSensitive = true, .contentIndex = index });
+	CHECK(result.matched(changed));
+	CHECK(result.matched(added));
+}
+
+TEST_CASE("Content index - results are the same with and without it", "[search][contents][index]")
+{
+	TempTree tree;
+	tree.makeFile(QSL("upper.txt"), "A NEEDLE IN CAPITALS");
+	tree.makeFile(QSL("lower.txt"), "a needle in lower case");
+	tree.makeFile(QSL("repeated.txt"), "neeeedle");
+	tree.makeFile(QSL("word.txt"), "needles are not a needle");
+	tree.makeFile(QSL("binary.dat"), QByteArray("head\0needle\0tail", 16));
+	tree.makeFile(QSL("kelvin.txt"), "\xE2\x84\xAA" "elvin"); // KELVIN SIGN, which folds to 'k'
+	tree.makeFile(QSL("utf16.txt"), "\xFF\xFE" + utf16(QSL("a needle in UTF-16"), QSysInfo::LittleEndian)); // Indexed as its text in UTF-8
+	tree.makeFile(QSL("none.txt"), "haystack");
+
+	IndexLocation location;
+	const auto index = location.build({ tree.path() });
+
+	const std::vector<SearchQuery> queries{
+		{ .contents = QSL("needle"), .contentsCaseSensitive = true },
+		{ .contents = QSL("NEEDLE") },
+		{ .contents = QSL("needle"), .contentsCaseSensitive = true, .contentsWholeWords = true },
+		{ .contents = QSL("head needle"), .contentsCaseSensitive = true, .contentsIsRegex = false },
+		{ .contents = QSL("kelvin") },
+		{ .contents = QSL("ne+dle"), .contentsCaseSensitive = true, .contentsIsRegex = true },
+		{ .contents = QSL("a ne*dle"), .contentsCaseSensitive = true, .contentsIsRegex = true },
+		{ .contents = QSL("need(le)?s"), .contentsCaseSensitive = true, .contentsIsRegex = true },
+		{ .contents = QSL("haystack|needle"), .contentsCaseSensitive = true, .contentsIsRegex = true },
+		{ .contents = QSL("[Nn]eedle\\b"), .contentsCaseSensitive = true, .contentsIsRegex = true },
+	};
+
+	for (SearchQuery query : queries)
+	{
+		query.roots = { tree.path() };
+		INFO(query.contents.toStdString());
+
+		SearchResult withoutIndex = runSearch(query);
+		query.contentIndex = index;
+		SearchResult withIndex = runSearch(query);
+
+		std::ranges::sort(withoutIndex.matches);
+		std::ranges::sort(withIndex.matches);
+		CHECK(withIndex.matches == withoutIndex.matches);
+	}
+}
+
+TEST_CASE("Content index - a rebuild replaces the index on disk and forgets deleted files", "[search][contents][index]")
+{
+	TempTree tree;
+	tree.makeFile(QSL("kept.txt"), "needle");
+	const QString deleted = tree.makeFile(QSL("deleted.txt"), "needle");
+
+	IndexLocation location;
+	CHECK(location.build({ tree.path() })->fileCount() == 2);
+
+	REQUIRE(QFile::remove(deleted));
+	tree.makeFile(QSL("new.txt"), "haystack");
+	CHECK(location.build({ tree.path() })->fileCount() == 2);
+
+	const auto reopened = CContentIndex::open(location.path());
+	REQUIRE(reopened);
+	CHECK(reopened->fileCount() == 2);
+	CHECK(reopened->verdict(reopened->candidates(CContentIndex::requiredTrigrams(QSL("needle"), false, true, false)),
+		deleted, 6, QDateTime::currentSecsSinceEpoch()) == CContentIndex::Verdict::NotIndexed);
+}
+
+TEST_CASE("Content index - overlapping roots index each file once", "[search][contents][index]")
+{
+	TempTree tree;
+	tree.makeFile(QSL("a.txt"), "needle");
+	tree.makeFile(QSL("sub/b.txt"), "needle");
+
+	IndexLocation location;
+	CHECK(location.build({ tree.path(), tree.path(QSL("sub")) })->fileCount() == 2);
+}
+
+TEST_CASE("Content index - a cancelled build leaves the existing index in place", "[search][contents][index]")
+{
+	TempTree tree;
+	tree.makeFile(QSL("a.txt"), "needle");
+
+	IndexLocation location;
+	CHECK(location.build({ tree.path() })->fileCount() == 1);
+
+	tree.makeFile(QSL("b.txt"), "needle");
+	CHECK_FALSE(CContentIndex::build(location.path(), { tree.path() }, std::atomic<bool>{true}));
+
+	const auto existing = CContentIndex::open(location.path());
+	REQUIRE(existing);
+	CHECK(existing->fileCount() == 1);
+}
+
+TEST_CASE("Content index - a damaged or foreign index file is not opened", "[search][contents][index]")
+{
+	IndexLocation location;
+	CHECK_FALSE(CContentIndex::open(location.path()));
+
+	QFile file{ location.path() };
+	REQUIRE(file.open(QFile::WriteOnly));
+	REQUIRE(file.write(QByteArray(200, 'x')) == 200);
+	file.close();
+
+	CHECK_FALSE(CContentIndex::open(location.path()));
+}
+
+TEST_CASE("Content index - only text every match must contain narrows a query", "[search][contents][index]")
+{
+	const auto trigramsOf = [](const char* contents, bool isRegex, bool caseSensitive = true) {
+		return CContentIndex::requiredTrigrams(QString::fromUtf8(contents), isRegex, caseSensitive, isRegex || !caseSensitive);
+	};
+
+	CHECK(trigramsOf("needle", false).size() == 4);
+	CHECK(trigramsOf("ne", false).empty());
+	// "ne" and "dle" - the quantified 'e' may be absent
+	CHECK(trigramsOf("nee?dle", true) == trigramsOf("dle", false));
+	// "ne" and "edle" - one 'e' is always there, but the run is broken by the repetition
+	CHECK(trigramsOf("ne+dle", true) == trigramsOf("edle", false));
+	CHECK(trigramsOf("a(needle)b", true).empty());
+	CHECK(trigramsOf("[abc]needle", true) == trigramsOf("needle", false));
+
+	CHECK(trigramsOf("needle|haystack", true).empty());
+	CHECK(trigramsOf("(?i)needle", true).empty());
+	CHECK(trigramsOf("\\Qneedle\\E", true).empty());
+	CHECK(trigramsOf("needle\\1", true).empty());
+
+	// 's' also matches U+017F LATIN SMALL LETTER LONG S case-insensitively
+	CHECK(trigramsOf("sss", false, false).empty());
+	CHECK(trigramsOf("needle", false, false) == trigramsOf("NEEDLE", false, false));
+}
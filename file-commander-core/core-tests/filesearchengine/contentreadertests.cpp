@@ -0,0 +1,76 @@
+#include "searchenginetesthelpers.h"
+#include "filesearchengine/cfilecontentreader.h"
+
+using Strategy = CFileContentReader::Strategy;
+
+TEST_CASE("Content reader - the read policy follows the file size", "[search][contents][reader]")
+{
+	CHECK(CFileContentReader::policyFor(1).strategy == Strategy::Read);
+	CHECK(CFileContentReader::policyFor(CFileContentReader::maxReadFileSize).strategy == Strategy::Read);
+	CHECK(CFileContentReader::policyFor(CFileContentReader::maxReadFileSize + 1).strategy == Strategy::MapWhole);
+	CHECK(CFileContentReader::policyFor(CFileContentReader::maxWholeMappingSize).strategy == Strategy::MapWhole);
+
+	const auto hugeFilePolicy = CFileContentReader::policyFor(CFileContentReader::maxWholeMappingSize + 1);
+	CHECK(hugeFilePolicy.strategy == Strategy::MapWindows);
+	CHECK(hugeFilePolicy.windowSize == CFileContentReader::mappingWindowSize);
+}
+
+TEST_CASE("Content reader - every policy hands over the whole file, once and in order", "[search][contents][reader]")
+{
+	TempTree tree;
+	// Not a whole number of windows, so that the last one is short
+	QByteArray contents(3 * 64 * 1024 + 123, '\0');
+	for (qsizetype i = 0; i < contents.size(); ++i)
+		contents[i] = static_cast<char>(i * 7);
+	const QString path = tree.makeFile(QSL("file.bin"), contents);
+
+	for (const CFileContentReader::ReadPolicy policy : { CFileContentReader::ReadPolicy{ Strategy::Read, 0 }, { Strategy::MapWhole, 0 }, { Strategy::MapWindows, 64 * 1024 } })
+	{
+		CFileContentReader reader;
+		REQUIRE(reader.open(path));
+		REQUIRE(reader.size() == static_cast<uint64_t>(contents.size()));
+
+		QByteArray seen;
+		size_t windowCount = 0;
+		const bool stopped = reader.scan(policy, [&](const std::byte* data, size_t length, uint64_t offset) {
+			CHECK(offset == static_cast<uint64_t>(seen.size()));
+			seen.append(reinterpret_cast<const char*>(data), static_cast<qsizetype>(length));
+			++windowCount;
+			return false;
+		});
+
+		CHECK(!stopped);
+		CHECK(seen == contents);
+		CHECK(windowCount == (policy.strategy == Strategy::MapWindows ? 4u : 1u));
+	}
+}
+
+TEST_CASE("Content reader - the scanner can stop the scan", "[search][contents][reader]")
+{
+	TempTree tree;
+	const QString path = tree.makeFile(QSL("file.bin"), QByteArray(4 * 64 * 1024, 'x'));
+
+	CFileContentReader reader;
+	REQUIRE(reader.open(path));
+
+	size_t windowCount = 0;
+	CHECK(reader.scan({ Strategy::MapWindows, 64 * 1024 }, [&](const std::byte*, size_t, uint64_t) {
+		return ++windowCount == 2;
+	}));
+	CHECK(windowCount == 2);
+}
+
+TEST_CASE("Content search - finds the text whether the file is read or mapped", "[search][contents][reader]")
+{
+	TempTree tree;
+	const auto readSize = static_cast<qsizetype>(CFileContentReader::maxReadFileSize);
+	const QString read = tree.makeFileWithNeedleAt(QSL("read.bin"), "needle", readSize - 6, readSize);
+	const QString mapped = tree.makeFileWithNeedleAt(QSL("mapped.bin"), "needle", readSize, readSize + 6);
+	const QString neither = tree.makeFileWithNeedleAt(QSL("neither.bin"), "other", readSize, readSize + 5);
+
+	const SearchResult result = runSearch({ .roots = { tree.path() }, .contents = QSL("needle"), .contentsCaseSensitive = true });
+	CHECK(result.count() == 2);
+	CHECK(result.matched(read));
+	CHECK(result.matched(mapped));
+	CHECK_FALSE(result.matched(neither));
+}
@@ -76,7 +76,113 @@ TEST_CASE("Search - NUL bytes do not hide the text around them", "[search][conte
 	const QString file = tree.makeFile(QSL("binary.dat"), QByteArray("head\0\0\0needle", 13));
 
 	// Case-insensitivity routes this through the regex path, the one that has to substitute the NULs out first.
-	CHECK(runSearch({ .roots = { tree.path() }, .contents = QSL("needle") }).matched(file));
+	CHECK(runSearch({ .roots = { tree.path() }, .contents = QSL("needle"), .skipBinaryFiles = false }).matched(file));
+}
+
+TEST_CASE("Search - binary files are skipped unless asked for", "[search][contents][encoding]")
+{
+	TempTree tree;
+	QByteArray contents{ 1024, '\0' };
+	contents.replace(100, 6, "needle");
+	const QString binary = tree.makeFile(QSL("binary.dat"), contents);
+	const QString text = tree.makeFile(QSL("text.txt"), "a needle");
+
+	for (const bool caseSensitive : { true, false })
+	{
+		const SearchResult skipping = runSearch({ .roots = { tree.path() }, .contents = QSL("needle"), .contentsCaseSensitive = caseSensitive });
+		CHECK_FALSE(skipping.matched(binary));
+		CHECK(skipping.matched(text));
+
+		const SearchResult notSkipping = runSearch({ .roots = { tree.path() }, .contents = QSL("needle"), .contentsCaseSensitive = caseSensitive, .skipBinaryFiles = false });
+		CHECK(notSkipping.matched(binary));
+		CHECK(notSkipping.matched(text));
+	}
+}
+
+TEST_CASE("Search - UTF-16 text is found, with offsets and lines in its own terms", "[search][contents][encoding]")
+{
+	TempTree tree;
+	const QString text = QSL("first line\nthe needle is here\n");
+	const QString littleEndian = tree.makeFile(QSL("le.txt"), "\xFF\xFE" + utf16(text, QSysInfo::LittleEndian));
+	const QString bigEndian = tree.makeFile(QSL("be.txt"), "\xFE\xFF" + utf16(text, QSysInfo::BigEndian));
+	const QString withoutBom = tree.makeFile(QSL("no-bom.txt"), utf16(text, QSysInfo::LittleEndian));
+
+	for (const bool caseSensitive : { true, false }) // The query transcoded for a byte search, and the file decoded for the regex engine
+	{
+		const SearchResult result = runSearch({ .roots = { tree.path() }, .contents = QSL("needle"), .contentsCaseSensitive = caseSensitive });
+		for (const auto& [file, bomLength] : { std::pair{ littleEndian, 2 }, std::pair{ bigEndian, 2 }, std::pair{ withoutBom, 0 } })
+		{
+			const auto locations = result.locationsOf(file);
+			REQUIRE(locations.size() == 1);
+			CHECK(locations[0].offset == static_cast<uint64_t>(bomLength + 2 * 15));
+			CHECK(locations[0].line == 2);
+			CHECK(locations[0].context == QSL("the needle is here"));
+		}
+	}
+}
+
+TEST_CASE("Search - a byte search in UTF-16 does not match across characters", "[search][contents][encoding]")
+{
+	TempTree tree;
+	// Encoded as "x a" "\0 b" "\0 x", which holds "a\0b\0" - "ab" in UTF-16LE - one byte off the characters
+	const QString file = tree.makeFile(QSL("le.txt"), "\xFF\xFE" + utf16(QStringLiteral(u"\u6178\u6200\u7800"), QSysInfo::LittleEndian));
+
+	CHECK_FALSE(runSearch({ .roots = { tree.path() }, .contents = QSL("ab"), .contentsCaseSensitive = true }).matched(file));
+}
+
+TEST_CASE("Search - text in a legacy code page is found", "[search][contents][encoding]")
+{
+	TempTree tree;
+	const QString text = QStringLiteral(u"Съешь же ещё этих мягких французских булок, да выпей чаю. Широкая электрификация южных губерний даст мощный толчок подъёму сельского хозяйства.");
+	const QString file = tree.makeFile(QSL("cp1251.txt"), inCodePage(text, "windows-1251"));
+
+	for (const bool caseSensitive : { true, false })
+	{
+		const auto locations = runSearch({ .roots = { tree.path() }, .contents = QStringLiteral(u"французских"), .contentsCaseSensitive = caseSensitive }).locationsOf(file);
+		REQUIRE(locations.size() == 1);
+		CHECK(locations[0].offset == static_cast<uint64_t>(text.indexOf(QStringLiteral(u"французских")))); // A byte per character
+	}
+}
+
+TEST_CASE("Search - compressed files are searched by their contents only when asked to", "[search][contents][compressed]")
+{
+	// Past the first decompressor window, so the offset and line count carry over from one window to the next
+	QByteArray contents;
+	for (int i = 0; i < 30'000; ++i)
+		contents += "log line " + QByteArray::number(i) + '\n';
+	const auto needleOffset = contents.size();
+	contents += "the needle is here\n";
+	REQUIRE(contents.size() > static_cast<qsizetype>(CStreamDecompressor::windowSize));
+
+	for (const auto& [format, extension] : { std::pair{ CStreamDecompressor::Format::Gzip, "gz" }, std::pair{ CStreamDecompressor::Format::Xz, "xz" }, std::pair{ CStreamDecompressor::Format::Zstd, "zst" } })
+	{
+		if (!CStreamDecompressor::isAvailable(format))
+		{
+			WARN("Compressed search is not available for ." << extension);
+			continue;
+		}
+
+		TempTree tree;
+		const QByteArray data = compressed(contents, format);
+		REQUIRE(!data.contains("needle"));
+		const QString file = tree.makeFile(QSL("app.log.") + extension, data);
+
+		CHECK_FALSE(runSearch({ .roots = { tree.path() }, .contents = QSL("needle"), .skipBinaryFiles = false }).matched(file));
+
+		for (const bool caseSensitive : { true, false })
+		{
+			const SearchResult result = runSearch({ .roots = { tree.path() }, .contents = QSL("needle"), .contentsCaseSensitive = caseSensitive, .searchCompressedFiles = true });
+			const auto locations = result.locationsOf(file);
+			REQUIRE(locations.size() == 1);
+			CHECK(locations[0].offset == static_cast<uint64_t>(needleOffset + 4));
+			CHECK(locations[0].line == 30'001);
+			CHECK(locations[0].context == QSL("the needle is here"));
+
+			CHECK(result.contentStatistics.compressedFilesSearched == 1);
+			CHECK(result.contentStatistics.bytesDecompressed == static_cast<uint64_t>(contents.size()));
+			CHECK(result.contentStatistics.bytesSearched >= result.contentStatistics.bytesDecompressed);
+		}
+	}
 }
 
 TEST_CASE("Search - text is found wherever it sits within a scan window", "[search][contents]")
@@ -158,3 +264,67 @@ TEST_CASE("Search - plain text is matched literally even when case-insensitive",
 	CHECK(result.matched(literal));
 	CHECK_FALSE(result.matched(wildcardDecoy));
 }
+
+TEST_CASE("Search - a content match reports its offset, line and the line around it", "[search][contents][locations]")
+{
+	TempTree tree;
+	const QString file = tree.makeFile(QSL("file.txt"), "first line\nsecond line\n\tthe needle is here\r\nlast line");
+
+	for (const bool caseSensitive : { true, false }) // The plain byte search, and the regex engine
+	{
+		const SearchResult result = runSearch({ .roots = { tree.path() }, .contents = QSL("needle"), .contentsCaseSensitive = caseSensitive });
+		const auto locations = result.locationsOf(file);
+		REQUIRE(locations.size() == 1);
+		CHECK(locations[0].offset == 28);
+		CHECK(locations[0].line == 3);
+		CHECK(locations[0].context == QSL("the needle is here"));
+	}
+}
+
+TEST_CASE("Search - every match in a file is reported up to the requested number, in file order", "[search][contents][locations]")
+{
+	TempTree tree;
+	QByteArray contents;
+	for (int i = 0; i < 10; ++i)
+		contents += "line " + QByteArray::number(i) + (i % 3 == 0 ? " needle\n" : "\n");
+	const QString file = tree.makeFile(QSL("file.txt"), contents);
+
+	const auto lines = [](const std::vector<CFileSearchEngine::MatchLocation>& locations) {
+		std::vector<uint64_t> numbers;
+		for (const auto& location : locations)
+			numbers.push_back(location.line);
+		return numbers;
+	};
+
+	CHECK(lines(runSearch({ .roots = { tree.path() }, .contents = QSL("needle"), .contentsCaseSensitive = true }).locationsOf(file)) == std::vector<uint64_t>{ 1 });
+	CHECK(lines(runSearch({ .roots = { tree.path() }, .contents = QSL("needle"), .contentsCaseSensitive = true, .matchLocationsPerFile = 2 }).locationsOf(file)) == std::vector<uint64_t>{ 1, 4 });
+	CHECK(lines(runSearch({ .roots = { tree.path() }, .contents = QSL("needle"), .matchLocationsPerFile = 100 }).locationsOf(file)) == std::vector<uint64_t>{ 1, 4, 7, 10 });
+}
+
+TEST_CASE("Search - line numbers count the newlines in every scan window before the match", "[search][contents][locations]")
+{
+	TempTree tree;
+	// A newline every 10 bytes, past several 4 KiB windows and the 16-byte vector width, with the needle on a line of its own
+	QByteArray contents;
+	for (int i = 0; i < 1000; ++i)
+		contents += "123456789\n";
+	const auto needleOffset = contents.size();
+	contents += "needle\n";
+	const QString file = tree.makeFile(QSL("file.txt"), contents);
+
+	const auto locations = runSearch({ .roots = { tree.path() }, .contents = QSL("needle"), .contentsCaseSensitive = true }).locationsOf(file);
+	REQUIRE(locations.size() == 1);
+	CHECK(locations[0].offset == static_cast<uint64_t>(needleOffset));
+	CHECK(locations[0].line == 1001);
+	CHECK(locations[0].context == QSL("needle"));
+}
+
+TEST_CASE("Search - a search by name reports no locations", "[search][locations]")
+{
+	TempTree tree;
+	const QString file = tree.makeFile(QSL("file.txt"), "needle");
+
+	const SearchResult result = runSearch({ .roots = { tree.path() }, .nameFilters = { QSL("file.txt") } });
+	REQUIRE(result.matched(file));
+	CHECK(result.locationsOf(file).empty());
+}
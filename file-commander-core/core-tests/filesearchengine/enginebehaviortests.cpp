@@ -1,6 +1,8 @@
 #include "searchenginetesthelpers.h"
 
+#include <chrono>
 #include <semaphore>
+#include <thread>
 
 TEST_CASE("Search - a query with nowhere to look is refused", "[search][engine]")
 {
@@ -119,3 +121,53 @@ TEST_CASE("Search - a content search spread across the worker pool reports every
 	CHECK(result.count() == fileCount);
 	CHECK(result.status == CFileSearchEngine::SearchFinished);
 }
+
+TEST_CASE("Search - matches are delivered in bounded batches, all of them before the search is reported finished", "[search][engine]")
+{
+	TempTree tree;
+	// Enough for the batch size to be what closes most batches, whatever the timing
+	constexpr size_t fileCount = CFileSearchEngine::matchBatchSize * 2 + 10;
+	for (size_t i = 0; i < fileCount; ++i)
+		tree.makeFile(QSL("f%1.txt").arg(i));
+
+	const SearchResult result = runSearch({ .roots = { tree.path() }, .nameFilters = { QSL("*.txt") } });
+
+	CHECK(result.count() == fileCount);
+	CHECK(result.matchBatches >= 3);
+	CHECK(result.largestMatchBatch <= CFileSearchEngine::matchBatchSize);
+	CHECK_FALSE(result.emptyMatchBatchReported);
+	CHECK_FALSE(result.matchesReportedAfterFinish);
+}
+
+TEST_CASE("Search - a batch that waits too long is delivered while the traversal is held up", "[search][engine]")
+{
+	TempTree tree;
+	// More than one tick of the traversal's progress reports, and fewer than a full batch
+	constexpr int fileCount = 200;
+	for (int i = 0; i < fileCount; ++i)
+		tree.makeFile(QSL("f%1.txt").arg(i));
+
+	SearchRunner runner;
+	// The second report comes with the matches of the first ticks pending; the traversal stays there until they
+	// arrive, or for long enough that they never would have by themselves.
+	int reports = 0;
+	bool deliveredWhileHeld = false;
+	runner.setItemScannedHook([&] {
+		if (++reports != 2)
+			return;
+
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{ 5 };
+		while (!deliveredWhileHeld && std::chrono::steady_clock::now() < deadline)
+		{
+			deliveredWhileHeld = runner.recordedSoFar().matchBatches > 0;
+			std::this_thread::sleep_for(CFileSearchEngine::matchBatchInterval / 5);
+		}
+	});
+
+	const SearchResult result = runner.run({ .roots = { tree.path() }, .nameFilters = { QSL("*.txt") } });
+
+	REQUIRE(reports >= 2);
+	CHECK(deliveredWhileHeld);
+	CHECK(result.count() == fileCount);
+	CHECK_FALSE(result.matchesReportedAfterFinish);
+}
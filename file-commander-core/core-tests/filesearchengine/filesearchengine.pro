@@ -12,7 +12,7 @@ UI_DIR      = ../../../build/$${OUTPUT_DIR}/$${TARGET}
 RCC_DIR     = ../../../build/$${OUTPUT_DIR}/$${TARGET}
 
 mac*|linux*|freebsd{
-	PRE_TARGETDEPS += $${DESTDIR_NOARCH}/libcpputils.a $${DESTDIR_NOARCH}/libqtutils.a $${DESTDIR}/libtest_utils.a
+	PRE_TARGETDEPS += $${DESTDIR_NOARCH}/libcpputils.a $${DESTDIR_NOARCH}/libqtutils.a $${DESTDIR}/libtest_utils.a $${DESTDIR}/libtext_encoding_detector.a
 }
 
 for (included_item, INCLUDEPATH): INCLUDEPATH += ../../$${included_item}
@@ -21,14 +21,32 @@ INCLUDEPATH += \
 	../../src/ \
 	../test-utils/src/
 
-LIBS += -L$${DESTDIR} -L$${DESTDIR_NOARCH} -lcpputils -lqtutils -ltest_utils
+LIBS += -L$${DESTDIR} -L$${DESTDIR_NOARCH} -lcpputils -lqtutils -ltest_utils -ltext_encoding_detector
 
 SOURCES += \
 	main.cpp \
 	namefiltertests.cpp \
+	namefiltermatchertests.cpp \
 	contentsearchtests.cpp \
 	enginebehaviortests.cpp \
+	contentindextests.cpp \
+	predicatetests.cpp \
+	scanexclusiontests.cpp \
+	readschedulertests.cpp \
+	contentreadertests.cpp \
+	contentencodingtests.cpp \
+	uringbatchreadertests.cpp \
+	streamdecompressortests.cpp \
+	withinresultstests.cpp \
 	../../src/filesearchengine/cfilesearchengine.cpp \
+	../../src/filesearchengine/ccontentencoding.cpp \
+	../../src/filesearchengine/ccontentindex.cpp \
+	../../src/filesearchengine/ccontentreadscheduler.cpp \
+	../../src/filesearchengine/cstreamdecompressor.cpp \
+	../../src/filesearchengine/cfilecontentreader.cpp \
+	../../src/filesearchengine/curingbatchreader.cpp \
+	../../src/filesearchengine/cnamefiltermatcher.cpp \
+	../../src/filesearchengine/filesearchpredicates.cpp \
 	../../src/cfilesystemobject.cpp \
 	../../src/filesystemhelperfunctions.cpp \
 	../../src/directoryscanner.cpp
@@ -36,5 +54,13 @@ SOURCES += \
 HEADERS += \
 	searchenginetesthelpers.h \
 	../../src/filesearchengine/cfilesearchengine.h \
+	../../src/filesearchengine/ccontentencoding.h \
+	../../src/filesearchengine/ccontentindex.h \
+	../../src/filesearchengine/ccontentreadscheduler.h \
+	../../src/filesearchengine/cstreamdecompressor.h \
+	../../src/filesearchengine/cfilecontentreader.h \
+	../../src/filesearchengine/curingbatchreader.h \
+	../../src/filesearchengine/cnamefiltermatcher.h \
+	../../src/filesearchengine/filesearchpredicates.h \
 	../../src/cfilesystemobject.h \
 	../../src/directoryscanner.h
@@ -0,0 +1,102 @@
+#include "filesearchengine/cnamefiltermatcher.h"
+
+#include "qtcore_helpers/qstring_helpers.hpp"
+
+#include "compiler/compiler_warnings_control.h"
+
+DISABLE_COMPILER_WARNINGS
+#include <QStringList>
+RESTORE_COMPILER_WARNINGS
+
+#include "3rdparty/catch2/catch.hpp"
+
+// The matcher on its own, for the names a test tree cannot easily hold and for the shapes that each take their own lookup.
+
+[[nodiscard]] static bool matches(const QStringList& filters, const QString& name, bool caseSensitive = false)
+{
+	return CNameFilterMatcher{ filters, caseSensitive }.matches(name);
+}
+
+TEST_CASE("Name filter matcher - literal, prefix, suffix and substring filters", "[search][names][matcher]")
+{
+	CHECK(matches({ QSL("^notes.txt$") }, QSL("notes.txt")));
+	CHECK_FALSE(matches({ QSL("^notes.txt$") }, QSL("notes.txt.bak")));
+
+	CHECK(matches({ QSL("^notes") }, QSL("notes.txt")));
+	CHECK_FALSE(matches({ QSL("^notes") }, QSL("mynotes.txt")));
+
+	CHECK(matches({ QSL("^*.log$") }, QSL("server.log")));
+	CHECK_FALSE(matches({ QSL("^*.log$") }, QSL("server.log.1")));
+	// Unanchored, an extension filter is a substring filter
+	CHECK(matches({ QSL("*.log") }, QSL("server.log.1")));
+
+	CHECK(matches({ QSL("note") }, QSL("mynotes.txt")));
+	CHECK_FALSE(matches({ QSL("note") }, QSL("readme.md")));
+}
+
+TEST_CASE("Name filter matcher - filters of different shapes combine as alternatives", "[search][names][matcher]")
+{
+	const QStringList filters{ QSL("^*.cpp$"), QSL("^*.h$"), QSL("^*.hpp$"), QSL("^Makefile$"), QSL("^test_"), QSL("^a?c$") };
+	CHECK(matches(filters, QSL("main.cpp")));
+	CHECK(matches(filters, QSL("main.h")));
+	CHECK(matches(filters, QSL("main.hpp")));
+	CHECK(matches(filters, QSL("makefile")));
+	CHECK(matches(filters, QSL("test_main.py")));
+	CHECK(matches(filters, QSL("abc")));
+
+	CHECK_FALSE(matches(filters, QSL("main.hxx")));
+	CHECK_FALSE(matches(filters, QSL("h")));
+	CHECK_FALSE(matches(filters, QSL("abbc")));
+}
+
+TEST_CASE("Name filter matcher - '*' between literals keeps their order and never overlaps them", "[search][names][matcher]")
+{
+	CHECK(matches({ QSL("^a*b*c$") }, QSL("a_b_c")));
+	CHECK_FALSE(matches({ QSL("^a*b*c$") }, QSL("a_c_b")));
+
+	CHECK(matches({ QSL("^ab*bc$") }, QSL("abbc")));
+	CHECK_FALSE(matches({ QSL("^ab*bc$") }, QSL("abc")));
+	CHECK_FALSE(matches({ QSL("^a*a$") }, QSL("a")));
+}
+
+TEST_CASE("Name filter matcher - '?' takes one character, even outside the BMP", "[search][names][matcher]")
+{
+	const QString emoji = QString::fromUcs4(U"a\U0001F600c");
+	CHECK(matches({ QSL("^a?c$") }, emoji));
+	CHECK_FALSE(matches({ QSL("^a??c$") }, emoji));
+	CHECK_FALSE(matches({ QSL("^a?c$") }, QSL("ac")));
+}
+
+TEST_CASE("Name filter matcher - wildcards match a newline, and '$' does not stop before one", "[search][names][matcher]")
+{
+	const QString withNewline = QSL("first\nsecond");
+	CHECK(matches({ QSL("^first*$") }, withNewline));
+	CHECK(matches({ QSL("^first?second$") }, withNewline));
+
+	CHECK_FALSE(matches({ QSL("^notes.txt$") }, QSL("notes.txt\n")));
+}
+
+TEST_CASE("Name filter matcher - case folding applies to every shape and beyond ASCII", "[search][names][matcher]")
+{
+	CHECK(matches({ QSL("^README.MD$") }, QSL("readme.md")));
+	CHECK(matches({ QSL("^*.TXT$") }, QSL("notes.txt")));
+	CHECK(matches({ QSL("^Ä?Ö$") }, QSL("äxö")));
+	// The Deseret letters have their case pairs outside the BMP
+	CHECK(matches({ QString::fromUcs4(U"^\U00010428$") }, QString::fromUcs4(U"\U00010400")));
+
+	CHECK_FALSE(matches({ QSL("^README.MD$") }, QSL("readme.md"), true));
+	CHECK_FALSE(matches({ QSL("^*.TXT$") }, QSL("notes.txt"), true));
+}
+
+TEST_CASE("Name filter matcher - what matches every name", "[search][names][matcher]")
+{
+	CHECK(CNameFilterMatcher{ {}, false }.matchesEverything());
+	CHECK(CNameFilterMatcher{ { QSL("*") }, false }.matchesEverything());
+	CHECK(CNameFilterMatcher{ { QSL("^**$") }, false }.matchesEverything());
+	CHECK(CNameFilterMatcher{ { QSL("^") }, false }.matchesEverything());
+	CHECK(CNameFilterMatcher{ { QSL("*.txt"), QSL("*") }, false }.matchesEverything());
+
+	CHECK_FALSE(CNameFilterMatcher{ { QSL("^$") }, false }.matchesEverything());
+	CHECK_FALSE(CNameFilterMatcher{ { QSL("?") }, false }.matchesEverything());
+	CHECK_FALSE(CNameFilterMatcher{ { QSL("*.txt") }, false }.matchesEverything());
+}
@@ -0,0 +1,226 @@
+#include "searchenginetesthelpers.h"
+
+#include "link_helpers.hpp"
+
+DISABLE_COMPILER_WARNINGS
+#include <QDateTime>
+RESTORE_COMPILER_WARNINGS
+
+static void setModificationTime(const QString& path, const QDateTime& time)
+{
+	QFile file{ path };
+	REQUIRE(file.open(QFile::ReadWrite));
+	REQUIRE(file.setFileTime(time, QFileDevice::FileModificationTime));
+}
+
+TEST_CASE("Search predicates - a size range only admits files within it", "[search][predicates]")
+{
+	TempTree tree;
+	const QString small = tree.makeFile(QSL("small.log"), QByteArray(10, 'a'));
+	const QString medium = tree.makeFile(QSL("medium.log"), QByteArray(100, 'a'));
+	const QString large = tree.makeFile(QSL("large.log"), QByteArray(1000, 'a'));
+	const QString dir = tree.makeDir(QSL("dir.log"));
+
+	SearchQuery query{ .roots = { tree.path() }, .nameFilters = { QSL("*.log") } };
+	query.predicates.minSize = 100;
+	const SearchResult atLeast = runSearch(query);
+	CHECK_FALSE(atLeast.matched(small));
+	CHECK(atLeast.matched(medium));
+	CHECK(atLeast.matched(large));
+	// Its size is not known, so a directory never satisfies a size condition
+	CHECK_FALSE(atLeast.matched(dir));
+
+	query.predicates.maxSize = 100;
+	const SearchResult exactly = runSearch(query);
+	CHECK(exactly.count() == 1);
+	CHECK(exactly.matched(medium));
+}
+
+TEST_CASE("Search predicates - a modification time range is inclusive", "[search][predicates]")
+{
+	TempTree tree;
+	const QDateTime reference = QDateTime::fromSecsSinceEpoch(1'700'000'000);
+	const QString old = tree.makeFile(QSL("old.txt"));
+	const QString onTheBoundary = tree.makeFile(QSL("boundary.txt"));
+	const QString recent = tree.makeFile(QSL("recent.txt"));
+	setModificationTime(old, reference.addDays(-10));
+	setModificationTime(onTheBoundary, reference);
+	setModificationTime(recent, reference.addSecs(60));
+
+	SearchQuery query{ .roots = { tree.path() } };
+	query.predicates.modifiedAfter = reference.toSecsSinceEpoch();
+	const SearchResult after = runSearch(query);
+	CHECK_FALSE(after.matched(old));
+	CHECK(after.matched(onTheBoundary));
+	CHECK(after.matched(recent));
+
+	query.predicates.modifiedAfter.reset();
+	query.predicates.modifiedBefore = reference.toSecsSinceEpoch();
+	const SearchResult before = runSearch(query);
+	CHECK(before.matched(old));
+	CHECK(before.matched(onTheBoundary));
+	CHECK_FALSE(before.matched(recent));
+}
+
+TEST_CASE("Search predicates - entry types select files, directories and links", "[search][predicates]")
+{
+	TempTree tree;
+	const QString file = tree.makeFile(QSL("target/file.txt"));
+	const QString dir = tree.makeDir(QSL("target/dir"));
+	const QString link = tree.path(QSL("link"));
+	REQUIRE(createDirectoryLink(tree.path(QSL("target/dir")), link));
+
+	SearchQuery query{ .roots = { tree.path(QSL("target")) } };
+	query.predicates.entryTypes = FileSearchPredicates::Files;
+	const SearchResult files = runSearch(query);
+	CHECK(files.matched(file));
+	CHECK_FALSE(files.matched(dir));
+
+	query.predicates.entryTypes = FileSearchPredicates::Directories;
+	const SearchResult dirs = runSearch(query);
+	CHECK(dirs.matched(dir));
+	CHECK_FALSE(dirs.matched(file));
+
+	query = SearchQuery{ .roots = { tree.path() } };
+	query.predicates.entryTypes = FileSearchPredicates::Links;
+	const SearchResult links = runSearch(query);
+	CHECK(links.matched(link));
+	CHECK_FALSE(links.matched(file));
+	CHECK_FALSE(links.matched(dir));
+}
+
+#ifndef _WIN32 // A leading dot does not hide anything on Windows
+TEST_CASE("Search predicates - hidden entries can be selected or left out", "[search][predicates]")
+{
+	TempTree tree;
+	const QString hidden = tree.makeFile(QSL(".hidden"));
+	const QString visible = tree.makeFile(QSL("visible"));
+
+	SearchQuery query{ .roots = { tree.path() } };
+	query.predicates.hidden = true;
+	const SearchResult onlyHidden = runSearch(query);
+	CHECK(onlyHidden.matched(hidden));
+	CHECK_FALSE(onlyHidden.matched(visible));
+
+	query.predicates.hidden = false;
+	const SearchResult onlyVisible = runSearch(query);
+	CHECK_FALSE(onlyVisible.matched(hidden));
+	CHECK(onlyVisible.matched(visible));
+}
+
+TEST_CASE("Search predicates - every required permission bit has to be set", "[search][predicates]")
+{
+	TempTree tree;
+	const QString executable = tree.makeFile(QSL("run.sh"));
+	const QString plain = tree.makeFile(QSL("notes.txt"));
+	REQUIRE(QFile::setPermissions(executable, QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner));
+	REQUIRE(QFile::setPermissions(plain, QFile::ReadOwner | QFile::WriteOwner));
+
+	SearchQuery query{ .roots = { tree.path() } };
+	query.predicates.requiredPermissions = QFile::ReadOwner | QFile::ExeOwner;
+	const SearchResult result = runSearch(query);
+	CHECK(result.matched(executable));
+	CHECK_FALSE(result.matched(plain));
+}
+#endif
+
+TEST_CASE("Search predicates - the owner has to match exactly", "[search][predicates]")
+{
+	TempTree tree;
+	const QString file = tree.makeFile(QSL("mine.txt"));
+	const QString currentUser = QFileInfo{ file }.owner();
+	if (currentUser.isEmpty())
+	{
+		WARN("The platform does not report file owners");
+		return;
+	}
+
+	SearchQuery query{ .roots = { tree.path() } };
+	query.predicates.owner = currentUser;
+	CHECK(runSearch(query).matched(file));
+
+	query.predicates.owner = currentUser + QSL("-somebody-else");
+	CHECK(runSearch(query).count() == 0);
+}
+
+TEST_CASE("Search predicates - apply to content searches as well", "[search][predicates][contents]")
+{
+	TempTree tree;
+	const QString small = tree.makeFile(QSL("small.txt"), "needle");
+	const QString large = tree.makeFile(QSL("large.txt"), QByteArray("needle") + QByteArray(1000, 'x'));
+
+	SearchQuery query{ .roots = { tree.path() }, .contents = QSL("needle"), .contentsCaseSensitive = true };
+	query.predicates.minSize = 100;
+	const SearchResult result = runSearch(query);
+	CHECK(result.count() == 1);
+	CHECK(result.matched(large));
+	CHECK_FALSE(result.matched(small));
+}
+
+TEST_CASE("Search predicates - size filter text", "[search][predicates]")
+{
+	CHECK(parseSizeFilter(QSL("1500")) == 1500u);
+	CHECK(parseSizeFilter(QSL(" 64K ")) == 64u * 1024u);
+	CHECK(parseSizeFilter(QSL("64 kb")) == 64u * 1024u);
+	CHECK(parseSizeFilter(QSL("1.5 MiB")) == 1536u * 1024u);
+	CHECK(parseSizeFilter(QSL("2G")) == 2ull * 1024u * 1024u * 1024u);
+	CHECK(parseSizeFilter(QSL("0")) == 0u);
+
+	CHECK_FALSE(parseSizeFilter(QString{}).has_value());
+	CHECK_FALSE(parseSizeFilter(QSL("K")).has_value());
+	CHECK_FALSE(parseSizeFilter(QSL("-1")).has_value());
+	CHECK_FALSE(parseSizeFilter(QSL("12 apples")).has_value());
+	CHECK_FALSE(parseSizeFilter(QSL("99999999T")).has_value());
+}
+
+TEST_CASE("Search predicates - built from the search window's filter fields, they filter", "[search][predicates]")
+{
+	TempTree tree;
+	const QDate day{ 2023, 11, 14 };
+	const QString small = tree.makeFile(QSL("small.log"), QByteArray(100, 'a'));
+	const QString largeThatDay = tree.makeFile(QSL("large-that-day.log"), QByteArray(5000, 'a'));
+	const QString largeLater = tree.makeFile(QSL("large-later.log"), QByteArray(5000, 'a'));
+	const QString dir = tree.makeDir(QSL("dir.log"));
+	setModificationTime(small, day.startOfDay().addSecs(3600));
+	setModificationTime(largeThatDay, day.startOfDay().addSecs(24 * 3600 - 1)); // The day's last second still belongs to it
+	setModificationTime(largeLater, day.addDays(1).startOfDay());
+
+	SearchFilterFields fields;
+	const auto everything = searchPredicatesFromFields(fields);
+	REQUIRE(everything.has_value());
+	CHECK(everything->empty());
+
+	SearchQuery query{ .roots = { tree.path() }, .nameFilters = { QSL("*.log") } };
+
+	SECTION("a size and a modification day")
+	{
+		fields.minSize = QSL("4K");
+		fields.modifiedFrom = day;
+		fields.modifiedTo = day;
+		const auto predicates = searchPredicatesFromFields(fields);
+		REQUIRE(predicates.has_value());
+		query.predicates = *predicates;
+
+		const SearchResult result = runSearch(query);
+		CHECK(result.count() == 1);
+		CHECK(result.matched(largeThatDay));
+	}
+
+	SECTION("a type")
+	{
+		fields.directories = true;
+		const auto predicates = searchPredicatesFromFields(fields);
+		REQUIRE(predicates.has_value());
+		query.predicates = *predicates;
+
+		const SearchResult result = runSearch(query);
+		CHECK(result.count() == 1);
+		CHECK(result.matched(dir));
+	}
+
+	SECTION("a size that is not one builds nothing")
+	{
+		fields.maxSize = QSL("large");
+		CHECK_FALSE(searchPredicatesFromFields(fields).has_value());
+	}
+}
@@ -0,0 +1,139 @@
+#include "searchenginetesthelpers.h"
+#include "filesearchengine/ccontentreadscheduler.h"
+
+#include <map>
+
+using StorageKind = CContentReadScheduler::StorageKind;
+
+// Records how many times each path was read; the reads arrive on the scheduler's reader threads.
+class ReadLog
+{
+public:
+	[[nodiscard]] CContentReadScheduler::ReadTask task()
+	{
+		return [this](const QString& path, bool /*reachedThroughLink*/) {
+			std::lock_guard lock{ _mutex };
+			++_reads[path];
+		};
+	}
+
+	[[nodiscard]] std::map<QString, size_t> reads() const
+	{
+		std::lock_guard lock{ _mutex };
+		return _reads;
+	}
+
+private:
+	mutable std::mutex _mutex;
+	std::map<QString, size_t> _reads;
+};
+
+TEST_CASE("Content read scheduler - every scheduled file is read exactly once, whatever the device", "[search][contents][scheduler]")
+{
+	TempTree tree;
+	// More than a batch, so that a rotational device dispatches one batch on its own and the rest at the end
+	const size_t fileCount = CContentReadScheduler::rotationalBatchSize + 100;
+	std::vector<QString> files;
+	for (size_t i = 0; i < fileCount; ++i)
+		files.push_back(tree.makeFile(QSL("f%1.txt").arg(i), "contents"));
+
+	for (const StorageKind kind : { StorageKind::Unknown, StorageKind::SolidState, StorageKind::Rotational })
+	{
+		ReadLog log;
+		const std::atomic<bool> cancelled{ false };
+		CContentReadScheduler scheduler{ log.task(), cancelled };
+		scheduler.setStorageKind(kind);
+		for (const QString& file : files)
+			scheduler.schedule(file, false);
+		scheduler.finish();
+
+		const auto reads = log.reads();
+		CHECK(reads.size() == fileCount);
+		CHECK(std::ranges::all_of(reads, [](const auto& read) { return read.second == 1; }));
+	}
+}
+
+TEST_CASE("Content read scheduler - switching devices dispatches what was batched for the previous one", "[search][contents][scheduler]")
+{
+	TempTree tree;
+	const QString onDisk = tree.makeFile(QSL("disk.txt"));
+	const QString onSsd = tree.makeFile(QSL("ssd.txt"));
+
+	ReadLog log;
+	const std::atomic<bool> cancelled{ false };
+	CContentReadScheduler scheduler{ log.task(), cancelled };
+	scheduler.setStorageKind(StorageKind::Rotational);
+	scheduler.schedule(onDisk, false);
+	scheduler.setStorageKind(StorageKind::SolidState);
+	scheduler.schedule(onSsd, false);
+	scheduler.finish();
+
+	CHECK(log.reads() == std::map<QString, size_t>{ { onDisk, 1 }, { onSsd, 1 } });
+}
+
+TEST_CASE("Content read scheduler - nothing still batched is read once the search is cancelled", "[search][contents][scheduler]")
+{
+	TempTree tree;
+	ReadLog log;
+	std::atomic<bool> cancelled{ false };
+	CContentReadScheduler scheduler{ log.task(), cancelled };
+	scheduler.setStorageKind(StorageKind::Rotational);
+	for (int i = 0; i < 10; ++i)
+		scheduler.schedule(tree.makeFile(QSL("f%1.txt").arg(i)), false);
+
+	cancelled = true;
+	scheduler.finish();
+
+	CHECK(log.reads().empty());
+}
+
+TEST_CASE("Content read scheduler - every kind of device gets at least one reader", "[search][contents][scheduler]")
+{
+	TempTree tree;
+	// Whatever the machine running the test has; Unknown is a valid answer, but asking must not fail
+	const StorageKind kind = CContentReadScheduler::storageKindOf(tree.path());
+	CHECK(CContentReadScheduler::readerCount(kind) >= 1);
+
+	for (const StorageKind anyKind : { StorageKind::Unknown, StorageKind::SolidState, StorageKind::Rotational })
+		CHECK(CContentReadScheduler::readerCount(anyKind) >= 1);
+}
+
+TEST_CASE("Content read scheduler - small files go to the batch task in batches, the rest one by one", "[search][contents][scheduler]")
+{
+	static constexpr size_t batchSize = 4;
+	static constexpr uint64_t maxBatchedSize = 100;
+
+	TempTree tree;
+	ReadLog log;
+	std::mutex batchesMutex;
+	std::vector<size_t> batchSizes;
+	std::map<QString, size_t> batchedReads;
+
+	const std::atomic<bool> cancelled{ false };
+	CContentReadScheduler scheduler{ log.task(), cancelled };
+	scheduler.setBatchReadTask([&](const std::vector<CContentReadScheduler::FileRead>& files) {
+		std::lock_guard lock{ batchesMutex };
+		batchSizes.push_back(files.size());
+		for (const auto& file : files)
+			++batchedReads[file.path];
+	}, maxBatchedSize, batchSize);
+
+	for (const StorageKind kind : { StorageKind::SolidState, StorageKind::Rotational })
+	{
+		scheduler.setStorageKind(kind);
+		for (int i = 0; i < 10; ++i)
+			scheduler.schedule(tree.makeFile(QSL("small%1_%2.txt").arg(static_cast<int>(kind)).arg(i)), false, maxBatchedSize);
+	}
+	const QString large = tree.makeFile(QSL("large.txt"));
+	scheduler.schedule(large, false, maxBatchedSize + 1);
+	const QString unknownSize = tree.makeFile(QSL("unknown.txt"));
+	scheduler.schedule(unknownSize, false);
+	scheduler.finish();
+
+	CHECK(log.reads() == std::map<QString, size_t>{ { large, 1 }, { unknownSize, 1 } });
+	CHECK(batchedReads.size() == 20);
+	CHECK(std::ranges::all_of(batchedReads, [](const auto& read) { return read.second == 1; }));
+	// Switching devices sends off the partial batch
+	CHECK(std::ranges::all_of(batchSizes, [](size_t size) { return size >= 1 && size <= batchSize; }));
+	CHECK(batchSizes.size() == 6);
+}
@@ -0,0 +1,115 @@
+#include "searchenginetesthelpers.h"
+
+#include "cfilesystemobject.h"
+#include "directoryscanner.h"
+
+// Every path a scan reports, relative to the tree and without a trailing slash.
+[[nodiscard]] static std::vector<QString> scannedPaths(const TempTree& tree, const ScanExclusions& exclusions)
+{
+	std::vector<QString> paths;
+	scanDirectory(CFileSystemObject{ tree.path() }, [&](const CFileSystemObject& item, bool /*reachedThroughLink*/) {
+		const QString relative = withoutTrailingSlash(item.fullAbsolutePath()).mid(tree.path().size() + 1);
+		if (!relative.isEmpty())
+			paths.push_back(relative);
+	}, std::atomic<bool>{false}, true, exclusions);
+
+	std::ranges::sort(paths);
+	return paths;
+}
+
+[[nodiscard]] static bool contains(const std::vector<QString>& paths, const char* path)
+{
+	return std::ranges::find(paths, QString::fromUtf8(path)) != paths.end();
+}
+
+TEST_CASE("Scan exclusions - a name pattern prunes matching entries at any depth", "[scan][exclusions]")
+{
+	TempTree tree;
+	tree.makeFile(QSL(".git/HEAD"));
+	tree.makeFile(QSL("web/node_modules/lib/index.js"));
+	tree.makeFile(QSL("web/app.js"));
+
+	const auto paths = scannedPaths(tree, { .patterns = { QSL(".git"), QSL("node_modules") } });
+	CHECK(paths == std::vector<QString>{ QSL("web"), QSL("web/app.js") });
+}
+
+TEST_CASE("Scan exclusions - a pattern with a slash is a path from the root", "[scan][exclusions]")
+{
+	TempTree tree;
+	tree.makeFile(QSL("build/out.o"));
+	tree.makeFile(QSL("src/build/generator.cpp"));
+	tree.makeFile(QSL("out/x/obj/a.o"));
+	tree.makeFile(QSL("out/x/y/obj/b.o"));
+	tree.makeFile(QSL("out/x/kept.txt"));
+
+	const auto paths = scannedPaths(tree, { .patterns = { QSL("/build"), QSL("out/**/obj") } });
+	CHECK_FALSE(contains(paths, "build"));
+	CHECK(contains(paths, "src/build/generator.cpp"));
+	CHECK_FALSE(contains(paths, "out/x/obj"));
+	CHECK_FALSE(contains(paths, "out/x/y/obj"));
+	CHECK(contains(paths, "out/x/kept.txt"));
+}
+
+TEST_CASE("Scan exclusions - a trailing slash limits a pattern to directories", "[scan][exclusions]")
+{
+	TempTree tree;
+	tree.makeFile(QSL("logs/today.log"));
+	tree.makeFile(QSL("sub/logs"));
+
+	const auto paths = scannedPaths(tree, { .patterns = { QSL("logs/") } });
+	CHECK_FALSE(contains(paths, "logs"));
+	CHECK(contains(paths, "sub/logs"));
+}
+
+TEST_CASE("Scan exclusions - wildcards, classes and re-inclusion", "[scan][exclusions]")
+{
+	TempTree tree;
+	tree.makeFile(QSL("a.o"));
+	tree.makeFile(QSL("keep.o"));
+	tree.makeFile(QSL("file1.tmp"));
+	tree.makeFile(QSL("fileX.tmp"));
+
+	const auto paths = scannedPaths(tree, { .patterns = { QSL("*.o"), QSL("!keep.o"), QSL("file[0-9].tmp") } });
+	CHECK(paths == std::vector<QString>{ QSL("fileX.tmp"), QSL("keep.o") });
+}
+
+TEST_CASE("Scan exclusions - ignore files apply to their own subtree, the closest one deciding", "[scan][exclusions]")
+{
+	TempTree tree;
+	tree.makeFile(QSL(".gitignore"), "# build products\n*.o\n/generated/\n");
+	tree.makeFile(QSL("main.o"));
+	tree.makeFile(QSL("generated/code.cpp"));
+	tree.makeFile(QSL("vendor/.gitignore"), "!*.o\r\n");
+	tree.makeFile(QSL("vendor/prebuilt.o"));
+	tree.makeFile(QSL("vendor/generated/kept.cpp"));
+	tree.makeFile(QSL("docs/.gitignore"), "draft.md\n");
+	tree.makeFile(QSL("docs/.ignore"), "!draft.md\n");
+	tree.makeFile(QSL("docs/draft.md"));
+	tree.makeFile(QSL("other/draft.md"));
+
+	const auto paths = scannedPaths(tree, { .useIgnoreFiles = true });
+	CHECK_FALSE(contains(paths, "main.o"));
+	CHECK_FALSE(contains(paths, "generated"));
+	CHECK(contains(paths, "vendor/prebuilt.o"));
+	// "/generated/" is anchored to the directory of the file that says so
+	CHECK(contains(paths, "vendor/generated/kept.cpp"));
+	// .ignore overrides .gitignore
+	CHECK(contains(paths, "docs/draft.md"));
+	// A rule in docs/.gitignore has no say outside docs
+	CHECK(contains(paths, "other/draft.md"));
+
+	// And none of it unless asked for
+	CHECK(contains(scannedPaths(tree, {}), "main.o"));
+}
+
+TEST_CASE("Search - excluded subtrees are not searched", "[search][exclusions]")
+{
+	TempTree tree;
+	const QString kept = tree.makeFile(QSL("src/needle.txt"), "needle");
+	const QString excluded = tree.makeFile(QSL("node_modules/needle.txt"), "needle");
+
+	const SearchResult result = runSearch({ .roots = { tree.path() }, .contents = QSL("needle"), .contentsCaseSensitive = true,
+		.exclusions = { .patterns = { QSL("node_modules") } } });
+	CHECK(result.matched(kept));
+	CHECK_FALSE(result.matched(excluded));
+}
@@ -5,6 +5,8 @@
 // Includes catch.hpp: the runner TU must #define CATCH_CONFIG_RUNNER before including this header.
 
 #include "filesearchengine/cfilesearchengine.h"
+#include "filesearchengine/ccontentindex.h"
+#include "filesearchengine/cstreamdecompressor.h"
 
 #include "qtcore_helpers/qstring_helpers.hpp"
 #include "qt_helpers.hpp" // operator<< for QString, so Catch2 can print a path in a failure report
@@ -16,14 +18,29 @@ DISABLE_COMPILER_WARNINGS
 #include <QFile>
 #include <QFileInfo>
 #include <QStringBuilder>
+#include <QSysInfo>
 #include <QTemporaryDir>
+#include <QTextCodec>
+#include <QtEndian>
 RESTORE_COMPILER_WARNINGS
 
 #include "3rdparty/catch2/catch.hpp"
 
+#ifdef FC_HAS_ZLIB
+#include <zlib.h>
+#endif
+#ifdef FC_HAS_LZMA
+#include <lzma.h>
+#endif
+#ifdef FC_HAS_ZSTD
+#include <zstd.h>
+#endif
+
 #include <algorithm>
 #include <functional>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <utility>
 #include <vector>
 
@@ -31,6 +48,76 @@ RESTORE_COMPILER_WARNINGS
 // has to stay in step with the engine's own constant.
 inline constexpr qsizetype contentScanWindowSize = 4 * 1024;
 
+// The text in UTF-16 of the given byte order, without a byte order mark.
+[[nodiscard]] inline QByteArray utf16(const QString& text, QSysInfo::Endian byteOrder)
+{
+	QByteArray encoded{ text.size() * 2, Qt::Uninitialized };
+	if (byteOrder == QSysInfo::LittleEndian)
+		qToLittleEndian<char16_t>(text.utf16(), text.size(), encoded.data());
+	else
+		qToBigEndian<char16_t>(text.utf16(), text.size(), encoded.data());
+	return encoded;
+}
+
+// The text in a legacy code page, e.g. "windows-1251".
+[[nodiscard]] inline QByteArray inCodePage(const QString& text, const char* codePage)
+{
+	QTextCodec* codec = QTextCodec::codecForName(codePage);
+	REQUIRE(codec);
+	return codec->fromUnicode(text);
+}
+
+// The data compressed into the given format, or nothing if this build has no library for it.
+[[nodiscard]] inline QByteArray compressed(const QByteArray& data, CStreamDecompressor::Format format)
+{
+	QByteArray result;
+	switch (format)
+	{
+#ifdef FC_HAS_ZLIB
+	case CStreamDecompressor::Format::Gzip:
+	{
+		z_stream stream{};
+		REQUIRE(::deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+		result.resize(static_cast<qsizetype>(::deflateBound(&stream, static_cast<uLong>(data.size()))));
+		stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.constData()));
+		stream.avail_in = static_cast<uInt>(data.size());
+		stream.next_out = reinterpret_cast<Bytef*>(result.data());
+		stream.avail_out = static_cast<uInt>(result.size());
+		REQUIRE(::deflate(&stream, Z_FINISH) == Z_STREAM_END);
+		result.resize(static_cast<qsizetype>(stream.total_out));
+		::deflateEnd(&stream);
+		break;
+	}
+#endif
+#ifdef FC_HAS_LZMA
+	case CStreamDecompressor::Format::Xz:
+	{
+		result.resize(static_cast<qsizetype>(::lzma_stream_buffer_bound(static_cast<size_t>(data.size()))));
+		size_t size = 0;
+		REQUIRE(::lzma_easy_buffer_encode(LZMA_PRESET_DEFAULT, LZMA_CHECK_CRC64, nullptr,
+			reinterpret_cast<const uint8_t*>(data.constData()), static_cast<size_t>(data.size()),
+			reinterpret_cast<uint8_t*>(result.data()), &size, static_cast<size_t>(result.size())) == LZMA_OK);
+		result.resize(static_cast<qsizetype>(size));
+		break;
+	}
+#endif
+#ifdef FC_HAS_ZSTD
+	case CStreamDecompressor::Format::Zstd:
+	{
+		result.resize(static_cast<qsizetype>(::ZSTD_compressBound(static_cast<size_t>(data.size()))));
+		const size_t size = ::ZSTD_compress(result.data(), static_cast<size_t>(result.size()), data.constData(), static_cast<size_t>(data.size()), 3);
+		REQUIRE(!::ZSTD_isError(size));
+		result.resize(static_cast<qsizetype>(size));
+		break;
+	}
+#endif
+	default:
+		break;
+	}
+
+	return result;
+}
+
 // A throwaway directory tree. Paths come back POSIX-separated, matching what the engine reports.
 class TempTree
 {
@@ -102,6 +189,14 @@ struct SearchQuery
 	bool contentsCaseSensitive = false;
 	bool contentsWholeWords = false;
 	bool contentsIsRegex = false;
+	std::shared_ptr<const CContentIndex> contentIndex;
+	FileSearchPredicates predicates;
+	ScanExclusions exclusions;
+	uint32_t matchLocationsPerFile = 1;
+	bool skipBinaryFiles = true;
+	bool searchCompressedFiles = false;
+	// Set: search within the last results of the same runner, and ignore roots
+	std::optional<CFileSearchEngine::ResultsScope> withinResults;
 };
 
 struct SearchResult
@@ -111,6 +206,12 @@ struct SearchResult
 	uint64_t itemsScanned = 0;
 	size_t finishedNotifications = 0; // Exactly one per accepted search
 	size_t linkReachedMatches = 0; // Of the matches above, how many the engine flagged as found through a directory link
+	size_t matchBatches = 0;
+	size_t largestMatchBatch = 0;
+	bool emptyMatchBatchReported = false;
+	bool matchesReportedAfterFinish = false;
+	std::vector<std::vector<CFileSearchEngine::MatchLocation>> locations; // Of each match above
+	CFileSearchEngine::ContentStatistics contentStatistics;
 
 	[[nodiscard]] bool matched(const QString& path) const
 	{
@@ -120,9 +221,20 @@ struct SearchResult
 	}
 
 	[[nodiscard]] size_t count() const { return matches.size(); }
+
+	[[nodiscard]] std::vector<CFileSearchEngine::MatchLocation> locationsOf(const QString& path) const
+	{
+		for (size_t i = 0; i < matches.size(); ++i)
+		{
+			if (withoutTrailingSlash(matches[i]) == withoutTrailingSlash(path))
+				return locations[i];
+		}
+
+		return {};
+	}
 };
 
-// Collects what the engine reports. The callbacks arrive off the calling thread - matchFound from the search
+// Collects what the engine reports. The callbacks arrive off the calling thread - matchesFound from the search
 // thread for a name search, and from the content pool's threads for a content search - so the state is guarded.
 class CollectingListener final : public CFileSearchEngine::FileSearchListener
 {
@@ -138,45 +250,68 @@ public:
 			_itemScannedHook();
 	}
 
-	void matchFound(const QString& path, bool reachedThroughLink) override
+	void matchesFound(std::vector<CFileSearchEngine::Match> matches) override
 	{
 		std::lock_guard lock{ _mutex };
-		_matches.push_back(path);
-		if (reachedThroughLink)
-			++_linkReachedMatches;
+		++_matchBatches;
+		_largestMatchBatch = std::max(_largestMatchBatch, matches.size());
+		_emptyMatchBatchReported |= matches.empty();
+		_matchesReportedAfterFinish |= _finishedNotifications > 0;
+
+		for (auto& match : matches)
+		{
+			_matches.push_back(std::move(match.path));
+			_locations.push_back(std::move(match.locations));
+			if (match.reachedThroughLink)
+				++_linkReachedMatches;
+		}
 	}
 
-	void searchFinished(CFileSearchEngine::SearchStatus status, uint64_t itemsScanned, uint64_t /*msElapsed*/) override
+	void searchFinished(CFileSearchEngine::SearchStatus status, uint64_t itemsScanned, uint64_t /*msElapsed*/, const CFileSearchEngine::ContentStatistics& contentStatistics) override
 	{
 		std::lock_guard lock{ _mutex };
 		_status = status;
 		_itemsScanned = itemsScanned;
+		_contentStatistics = contentStatistics;
 		++_finishedNotifications;
 	}
 
 	[[nodiscard]] SearchResult collect() const
 	{
 		std::lock_guard lock{ _mutex };
-		return SearchResult{ _matches, _status, _itemsScanned, _finishedNotifications, _linkReachedMatches };
+		return SearchResult{ _matches, _status, _itemsScanned, _finishedNotifications, _linkReachedMatches,
+			_matchBatches, _largestMatchBatch, _emptyMatchBatchReported, _matchesReportedAfterFinish, _locations, _contentStatistics };
 	}
 
 	void clear()
 	{
 		std::lock_guard lock{ _mutex };
 		_matches.clear();
+		_locations.clear();
 		_status = CFileSearchEngine::SearchFinished;
 		_itemsScanned = 0;
+		_contentStatistics = {};
 		_finishedNotifications = 0;
 		_linkReachedMatches = 0;
+		_matchBatches = 0;
+		_largestMatchBatch = 0;
+		_emptyMatchBatchReported = false;
+		_matchesReportedAfterFinish = false;
 	}
 
 private:
 	mutable std::mutex _mutex;
 	std::vector<QString> _matches;
+	std::vector<std::vector<CFileSearchEngine::MatchLocation>> _locations;
 	CFileSearchEngine::SearchStatus _status = CFileSearchEngine::SearchFinished;
 	uint64_t _itemsScanned = 0;
+	CFileSearchEngine::ContentStatistics _contentStatistics;
 	size_t _finishedNotifications = 0;
 	size_t _linkReachedMatches = 0;
+	size_t _matchBatches = 0;
+	size_t _largestMatchBatch = 0;
+	bool _emptyMatchBatchReported = false;
+	bool _matchesReportedAfterFinish = false;
 	std::function<void()> _itemScannedHook;
 };
 
@@ -189,12 +324,24 @@ public:
 
 	[[nodiscard]] bool start(const SearchQuery& query)
 	{
+		_engine.setContentIndex(query.contentIndex);
+		_engine.setSkipBinaryFiles(query.skipBinaryFiles);
+		_engine.setSearchCompressedFiles(query.searchCompressedFiles);
+		if (query.withinResults)
+		{
+			return _engine.searchWithinResults(*query.withinResults, query.nameFilters, query.nameCaseSensitive,
+				query.contents, query.contentsCaseSensitive, query.contentsWholeWords, query.contentsIsRegex, &_listener, query.predicates, query.matchLocationsPerFile);
+		}
+
 		return _engine.search(query.nameFilters, query.nameCaseSensitive, query.roots,
-			query.contents, query.contentsCaseSensitive, query.contentsWholeWords, query.contentsIsRegex, &_listener);
+			query.contents, query.contentsCaseSensitive, query.contentsWholeWords, query.contentsIsRegex, &_listener, query.predicates, query.exclusions, query.matchLocationsPerFile);
 	}
 
 	void stop() { _engine.stopSearching(); }
 
+	[[nodiscard]] bool hasKeptResults() const { return _engine.hasKeptResults(); }
+	void discardKeptResults() { _engine.discardKeptResults(); }
+
 	[[nodiscard]] bool searchInProgress() const { return _engine.searchInProgress(); }
 
 	// Joining is all the synchronization a test needs: the engine reports completion from the search thread as its
@@ -211,6 +358,9 @@ public:
 		return finish();
 	}
 
+	// What has been reported so far, while the search may still be running
+	[[nodiscard]] SearchResult recordedSoFar() const { return _listener.collect(); }
+
 	// One runner can serve several searches; what they report accumulates until this is called.
 	void clearRecorded() { _listener.clear(); }
 
@@ -0,0 +1,152 @@
+#include "searchenginetesthelpers.h"
+#include "filesearchengine/cstreamdecompressor.h"
+
+using Format = CStreamDecompressor::Format;
+
+namespace {
+
+struct Decompressed {
+	QByteArray contents;
+	size_t windows = 0;
+	bool windowsWhole = true; // Every window but the last one was windowSize long
+	bool offsetsContiguous = true;
+};
+
+// Feeds the data to the decompressor inputChunk bytes at a time, and collects what comes out.
+[[nodiscard]] Decompressed decompress(Format format, const QByteArray& data, size_t inputChunk, bool stopAfterFirstWindow = false)
+{
+	size_t inputOffset = 0;
+	const auto input = [&]() -> std::optional<std::span<const std::byte>> {
+		const size_t length = std::min(inputChunk, static_cast<size_t>(data.size()) - inputOffset);
+		const std::span chunk{ reinterpret_cast<const std::byte*>(data.constData()) + inputOffset, length };
+		inputOffset += length;
+		return chunk;
+	};
+
+	Decompressed result;
+	size_t lastWindowLength = CStreamDecompressor::windowSize;
+	const std::atomic_bool notCancelled{ false };
+	const uint64_t total = CStreamDecompressor::decompress(format, input, [&](const std::byte* window, size_t length, uint64_t offset) {
+		result.windowsWhole = result.windowsWhole && lastWindowLength == CStreamDecompressor::windowSize;
+		result.offsetsContiguous = result.offsetsContiguous && offset == static_cast<uint64_t>(result.contents.size());
+		lastWindowLength = length;
+		result.contents.append(reinterpret_cast<const char*>(window), static_cast<qsizetype>(length));
+		++result.windows;
+		return stopAfterFirstWindow;
+	}, notCancelled);
+
+	CHECK(total == static_cast<uint64_t>(result.contents.size()));
+	return result;
+}
+
+[[nodiscard]] QByteArray sampleText()
+{
+	QByteArray text;
+	for (int i = 0; i < 100'000; ++i)
+		text += "line " + QByteArray::number(i * 7919 % 100'003) + '\n';
+	return text;
+}
+
+constexpr std::pair<Format, const char*> formats[] {
+	{ Format::Gzip, "gzip" },
+	{ Format::Xz, "xz" },
+	{ Format::Zstd, "zstd" }
+};
+
+} // namespace
+
+TEST_CASE("Stream decompressor - a format is told by its magic number", "[search][contents][compressed]")
+{
+	const QByteArray text = sampleText().first(1000);
+	for (const auto& [format, name] : formats)
+	{
+		if (!CStreamDecompressor::isAvailable(format))
+		{
+			WARN(name << " is not available in this build");
+			continue;
+		}
+
+		const QByteArray data = compressed(text, format);
+		CHECK(CStreamDecompressor::formatOf(reinterpret_cast<const std::byte*>(data.constData()), static_cast<size_t>(data.size())) == format);
+	}
+
+	CHECK(CStreamDecompressor::formatOf(reinterpret_cast<const std::byte*>(text.constData()), static_cast<size_t>(text.size())) == Format::None);
+	// Too short to hold a magic number
+	const std::byte gzipStart[] { std::byte{ 0x1F } };
+	CHECK(CStreamDecompressor::formatOf(gzipStart, sizeof(gzipStart)) == Format::None);
+}
+
+TEST_CASE("Stream decompressor - the contents come out whole, in full windows, however the input is chunked", "[search][contents][compressed]")
+{
+	const QByteArray text = sampleText();
+	REQUIRE(text.size() > 2 * static_cast<qsizetype>(CStreamDecompressor::windowSize));
+
+	for (const auto& [format, name] : formats)
+	{
+		if (!CStreamDecompressor::isAvailable(format))
+		{
+			WARN(name << " is not available in this build");
+			continue;
+		}
+
+		const QByteArray data = compressed(text, format);
+		for (const size_t inputChunk : { size_t{ 1000 }, CStreamDecompressor::inputChunkSize, static_cast<size_t>(data.size()) })
+		{
+			const Decompressed result = decompress(format, data, inputChunk);
+			CHECK(result.contents == text);
+			CHECK(result.windows == (static_cast<size_t>(text.size()) + CStreamDecompressor::windowSize - 1) / CStreamDecompressor::windowSize);
+			CHECK(result.windowsWhole);
+			CHECK(result.offsetsContiguous);
+		}
+	}
+}
+
+TEST_CASE("Stream decompressor - concatenated streams are read one after another", "[search][contents][compressed]")
+{
+	for (const auto& [format, name] : formats)
+	{
+		if (!CStreamDecompressor::isAvailable(format))
+		{
+			WARN(name << " is not available in this build");
+			continue;
+		}
+
+		const QByteArray data = compressed("first part\n", format) + compressed("second part\n", format);
+		CHECK(decompress(format, data, CStreamDecompressor::inputChunkSize).contents == "first part\nsecond part\n");
+	}
+}
+
+TEST_CASE("Stream decompressor - whatever a truncated stream holds is still handed over", "[search][contents][compressed]")
+{
+	const QByteArray text = sampleText();
+	for (const auto& [format, name] : formats)
+	{
+		if (!CStreamDecompressor::isAvailable(format))
+		{
+			WARN(name << " is not available in this build");
+			continue;
+		}
+
+		const QByteArray data = compressed(text, format);
+		const Decompressed result = decompress(format, data.first(data.size() / 2), CStreamDecompressor::inputChunkSize);
+		CHECK(!result.contents.isEmpty());
+		CHECK(text.startsWith(result.contents));
+	}
+}
+
+TEST_CASE("Stream decompressor - the scanner can stop it early", "[search][contents][compressed]")
+{
+	const QByteArray text = sampleText();
+	for (const auto& [format, name] : formats)
+	{
+		if (!CStreamDecompressor::isAvailable(format))
+		{
+			WARN(name << " is not available in this build");
+			continue;
+		}
+
+		const Decompressed result = decompress(format, compressed(text, format), CStreamDecompressor::inputChunkSize, true);
+		CHECK(result.windows == 1);
+		CHECK(result.contents == text.first(static_cast<qsizetype>(CStreamDecompressor::windowSize)));
+	}
+}
@@ -0,0 +1,98 @@
+#include "searchenginetesthelpers.h"
+#include "filesearchengine/cfilecontentreader.h"
+#include "filesearchengine/curingbatchreader.h"
+
+#include <chrono>
+
+TEST_CASE("io_uring batch reader - small files are handed over whole, the rest are left to the caller", "[search][contents][uring]")
+{
+	auto reader = CUringBatchReader::create();
+	if (!reader)
+	{
+		WARN("io_uring is not available here");
+		return;
+	}
+
+	TempTree tree;
+	std::vector<QString> paths;
+	std::vector<QByteArray> contents;
+	// More than a batch, so that the last one is partial
+	for (int i = 0; i < static_cast<int>(CUringBatchReader::batchSize) * 2 + 5; ++i)
+	{
+		contents.push_back(QByteArray(i * 37, static_cast<char>('a' + i % 26)));
+		paths.push_back(tree.makeFile(QSL("f%1.txt").arg(i), contents.back()));
+	}
+
+	const size_t tooLarge = paths.size();
+	paths.push_back(tree.makeFile(QSL("large.bin"), QByteArray(static_cast<qsizetype>(CUringBatchReader::bufferSize), 'x')));
+	const size_t missing = paths.size();
+	paths.push_back(tree.path() + QSL("/missing.txt"));
+
+	std::vector<size_t> handedOver(paths.size(), 0);
+	const std::vector<size_t> unread = reader->read(paths, [&](size_t index, const std::byte* data, size_t length) {
+		REQUIRE(index < contents.size());
+		CHECK(QByteArray(reinterpret_cast<const char*>(data), static_cast<qsizetype>(length)) == contents[index]);
+		++handedOver[index];
+	});
+
+	CHECK(unread == std::vector<size_t>{ tooLarge, missing });
+	for (size_t i = 0; i < contents.size(); ++i)
+		CHECK(handedOver[i] == 1);
+	CHECK(handedOver[tooLarge] == 0);
+	CHECK(handedOver[missing] == 0);
+}
+
+TEST_CASE("Search - content matches are the same whether small files are read in batches or not", "[search][contents][uring]")
+{
+	TempTree tree;
+	const QString small = tree.makeFileWithNeedleAt(QSL("small.txt"), "needle", 100, 200);
+	const auto bufferSize = static_cast<qsizetype>(CUringBatchReader::bufferSize);
+	const QString large = tree.makeFileWithNeedleAt(QSL("large.txt"), "needle", bufferSize, bufferSize + 100);
+	tree.makeFileWithNeedleAt(QSL("none.txt"), "other", 100, 200);
+
+	const SearchResult result = runSearch({ .roots = { tree.path() }, .contents = QSL("needle"), .contentsCaseSensitive = true });
+	CHECK(result.count() == 2);
+	CHECK(result.matched(small));
+	CHECK(result.matched(large));
+}
+
+// Hidden; run with: filesearchengine_test "[benchmark]"
+TEST_CASE("io_uring batch reader - files per second against reading one file at a time", "[.][benchmark][uring]")
+{
+	auto reader = CUringBatchReader::create();
+	if (!reader)
+	{
+		WARN("io_uring is not available here");
+		return;
+	}
+
+	static constexpr int fileCount = 20'000;
+	TempTree tree;
+	std::vector<QString> paths;
+	paths.reserve(fileCount);
+	for (int i = 0; i < fileCount; ++i)
+		paths.push_back(tree.makeFile(QSL("d%1/f%2.txt").arg(i / 1000).arg(i), QByteArray(1 + i % 4096, 'x')));
+
+	using Clock = std::chrono::steady_clock;
+	const auto filesPerSecond = [](Clock::duration elapsed) {
+		return static_cast<double>(fileCount) / std::chrono::duration<double>(elapsed).count();
+	};
+
+	size_t bytes = 0;
+	auto start = Clock::now();
+	for (const QString& path : paths)
+	{
+		CFileContentReader fileReader;
+		if (fileReader.open(path))
+			fileReader.scan([&](const std::byte*, size_t length, uint64_t) { bytes += length; return false; });
+	}
+	const double oneByOne = filesPerSecond(Clock::now() - start);
+
+	size_t batchedBytes = 0;
+	start = Clock::now();
+	CHECK(reader->read(paths, [&](size_t, const std::byte*, size_t length) { batchedBytes += length; }).empty());
+	const double batched = filesPerSecond(Clock::now() - start);
+
+	CHECK(batchedBytes == bytes);
+	WARN("One file at a time: " << oneByOne << " files/s; io_uring batches: " << batched << " files/s");
+}
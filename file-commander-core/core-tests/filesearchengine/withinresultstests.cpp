@@ -0,0 +1,89 @@
+#include "searchenginetesthelpers.h"
+
+using Scope = CFileSearchEngine::ResultsScope;
+
+TEST_CASE("Search within results - there is nothing to search within before a search has completed", "[search][within]")
+{
+	SearchRunner runner;
+	CHECK_FALSE(runner.hasKeptResults());
+	CHECK_FALSE(runner.start({ .withinResults = Scope::Matches }));
+
+	TempTree tree;
+	tree.makeFile(QSL("a.txt"));
+	runner.setItemScannedHook([&runner] { runner.stop(); });
+	REQUIRE(runner.run({ .roots = { tree.path() } }).status == CFileSearchEngine::SearchCancelled);
+	CHECK_FALSE(runner.hasKeptResults());
+}
+
+TEST_CASE("Search within results - a narrower query only looks at the last matches", "[search][within]")
+{
+	TempTree tree;
+	const QString withNeedle = tree.makeFile(QSL("a.txt"), "a needle");
+	const QString withoutNeedle = tree.makeFile(QSL("b.txt"), "no match here");
+	const QString otherName = tree.makeFile(QSL("sub/c.log"), "another needle");
+
+	SearchRunner runner;
+	const SearchResult byName = runner.run({ .roots = { tree.path() }, .nameFilters = { QSL("*.txt") } });
+	REQUIRE(byName.count() == 2);
+	REQUIRE(runner.hasKeptResults());
+
+	// Created after the search: only a walk of the disk would find it
+	const QString createdLater = tree.makeFile(QSL("d.txt"), "a needle too");
+
+	runner.clearRecorded();
+	const SearchResult byContents = runner.run({ .nameFilters = { QSL("*") }, .contents = QSL("needle"), .withinResults = Scope::Matches });
+	CHECK(byContents.status == CFileSearchEngine::SearchFinished);
+	CHECK(byContents.matched(withNeedle));
+	CHECK_FALSE(byContents.matched(withoutNeedle));
+	CHECK_FALSE(byContents.matched(otherName));
+	CHECK_FALSE(byContents.matched(createdLater));
+	CHECK(byContents.itemsScanned == 2);
+	CHECK(byContents.locationsOf(withNeedle).size() == 1);
+}
+
+TEST_CASE("Search within results - a broader query looks at everything the original search traversed", "[search][within]")
+{
+	TempTree tree;
+	const QString text = tree.makeFile(QSL("a.txt"), "a needle");
+	const QString log = tree.makeFile(QSL("sub/c.log"), "another needle");
+
+	SearchRunner runner;
+	const SearchResult original = runner.run({ .roots = { tree.path() }, .nameFilters = { QSL("*.txt") } });
+	REQUIRE(original.count() == 1);
+
+	// Narrowed to nothing, and then broadened again: the traversal outlives the matches
+	runner.clearRecorded();
+	REQUIRE(runner.run({ .nameFilters = { QSL("*.none") }, .withinResults = Scope::Matches }).count() == 0);
+	REQUIRE(runner.hasKeptResults());
+
+	runner.clearRecorded();
+	const SearchResult broadened = runner.run({ .nameFilters = { QSL("*.log") }, .withinResults = Scope::Traversed });
+	CHECK(broadened.matched(log));
+	CHECK_FALSE(broadened.matched(text));
+	CHECK(broadened.itemsScanned == original.itemsScanned);
+
+	runner.clearRecorded();
+	const SearchResult byContents = runner.run({ .contents = QSL("needle"), .withinResults = Scope::Traversed });
+	CHECK(byContents.matched(text));
+	CHECK(byContents.matched(log));
+}
+
+TEST_CASE("Search within results - a new search of the disk replaces what was kept", "[search][within]")
+{
+	TempTree first, second;
+	first.makeFile(QSL("a.txt"));
+	const QString inSecond = second.makeFile(QSL("b.txt"));
+
+	SearchRunner runner;
+	REQUIRE(runner.run({ .roots = { first.path() } }).count() > 0);
+	runner.clearRecorded();
+	REQUIRE(runner.run({ .roots = { second.path() } }).matched(inSecond));
+
+	runner.clearRecorded();
+	const SearchResult within = runner.run({ .nameFilters = { QSL("*.txt") }, .withinResults = Scope::Traversed });
+	CHECK(within.count() == 1);
+	CHECK(within.matched(inSecond));
+
+	runner.discardKeptResults();
+	CHECK_FALSE(runner.hasKeptResults());
+}
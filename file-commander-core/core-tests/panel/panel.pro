@@ -33,6 +33,7 @@ SOURCES += \
 	contentsaccesstests.cpp \
 	lifetimetests.cpp \
 	../../src/cpanel.cpp \
+	../../src/settings.cpp \
 	../../src/cfilesystemobject.cpp \
 	../../src/filesystemhelperfunctions.cpp \
 	../../src/directoryscanner.cpp \
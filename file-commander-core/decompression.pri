@@ -0,0 +1,22 @@
+# The decompression libraries content search can look inside compressed files with (see cstreamdecompressor.h).
+# Each one is optional: a format whose library pkg-config can't find is searched by its compressed bytes, as any other file.
+# Included by everything that compiles or links the search engine.
+
+!win* {
+	CONFIG += link_pkgconfig
+
+	packagesExist(zlib) {
+		DEFINES += FC_HAS_ZLIB
+		PKGCONFIG += zlib
+	}
+
+	packagesExist(liblzma) {
+		DEFINES += FC_HAS_LZMA
+		PKGCONFIG += liblzma
+	}
+
+	packagesExist(libzstd) {
+		DEFINES += FC_HAS_ZSTD
+		PKGCONFIG += libzstd
+	}
+}
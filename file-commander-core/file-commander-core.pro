@@ -28,6 +28,14 @@ HEADERS += \
 	src/filesystemhelperfunctions.h \
 	src/iconprovider/ciconproviderimpl.h \
 	src/filesearchengine/cfilesearchengine.h \
+	src/filesearchengine/ccontentencoding.h \
+	src/filesearchengine/ccontentindex.h \
+	src/filesearchengine/ccontentreadscheduler.h \
+	src/filesearchengine/cstreamdecompressor.h \
+	src/filesearchengine/cfilecontentreader.h \
+	src/filesearchengine/curingbatchreader.h \
+	src/filesearchengine/cnamefiltermatcher.h \
+	src/filesearchengine/filesearchpredicates.h \
 	src/directoryscanner.h \
 	src/diskenumerator/volumeinfo.hpp \
 	src/diskenumerator/cvolumeenumerator.h \
@@ -41,6 +49,7 @@ SOURCES += \
 	src/cfilesystemobject.cpp \
 	src/ccontroller.cpp \
 	src/cpanel.cpp \
+	src/settings.cpp \
 	src/filesystemhelperfunctions.cpp \
 	src/filesystemhelpers/filestatistics.cpp \
 	src/filesystemwatcher/cfilesystemwatchertimerbased.cpp \
@@ -49,6 +58,14 @@ SOURCES += \
 	src/shell/cshell.cpp \
 	src/favoritelocationslist/cfavoritelocations.cpp \
 	src/filesearchengine/cfilesearchengine.cpp \
+	src/filesearchengine/ccontentencoding.cpp \
+	src/filesearchengine/ccontentindex.cpp \
+	src/filesearchengine/ccontentreadscheduler.cpp \
+	src/filesearchengine/cstreamdecompressor.cpp \
+	src/filesearchengine/cfilecontentreader.cpp \
+	src/filesearchengine/curingbatchreader.cpp \
+	src/filesearchengine/cnamefiltermatcher.cpp \
+	src/filesearchengine/filesearchpredicates.cpp \
 	src/directoryscanner.cpp \
 	src/diskenumerator/cvolumeenumerator.cpp \
 	src/filecomparator/cfilecomparator.cpp \
@@ -2,6 +2,8 @@
 
 #include "qtcore_helpers/qstring_helpers.hpp"
 
+struct ScanExclusions; // directoryscanner.h
+
 /////////////////////////////////////////////////
 // Internal values persisted between sessions
 /////////////////////////////////////////////////
@@ -58,10 +60,22 @@
 
 // Operations
 #define KEY_OPERATIONS_ASK_FOR_COPY_MOVE_CONFIRMATION QSL("Operations/CopyMove/AskForConfirmation")
+// The copy/move prompt's last verification and resumption choices, which also apply when the prompt is not shown
+#define KEY_OPERATIONS_VERIFY_COPIES QSL("Operations/CopyMove/VerifyCopies")
+#define KEY_OPERATIONS_WRITE_VERIFICATION_MANIFEST QSL("Operations/CopyMove/WriteVerificationManifest")
+#define KEY_OPERATIONS_RESUME_LARGE_FILES QSL("Operations/Copy/ResumeLargeFiles")
 
 // Editing
 #define KEY_EDITOR_PATH QSL("Edit/EditorProgramPath")
 
 // Other
 #define KEY_OTHER_SHELL_COMMAND_NAME QSL("Other/Shell/ShellCommandName")
+// Subtrees that searches, the flat view and folder comparison leave out: .gitignore-style patterns, and whether to honour ignore files
+#define KEY_OTHER_SCAN_EXCLUSION_PATTERNS QSL("Other/Scan/ExclusionPatterns")
+#define KEY_OTHER_SCAN_USE_IGNORE_FILES QSL("Other/Scan/UseIgnoreFiles")
+// The two above, read together; defaults to no exclusions
+[[nodiscard]] ScanExclusions scanExclusionsFromSettings();
+// The opt-in content index that narrows content searches, and the folders it covers; built from the file search window
+#define KEY_OTHER_CONTENT_INDEX_ENABLED QSL("Other/ContentIndex/Enabled")
+#define KEY_OTHER_CONTENT_INDEX_ROOTS QSL("Other/ContentIndex/Roots")
 #define KEY_OTHER_CHECK_FOR_UPDATES_AUTOMATICALLY QSL("Other/UpdateChecking/CheckAutomatically")
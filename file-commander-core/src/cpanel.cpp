@@ -336,10 +336,12 @@ void CPanel::enqueueFileListUpdate(FileListUpdateRequest request, FileListRefres
 
 		if (request.displayMode == AllObjectsMode)
 		{
+			const ScanExclusions exclusions = scanExclusionsFromSettings();
+
 			scanDirectory(CFileSystemObject(request.path), [&items, showHiddenFiles](const CFileSystemObject& item, bool /*reachedThroughLink*/) {
 				if (item.isFile() && item.exists() && (showHiddenFiles || !item.isHidden()))
 					items[item.hash()] = item;
-			}, _abortBackgroundTasks);
+			}, _abortBackgroundTasks, true, exclusions);
 		}
 		else
 		{
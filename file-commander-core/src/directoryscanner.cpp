@@ -5,22 +5,363 @@
 
 DISABLE_COMPILER_WARNINGS
 #include <QDir>
+#include <QFile>
+#include <QRegularExpression>
+#include <QStringTokenizer>
 RESTORE_COMPILER_WARNINGS
 
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+namespace
+{
+// One line of a .gitignore-style pattern list, compiled. Most lines are a plain name, a name prefix or suffix such as
+// "*.o", or a plain path; those keep their literal for a hash lookup, and only the rest are matched by a regex.
+struct IgnoreRule
+{
+	enum class Shape { Name, NamePrefix, NameSuffix, Path, Glob };
+
+	Shape shape = Shape::Glob;
+	QString literal;
+	QRegularExpression regex; // Glob only
+	bool negated = false;
+	bool directoryOnly = false;
+	// Matched against the path from the rules' base directory rather than against the bare name
+	bool matchesPath = false;
+};
+
+// Lets a literal be looked up by a view into the name or path, with nothing to allocate per lookup
+struct LiteralHash
+{
+	using is_transparent = void;
+	[[nodiscard]] size_t operator()(QStringView literal) const noexcept { return qHash(literal); }
+};
+
+// The index of the last rule with each literal, which is the one that decides among them
+using RuleIndexByLiteral = std::unordered_map<QString, size_t, LiteralHash, std::equal_to<>>;
+
+struct LiteralRules
+{
+	RuleIndexByLiteral anyEntry;
+	RuleIndexByLiteral directoriesOnly;
+};
+
+// The rules one directory contributes, in file order: a later rule overrides an earlier one. Every literal shape is
+// merged into hash lookups - prefixes and suffixes one per literal length - that answer with the last matching rule.
+struct IgnoreFrame
+{
+	QString basePrefix; // The root-relative path of the directory the rules came from, '/'-terminated; empty for the root
+	std::vector<IgnoreRule> rules;
+
+	LiteralRules names;
+	LiteralRules paths;
+	// By literal length, ascending
+	std::vector<std::pair<qsizetype, LiteralRules>> prefixes;
+	std::vector<std::pair<qsizetype, LiteralRules>> suffixes;
+	std::vector<size_t> globs; // Ascending
+
+	void add(IgnoreRule rule);
+};
+
+struct ScanContext
+{
+	const std::function<void(const CFileSystemObject&, bool)>& observer;
+	const std::atomic<bool>& abort;
+	const bool followDirLinks;
+	const bool useIgnoreFiles;
+
+	IgnoreFrame exclusionPatterns;
+	// The ignore files of the directories on the current branch, outermost first
+	std::vector<IgnoreFrame> ignoreFiles;
+	std::vector<QString> dirsBeingScanned;
+};
+
+// The index of the ']' closing the class opened at 'start', or -1. A ']' right after the opening (or after its
+// negation) is a member of the class rather than its end.
+[[nodiscard]] qsizetype bracketClassEnd(QStringView glob, qsizetype start)
+{
+	qsizetype i = start + 1;
+	if (i < glob.size() && (glob[i] == '!' || glob[i] == '^'))
+		++i;
+	if (i < glob.size() && glob[i] == ']')
+		++i;
+
+	for (; i < glob.size(); ++i)
+	{
+		if (glob[i] == ']')
+			return i;
+	}
+
+	return -1;
+}
+
+// '*' and '?' stay within one path component, "**" as a whole component spans any number of them, [...] is a class.
+[[nodiscard]] QString ignoreGlobToRegex(QStringView glob)
+{
+	QString pattern = QStringLiteral("\\A");
+	for (qsizetype i = 0; i < glob.size(); ++i)
+	{
+		const QChar c = glob[i];
+		if (c == '\\' && i + 1 < glob.size())
+			pattern += QRegularExpression::escape(glob.sliced(++i, 1));
+		else if (c == '*')
+		{
+			const bool isWholeComponent = (i == 0 || glob[i - 1] == '/') && i + 1 < glob.size() && glob[i + 1] == '*' && (i + 2 == glob.size() || glob[i + 2] == '/');
+			if (isWholeComponent && i + 2 == glob.size())
+			{
+				// "foo/**": everything inside
+				pattern += QLatin1StringView{ ".*" };
+				i += 1;
+			}
+			else if (isWholeComponent)
+			{
+				// "**/foo": any number of leading directories, including none
+				pattern += QLatin1StringView{ "(?:.*/)?" };
+				i += 2;
+			}
+			else
+			{
+				pattern += QLatin1StringView{ "[^/]*" };
+				while (i + 1 < glob.size() && glob[i + 1] == '*')
+					++i;
+			}
+		}
+		else if (c == '?')
+			pattern += QLatin1StringView{ "[^/]" };
+		else if (c == '[' && bracketClassEnd(glob, i) >= 0)
+		{
+			const qsizetype classEnd = bracketClassEnd(glob, i);
+			pattern += '[';
+			qsizetype j = i + 1;
+			if (glob[j] == '!' || glob[j] == '^')
+			{
+				pattern += '^';
+				++j;
+			}
+
+			for (; j < classEnd; ++j)
+			{
+				// Everything the regex engine would read as syntax inside a class
+				if (glob[j] == '\\' || glob[j] == '[' || glob[j] == ']' || glob[j] == '^')
+					pattern += '\\';
+				pattern += glob[j];
+			}
+
+			pattern += ']';
+			i = classEnd;
+		}
+		else
+			pattern += QRegularExpression::escape(glob.sliced(i, 1));
+	}
+
+	return pattern += QLatin1StringView{ "\\z" };
+}
+
+[[nodiscard]] std::optional<IgnoreRule> compileIgnoreRule(QStringView line)
+{
+	if (line.endsWith('\r'))
+		line.chop(1);
+
+	// Trailing spaces are not part of the pattern unless escaped
+	while (line.endsWith(' ') && !line.endsWith(QStringView{ u"\\ " }))
+		line.chop(1);
+
+	if (line.isEmpty() || line.startsWith('#'))
+		return std::nullopt;
+
+	IgnoreRule rule;
+	if (line.startsWith('!'))
+	{
+		rule.negated = true;
+		line = line.sliced(1);
+	}
+
+	if (line.endsWith('/'))
+	{
+		rule.directoryOnly = true;
+		line.chop(1);
+	}
+
+	// A slash at the start or in the middle anchors the pattern to the base directory; without one, it matches a name at any depth
+	rule.matchesPath = line.contains('/');
+	if (line.startsWith('/'))
+		line = line.sliced(1);
+
+	if (line.isEmpty())
+		return std::nullopt;
+
+	const auto isLiteral = [](QStringView text) {
+		return std::ranges::none_of(text, [](QChar c) { return c == '*' || c == '?' || c == '[' || c == '\\'; });
+	};
+
+	if (isLiteral(line))
+	{
+		rule.shape = rule.matchesPath ? IgnoreRule::Shape::Path : IgnoreRule::Shape::Name;
+		rule.literal = line.toString();
+		return rule;
+	}
+
+	if (!rule.matchesPath && line.size() > 1 && line.startsWith('*') && isLiteral(line.sliced(1)))
+	{
+		rule.shape = IgnoreRule::Shape::NameSuffix;
+		rule.literal = line.sliced(1).toString();
+		return rule;
+	}
+
+	if (!rule.matchesPath && line.size() > 1 && line.endsWith('*') && isLiteral(line.chopped(1)))
+	{
+		rule.shape = IgnoreRule::Shape::NamePrefix;
+		rule.literal = line.chopped(1).toString();
+		return rule;
+	}
+
+	rule.regex.setPattern(ignoreGlobToRegex(line));
+	if (!rule.regex.isValid())
+		return std::nullopt;
+
+	return rule;
+}
+
+void IgnoreFrame::add(IgnoreRule rule)
+{
+	const size_t index = rules.size();
+	const auto addLiteral = [&](LiteralRules& literals) {
+		(rule.directoryOnly ? literals.directoriesOnly : literals.anyEntry).insert_or_assign(rule.literal, index);
+	};
+	const auto addLiteralOfLength = [&](std::vector<std::pair<qsizetype, LiteralRules>>& group) {
+		auto position = std::ranges::lower_bound(group, rule.literal.size(), {}, &std::pair<qsizetype, LiteralRules>::first);
+		if (position == group.end() || position->first != rule.literal.size())
+			position = group.insert(position, { rule.literal.size(), LiteralRules{} });
+		addLiteral(position->second);
+	};
+
+	switch (rule.shape)
+	{
+	case IgnoreRule::Shape::Name:
+		addLiteral(names);
+		break;
+	case IgnoreRule::Shape::NamePrefix:
+		addLiteralOfLength(prefixes);
+		break;
+	case IgnoreRule::Shape::NameSuffix:
+		addLiteralOfLength(suffixes);
+		break;
+	case IgnoreRule::Shape::Path:
+		addLiteral(paths);
+		break;
+	case IgnoreRule::Shape::Glob:
+		globs.push_back(index);
+		break;
+	}
+
+	rules.push_back(std::move(rule));
+}
+
+void appendIgnoreRules(IgnoreFrame& frame, const QString& text)
+{
+	for (const QStringView line : QStringTokenizer{ text, u'\n' })
+	{
+		if (auto rule = compileIgnoreRule(line))
+			frame.add(std::move(*rule));
+	}
+}
+
+// The rules of the ignore files among a directory's entries: .gitignore first, so that .ignore overrides it.
+void readIgnoreFiles(const QFileInfoList& entries, IgnoreFrame& frame)
+{
+	for (const QLatin1StringView ignoreFileName : { QLatin1StringView{ ".gitignore" }, QLatin1StringView{ ".ignore" } })
+	{
+		const auto ignoreFile = std::ranges::find_if(entries, [&](const QFileInfo& entry) { return entry.fileName() == ignoreFileName && entry.isFile(); });
+		if (ignoreFile == entries.end())
+			continue;
+
+		QFile file{ ignoreFile->absoluteFilePath() };
+		if (file.open(QFile::ReadOnly))
+			appendIgnoreRules(frame, QString::fromUtf8(file.readAll()));
+	}
+}
+
+// true or false if the frame's last matching rule excludes or re-includes the entry, nullopt if none of its rules match.
+[[nodiscard]] std::optional<bool> frameVerdict(const IgnoreFrame& frame, QStringView relativePath, QStringView name, bool isDir)
+{
+	std::optional<size_t> lastMatch;
+	const auto lookUp = [&](const LiteralRules& literals, QStringView key) {
+		for (const RuleIndexByLiteral* rules : { &literals.anyEntry, isDir ? &literals.directoriesOnly : nullptr })
+		{
+			if (!rules || rules->empty())
+				continue;
+
+			if (const auto rule = rules->find(key); rule != rules->end() && (!lastMatch || rule->second > *lastMatch))
+				lastMatch = rule->second;
+		}
+	};
+
+	const QStringView pathFromBase = relativePath.sliced(frame.basePrefix.size());
+	lookUp(frame.names, name);
+	lookUp(frame.paths, pathFromBase);
+	for (const auto& [length, literals] : frame.prefixes)
+	{
+		if (length > name.size())
+			break;
+		lookUp(literals, name.first(length));
+	}
+	for (const auto& [length, literals] : frame.suffixes)
+	{
+		if (length > name.size())
+			break;
+		lookUp(literals, name.last(length));
+	}
+
+	// Only a glob later than the last literal match can still change the verdict
+	for (auto index = frame.globs.rbegin(); index != frame.globs.rend() && (!lastMatch || *index > *lastMatch); ++index)
+	{
+		const IgnoreRule& rule = frame.rules[*index];
+		if (rule.directoryOnly && !isDir)
+			continue;
+
+		if (rule.regex.matchView(rule.matchesPath ? pathFromBase : name).hasMatch())
+		{
+			lastMatch = *index;
+			break;
+		}
+	}
+
+	if (!lastMatch)
+		return std::nullopt;
+	return !frame.rules[*lastMatch].negated;
+}
+
+[[nodiscard]] bool isExcluded(const ScanContext& context, QStringView relativePath, QStringView name, bool isDir)
+{
+	if (frameVerdict(context.exclusionPatterns, relativePath, name, isDir).value_or(false))
+		return true;
+
+	// The closest ignore file with an opinion decides
+	for (auto frame = context.ignoreFiles.rbegin(); frame != context.ignoreFiles.rend(); ++frame)
+	{
+		if (const auto verdict = frameVerdict(*frame, relativePath, name, isDir))
+			return *verdict;
+	}
+
+	return false;
+}
+} // namespace
+
+// relativeDir: the root-relative path of root's children, '/'-terminated; empty for the scan root's.
 static void scanDirectoryRecursive(const CFileSystemObject& root,
-	const std::function<void(const CFileSystemObject&, bool)>& observer,
-	const std::atomic<bool>& abort,
-	const bool followDirLinks,
+	ScanContext& context,
 	const bool reachedThroughLink,
-	std::vector<QString>& dirsBeingScanned)
+	const QString& relativeDir)
 {
-	if (abort)
+	if (context.abort)
 		return;
 
-	if (observer)
-		observer(root, reachedThroughLink);
+	if (context.observer)
+		context.observer(root, reachedThroughLink);
 
 	if (!root.isDir())
 		return;
@@ -28,7 +369,7 @@ static void scanDirectoryRecursive(const CFileSystemObject& root,
 	const bool traversingLink = root.isLink();
 	if (traversingLink)
 	{
-		if (!followDirLinks)
+		if (!context.followDirLinks)
 			return;
 
 		// Cycle guard: a link is only traversed if its target is not a directory already being scanned higher up this branch;
@@ -39,32 +380,62 @@ static void scanDirectoryRecursive(const CFileSystemObject& root,
 		if (!targetId) // Broken link, or a filesystem exposing no identity: refuse to follow rather than risk looping
 			return;
 
-		for (const QString& dirPath : dirsBeingScanned)
+		for (const QString& dirPath : context.dirsBeingScanned)
 		{
 			if (resolvedObjectId(dirPath) == targetId)
 				return;
 		}
 	}
 
-	dirsBeingScanned.push_back(root.fullAbsolutePath());
+	context.dirsBeingScanned.push_back(root.fullAbsolutePath());
 
 	const auto list = QDir{root.fullAbsolutePath()}.entryInfoList(QDir::Files | QDir::Dirs | QDir::Hidden | QDir::NoDotAndDotDot | QDir::System);
+
+	// Read once per directory, and only in effect while its own subtree is being scanned
+	bool ignoreFrameAdded = false;
+	if (context.useIgnoreFiles)
+	{
+		IgnoreFrame frame{ .basePrefix = relativeDir };
+		readIgnoreFiles(list, frame);
+		if (!frame.rules.empty())
+		{
+			context.ignoreFiles.push_back(std::move(frame));
+			ignoreFrameAdded = true;
+		}
+	}
+
+	const bool checkExclusions = !context.exclusionPatterns.rules.empty() || !context.ignoreFiles.empty();
 	for (const auto& entry : list)
 	{
-		if (abort)
+		if (context.abort)
 			break;
 
-		scanDirectoryRecursive(CFileSystemObject(entry), observer, abort, followDirLinks, reachedThroughLink || traversingLink, dirsBeingScanned);
+		const QString name = entry.fileName();
+		const QString relativePath = relativeDir + name;
+		if (checkExclusions && isExcluded(context, relativePath, name, entry.isDir()))
+			continue;
+
+		scanDirectoryRecursive(CFileSystemObject(entry), context, reachedThroughLink || traversingLink, entry.isDir() ? relativePath + '/' : QString{});
 	}
 
-	dirsBeingScanned.pop_back();
+	if (ignoreFrameAdded)
+		context.ignoreFiles.pop_back();
+
+	context.dirsBeingScanned.pop_back();
 }
 
 void scanDirectory(const CFileSystemObject& root,
 	const std::function<void(const CFileSystemObject&, bool)>& observer,
 	const std::atomic<bool>& abort,
-	const bool followDirLinks)
+	const bool followDirLinks,
+	const ScanExclusions& exclusions)
 {
-	std::vector<QString> dirsBeingScanned;
-	scanDirectoryRecursive(root, observer, abort, followDirLinks, false, dirsBeingScanned);
+	ScanContext context{ observer, abort, followDirLinks, exclusions.useIgnoreFiles, {}, {}, {} };
+	for (const QString& pattern : exclusions.patterns)
+	{
+		if (auto rule = compileIgnoreRule(pattern))
+			context.exclusionPatterns.add(std::move(*rule));
+	}
+
+	scanDirectoryRecursive(root, context, false, QString{});
 }
@@ -1,10 +1,29 @@
 #pragma once
 
+#include "compiler/compiler_warnings_control.h"
+
+DISABLE_COMPILER_WARNINGS
+#include <QStringList>
+RESTORE_COMPILER_WARNINGS
+
 #include <atomic>
 #include <functional>
 
 class CFileSystemObject;
 
+// What a scan leaves out. An excluded entry is not reported, and an excluded directory is not enumerated at all.
+struct ScanExclusions
+{
+	// .gitignore syntax, relative to the scan root: "node_modules" or "*.o" exclude every entry by that name, "/build"
+	// or "out/**/obj" are paths from the root, a trailing '/' limits a pattern to directories, and '!' re-includes.
+	QStringList patterns;
+	// Also honour the .gitignore and .ignore files found in the scanned directories, each covering its own subtree the
+	// way git applies it; where both exist, .ignore wins.
+	bool useIgnoreFiles = false;
+
+	[[nodiscard]] bool empty() const noexcept { return patterns.isEmpty() && !useIgnoreFiles; }
+};
+
 // Depth-first scan; every discovered item is passed to the observer, with reachedThroughLink = true for items found by
 // traversing a directory link (symlink / junction). With followDirLinks = false, a directory link is still reported
 // as an item, but its contents are not.
@@ -12,4 +31,5 @@ class CFileSystemObject;
 void scanDirectory(const CFileSystemObject& root,
 	const std::function<void (const CFileSystemObject& item, bool reachedThroughLink)>& observer,
 	const std::atomic<bool>& abort = std::atomic<bool>{false},
-	bool followDirLinks = true);
+	bool followDirLinks = true,
+	const ScanExclusions& exclusions = {});
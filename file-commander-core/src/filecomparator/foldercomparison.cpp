@@ -32,7 +32,7 @@ QString rootPrefix(const QString& root)
 	return prefix;
 }
 
-SideMap enumerateSide(const QString& root, const QString& prefix, const std::atomic<bool>& abort)
+SideMap enumerateSide(const QString& root, const QString& prefix, const std::atomic<bool>& abort, const ScanExclusions& exclusions)
 {
 	SideMap entries;
 
@@ -53,7 +53,7 @@ SideMap enumerateSide(const QString& root, const QString& prefix, const std::ato
 		entry.size = item.size();
 		entry.isDirectory = item.isDir();
 		entries.emplace(std::move(relativePath), std::move(entry));
-	}, abort);
+	}, abort, true, exclusions);
 
 	return entries;
 }
@@ -100,13 +100,13 @@ FolderComparisonEntry singleSidedEntry(const SideEntry& side, const EntryDiffere
 } // namespace
 
 FolderComparisonResult compareFolders(const QString& leftRoot, const QString& rightRoot, const PairingMode pairingMode,
-	const std::atomic<bool>& abort, const std::function<void (int percent)>& onProgress)
+	const std::atomic<bool>& abort, const std::function<void (int percent)>& onProgress, const ScanExclusions& exclusions)
 {
 	FolderComparisonResult result;
 
 	const QString leftPrefix = rootPrefix(leftRoot), rightPrefix = rootPrefix(rightRoot);
-	SideMap left = enumerateSide(leftRoot, leftPrefix, abort);
-	SideMap right = enumerateSide(rightRoot, rightPrefix, abort);
+	SideMap left = enumerateSide(leftRoot, leftPrefix, abort, exclusions);
+	SideMap right = enumerateSide(rightRoot, rightPrefix, abort, exclusions);
 	if (abort)
 	{
 		result.aborted = true;
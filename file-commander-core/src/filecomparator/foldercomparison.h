@@ -1,6 +1,7 @@
 #pragma once
 
 #include "cfilesystemobject.h"
+#include "directoryscanner.h"
 
 #include <atomic>
 #include <functional>
@@ -45,6 +46,8 @@ enum class PairingMode {
 // A directory present on one side only contributes an entry for itself and one for each of its descendants, leaving the
 // caller free to collapse them for display.
 // Progress covers the content-comparison phase only - enumeration runs first and has no denominator to report against.
+// Excluded entries are left out on both sides, so they never show up as differences; each side reads its own ignore files.
 FolderComparisonResult compareFolders(const QString& leftRoot, const QString& rightRoot,
 	PairingMode pairingMode = PairingMode::Exact, const std::atomic<bool>& abort = std::atomic<bool>{false},
-	const std::function<void (int percent)>& onProgress = {});
+	const std::function<void (int percent)>& onProgress = {},
+	const ScanExclusions& exclusions = {});
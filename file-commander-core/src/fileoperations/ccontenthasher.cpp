@@ -0,0 +1,130 @@
+#include "ccontenthasher.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace
+{
+
+constexpr uint64_t prime1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t prime3 = 0x165667B19E3779F9ull;
+constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63ull;
+constexpr uint64_t prime5 = 0x27D4EB2F165667C5ull;
+
+// XXH64 reads its input as little-endian words, whatever the machine
+uint64_t readLittleEndian(const std::byte* bytes, const size_t width) noexcept
+{
+	uint64_t value = 0;
+	for (size_t i = width; i-- > 0;)
+		value = (value << 8) | static_cast<uint64_t>(bytes[i]);
+	return value;
+}
+
+uint64_t round(uint64_t accumulator, const uint64_t input) noexcept
+{
+	accumulator += input * prime2;
+	accumulator = std::rotl(accumulator, 31);
+	return accumulator * prime1;
+}
+
+uint64_t mergeRound(uint64_t hash, const uint64_t accumulator) noexcept
+{
+	hash ^= round(0, accumulator);
+	return hash * prime1 + prime4;
+}
+
+} // namespace
+
+std::array<uint64_t, 4> CContentHasher::initialAccumulators() noexcept
+{
+	// Seed 0
+	return { prime1 + prime2, prime2, 0, 0 - prime1 };
+}
+
+void CContentHasher::update(const void* const data, size_t length) noexcept
+{
+	const auto* bytes = static_cast<const std::byte*>(data);
+	_totalLength += length;
+
+	if (_pendingLength > 0)
+	{
+		const size_t taken = std::min(length, stripeSize - _pendingLength);
+		std::copy_n(bytes, taken, _pending.data() + _pendingLength);
+		_pendingLength += taken;
+		bytes += taken;
+		length -= taken;
+		if (_pendingLength < stripeSize)
+			return;
+
+		consumeStripe(_pending.data());
+		_pendingLength = 0;
+	}
+
+	for (; length >= stripeSize; bytes += stripeSize, length -= stripeSize)
+		consumeStripe(bytes);
+
+	std::copy_n(bytes, length, _pending.data());
+	_pendingLength = length;
+}
+
+void CContentHasher::updateZeros(uint64_t length) noexcept
+{
+	static constexpr std::array<std::byte, 64 * 1024> zeros{};
+	while (length > 0)
+	{
+		const size_t piece = static_cast<size_t>(std::min<uint64_t>(length, zeros.size()));
+		update(zeros.data(), piece);
+		length -= piece;
+	}
+}
+
+uint64_t CContentHasher::digest() const noexcept
+{
+	uint64_t hash = 0;
+	if (_totalLength >= stripeSize)
+	{
+		hash = std::rotl(_accumulators[0], 1) + std::rotl(_accumulators[1], 7) + std::rotl(_accumulators[2], 12) + std::rotl(_accumulators[3], 18);
+		for (const uint64_t accumulator : _accumulators)
+			hash = mergeRound(hash, accumulator);
+	}
+	else
+		hash = prime5; // + the seed, 0
+
+	hash += _totalLength;
+
+	// The tail that did not fill a stripe: words, then a half word, then bytes
+	const std::byte* tail = _pending.data();
+	size_t remaining = _pendingLength;
+	for (; remaining >= 8; tail += 8, remaining -= 8)
+	{
+		hash ^= round(0, readLittleEndian(tail, 8));
+		hash = std::rotl(hash, 27) * prime1 + prime4;
+	}
+	if (remaining >= 4)
+	{
+		hash ^= readLittleEndian(tail, 4) * prime1;
+		hash = std::rotl(hash, 23) * prime2 + prime3;
+		tail += 4;
+		remaining -= 4;
+	}
+	for (; remaining > 0; ++tail, --remaining)
+	{
+		hash ^= static_cast<uint64_t>(*tail) * prime5;
+		hash = std::rotl(hash, 11) * prime1;
+	}
+
+	// Avalanche
+	hash ^= hash >> 33;
+	hash *= prime2;
+	hash ^= hash >> 29;
+	hash *= prime3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+void CContentHasher::consumeStripe(const std::byte* const stripe) noexcept
+{
+	for (size_t lane = 0; lane < _accumulators.size(); ++lane)
+		_accumulators[lane] = round(_accumulators[lane], readLittleEndian(stripe + lane * 8, 8));
+}
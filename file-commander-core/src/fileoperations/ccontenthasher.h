@@ -0,0 +1,29 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <stdint.h>
+
+// XXH64 of a byte stream fed in pieces of any size: a fast non-cryptographic hash, for telling a faithful copy from a
+// damaged one - not for withstanding deliberate tampering. The digest is the one xxhsum -H1 prints for the whole stream.
+class CContentHasher
+{
+public:
+	void update(const void* data, size_t length) noexcept;
+	// As many zero bytes - a hole of a sparse file, which reads back as zeros
+	void updateZeros(uint64_t length) noexcept;
+
+	// Of everything fed so far; more can be fed after.
+	[[nodiscard]] uint64_t digest() const noexcept;
+
+private:
+	static constexpr size_t stripeSize = 32;
+
+	[[nodiscard]] static std::array<uint64_t, 4> initialAccumulators() noexcept;
+	void consumeStripe(const std::byte* stripe) noexcept;
+
+	std::array<uint64_t, 4> _accumulators = initialAccumulators();
+	std::array<std::byte, stripeSize> _pending{}; // The start of a stripe that is not complete yet
+	size_t _pendingLength = 0;
+	uint64_t _totalLength = 0;
+};
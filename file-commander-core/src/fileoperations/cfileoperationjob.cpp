@@ -9,9 +9,14 @@
 
 #include <algorithm>
 
-CFileOperationJob::CFileOperationJob(FileOperationRequest request, const uint64_t transferChunkSize) :
+CFileOperationJob::CFileOperationJob(FileOperationRequest request, const uint64_t transferChunkSize, const uint32_t fileCopyWorkers,
+	CFileOperationQueue* const queue, const PageCachePolicy pageCachePolicy, CTransferThrottle* const sharedThrottle) :
 	_request{ mv(request) },
-	_transferChunkSize{ transferChunkSize }
+	_transferChunkSize{ transferChunkSize },
+	_fileCopyWorkers{ fileCopyWorkers },
+	_queue{ queue },
+	_pageCachePolicy{ pageCachePolicy },
+	_throttle{ sharedThrottle }
 {
 }
 
@@ -22,6 +27,9 @@ CFileOperationJob::~CFileOperationJob()
 		_thread.requestCancellation();
 	}
 	_stateChanged.notify_all();
+	if (_queue)
+		_queue->wake();
+	_throttle.cancel();
 	_thread.join();
 }
 
@@ -54,18 +62,65 @@ void CFileOperationJob::cancel()
 		std::erase_if(_events, [](const OperationEvent& event) { return std::holds_alternative<DecisionRequest>(event); });
 	}
 	_stateChanged.notify_all();
+	// The queue evaluates the flag under its own mutex, so it must be woken after the flag is set
+	if (_queue)
+		_queue->wake();
+	_throttle.cancel();
 }
 
 void CFileOperationJob::setPaused(const bool paused)
 {
+	std::optional<CFileOperationQueue::JobId> queuedAs;
 	{
 		std::lock_guard lock{ _mutex };
 		if (_pauseRequested == paused)
 			return;
 		_pauseRequested = paused;
+		queuedAs = _queuedAs;
 	}
 	if (!paused)
 		_stateChanged.notify_all();
+	// Without effect once the job has been admitted; from then on, its checkpoints honor the pause
+	if (queuedAs)
+		_queue->setHeld(*queuedAs, paused);
+}
+
+bool CFileOperationJob::prioritize()
+{
+	std::optional<CFileOperationQueue::JobId> queuedAs;
+	{
+		std::lock_guard lock{ _mutex };
+		queuedAs = _queuedAs;
+	}
+	return queuedAs && _queue->prioritize(*queuedAs);
+}
+
+bool CFileOperationJob::moveUp()
+{
+	std::optional<CFileOperationQueue::JobId> queuedAs;
+	{
+		std::lock_guard lock{ _mutex };
+		queuedAs = _queuedAs;
+	}
+	if (!queuedAs)
+		return false;
+
+	// The queue may change between the two calls; moveJob() then still only moves a job that is queued
+	const std::vector<CFileOperationQueue::QueuedJob> queuedJobs = _queue->queuedJobs();
+	const auto job = std::ranges::find(queuedJobs, *queuedAs, &CFileOperationQueue::QueuedJob::id);
+	if (job == queuedJobs.end() || job == queuedJobs.begin())
+		return false;
+	return _queue->moveJob(*queuedAs, static_cast<size_t>(job - queuedJobs.begin()) - 1);
+}
+
+void CFileOperationJob::setTransferRateLimit(const std::optional<uint64_t> bytesPerSecond)
+{
+	_throttle.setLimit(bytesPerSecond);
+}
+
+void CFileOperationJob::setTransferPriority(const TransferPriority priority)
+{
+	_throttle.setPriority(priority);
 }
 
 bool CFileOperationJob::submitDecision(Decision decision)
@@ -128,14 +183,40 @@ void CFileOperationJob::runOperation(const std::atomic<bool>& cancellationReques
 	// The job is not finished until a summary is queued, and an executor that throws must not cost the dialog its completion.
 	OperationSummary summary{ .status = CompletionStatus::Failed };
 	EXEC_ON_SCOPE_EXIT([this, &summary] {
+		// Hands the job's devices on to the next job in the queue, however this one ended
+		if (_queuedAs)
+			_queue->remove(*_queuedAs);
+
 		std::lock_guard lock{ _mutex };
 		_events.emplace_back(mv(summary)); // The summary precedes the status flip: Finished implies it is queued
 		_finished = true;
 	});
 
+	// A delete only touches metadata and is over in moments; queued, it would wait behind a long copy on the same disk.
+	if (_queue && !std::holds_alternative<PermanentDeleteRequest>(_request))
+	{
+		// Which devices the request is on takes reading the filesystem, which is this thread's job rather than the UI's
+		auto devices = CFileOperationQueue::devicesOf(_request);
+		{
+			// Together with the pause state, so that a setPaused() either finds the job queued or is reflected here.
+			// The queue's lock is never held while taking this one, so the nesting cannot deadlock.
+			std::lock_guard lock{ _mutex };
+			_queuedAs = _queue->enqueue(mv(devices), _pauseRequested);
+		}
+
+		const bool admitted = _queue->waitForTurn(*_queuedAs,
+			[&cancellationRequested] { return cancellationRequested.load(); },
+			[this] { enqueueProgress(ProgressSnapshot{ .phase = OperationPhase::Queued }); });
+		if (!admitted)
+		{
+			summary.status = CompletionStatus::Cancelled;
+			return;
+		}
+	}
+
 	summary = std::visit([&]<typename Request>(const Request& request) {
 		if constexpr (std::is_same_v<Request, TransferRequest>)
-			return CTransferExecutor{ context, _transferChunkSize }.run(request);
+			return CTransferExecutor{ context, _transferChunkSize, _fileCopyWorkers, _pageCachePolicy, &_throttle }.run(request);
 		else
 			return CDeleteExecutor{ context }.run(request);
 	}, _request);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "cfileoperationqueue.h"
+#include "ctransferthrottle.h"
 #include "fileoperationtypes.h"
 
 #include "threading/cinterruptablethread.h"
@@ -35,7 +37,16 @@ enum class JobStatus
 class CFileOperationJob
 {
 public:
-	explicit CFileOperationJob(FileOperationRequest request, uint64_t transferChunkSize = 8 * 1024 * 1024);
+	// What the application passes for fileCopyWorkers: a copy of many small files is bound by the latency of each
+	// one's create, write and rename, which a few at a time hide well, even on a single disk.
+	static constexpr uint32_t interactiveFileCopyWorkers = 4;
+
+	// transferChunkSize and fileCopyWorkers: see CTransferExecutor. One worker copies strictly one file at a time.
+	// With a queue, a copy or move waits there for its turn on its devices before it touches the filesystem; a delete,
+	// which is over in moments, never queues behind one. Without a queue every job starts right away. pageCachePolicy: for every file a transfer copies. A transfer is paced by a throttle of its
+	// own, which shares sharedThrottle's limit with the other jobs on it, if set.
+	explicit CFileOperationJob(FileOperationRequest request, uint64_t transferChunkSize = 8 * 1024 * 1024, uint32_t fileCopyWorkers = 1,
+		CFileOperationQueue* queue = nullptr, PageCachePolicy pageCachePolicy = PageCachePolicy::Automatic, CTransferThrottle* sharedThrottle = nullptr);
 	~CFileOperationJob(); // Requests cancellation, wakes every wait, joins
 
 	CFileOperationJob(const CFileOperationJob&) = delete;
@@ -48,7 +59,16 @@ public:
 	// decision event: cancellation makes it unanswerable. Valid in any state: a cancel() before start()
 	// is remembered and applied there, past the wrapper's flag reset.
 	void cancel();
+	// A job paused while still queued is passed over by the queue until it is resumed.
 	void setPaused(bool paused);
+	// Moves the job to the front of its queue; false if it is not waiting there.
+	bool prioritize();
+	// Moves the job one place ahead in its queue; false if it is not waiting there, or is first already.
+	bool moveUp();
+	// This job's own throughput limit, in bytes per second; nullopt: unlimited. Both take effect from the next chunk on,
+	// and can be set at any time.
+	void setTransferRateLimit(std::optional<uint64_t> bytesPerSecond);
+	void setTransferPriority(TransferPriority priority);
 	// False = no unanswered decision is pending, or the supplied answer is invalid. Duplicate and late responses
 	// are therefore rejected.
 	// There are no decision IDs: the worker cannot reach a second decision while blocked on the first.
@@ -73,6 +93,10 @@ private:
 
 	const FileOperationRequest _request;
 	const uint64_t _transferChunkSize;
+	const uint32_t _fileCopyWorkers;
+	CFileOperationQueue* const _queue;
+	const PageCachePolicy _pageCachePolicy;
+	CTransferThrottle _throttle; // Thread-safe on its own; cancelled along with the job
 
 	mutable std::mutex _mutex;
 	std::condition_variable _stateChanged;
@@ -81,6 +105,7 @@ private:
 	bool _finished = false; // Set only after the summary event is queued: Finished implies the summary is observable
 	bool _cancelledBeforeStart = false; // Write-once, consumed by start(); never read as a runtime cancellation predicate
 	bool _pauseRequested = false;
+	std::optional<CFileOperationQueue::JobId> _queuedAs; // Set once by the worker, when there is a queue
 	std::optional<DecisionRequest> _pendingRequest;
 	std::optional<Decision> _submittedDecision;
 
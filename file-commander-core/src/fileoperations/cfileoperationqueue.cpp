@@ -0,0 +1,201 @@
+#include "cfileoperationqueue.h"
+#include "cfilesystemobject.h"
+
+#include "lang/utils.hpp" // mv()
+
+#include <algorithm>
+#include <limits>
+#include <optional>
+
+namespace
+{
+
+bool sharesDevice(const std::vector<uint64_t>& devices, const std::vector<uint64_t>& busyDevices)
+{
+	return std::ranges::any_of(devices, [&busyDevices](const uint64_t device) {
+		return std::ranges::find(busyDevices, device) != busyDevices.end();
+	});
+}
+
+#ifdef _WIN32
+// A network share has no drive number. What jobs on it contend for is the server behind it, which is best told by
+// the share's name: one key per share, set apart from the drive numbers (0 to 25) by its top bit.
+std::optional<uint64_t> networkShareKey(const CEntryPath& path)
+{
+	const QString& value = path.value();
+	if (!value.startsWith(QLatin1String("//")))
+		return std::nullopt;
+
+	const qsizetype serverEnd = value.indexOf(u'/', 2);
+	if (serverEnd < 0)
+		return std::nullopt;
+	const qsizetype shareEnd = value.indexOf(u'/', serverEnd + 1);
+	const QString share = value.left(shareEnd < 0 ? value.size() : shareEnd).toCaseFolded();
+	return (uint64_t{ 1 } << 63) | static_cast<uint64_t>(qHash(share));
+}
+#endif
+
+} // namespace
+
+CFileOperationQueue& CFileOperationQueue::get()
+{
+	static CFileOperationQueue queue;
+	return queue;
+}
+
+std::vector<uint64_t> CFileOperationQueue::devicesOf(const FileOperationRequest& request)
+{
+	std::vector<uint64_t> devices;
+	const auto add = [&devices](const CEntryPath& path) {
+#ifdef _WIN32
+		const uint64_t device = networkShareKey(path).value_or(CFileSystemObject{ path.value() }.rootFileSystemId());
+#else
+		// A path that doesn't exist yet is on the device of its nearest existing ancestor
+		const uint64_t device = CFileSystemObject{ path.value() }.rootFileSystemId();
+#endif
+		if (device != std::numeric_limits<uint64_t>::max() && std::ranges::find(devices, device) == devices.end())
+			devices.push_back(device);
+	};
+
+	std::visit([&add]<typename Request>(const Request& typedRequest) {
+		// The sources of a request mostly share one parent, often one of thousands of selected entries
+		std::vector<CEntryPath> parents;
+		for (const CEntryPath& source : typedRequest.sources)
+		{
+			CEntryPath parent = source.isRoot() ? source : source.parent();
+			if (std::ranges::find(parents, parent) == parents.end())
+			{
+				add(parent);
+				parents.push_back(mv(parent));
+			}
+		}
+		if constexpr (std::is_same_v<Request, TransferRequest>)
+			add(typedRequest.destination.path);
+	}, request);
+
+	return devices;
+}
+
+CFileOperationQueue::JobId CFileOperationQueue::enqueue(std::vector<uint64_t> devices, const bool held)
+{
+	std::lock_guard lock{ _mutex };
+	const JobId id = _nextId++;
+	_queued.push_back(Entry{ id, mv(devices), held });
+	admitQueuedJobs();
+	return id;
+}
+
+bool CFileOperationQueue::waitForTurn(const JobId id, const std::function<bool()>& stopWaiting, const std::function<void()>& waiting)
+{
+	const auto admitted = [this, id] {
+		return std::ranges::any_of(_running, [id](const Entry& entry) { return entry.id == id; });
+	};
+
+	std::unique_lock lock{ _mutex };
+	if (admitted())
+		return true;
+
+	if (waiting)
+	{
+		lock.unlock();
+		waiting();
+		lock.lock();
+	}
+
+	_changed.wait(lock, [&] { return admitted() || stopWaiting(); });
+	return admitted();
+}
+
+void CFileOperationQueue::wake()
+{
+	// Taking the lock orders this after whatever the caller changed for stopWaiting, so no waiter misses it
+	{
+		std::lock_guard lock{ _mutex };
+	}
+	_changed.notify_all();
+}
+
+void CFileOperationQueue::remove(const JobId id)
+{
+	{
+		std::lock_guard lock{ _mutex };
+		std::erase_if(_queued, [id](const Entry& entry) { return entry.id == id; });
+		std::erase_if(_running, [id](const Entry& entry) { return entry.id == id; });
+		admitQueuedJobs();
+	}
+	_changed.notify_all();
+}
+
+std::vector<CFileOperationQueue::QueuedJob> CFileOperationQueue::queuedJobs() const
+{
+	std::lock_guard lock{ _mutex };
+	std::vector<QueuedJob> jobs;
+	jobs.reserve(_queued.size());
+	for (const Entry& entry : _queued)
+		jobs.push_back(QueuedJob{ entry.id, entry.devices, entry.held });
+	return jobs;
+}
+
+bool CFileOperationQueue::moveJob(const JobId id, const size_t position)
+{
+	{
+		std::lock_guard lock{ _mutex };
+		const auto job = std::ranges::find(_queued, id, &Entry::id);
+		if (job == _queued.end())
+			return false;
+
+		Entry entry = mv(*job);
+		_queued.erase(job);
+		_queued.insert(_queued.begin() + static_cast<ptrdiff_t>(std::min(position, _queued.size())), mv(entry));
+		admitQueuedJobs();
+	}
+	_changed.notify_all();
+	return true;
+}
+
+bool CFileOperationQueue::prioritize(const JobId id)
+{
+	return moveJob(id, 0);
+}
+
+bool CFileOperationQueue::setHeld(const JobId id, const bool held)
+{
+	{
+		std::lock_guard lock{ _mutex };
+		const auto job = std::ranges::find(_queued, id, &Entry::id);
+		if (job == _queued.end())
+			return false;
+
+		job->held = held;
+		admitQueuedJobs();
+	}
+	_changed.notify_all();
+	return true;
+}
+
+void CFileOperationQueue::admitQueuedJobs()
+{
+	std::vector<uint64_t> busyDevices;
+	for (const Entry& entry : _running)
+		busyDevices.insert(busyDevices.end(), entry.devices.begin(), entry.devices.end());
+
+	for (auto entry = _queued.begin(); entry != _queued.end();)
+	{
+		if (entry->held)
+		{
+			++entry;
+			continue;
+		}
+
+		// Admitted or not, its devices are taken from here on: a job further back must wait for this one
+		const bool canStart = !sharesDevice(entry->devices, busyDevices);
+		busyDevices.insert(busyDevices.end(), entry->devices.begin(), entry->devices.end());
+		if (canStart)
+		{
+			_running.push_back(mv(*entry));
+			entry = _queued.erase(entry);
+		}
+		else
+			++entry;
+	}
+}
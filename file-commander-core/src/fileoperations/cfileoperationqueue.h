@@ -0,0 +1,73 @@
+#pragma once
+
+#include "fileoperationtypes.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+// Decides when each file operation job may start, so that jobs that share a device take turns on it instead of
+// thrashing it, while jobs on different devices run side by side. A job is keyed by the devices its sources and its
+// destination are on (CFileSystemObject::rootFileSystemId), or on Windows by the network share a UNC path is on.
+// Jobs are admitted in queue order: a queued job starts as soon as none of its devices is in use by a running job,
+// or wanted by a job ahead of it in the queue - so that a later job never overtakes an earlier one on the same
+// device. A held job keeps its place, but is passed over. Thread-safe.
+class CFileOperationQueue
+{
+public:
+	using JobId = uint64_t;
+
+	struct QueuedJob
+	{
+		JobId id;
+		std::vector<uint64_t> devices;
+		bool held = false;
+	};
+
+	// The one the application runs all of its jobs through
+	[[nodiscard]] static CFileOperationQueue& get();
+
+	// Where the request's sources are and, for a transfer, where its destination is; a path whose device can't be
+	// told is left out. Reads the filesystem, once per distinct parent directory of the sources: a source is taken to
+	// be on its parent's device, which only a source that is a mount point itself is not.
+	[[nodiscard]] static std::vector<uint64_t> devicesOf(const FileOperationRequest& request);
+
+	// Adds a job at the back of the queue; it may be admitted right away.
+	[[nodiscard]] JobId enqueue(std::vector<uint64_t> devices, bool held = false);
+	// Blocks until the job is admitted (true), or until stopWaiting() holds (false). waiting is called once, without
+	// the lock held, if the job is not admitted right away. stopWaiting is evaluated under the lock, so whatever
+	// it depends on must be changed before calling wake().
+	[[nodiscard]] bool waitForTurn(JobId id, const std::function<bool()>& stopWaiting, const std::function<void()>& waiting = {});
+	void wake();
+	// Takes the job out of the queue, or releases the devices of a running one.
+	void remove(JobId id);
+
+	// --- For the UI ---
+
+	// The jobs that have not been admitted yet, in queue order
+	[[nodiscard]] std::vector<QueuedJob> queuedJobs() const;
+	// Moves a queued job to the position among the queued ones, or to the back if there are fewer; false if the job
+	// is not queued (any more).
+	bool moveJob(JobId id, size_t position);
+	bool prioritize(JobId id); // To the front
+	bool setHeld(JobId id, bool held);
+
+private:
+	struct Entry
+	{
+		JobId id;
+		std::vector<uint64_t> devices;
+		bool held = false;
+	};
+
+	// Under _mutex
+	void admitQueuedJobs();
+
+	mutable std::mutex _mutex;
+	std::condition_variable _changed;
+	std::vector<Entry> _queued;
+	std::vector<Entry> _running;
+	JobId _nextId = 1;
+};
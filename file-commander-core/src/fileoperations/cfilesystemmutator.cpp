@@ -3,6 +3,7 @@
 #include "thiniobridge.h"
 
 #include "assert/advanced_assert.h"
+#include "threading/cthreadpool.h"
 
 DISABLE_COMPILER_WARNINGS
 #include <QStringBuilder>
@@ -19,8 +20,15 @@ RESTORE_COMPILER_WARNINGS
 #include <stdio.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/utsname.h>
+#endif
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <optional>
 #include <utility>
 #include <vector>
 
@@ -453,6 +461,15 @@ std::expected<CopyableDirectoryTimes, CFileSystemError> readCopyableDirectoryTim
 	return result;
 }
 
+std::expected<std::optional<thin_io::timestamp>, CFileSystemError> readLastWriteTime(const CEntryPath& path)
+{
+	const auto native = thinIoPath(path);
+	const auto times = thin_io::get_times(nativeCStr(native));
+	if (!times)
+		return std::unexpected(makeFileSystemError(captureNativeError()));
+	return times->last_write;
+}
+
 std::expected<void, CFileSystemError> CFileSystemMutator::renameEntry(const CEntryPath& source, const CEntryPath& destination, const ReplacementMode replacement)
 {
 #ifdef _WIN32
@@ -574,6 +591,250 @@ std::expected<void, CFileSystemError> CFileSystemMutator::renameEntry(const CEnt
 #endif
 }
 
+#ifdef __linux__
+std::expected<void, CFileSystemError> CFileSystemMutator::linkAnonymousFile(const int fd, const CEntryPath& destination, const ReplacementMode replacement)
+{
+	using OperationTestHooks::fireHook, OperationTestHooks::Point;
+
+	const QByteArray fdPath = "/proc/self/fd/" + QByteArray::number(fd);
+	const auto linkError = [&fdPath](const NativePathString& name) -> std::optional<NativeErrorCode> {
+		if (::linkat(AT_FDCWD, fdPath.constData(), AT_FDCWD, nativeCStr(name), AT_SYMLINK_FOLLOW) == 0)
+			return {};
+		return captureNativeError();
+	};
+
+	if (replacement == ReplacementMode::RequireAbsent)
+	{
+		if (const auto forcedError = fireHook(Point::RenameEntry_Native))
+			return std::unexpected(renameErrorFromNative(*forcedError));
+
+		if (const auto errorCode = linkError(thinIoPath(destination)))
+			return std::unexpected(renameErrorFromNative(*errorCode));
+		return {};
+	}
+
+	static constexpr int maximumTemporaryNameAttempts = 10;
+	for (int attempt = 0; attempt < maximumTemporaryNameAttempts; ++attempt)
+	{
+		const CEntryPath temporaryPath = destination.parent().child(
+			QStringLiteral(".file-commander-copy-") % QUuid::createUuid().toString(QUuid::WithoutBraces) % QStringLiteral(".tmp"));
+		const auto temporaryNative = thinIoPath(temporaryPath);
+		const auto errorCode = linkError(temporaryNative);
+		if (!errorCode)
+		{
+			auto replaced = renameEntry(temporaryPath, destination, ReplacementMode::ReplaceExistingFile);
+			if (!replaced)
+				(void)::unlink(nativeCStr(temporaryNative)); // The file itself stays, unnamed again, with its open descriptor
+			return replaced;
+		}
+
+		if (classifyNativeError(*errorCode) != FileErrorCategory::AlreadyExists)
+			return std::unexpected(makeFileSystemError(*errorCode));
+	}
+
+	return std::unexpected(CFileSystemError{ FileErrorCategory::IoFailure, EEXIST,
+		QStringLiteral("Could not reserve a unique temporary name for the replacement") });
+}
+#endif
+
+namespace
+{
+
+// One flush mostly waits for the disk; with several in flight it can write them back in one pass
+constexpr size_t concurrentFlushes = 8;
+
+// The first failure of flush() on any of the paths; every path is attempted regardless
+std::optional<NativeErrorCode> flushConcurrently(const std::vector<CEntryPath>& paths, bool (*flush)(const CEntryPath&))
+{
+	if (paths.empty())
+		return std::nullopt;
+
+	std::atomic<size_t> next = 0;
+	std::mutex errorMutex;
+	std::optional<NativeErrorCode> firstError;
+
+	const size_t workerCount = std::min(concurrentFlushes, paths.size());
+	CThreadPool flushPool(workerCount, "File flush pool");
+	for (size_t worker = 0; worker < workerCount; ++worker)
+	{
+		flushPool.enqueue([&] {
+			for (size_t index = next++; index < paths.size(); index = next++)
+			{
+				if (flush(paths[index]))
+					continue;
+
+				const NativeErrorCode errorCode = captureNativeError();
+				std::lock_guard lock{ errorMutex };
+				if (!firstError)
+					firstError = errorCode;
+			}
+		});
+	}
+
+	flushPool.finishAllThreads(true);
+	return firstError;
+}
+
+#ifndef _WIN32
+// fsync(), or with dataOnly fdatasync(): the data, and only as much metadata as it takes to read it back
+bool syncPath(const CEntryPath& path, const bool dataOnly)
+{
+	const auto native = thinIoPath(path);
+	const int fd = ::open(nativeCStr(native), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+#ifdef __APPLE__
+	const bool synced = ::fsync(fd) == 0; // No fdatasync() to speak of
+	(void)dataOnly;
+#else
+	const bool synced = (dataOnly ? ::fdatasync(fd) : ::fsync(fd)) == 0;
+#endif
+	const int syncError = errno;
+	::close(fd);
+	errno = syncError;
+	return synced;
+}
+#endif
+
+#ifdef __linux__
+// Before 5.8, syncfs() returned 0 even when the writeback it started failed; it can't be told apart from a success.
+bool syncfsReportsWritebackErrors()
+{
+	static const bool reports = [] {
+		utsname system{};
+		unsigned major = 0, minor = 0;
+		if (::uname(&system) != 0 || ::sscanf(system.release, "%u.%u", &major, &minor) != 2)
+			return false;
+		return major > 5 || (major == 5 && minor >= 8);
+	}();
+	return reports;
+}
+#endif
+
+} // namespace
+
+std::expected<void, CFileSystemError> CFileSystemMutator::flushPublishedFiles(const std::vector<CEntryPath>& files)
+{
+	using OperationTestHooks::fireHook, OperationTestHooks::Point;
+
+	if (const auto forcedError = fireHook(Point::FlushPublishedFiles_Native))
+		return std::unexpected(makeFileSystemError(*forcedError));
+
+#ifndef _WIN32
+	// Usually all in the one directory
+	std::vector<CEntryPath> directories;
+	for (const CEntryPath& file : files)
+	{
+		if (CEntryPath directory = file.parent(); std::ranges::find(directories, directory) == directories.end())
+			directories.push_back(std::move(directory));
+	}
+#endif
+
+#ifdef __linux__
+	if (syncfsReportsWritebackErrors())
+	{
+		// Writes back everything dirty on the directory's filesystem, the files' data and the entries naming them alike,
+		// and waits for the disk once - where an fdatasync() per file would wait once per file. Once per filesystem:
+		// the directories of one group are usually all on the one.
+		std::vector<dev_t> syncedDevices;
+		for (const CEntryPath& directory : directories)
+		{
+			const auto native = thinIoPath(directory);
+			const int fd = ::open(nativeCStr(native), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			if (fd < 0)
+				return std::unexpected(makeFileSystemError(captureNativeError()));
+
+			struct stat directoryStat;
+			if (::fstat(fd, &directoryStat) == 0)
+			{
+				if (std::ranges::find(syncedDevices, directoryStat.st_dev) != syncedDevices.end())
+				{
+					::close(fd);
+					continue;
+				}
+				syncedDevices.push_back(directoryStat.st_dev);
+			}
+
+			const bool synced = ::syncfs(fd) == 0;
+			const NativeErrorCode errorCode = synced ? NativeErrorCode{} : captureNativeError();
+			::close(fd);
+			if (!synced)
+				return std::unexpected(makeFileSystemError(errorCode));
+		}
+		return {};
+	}
+
+	// An older kernel's syncfs() would report a failed writeback as a success: every file's data instead, then the
+	// directories, as elsewhere
+	auto errorCode = flushConcurrently(files, [](const CEntryPath& file) { return syncPath(file, true); });
+	if (!errorCode)
+		errorCode = flushConcurrently(directories, [](const CEntryPath& directory) { return syncPath(directory, false); });
+	if (errorCode)
+		return std::unexpected(makeFileSystemError(*errorCode));
+	return {};
+#elif defined _WIN32
+	// NTFS journals the directory entries itself; only the files' data needs flushing
+	const auto errorCode = flushConcurrently(files, [](const CEntryPath& file) {
+		const Win32Path nativePath{ file };
+		if (!nativePath) [[unlikely]]
+		{
+			::SetLastError(static_cast<DWORD>(nativePath.error()));
+			return false;
+		}
+
+		// Flushing takes write access; the sharing modes keep out of the way of anyone who has the file open
+		const HANDLE handle = ::CreateFileW(nativePath.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (handle == INVALID_HANDLE_VALUE)
+			return false;
+
+		const bool flushed = ::FlushFileBuffers(handle) != 0;
+		const DWORD flushError = ::GetLastError();
+		::CloseHandle(handle);
+		::SetLastError(flushError);
+		return flushed;
+	});
+	if (errorCode)
+		return std::unexpected(makeFileSystemError(*errorCode));
+	return {};
+#else
+	// The files first: a name made durable before the data it names would be a torn file after a crash
+	auto errorCode = flushConcurrently(files, [](const CEntryPath& file) { return syncPath(file, false); });
+	if (!errorCode)
+		errorCode = flushConcurrently(directories, [](const CEntryPath& directory) { return syncPath(directory, false); });
+	if (errorCode)
+		return std::unexpected(makeFileSystemError(*errorCode));
+	return {};
+#endif
+}
+
+std::expected<void, CFileSystemError> CFileSystemMutator::applyFileMetadata(const CEntryPath& file, const thin_io::entry_times& times,
+	const thin_io::file_permissions permissions)
+{
+	using OperationTestHooks::fireHook, OperationTestHooks::Point;
+
+	if (const auto forcedError = fireHook(Point::ApplyFileMetadata_Native))
+		return std::unexpected(makeFileSystemError(*forcedError));
+
+	thin_io::file handle;
+	const auto native = thinIoPath(file);
+	if (!handle.open(nativeCStr(native), thin_io::file::access_mode::Write))
+		return std::unexpected(makeFileSystemError(captureNativeError()));
+
+	// The times first: permissions that make the file read-only would not stop them, but they are the last word
+	if (!handle.set_times(times) || !handle.set_permissions(permissions))
+	{
+		const NativeErrorCode errorCode = captureNativeError();
+		(void)handle.close();
+		return std::unexpected(makeFileSystemError(errorCode));
+	}
+
+	if (!handle.close())
+		return std::unexpected(makeFileSystemError(captureNativeError()));
+	return {};
+}
+
 std::expected<void, CFileSystemError> CFileSystemMutator::removeEntry(const EntrySnapshot& entry)
 {
 	using OperationTestHooks::fireHook, OperationTestHooks::Point;
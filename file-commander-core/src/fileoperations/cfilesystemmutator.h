@@ -2,7 +2,10 @@
 
 #include "fileoperationtypes.h"
 
+#include "file.hpp" // thin_io
+
 #include <expected>
+#include <vector>
 
 // Category of a captured native error code. Context-free; primitives that know more (e.g. rename's
 // destination-exists forms) refine the result locally before returning it.
@@ -59,6 +62,8 @@ struct DirectoryTraversalIdentity
 // Directory times for later application to an operation-created destination directory. Follows a directory
 // link deliberately: its only link use is materialization of the target directory's contents.
 [[nodiscard]] std::expected<CopyableDirectoryTimes, CFileSystemError> readCopyableDirectoryTimes(const CEntryPath& source);
+// Follows a link. nullopt: the filesystem does not report a last-write time.
+[[nodiscard]] std::expected<std::optional<thin_io::timestamp>, CFileSystemError> readLastWriteTime(const CEntryPath& path);
 
 // Stateless native mutations. These own native path conversion, link-entry addressing, and platform branches;
 // callers never learn which platform primitive ran.
@@ -73,6 +78,22 @@ public:
 	// regular destination's read-only attribute when the native replacement requires it, then retries once.
 	static std::expected<void, CFileSystemError> renameEntry(const CEntryPath& source, const CEntryPath& destination, ReplacementMode replacement);
 
+#ifdef __linux__
+	// Gives an unnamed (O_TMPFILE) file, open as fd, its first name. RequireAbsent is a single link, which never
+	// replaces anything; ReplaceExistingFile links it under a unique hidden sibling and renames that over the
+	// destination as renameEntry() does, removing the sibling again if that fails.
+	static std::expected<void, CFileSystemError> linkAnonymousFile(int fd, const CEntryPath& destination, ReplacementMode replacement);
+#endif
+
+	// Makes published files durable - their data, and the directory entries that name them - in one go for the lot:
+	// on Linux 5.8 and later one syncfs() per filesystem their directories are on (an earlier syncfs() does not report
+	// a failed writeback), elsewhere a flush of every file, several at a time on the "File flush pool" threads, and
+	// then of their directories.
+	static std::expected<void, CFileSystemError> flushPublishedFiles(const std::vector<CEntryPath>& files);
+	// Gives a published regular file the times (access time aside) and permissions captured from its source, as
+	// CStagedFileCopy::commit() does through the staging handle; follows a link.
+	static std::expected<void, CFileSystemError> applyFileMetadata(const CEntryPath& file, const thin_io::entry_times& times, thin_io::file_permissions permissions);
+
 	// Removes the entry itself: links are unlinked, never followed; a directory must be empty.
 	static std::expected<void, CFileSystemError> removeEntry(const EntrySnapshot& entry);
 
@@ -29,6 +29,7 @@ void COperationProgress::setCurrentEntry(CEntryPath entry, const std::optional<u
 {
 	_currentEntry = mv(entry);
 	_currentEntryBytesProcessed = 0;
+	_currentEntrySkippedBytes = 0;
 	_currentEntryBytesTotal = bytesTotal;
 }
 
@@ -36,6 +37,7 @@ void COperationProgress::clearCurrentEntry()
 {
 	_currentEntry.reset();
 	_currentEntryBytesProcessed = 0;
+	_currentEntrySkippedBytes = 0;
 	_currentEntryBytesTotal.reset();
 }
 
@@ -43,8 +45,9 @@ void COperationProgress::currentEntryAbandoned() noexcept
 {
 	_bytesProcessed -= _currentEntryBytesProcessed;
 	if (_primaryUnit == PrimaryProgressUnit::Bytes)
-		_transferredPrimaryUnits -= _currentEntryBytesProcessed;
+		_transferredPrimaryUnits -= _currentEntryBytesProcessed - _currentEntrySkippedBytes;
 	_currentEntryBytesProcessed = 0;
+	_currentEntrySkippedBytes = 0;
 }
 
 void COperationProgress::fileTransferAdvanced(const uint64_t bytes) noexcept
@@ -53,6 +56,23 @@ void COperationProgress::fileTransferAdvanced(const uint64_t bytes) noexcept
 	_currentEntryBytesProcessed += bytes;
 	if (_primaryUnit == PrimaryProgressUnit::Bytes)
 		_transferredPrimaryUnits += bytes;
+
+	_recentWindowBytes += bytes;
+	const auto active = activeDuration();
+	if (const auto windowLength = active - _recentWindowStart; windowLength >= recentThroughputWindow)
+	{
+		using namespace std::chrono;
+		_recentBytesPerSecond = _recentWindowBytes * 1000 / static_cast<uint64_t>(duration_cast<milliseconds>(windowLength).count());
+		_recentWindowStart = active;
+		_recentWindowBytes = 0;
+	}
+}
+
+void COperationProgress::fileBytesSkipped(const uint64_t bytes) noexcept
+{
+	_bytesProcessed += bytes;
+	_currentEntryBytesProcessed += bytes;
+	_currentEntrySkippedBytes += bytes;
 }
 
 void COperationProgress::itemCompleted() noexcept
@@ -62,6 +82,11 @@ void COperationProgress::itemCompleted() noexcept
 		++_transferredPrimaryUnits;
 }
 
+void COperationProgress::setTransferRateLimit(const std::optional<uint64_t> bytesPerSecond) noexcept
+{
+	_transferRateLimit = bytesPerSecond;
+}
+
 void COperationProgress::advanceWithoutTransfer(const uint64_t bytes, const size_t items) noexcept
 {
 	_bytesProcessed += bytes;
@@ -98,6 +123,8 @@ ProgressSnapshot COperationProgress::makeSnapshot() const
 	snapshot.currentEntryBytesTotal = _currentEntryBytesTotal;
 	snapshot.itemsProcessed = _itemsProcessed;
 	snapshot.itemsTotal = _itemsTotal;
+	snapshot.bytesPerSecondLimit = _transferRateLimit;
+	snapshot.recentBytesPerSecond = _recentBytesPerSecond;
 
 	using namespace std::chrono;
 	const auto activeMs = duration_cast<milliseconds>(activeDuration()).count();
@@ -135,6 +162,11 @@ bool COperationExecutionContext::checkpoint()
 	return proceed;
 }
 
+bool COperationExecutionContext::concurrentCheckpoint() const
+{
+	return _checkpoint();
+}
+
 std::optional<Decision> COperationExecutionContext::resolveDecision(OperationIssue issue, const bool remainingMatchingScopeAllowed)
 {
 	const auto kindIndex = static_cast<size_t>(issue.kind);
@@ -193,6 +225,18 @@ void COperationExecutionContext::recordFailure(OperationDiagnostic diagnostic)
 		_accumulatedSummary.representativeFailures.push_back(mv(diagnostic));
 }
 
+void COperationExecutionContext::addTransferredBytes(const uint64_t bytes, const CopyBackend backend) noexcept
+{
+	_accumulatedSummary.transferredBytes += bytes;
+	switch (backend)
+	{
+	case CopyBackend::Clone: _accumulatedSummary.clonedBytes += bytes; break;
+	case CopyBackend::KernelCopy: _accumulatedSummary.kernelCopiedBytes += bytes; break;
+	case CopyBackend::OverlappedWrite: _accumulatedSummary.overlappedWriteBytes += bytes; break;
+	case CopyBackend::MappedWrite: _accumulatedSummary.mappedWriteBytes += bytes; break;
+	}
+}
+
 OperationSummary COperationExecutionContext::makeSummary(const CompletionStatus status) const
 {
 	OperationSummary summary = _accumulatedSummary;
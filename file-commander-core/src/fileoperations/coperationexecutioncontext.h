@@ -26,7 +26,12 @@ public:
 	void currentEntryAbandoned() noexcept;
 
 	void fileTransferAdvanced(uint64_t bytes) noexcept;
+	// Passed over without a transfer - a hole of a sparse file, or what an earlier, suspended copy of the file had
+	// staged: the file is that much further along, but nothing was transferred.
+	void fileBytesSkipped(uint64_t bytes) noexcept;
 	void itemCompleted() noexcept;
+	// The throughput limit in effect (CTransferThrottle::effectiveLimit()), for the snapshot to report
+	void setTransferRateLimit(std::optional<uint64_t> bytesPerSecond) noexcept;
 	// Skipped, already-satisfied, or structurally retained work: advances the processed totals without
 	// entering the speed basis.
 	void advanceWithoutTransfer(uint64_t bytes, size_t items) noexcept;
@@ -36,6 +41,10 @@ public:
 
 	[[nodiscard]] ProgressSnapshot makeSnapshot() const;
 
+	// What the recent throughput is measured over: long enough to smooth out the chunks, short enough to follow a
+	// change of the limit
+	static constexpr std::chrono::seconds recentThroughputWindow{ 2 };
+
 private:
 	[[nodiscard]] std::chrono::steady_clock::duration activeDuration() const noexcept;
 
@@ -48,10 +57,17 @@ private:
 
 	std::optional<CEntryPath> _currentEntry;
 	uint64_t _currentEntryBytesProcessed = 0;
+	uint64_t _currentEntrySkippedBytes = 0; // The part of _currentEntryBytesProcessed that is not in the speed basis
 	std::optional<uint64_t> _currentEntryBytesTotal;
 
 	uint64_t _transferredPrimaryUnits = 0; // The speed basis: genuinely performed work only
 
+	std::optional<uint64_t> _transferRateLimit;
+	// Transferred bytes since the start of the current window, which is in active time
+	std::chrono::steady_clock::duration _recentWindowStart{ 0 };
+	uint64_t _recentWindowBytes = 0;
+	std::optional<uint64_t> _recentBytesPerSecond; // Of the last whole window
+
 	std::chrono::steady_clock::time_point _activeSince;
 	std::chrono::steady_clock::duration _accumulatedActive{ 0 };
 	bool _waiting = false;
@@ -75,6 +91,10 @@ public:
 
 	// False = cancellation; no new mutation may start.
 	[[nodiscard]] bool checkpoint();
+	// The same pause and cancellation checkpoint, for the executor's helper threads: safe to call from any number of
+	// them at once, for it leaves the progress tracker alone - the executor's own thread accounts any pause at its next
+	// checkpoint().
+	[[nodiscard]] bool concurrentCheckpoint() const;
 
 	// The one decision entry point. Builds the DecisionRequest from the normative table, consults the
 	// remembered table first (only when remainingMatchingScopeAllowed), forwards to the decision provider
@@ -97,7 +117,7 @@ public:
 	void addCompletedItems(const size_t count) noexcept { _accumulatedSummary.completedItems += count; }
 	void addSkippedItems(const size_t count) noexcept { _accumulatedSummary.skippedItems += count; }
 	void addAlreadySatisfiedItems(const size_t count) noexcept { _accumulatedSummary.alreadySatisfiedItems += count; }
-	void addTransferredBytes(const uint64_t bytes) noexcept { _accumulatedSummary.transferredBytes += bytes; }
+	void addTransferredBytes(uint64_t bytes, CopyBackend backend) noexcept;
 
 	// Failed items are counted by recordFailure: every originating failed item records exactly one
 	// terminal diagnostic, and propagated parent outcomes record none.
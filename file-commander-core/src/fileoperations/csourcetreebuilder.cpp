@@ -5,9 +5,25 @@
 
 #include "assert/advanced_assert.h"
 #include "lang/utils.hpp" // mv()
+#include "threading/cthreadpool.h"
 #include "utility/on_scope_exit.hpp"
 
+#ifndef _WIN32
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
 
 namespace
 {
@@ -26,54 +42,72 @@ struct SourceTreeBuildLimits
 constexpr SourceTreeBuildLimits productionLimits{ .maximumDepth = 300, .maximumNodeCount = 2'000'000 };
 constexpr size_t directoryChildrenPerCheckpoint = 64;
 
-struct BuildState
+// Directory listings in flight at once. Each mostly waits on the filesystem - on a network share, for a round trip
+// per request - so several overlap well even on one disk.
+constexpr size_t concurrentDirectoryScans = 8;
+// How long the build thread waits for a listing before it runs a checkpoint anyway
+constexpr std::chrono::milliseconds checkpointWhileWaiting{ 100 };
+
+// A directory of the manifest whose scan has been requested. Children point at their parent, so the active branch
+// above any directory is a walk up the chain.
+struct PendingDirectory
 {
-	COperationExecutionContext& context;
-	const SourceTreeBuildMode mode;
-	const SourceTreeBuildLimits limits;
-	size_t discoveredCount = 0;
-	// Materializing copy/copy-based-move scans are the only mode that follows directory links and populates this
-	// cycle history. Only the current DFS branch matters. Pairing entry and mount identities lets a link reach the
-	// same underlying Linux inode through another bind-mounted view, whose descendant mounts may differ, exactly once;
-	// reaching the same entry through the same view is a genuine cycle. Keeping these keys off SourceNode also avoids
-	// any per-manifest-node storage cost.
-	std::vector<DirectoryTraversalIdentity> activeBranchTraversalIdentities;
-
-	// Why buildNode() returned BuildStopped; exactly one is set on termination.
-	std::optional<OperationDiagnostic> failure;
-	bool cancelled = false;
+	SourceNode* node; // Its place in the manifest: the root, or a slot in the parent's children reserved up front
+	PendingDirectory* parent;
+	size_t depth;
+	// Materializing copy/copy-based-move scans are the only mode that follows directory links and fills this in: the
+	// directory's own identity, or a followed link's target's. Only the branch above a directory matters to its cycle
+	// detection. Pairing entry and mount identities lets a link reach the same underlying Linux inode through another
+	// bind-mounted view, whose descendant mounts may differ, exactly once; reaching the same entry through the same view
+	// is a genuine cycle. Keeping these keys off SourceNode also avoids any per-manifest-node storage cost.
+	std::optional<DirectoryTraversalIdentity> traversalIdentity;
+	size_t unfinishedChildren = 0; // Subdirectories whose own subtree is not complete yet
+	bool scanned = false;
 };
 
-enum class NodePosition
+// One entry of a directory listing, classified as far as the entry itself tells; links are left to the caller.
+struct ListedChild
 {
-	Root,
-	Child
+	thin_io::native_string name;
+	OperationEntryKind kind = OperationEntryKind::Unknown; // FileLink or DirectoryLink for any link: the link entry's own directory-ness
+	uint64_t size = 0;
+	std::optional<NativeErrorCode> inspectionError; // The entry's own inspection failed, or found it gone
 };
 
-struct ChildVanished {};
-struct BuildStopped {};
-using BuildNodeResult = std::variant<SourceNode, ChildVanished, BuildStopped>;
+// A materialized directory link's target: whether there is one, and its traversal identity if the filesystem has one.
+struct LinkTarget
+{
+	bool exists = false;
+	std::optional<DirectoryTraversalIdentity> identity;
+};
 
-void publishScanProgress(BuildState& state, const CEntryPath& currentEntry)
+struct ScannedChild
 {
-	ProgressSnapshot snapshot;
-	snapshot.phase = OperationPhase::Scanning;
-	snapshot.currentEntry = currentEntry;
-	snapshot.itemsProcessed = state.discoveredCount;
-	state.context.publishProgress(snapshot); // Totals stay absent: a partial aggregate must not look exact
-}
+	EntrySnapshot entry;
+	LinkTarget linkTarget; // DirectoryLink in a materializing scan only
+};
 
-void failBuild(BuildState& state, EntrySnapshot failedEntry, CFileSystemError error)
+struct ScanRequest
 {
-	state.failure = OperationDiagnostic{ FailureDetails{ FailedAction::InspectSource, mv(error) }, mv(failedEntry), {} };
-}
+	PendingDirectory* directory;
+	EntrySnapshot entry; // The scanner's own copy: the manifest is only ever touched by the build thread
+};
 
-bool buildCancelledAtCheckpoint(BuildState& state)
+// What a scanner found in one directory, for the build thread to add to the manifest.
+struct DirectoryScan
 {
-	if (state.context.checkpoint())
-		return false;
-	state.cancelled = true;
-	return true;
+	PendingDirectory* directory;
+	std::optional<DirectoryTraversalIdentity> traversalIdentity; // A real directory's own, in a materializing scan
+	std::vector<ScannedChild> children; // In name order
+	// The directory could not be scanned; children are then meaningless. vanished: the listing found nothing at the path.
+	std::optional<OperationDiagnostic> failure;
+	bool vanished = false;
+	bool cancelled = false; // Stopped at the scanner's checkpoint before the listing; nothing else is set
+};
+
+OperationDiagnostic scanFailure(EntrySnapshot failedEntry, CFileSystemError error)
+{
+	return OperationDiagnostic{ FailureDetails{ FailedAction::InspectSource, mv(error) }, mv(failedEntry), {} };
 }
 
 CFileSystemError unrepresentableSourceNameError()
@@ -92,236 +126,553 @@ CFileSystemError sourceTreeNodeLimitError()
 	return { FileErrorCategory::Unsupported, 0, QStringLiteral("The source tree contains too many entries to process safely") };
 }
 
-// Classifies one listed child into a snapshot. nullopt without a recorded failure means the entry
-// vanished between the listing and its inspection - a race, the child is simply not part of the tree.
-std::optional<EntrySnapshot> classifyChild(BuildState& state, CEntryPath childPath, const thin_io::directory_entry& listed)
+#ifndef _WIN32
+OperationEntryKind entryKindOfMode(const mode_t mode) noexcept
+{
+	if (S_ISLNK(mode))
+		return OperationEntryKind::FileLink; // A symlink is never itself a directory; unlink() removes it
+	if (S_ISDIR(mode))
+		return OperationEntryKind::Directory;
+	if (S_ISREG(mode))
+		return OperationEntryKind::RegularFile;
+	return OperationEntryKind::Other;
+}
+#endif
+
+// Lists the directory, following it if it is a directory link. On POSIX every entry is inspected relative to the open
+// directory - fstatat() on its descriptor, only where the listed type alone does not do - so no child path is resolved
+// from the root again.
+std::expected<std::vector<ListedChild>, NativeErrorCode> listDirectory(const CEntryPath& directory)
 {
-	if (isLinkEntry(listed.attributes))
+	const auto native = thinIoPath(directory);
+#ifdef _WIN32
+	auto listing = thin_io::list_directory(nativeCStr(native));
+	if (!listing)
+		return std::unexpected(listing.error().native_code);
+
+	std::vector<ListedChild> children;
+	children.reserve(listing->size());
+	for (auto& listed : *listing)
+	{
+		ListedChild& child = children.emplace_back(ListedChild{ .name = mv(listed.name) });
+		const bool directoryEntry = listed.attributes.kind == thin_io::entry_kind::directory;
+		if (isLinkEntry(listed.attributes))
+			child.kind = directoryEntry ? OperationEntryKind::DirectoryLink : OperationEntryKind::FileLink;
+		else if (directoryEntry)
+			child.kind = OperationEntryKind::Directory;
+		else if (listed.attributes.kind == thin_io::entry_kind::regular_file)
+		{
+			assert_debug_only(listed.logical_size.has_value()); // Windows listings carry sizes
+			child.kind = OperationEntryKind::RegularFile;
+			child.size = listed.logical_size.value_or(0);
+		}
+		else
+			child.kind = OperationEntryKind::Other;
+	}
+	return children;
+#else
+	const int fd = ::open(nativeCStr(native), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0)
+		return std::unexpected(captureNativeError());
+
+	DIR* const stream = ::fdopendir(fd);
+	if (!stream)
+	{
+		const NativeErrorCode errorCode = captureNativeError();
+		::close(fd);
+		return std::unexpected(errorCode);
+	}
+	EXEC_ON_SCOPE_EXIT([stream] { ::closedir(stream); }); // Closes fd as well
+
+	std::vector<ListedChild> children;
+	for (;;)
 	{
-		if (state.mode == SourceTreeBuildMode::PermanentDelete)
+		errno = 0;
+		const dirent* const entry = ::readdir(stream);
+		if (!entry)
 		{
-			// Delete addresses the link entry itself; its own directory-ness selects the removal primitive.
-			const bool directoryEntry = listed.attributes.kind == thin_io::entry_kind::directory;
-			return EntrySnapshot{ mv(childPath), directoryEntry ? OperationEntryKind::DirectoryLink : OperationEntryKind::FileLink, 0 };
+			if (errno != 0)
+				return std::unexpected(captureNativeError());
+			return children;
 		}
+		if (::strcmp(entry->d_name, ".") == 0 || ::strcmp(entry->d_name, "..") == 0)
+			continue;
 
-		// Materialization needs the followed target's classification and size.
-		auto inspected = inspectEntry(childPath);
-		if (!inspected)
+		ListedChild& child = children.emplace_back(ListedChild{ .name = entry->d_name });
+		switch (entry->d_type)
 		{
-			// The diagnostic keeps the link's own kind: a directory link must not be reported as a file link.
-			const bool directoryEntry = listed.attributes.kind == thin_io::entry_kind::directory;
-			failBuild(state, EntrySnapshot{ mv(childPath), directoryEntry ? OperationEntryKind::DirectoryLink : OperationEntryKind::FileLink, 0 },
-				mv(inspected.error()));
-			return {};
+		case DT_DIR:
+			child.kind = OperationEntryKind::Directory;
+			break;
+		case DT_LNK:
+			child.kind = OperationEntryKind::FileLink;
+			break;
+		case DT_REG:
+			child.kind = OperationEntryKind::RegularFile;
+			break;
+		case DT_UNKNOWN: // Some filesystems never fill the type in
+			break;
+		default:
+			child.kind = OperationEntryKind::Other;
+			break;
 		}
-		if (!inspected->has_value())
-			return {};
-		return mv(**inspected);
+
+		// Listings carry no sizes
+		if (child.kind != OperationEntryKind::RegularFile && child.kind != OperationEntryKind::Unknown)
+			continue;
+
+		struct stat status;
+		if (::fstatat(fd, entry->d_name, &status, AT_SYMLINK_NOFOLLOW) != 0)
+		{
+			child.inspectionError = captureNativeError();
+			continue;
+		}
+		child.kind = entryKindOfMode(status.st_mode);
+		if (child.kind == OperationEntryKind::RegularFile)
+			child.size = static_cast<uint64_t>(status.st_size);
 	}
+#endif
+}
 
-	switch (listed.attributes.kind)
+// Classifies one listed child into a snapshot. nullopt means the entry vanished between the listing and its
+// inspection - a race, the child is simply not part of the tree.
+std::expected<std::optional<EntrySnapshot>, OperationDiagnostic> classifyChild(CEntryPath childPath, const ListedChild& listed,
+	const SourceTreeBuildMode mode)
+{
+	if (listed.inspectionError)
 	{
-	case thin_io::entry_kind::directory:
-		return EntrySnapshot{ mv(childPath), OperationEntryKind::Directory, 0 };
-	case thin_io::entry_kind::regular_file:
+		if (classifyNativeError(*listed.inspectionError) == FileErrorCategory::NotFound)
+			return std::nullopt;
+		return std::unexpected(scanFailure(EntrySnapshot{ mv(childPath), listed.kind, 0 }, makeFileSystemError(*listed.inspectionError)));
+	}
+
+	const bool link = listed.kind == OperationEntryKind::FileLink || listed.kind == OperationEntryKind::DirectoryLink;
+	// Delete addresses the link entry itself; its own directory-ness selects the removal primitive.
+	if (!link || mode == SourceTreeBuildMode::PermanentDelete)
+		return EntrySnapshot{ mv(childPath), listed.kind, listed.size };
+
+	// Materialization needs the followed target's classification and size.
+	auto inspected = inspectEntry(childPath);
+	if (!inspected)
 	{
-		uint64_t size = 0;
-		if (listed.logical_size)
-			size = *listed.logical_size;
+		// The diagnostic keeps the link's own kind: a directory link must not be reported as a file link.
+		return std::unexpected(scanFailure(EntrySnapshot{ mv(childPath), listed.kind, 0 }, mv(inspected.error())));
+	}
+	return mv(*inspected);
+}
+
+std::expected<LinkTarget, CFileSystemError> readLinkTarget(const CEntryPath& link, [[maybe_unused]] const SourceTreeBuildLimits& limits)
+{
+	auto targetTraversalIdentity = readDirectoryTraversalIdentity(link, thin_io::link_behavior::follow);
+#ifdef FILE_OPERATIONS_TEST_HOOKS
+	if (targetTraversalIdentity && limits.directoryLinkIdentityMode == DirectoryLinkIdentityModeForTesting::Unavailable)
+		targetTraversalIdentity = std::optional<DirectoryTraversalIdentity>{};
+#endif
+	if (!targetTraversalIdentity)
+	{
+		// A broken link stays a leaf entry. Any other failure aborts the build: silently materializing
+		// nothing from an unreadable target would make the copy falsely look complete.
+		if (targetTraversalIdentity.error().category == FileErrorCategory::NotFound)
+			return LinkTarget{};
+		return std::unexpected(mv(targetTraversalIdentity.error()));
+	}
+	return LinkTarget{ .exists = true, .identity = *targetTraversalIdentity };
+}
+
+// Everything a scanner does for one directory: its own traversal identity, the listing, and the classification of
+// each child. Runs on a scanner thread.
+void scanDirectory(DirectoryScan& scan, const EntrySnapshot& directory, const SourceTreeBuildMode mode, const SourceTreeBuildLimits& limits)
+{
+	if (directory.kind == OperationEntryKind::Directory && mode == SourceTreeBuildMode::MaterializingTransfer)
+	{
+		// Read before the children, so that a deeper directory link can recognize a return to this exact mounted view
+		// and stop before listing it again.
+		auto traversalIdentity = readDirectoryTraversalIdentity(directory.path, thin_io::link_behavior::follow);
+		if (!traversalIdentity)
+		{
+			// A vanished directory is reported by the listing below; anything else aborts the build.
+			if (traversalIdentity.error().category != FileErrorCategory::NotFound)
+			{
+				scan.failure = scanFailure(directory, mv(traversalIdentity.error()));
+				return;
+			}
+		}
 		else
+			scan.traversalIdentity = *traversalIdentity;
+		// Without stable object identity this directory cannot participate in early cycle detection. The fixed
+		// traversal limits still bound the scan; absence of the finer mount component alone uses object identity.
+	}
+
+	auto listing = listDirectory(directory.path);
+	if (!listing)
+	{
+		auto error = makeFileSystemError(listing.error());
+		scan.vanished = error.category == FileErrorCategory::NotFound;
+		scan.failure = scanFailure(directory, mv(error));
+		return;
+	}
+
+	// Name order makes the manifest the same however the scans of different directories interleave
+	std::ranges::sort(*listing, {}, &ListedChild::name);
+	scan.children.reserve(listing->size());
+	for (const ListedChild& listed : *listing)
+	{
+		const auto childName = decodeNativeNameLosslessly(listed.name);
+		if (!childName)
+		{
+			// The parent is the narrowest path that can be named faithfully. Never manufacture a child
+			// path: it could alias a different entry after the lossy decode/encode round trip.
+			scan.failure = scanFailure(directory, unrepresentableSourceNameError());
+			return;
+		}
+
+		auto childEntry = classifyChild(directory.path.child(*childName), listed, mode);
+		if (!childEntry)
 		{
-			// POSIX listings carry no sizes
-			const auto native = thinIoPath(childPath);
-			const auto metadata = thin_io::get_entry_metadata(nativeCStr(native), thin_io::link_behavior::do_not_follow);
-			if (!metadata)
+			scan.failure = mv(childEntry.error());
+			return;
+		}
+		if (!childEntry->has_value())
+			continue; // Vanished between listing and classification
+
+		ScannedChild& child = scan.children.emplace_back(ScannedChild{ .entry = mv(**childEntry) });
+		if (child.entry.kind == OperationEntryKind::DirectoryLink && mode == SourceTreeBuildMode::MaterializingTransfer)
+		{
+			auto linkTarget = readLinkTarget(child.entry.path, limits);
+			if (!linkTarget)
 			{
-				const auto code = metadata.error().native_code;
-				if (classifyNativeError(code) == FileErrorCategory::NotFound)
-					return {};
-				failBuild(state, EntrySnapshot{ mv(childPath), OperationEntryKind::RegularFile, 0 }, makeFileSystemError(code));
-				return {};
+				scan.failure = scanFailure(child.entry, mv(linkTarget.error()));
+				return;
 			}
-			size = metadata->logical_size;
+			child.linkTarget = mv(*linkTarget);
 		}
-		return EntrySnapshot{ mv(childPath), OperationEntryKind::RegularFile, size };
 	}
-	default:
-		return EntrySnapshot{ mv(childPath), OperationEntryKind::Other, 0 };
+}
+
+// Scans requested directories on the "Source tree scanner pool" threads, up to concurrentDirectoryScans at a time. The
+// scanners never touch the manifest: a request carries everything a scan needs, and the build thread collects the
+// results. Each scan passes the job's pause and cancellation checkpoint before its listing, as the build thread does
+// before requesting it: a paused job lists nothing more.
+class DirectoryScanners
+{
+public:
+	DirectoryScanners(const COperationExecutionContext& context, const SourceTreeBuildMode mode, const SourceTreeBuildLimits& limits) :
+		_context{ context },
+		_mode{ mode },
+		_limits{ limits }
+	{}
+
+	// Drops the queued requests; the scans in flight finish first, and their results with them
+	~DirectoryScanners()
+	{
+		_stopping = true;
+		if (_pool)
+			_pool->finishAllThreads(true);
+	}
+
+	DirectoryScanners(const DirectoryScanners&) = delete;
+	DirectoryScanners& operator=(const DirectoryScanners&) = delete;
+
+	void request(ScanRequest request)
+	{
+		if (!_pool)
+			_pool = std::make_unique<CThreadPool>(concurrentDirectoryScans, "Source tree scanner pool");
+
+		_pool->enqueue([this, request = mv(request)] {
+			if (_stopping)
+				return;
+
+			DirectoryScan result = perform(request);
+			std::lock_guard lock{ _mutex };
+			_scans.push_back(mv(result));
+			_finished.notify_one();
+		});
+	}
+
+	// The next finished scan; nullopt if none finished within the timeout
+	[[nodiscard]] std::optional<DirectoryScan> next(const std::chrono::milliseconds timeout)
+	{
+		std::unique_lock lock{ _mutex };
+		if (!_finished.wait_for(lock, timeout, [this] { return !_scans.empty(); }))
+			return std::nullopt;
+
+		DirectoryScan result = mv(_scans.front());
+		_scans.pop_front();
+		return result;
+	}
+
+private:
+	[[nodiscard]] DirectoryScan perform(const ScanRequest& request) const
+	{
+		DirectoryScan result{ .directory = request.directory };
+		if (!_context.concurrentCheckpoint())
+			result.cancelled = true;
+		else
+			scanDirectory(result, request.entry, _mode, _limits);
+		return result;
 	}
+
+private:
+	const COperationExecutionContext& _context;
+	const SourceTreeBuildMode _mode;
+	const SourceTreeBuildLimits _limits;
+
+	std::mutex _mutex;
+	std::condition_variable _finished;
+	std::deque<DirectoryScan> _scans; // Guarded by _mutex
+	std::atomic<bool> _stopping = false;
+
+	std::unique_ptr<CThreadPool> _pool; // Last: finished before anything its tasks use goes away; created by the first request
+};
+
+struct BuildState
+{
+	COperationExecutionContext& context;
+	const SourceTreeBuildMode mode;
+	const SourceTreeBuildLimits limits;
+	size_t discoveredCount = 0;
+	std::deque<PendingDirectory> directories; // Never moved: scans and subdirectories point into it
+	size_t scansOutstanding = 0;
+
+	// Why the build stopped; exactly one is set on termination.
+	std::optional<OperationDiagnostic> failure;
+	bool cancelled = false;
+
+	// Last: stopped before anything its scans point at goes away
+	DirectoryScanners scanners{ context, mode, limits };
+};
+
+void publishScanProgress(BuildState& state, const CEntryPath& currentEntry)
+{
+	ProgressSnapshot snapshot;
+	snapshot.phase = OperationPhase::Scanning;
+	snapshot.currentEntry = currentEntry;
+	snapshot.itemsProcessed = state.discoveredCount;
+	state.context.publishProgress(snapshot); // Totals stay absent: a partial aggregate must not look exact
+}
+
+void failBuild(BuildState& state, EntrySnapshot failedEntry, CFileSystemError error)
+{
+	state.failure = scanFailure(mv(failedEntry), mv(error));
+}
+
+bool buildCancelledAtCheckpoint(BuildState& state)
+{
+	if (state.context.checkpoint())
+		return false;
+	state.cancelled = true;
+	return true;
 }
 
-// Recursive DFS producing one immutable node. A vanished child is recoverable by its parent; a stopped
-// build has recorded either a failure or cancellation in state.
-BuildNodeResult buildNode(BuildState& state, EntrySnapshot entry, const SourceOwnership ownership, const NodePosition position, const size_t depth)
+// Counts one entry into the manifest against the limits. false: the build stopped.
+bool discoverEntry(BuildState& state, const EntrySnapshot& entry, const size_t depth)
 {
 	if (depth > state.limits.maximumDepth)
 	{
-		failBuild(state, mv(entry), sourceTreeDepthLimitError());
-		return BuildStopped{};
+		failBuild(state, entry, sourceTreeDepthLimitError());
+		return false;
 	}
 	if (state.discoveredCount >= state.limits.maximumNodeCount)
 	{
-		failBuild(state, mv(entry), sourceTreeNodeLimitError());
-		return BuildStopped{};
+		failBuild(state, entry, sourceTreeNodeLimitError());
+		return false;
 	}
 
-	const size_t activeIdentityCountOnEntry = state.activeBranchTraversalIdentities.size();
-	// A frame owns every branch traversal identity added beneath it. Restore the incoming depth on every exit,
-	// including cancellation, failure, and a recoverable child disappearance.
-	EXEC_ON_SCOPE_EXIT([&state, activeIdentityCountOnEntry] {
-		assert_debug_only(state.activeBranchTraversalIdentities.size() >= activeIdentityCountOnEntry);
-		while (state.activeBranchTraversalIdentities.size() > activeIdentityCountOnEntry)
-			state.activeBranchTraversalIdentities.pop_back();
-	});
-
 	++state.discoveredCount;
 	publishScanProgress(state, entry.path);
+	return true;
+}
 
-	SourceNode node{ .entry = mv(entry), .ownership = ownership };
+// Whether a directory link's target is already being traversed above the link: through the same mounted view, it
+// could only duplicate that view's content or recurse forever.
+bool onActiveBranch(const PendingDirectory* directory, const DirectoryTraversalIdentity& identity)
+{
+	for (; directory; directory = directory->parent)
+	{
+		if (directory->traversalIdentity == identity)
+			return true;
+	}
+	return false;
+}
+
+bool descendsInto(const BuildState& state, const PendingDirectory* parent, const OperationEntryKind kind, const LinkTarget& linkTarget)
+{
+	if (kind == OperationEntryKind::Directory)
+		return true;
+	if (kind != OperationEntryKind::DirectoryLink || state.mode != SourceTreeBuildMode::MaterializingTransfer || !linkTarget.exists)
+		return false;
 
-	bool descend = false;
-	if (node.entry.kind == OperationEntryKind::Directory)
+	// Identity is an optimization for terminating cycles early, not a prerequisite for correct materialization:
+	// the depth and node-count limits bound an identity-less cycle before execution. The same object reached through
+	// another mounted view is intentionally not a match: on Linux a bind mount can expose different descendant mounts,
+	// so that namespace view has content still worth scanning. Once that view itself appears again on the branch, the
+	// complete key matches and terminates it.
+	return !linkTarget.identity || !onActiveBranch(parent, *linkTarget.identity);
+}
+
+// Hands the directory's scan to the scanners. false: cancelled at the checkpoint before it.
+bool requestScan(BuildState& state, SourceNode& node, PendingDirectory* parent, const size_t depth, std::optional<DirectoryTraversalIdentity> linkTargetIdentity)
+{
+	if (buildCancelledAtCheckpoint(state))
+		return false;
+
+	PendingDirectory& directory = state.directories.emplace_back(PendingDirectory{
+		.node = &node, .parent = parent, .depth = depth, .traversalIdentity = mv(linkTargetIdentity) });
+	if (parent)
+		++parent->unfinishedChildren;
+	++state.scansOutstanding;
+	state.scanners.request(ScanRequest{ .directory = &directory, .entry = node.entry });
+	return true;
+}
+
+void totalUp(SourceNode& node)
+{
+	// A subdirectory that vanished before its listing was never totalled up, and is not part of the tree
+	std::erase_if(node.children, [](const SourceNode& child) { return child.subtreeItems == 0; });
+
+	node.subtreeBytes = node.entry.size;
+	node.subtreeItems = 1;
+	for (const SourceNode& child : node.children)
 	{
-		descend = true;
-		if (state.mode == SourceTreeBuildMode::MaterializingTransfer)
-		{
-			// Register every real directory on the active branch before scanning its children. A deeper directory
-			// link can then recognize a return to this exact mounted view and stop before listing it again.
-			const auto traversalIdentity = readDirectoryTraversalIdentity(node.entry.path, thin_io::link_behavior::follow);
-			if (!traversalIdentity)
-			{
-				// A vanished directory is reported by the listing below; anything else aborts the build.
-				if (traversalIdentity.error().category != FileErrorCategory::NotFound)
-				{
-					failBuild(state, node.entry, traversalIdentity.error());
-					return BuildStopped{};
-				}
-			}
-			else if (*traversalIdentity)
-				state.activeBranchTraversalIdentities.push_back(**traversalIdentity);
-			// Without stable object identity this directory cannot participate in early cycle detection. The fixed
-			// traversal limits still bound the scan; absence of the finer mount component alone uses object identity.
-		}
+		node.subtreeBytes += child.subtreeBytes;
+		node.subtreeItems += child.subtreeItems;
+	}
+}
+
+// Totals up a directory whose subtree is complete, and then each enclosing directory that this completes in turn.
+void completeDirectory(PendingDirectory& directory, const bool vanished)
+{
+	if (!vanished)
+		totalUp(*directory.node);
+
+	for (PendingDirectory* parent = directory.parent; parent; parent = parent->parent)
+	{
+		assert_debug_only(parent->unfinishedChildren > 0);
+		if (--parent->unfinishedChildren != 0 || !parent->scanned)
+			return;
+		totalUp(*parent->node);
 	}
-	else if (node.entry.kind == OperationEntryKind::DirectoryLink && state.mode == SourceTreeBuildMode::MaterializingTransfer)
+}
+
+// Adds a finished scan's children to the manifest, requesting the scans of those to descend into. false: the build stopped.
+bool addScan(BuildState& state, DirectoryScan& scan)
+{
+	PendingDirectory& directory = *scan.directory;
+	if (scan.cancelled)
 	{
-		auto targetTraversalIdentity = readDirectoryTraversalIdentity(node.entry.path, thin_io::link_behavior::follow);
-#ifdef FILE_OPERATIONS_TEST_HOOKS
-		if (targetTraversalIdentity && state.limits.directoryLinkIdentityMode == DirectoryLinkIdentityModeForTesting::Unavailable)
-			targetTraversalIdentity = std::optional<DirectoryTraversalIdentity>{};
-#endif
-		if (!targetTraversalIdentity)
-		{
-			// A broken link stays a leaf entry. Any other failure aborts the build: silently materializing
-			// nothing from an unreadable target would make the copy falsely look complete.
-			if (targetTraversalIdentity.error().category != FileErrorCategory::NotFound)
-			{
-				failBuild(state, node.entry, targetTraversalIdentity.error());
-				return BuildStopped{};
-			}
-		}
-		else if (*targetTraversalIdentity)
-		{
-			// The same object reached through another mounted view is intentionally not a match: on Linux a bind
-			// mount can expose different descendant mounts, so that namespace view has content still worth scanning.
-			// Once that view itself appears again on the active branch, the complete key matches and terminates it.
-			if (std::find(state.activeBranchTraversalIdentities.begin(), state.activeBranchTraversalIdentities.end(), **targetTraversalIdentity)
-				== state.activeBranchTraversalIdentities.end())
-			{
-				descend = true;
-				state.activeBranchTraversalIdentities.push_back(**targetTraversalIdentity);
-			}
-			// A target already on the recursion path through the same mounted view stays a leaf: traversing it
-			// again could only duplicate that view's content or recurse forever.
-		}
-		else
+		state.cancelled = true;
+		return false;
+	}
+	if (scan.failure)
+	{
+		// Only a child directory may vanish from the tree; a root that has gone remains a failure
+		if (scan.vanished && directory.parent)
 		{
-			// Identity is an optimization for terminating cycles early, not a prerequisite for correct
-			// materialization. The depth and node-count limits bound an identity-less cycle before execution.
-			descend = true;
+			completeDirectory(directory, true);
+			return true;
 		}
+		state.failure = mv(scan.failure);
+		return false;
 	}
+	if (buildCancelledAtCheckpoint(state))
+		return false;
 
-	if (descend)
-	{
-		if (buildCancelledAtCheckpoint(state))
-			return BuildStopped{};
+	SourceNode& node = *directory.node;
+	if (scan.traversalIdentity)
+		directory.traversalIdentity = scan.traversalIdentity;
 
-		const auto native = thinIoPath(node.entry.path);
-		const auto listing = thin_io::list_directory(nativeCStr(native));
-		if (!listing)
+	const bool borrowedChildren = node.ownership == SourceOwnership::BorrowedThroughDirectoryLink || node.entry.kind == OperationEntryKind::DirectoryLink;
+	const SourceOwnership childOwnership = borrowedChildren ? SourceOwnership::BorrowedThroughDirectoryLink : SourceOwnership::Owned;
+
+	// Never grown past this: the scans requested below point into it. The node budget runs out before it could be.
+	const size_t remainingNodeBudget = state.limits.maximumNodeCount - state.discoveredCount;
+	node.children.reserve(std::min(scan.children.size(), remainingNodeBudget));
+	size_t childrenSinceCheckpoint = 0;
+	for (ScannedChild& child : scan.children)
+	{
+		if (childrenSinceCheckpoint == directoryChildrenPerCheckpoint)
 		{
-			auto error = makeFileSystemError(listing.error().native_code);
-			if (position == NodePosition::Child && error.category == FileErrorCategory::NotFound)
-				return ChildVanished{};
-			failBuild(state, node.entry, mv(error));
-			return BuildStopped{};
+			if (buildCancelledAtCheckpoint(state))
+				return false;
+			childrenSinceCheckpoint = 0;
 		}
-		if (buildCancelledAtCheckpoint(state))
-			return BuildStopped{};
+		++childrenSinceCheckpoint;
 
-		const bool borrowedChildren = ownership == SourceOwnership::BorrowedThroughDirectoryLink || node.entry.kind == OperationEntryKind::DirectoryLink;
-		const SourceOwnership childOwnership = borrowedChildren ? SourceOwnership::BorrowedThroughDirectoryLink : SourceOwnership::Owned;
+		if (!discoverEntry(state, child.entry, directory.depth + 1))
+			return false;
 
-		const size_t remainingNodeBudget = state.limits.maximumNodeCount - state.discoveredCount;
-		node.children.reserve(std::min(listing->size(), remainingNodeBudget));
-		size_t childrenSinceCheckpoint = 0;
-		for (const auto& listed : *listing)
+		assert_debug_only(node.children.size() < node.children.capacity());
+		SourceNode& childNode = node.children.emplace_back(SourceNode{ .entry = mv(child.entry), .ownership = childOwnership });
+		if (!descendsInto(state, &directory, childNode.entry.kind, child.linkTarget))
 		{
-			if (childrenSinceCheckpoint == directoryChildrenPerCheckpoint)
-			{
-				if (buildCancelledAtCheckpoint(state))
-					return BuildStopped{};
-				childrenSinceCheckpoint = 0;
-			}
-			++childrenSinceCheckpoint;
+			childNode.subtreeBytes = childNode.entry.size;
+			childNode.subtreeItems = 1;
+		}
+		else if (!requestScan(state, childNode, &directory, directory.depth + 1, child.linkTarget.identity))
+			return false;
+	}
 
-			auto childName = decodeNativeNameLosslessly(listed.name);
-			if (!childName)
-			{
-				// The parent is the narrowest path that can be named faithfully. Never manufacture a child
-				// path: it could alias a different entry after the lossy decode/encode round trip.
-				failBuild(state, node.entry, unrepresentableSourceNameError());
-				return BuildStopped{};
-			}
+	directory.scanned = true;
+	if (directory.unfinishedChildren == 0)
+		completeDirectory(directory, false);
+	return true;
+}
 
-			auto childEntry = classifyChild(state, node.entry.path.child(*childName), listed);
-			if (!childEntry)
-			{
-				if (state.failure)
-					return BuildStopped{};
-				continue; // Vanished between listing and classification
-			}
+// Builds the tree into root. The build thread discovers every entry itself - in the limits, progress and checkpoints -
+// while the directory listings run concurrently on the scanners. false: the build stopped.
+bool buildTree(BuildState& state, SourceNode& root)
+{
+	if (!discoverEntry(state, root.entry, 1))
+		return false;
 
-			auto childResult = buildNode(state, mv(*childEntry), childOwnership, NodePosition::Child, depth + 1);
-			if (auto* childNode = std::get_if<SourceNode>(&childResult))
-				node.children.push_back(mv(*childNode));
-			else if (std::holds_alternative<BuildStopped>(childResult))
-				return BuildStopped{};
+	LinkTarget linkTarget;
+	if (root.entry.kind == OperationEntryKind::DirectoryLink && state.mode == SourceTreeBuildMode::MaterializingTransfer)
+	{
+		auto target = readLinkTarget(root.entry.path, state.limits);
+		if (!target)
+		{
+			failBuild(state, root.entry, mv(target.error()));
+			return false;
 		}
+		linkTarget = mv(*target);
 	}
 
-	node.subtreeBytes = node.entry.size;
-	node.subtreeItems = 1;
-	for (const SourceNode& child : node.children)
+	if (!descendsInto(state, nullptr, root.entry.kind, linkTarget))
 	{
-		node.subtreeBytes += child.subtreeBytes;
-		node.subtreeItems += child.subtreeItems;
+		root.subtreeBytes = root.entry.size;
+		root.subtreeItems = 1;
+		return true;
 	}
-	return node;
+
+	if (!requestScan(state, root, nullptr, 1, linkTarget.identity))
+		return false;
+	while (state.scansOutstanding > 0)
+	{
+		auto scan = state.scanners.next(checkpointWhileWaiting);
+		if (!scan)
+		{
+			if (buildCancelledAtCheckpoint(state))
+				return false;
+			continue;
+		}
+
+		--state.scansOutstanding;
+		if (!addScan(state, *scan))
+			return false;
+	}
+
+	assert_debug_only(root.subtreeItems != 0);
+	return true;
 }
 
 SourceTreeResult buildSourceTreeWithLimits(COperationExecutionContext& context, EntrySnapshot root, const SourceTreeBuildMode mode,
 	const SourceTreeBuildLimits limits)
 {
 	BuildState state{ .context = context, .mode = mode, .limits = limits };
-	auto result = buildNode(state, mv(root), SourceOwnership::Owned, NodePosition::Root, 1);
-	assert_debug_only(state.activeBranchTraversalIdentities.empty());
-	if (auto* tree = std::get_if<SourceNode>(&result))
-		return mv(*tree);
+	SourceNode tree{ .entry = mv(root), .ownership = SourceOwnership::Owned };
+	if (buildTree(state, tree))
+		return tree;
 
-	assert_debug_only(std::holds_alternative<BuildStopped>(result)); // A root is never a recoverable child disappearance
 	if (state.failure)
 		return mv(*state.failure);
 
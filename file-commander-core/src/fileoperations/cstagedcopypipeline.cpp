@@ -0,0 +1,175 @@
+#include "cstagedcopypipeline.h"
+#include "ccontenthasher.h"
+#include "cfilesystemmutator.h"
+#include "ctransferthrottle.h"
+#include "thiniobridge.h"
+
+#include "assert/advanced_assert.h"
+#include "lang/utils.hpp" // mv()
+
+#include <algorithm>
+#include <new>
+#include <system_error>
+
+void CStagedCopyPipeline::AlignedDelete::operator()(std::byte* buffer) const noexcept
+{
+	::operator delete[](buffer, std::align_val_t{ bufferAlignment });
+}
+
+std::unique_ptr<CStagedCopyPipeline> CStagedCopyPipeline::start(thin_io::file& source, const uint64_t sourceOffset, const uint64_t sourceSize, const TransferPriority priority)
+{
+	assert_debug_only(sourceOffset < sourceSize);
+
+	std::unique_ptr<CStagedCopyPipeline> pipeline{ new CStagedCopyPipeline{ sourceOffset, sourceSize, priority } };
+	pipeline->_source = mv(source);
+	try
+	{
+		pipeline->_reader.start([reader = pipeline.get()](const std::atomic<bool>&) { reader->readSource(); });
+	}
+	catch (const std::system_error&)
+	{
+		source = mv(pipeline->_source);
+		return nullptr;
+	}
+
+	return pipeline;
+}
+
+CStagedCopyPipeline::CStagedCopyPipeline(const uint64_t sourceOffset, const uint64_t sourceSize, const TransferPriority priority) :
+	_sourceOffset{ sourceOffset },
+	_sourceSize{ sourceSize },
+	_priority{ priority }
+{
+	for (Buffer& buffer : _ring)
+		buffer.data.reset(static_cast<std::byte*>(::operator new[](bufferSize, std::align_val_t{ bufferAlignment })));
+}
+
+CStagedCopyPipeline::~CStagedCopyPipeline()
+{
+	{
+		std::lock_guard lock{ _mutex };
+		_stopRequested = true;
+	}
+	_bufferDrained.notify_one();
+
+	_reader.join();
+
+	(void)_source.close(); // A read-side close failure puts no data at risk
+}
+
+std::expected<uint64_t, FailureDetails> CStagedCopyPipeline::drainInto(thin_io::file& staging, const uint64_t maxBytes, CContentHasher* const hasher)
+{
+	size_t filledBuffers = 0;
+	{
+		std::unique_lock lock{ _mutex };
+		_bufferFilled.wait(lock, [this] { return _filledBuffers > 0 || _readFailure.has_value(); });
+		if (_filledBuffers == 0)
+			return std::unexpected{ *_readFailure };
+
+		filledBuffers = _filledBuffers;
+	}
+
+	// Whatever the reader fills meanwhile is left for the next call, so that this one returns as soon as it can
+	uint64_t written = 0;
+	size_t drainedBuffers = 0;
+	while (written < maxBytes && drainedBuffers < filledBuffers)
+	{
+		const Buffer& buffer = _ring[_nextToDrain];
+		const uint64_t length = std::min(maxBytes - written, buffer.length - _drainedOfNext);
+		const auto result = staging.write(buffer.data.get() + _drainedOfNext, length);
+		if (!result) [[unlikely]]
+			return std::unexpected{ FailureDetails{ FailedAction::WriteDestination, makeFileSystemError(captureNativeError()) } };
+		else if (*result == 0) [[unlikely]]
+			break; // The session reports a write that makes no progress
+
+		if (hasher)
+			hasher->update(buffer.data.get() + _drainedOfNext, static_cast<size_t>(*result));
+		written += *result;
+		_drainedOfNext += *result;
+		if (_drainedOfNext == buffer.length)
+		{
+			_drainedOfNext = 0;
+			_nextToDrain = (_nextToDrain + 1) % bufferCount;
+			++drainedBuffers;
+		}
+	}
+
+	if (drainedBuffers > 0)
+	{
+		{
+			std::lock_guard lock{ _mutex };
+			_filledBuffers -= drainedBuffers;
+		}
+		_bufferDrained.notify_one();
+	}
+
+	return written;
+}
+
+void CStagedCopyPipeline::setPriority(const TransferPriority priority) noexcept
+{
+	_priority = priority;
+}
+
+void CStagedCopyPipeline::readSource() noexcept
+{
+	CTransferThrottle::applyPriorityToThisThread(_priority);
+	if (_sourceOffset > 0 && !_source.seek(_sourceOffset)) [[unlikely]]
+	{
+		const NativeErrorCode errorCode = captureNativeError();
+		std::lock_guard lock{ _mutex };
+		_readFailure = FailureDetails{ FailedAction::ReadSource, makeFileSystemError(errorCode) };
+		_bufferFilled.notify_one();
+		return;
+	}
+
+	uint64_t offset = _sourceOffset;
+	for (size_t next = 0; offset < _sourceSize; next = (next + 1) % bufferCount)
+	{
+		{
+			std::unique_lock lock{ _mutex };
+			_bufferDrained.wait(lock, [this] { return _filledBuffers < bufferCount || _stopRequested; });
+			if (_stopRequested)
+				return;
+		}
+
+		CTransferThrottle::applyPriorityToThisThread(_priority);
+
+		// Not guarded: the writer doesn't touch a buffer until it has been counted as filled
+		Buffer& buffer = _ring[next];
+		const uint64_t wanted = std::min(static_cast<uint64_t>(bufferSize), _sourceSize - offset);
+		buffer.length = 0;
+		std::optional<FailureDetails> failure;
+		while (buffer.length < wanted)
+		{
+			const auto result = _source.read(buffer.data.get() + buffer.length, wanted - buffer.length);
+			if (!result) [[unlikely]]
+			{
+				failure = FailureDetails{ FailedAction::ReadSource, makeFileSystemError(captureNativeError()) };
+				break;
+			}
+			else if (*result == 0) [[unlikely]] // It has shrunk since begin()
+			{
+				failure = FailureDetails{ FailedAction::ReadSource,
+					CFileSystemError{ FileErrorCategory::IoFailure, 0, QStringLiteral("The source ended before its size at the start of the copy") } };
+				break;
+			}
+
+			buffer.length += *result;
+		}
+
+		offset += buffer.length;
+		const bool failed = failure.has_value();
+		{
+			std::lock_guard lock{ _mutex };
+			// What was read before a failure is still written, the same as a sequential copy would have
+			if (buffer.length > 0)
+				++_filledBuffers;
+			_readFailure = mv(failure);
+		}
+		_bufferFilled.notify_one();
+
+		if (failed)
+			return;
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "fileoperationtypes.h"
+
+#include "file.hpp" // thin_io
+#include "threading/cinterruptablethread.h"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <expected>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdint.h>
+
+class CContentHasher;
+
+// The overlapped transfer of a CStagedFileCopy (CopyBackend::OverlappedWrite): a reader thread fills a ring of
+// aligned buffers from the source while the session's own thread drains them into the staging file, so that reading
+// one disk and writing another go on at the same time instead of taking turns. The reader is never more than the
+// ring ahead of the writer, and stops at the size the session captured - a pause or a cancellation between two
+// writeNext() calls only leaves it waiting for a free buffer. The reader does its I/O at the job's TransferPriority, like
+// the threads that pass the job's throttle.
+class CStagedCopyPipeline
+{
+public:
+	static constexpr size_t bufferCount = 4;
+	static constexpr size_t bufferSize = 1024 * 1024;
+	// A page, which is also enough for unbuffered I/O on any common device
+	static constexpr size_t bufferAlignment = 4096;
+
+	// Takes the source over and starts reading it from sourceOffset up to sourceSize; nullptr, leaving the source
+	// where it was, if the reader thread could not be started.
+	[[nodiscard]] static std::unique_ptr<CStagedCopyPipeline> start(thin_io::file& source, uint64_t sourceOffset, uint64_t sourceSize, TransferPriority priority);
+	// Stops the reader and closes the source
+	~CStagedCopyPipeline();
+
+	CStagedCopyPipeline(const CStagedCopyPipeline&) = delete;
+	CStagedCopyPipeline& operator=(const CStagedCopyPipeline&) = delete;
+
+	// Writes at most maxBytes of what the reader has brought in so far to the staging file, at its current position;
+	// only waits for the reader if it has nothing to hand over yet. A read failure is reported once everything that
+	// was read before it has been written. hasher, if set, is fed what was written, in order.
+	[[nodiscard]] std::expected<uint64_t, FailureDetails> drainInto(thin_io::file& staging, uint64_t maxBytes, CContentHasher* hasher = nullptr);
+	// Takes effect from the reader's next buffer on
+	void setPriority(TransferPriority priority) noexcept;
+
+private:
+	CStagedCopyPipeline(uint64_t sourceOffset, uint64_t sourceSize, TransferPriority priority);
+
+	void readSource() noexcept;
+
+	struct AlignedDelete {
+		void operator()(std::byte* buffer) const noexcept;
+	};
+
+	struct Buffer {
+		std::unique_ptr<std::byte[], AlignedDelete> data;
+		uint64_t length = 0;
+	};
+
+	thin_io::file _source;
+	const uint64_t _sourceOffset;
+	const uint64_t _sourceSize;
+	std::atomic<TransferPriority> _priority;
+
+	std::array<Buffer, bufferCount> _ring;
+	// The reader fills the buffers in ring order, and the writer drains them in the same order
+	size_t _nextToDrain = 0;
+	uint64_t _drainedOfNext = 0;
+
+	std::mutex _mutex;
+	std::condition_variable _bufferFilled;
+	std::condition_variable _bufferDrained;
+	size_t _filledBuffers = 0; // Guarded by _mutex, like the two below
+	std::optional<FailureDetails> _readFailure;
+	bool _stopRequested = false;
+
+	CInterruptableThread _reader{ "Staged copy reader" };
+};
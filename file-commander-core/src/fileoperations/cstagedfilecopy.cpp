@@ -1,5 +1,6 @@
 #include "cstagedfilecopy.h"
 #include "cfilesystemmutator.h"
+#include "cstagedcopypipeline.h"
 #include "operationtesthooks.h"
 #include "thiniobridge.h"
 
@@ -15,9 +16,18 @@ RESTORE_COMPILER_WARNINGS
 #include <Windows.h>
 #else
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/fs.h> // FICLONERANGE
+#include <sys/ioctl.h>
 #endif
 
 #include <algorithm>
+#include <utility>
 
 using OperationTestHooks::fireHook;
 using OperationTestHooks::Point;
@@ -57,69 +67,149 @@ bool isUnsupportedPreallocationError(const NativeErrorCode code) noexcept
 #endif
 }
 
-} // namespace
+// Whether the staging file is on another volume than the source - that is, whether reading the one and writing the
+// other can overlap rather than contend for the same device. False if it can't be told.
+bool isOnAnotherDevice(const CEntryPath& source, const CEntryPath& staging)
+{
+#ifdef _WIN32
+	const auto volumeOf = [](const CEntryPath& path) {
+		const auto native = thinIoPath(path);
+		std::wstring volume(MAX_PATH + 1, L'\0');
+		if (!::GetVolumePathNameW(nativeCStr(native), volume.data(), static_cast<DWORD>(volume.size())))
+			return std::wstring{};
+		volume.resize(::wcslen(volume.c_str()));
+		return volume;
+	};
+
+	const std::wstring sourceVolume = volumeOf(source);
+	const std::wstring stagingVolume = volumeOf(staging);
+	return !sourceVolume.empty() && !stagingVolume.empty() && ::_wcsicmp(sourceVolume.c_str(), stagingVolume.c_str()) != 0;
+#else
+	struct stat sourceInfo, stagingInfo;
+	const auto sourceNative = thinIoPath(source);
+	const auto stagingNative = thinIoPath(staging);
+	return ::stat(nativeCStr(sourceNative), &sourceInfo) == 0 && ::stat(nativeCStr(stagingNative), &stagingInfo) == 0
+		&& sourceInfo.st_dev != stagingInfo.st_dev;
+#endif
+}
 
-std::expected<CStagedFileCopy, StagedCopyBeginFailure> CStagedFileCopy::begin(CEntryPath source, CEntryPath destination)
+// length bytes from offset on; false if the file ends before, or can't be read
+bool readFully(thin_io::file& file, const uint64_t offset, std::byte* const buffer, const uint64_t length)
 {
-	assert_debug_only(!destination.isRoot());
+	if (!file.seek(offset))
+		return false;
 
-	thin_io::file sourceFile;
+	for (uint64_t done = 0; done < length;)
 	{
-		const auto sourceNative = thinIoPath(source);
-		if (!sourceFile.open(nativeCStr(sourceNative), thin_io::file::access_mode::Read)) [[unlikely]]
-			return failBegin(FailedAction::ReadSource, captureNativeError());
+		const auto read = file.read(buffer + done, length - done);
+		if (!read || *read == 0)
+			return false;
+		done += *read;
 	}
+	return true;
+}
 
-#ifndef _WIN32
-	const auto sourceIsRegularFile = sourceFile.is_regular_file();
-	if (!sourceIsRegularFile) [[unlikely]]
-		return failBegin(FailedAction::ReadSource, captureNativeError());
-	if (!*sourceIsRegularFile) [[unlikely]]
+#ifdef __linux__
+// A second descriptor onto a file the session already has open through thin_io, or -1. It is opened by the same
+// path right after, and checked to be a regular file of the captured size; anything else leaves the session to
+// the mapped write, which only uses the thin_io handles.
+int openKernelDescriptor(const CEntryPath& path, const int flags, const uint64_t expectedSize) noexcept
+{
+	const auto native = thinIoPath(path);
+	const int fd = ::open(nativeCStr(native), flags | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	struct stat info;
+	if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || static_cast<uint64_t>(info.st_size) != expectedSize)
 	{
-		return failBegin(FailureDetails{ FailedAction::ReadSource,
-			CFileSystemError{ FileErrorCategory::Unsupported, 0, QStringLiteral("The opened source is not a regular file") } });
+		::close(fd);
+		return -1;
 	}
-#endif
 
-	// Metadata comes from the open handle - provably the same effective file that supplies the bytes,
-	// even when the source path is a link being materialized.
-	thin_io::entry_times sourceTimes;
-	thin_io::file_permissions sourcePermissions;
-	if (const auto forcedError = fireHook(Point::StagedCopy_CaptureMetadata_Native))
-		return failBegin(FailedAction::PreserveFileMetadata, *forcedError);
+	return fd;
+}
 
-	if (const auto times = sourceFile.times(); times) [[likely]]
-		sourceTimes = *times;
-	else
-		return failBegin(FailedAction::PreserveFileMetadata, captureNativeError());
-	sourceTimes.last_access.reset(); // Never transferred: reading the source for this copy already changed it
+// The filesystem or the kernel cannot copy between these two files, as opposed to the copy having gone wrong.
+bool isUnsupportedKernelCopyError(const int code) noexcept
+{
+	return code == ENOSYS || code == EOPNOTSUPP || code == EXDEV || code == EINVAL || code == EBADF;
+}
 
-	if (const auto permissions = sourceFile.permissions(); permissions) [[likely]]
-		sourcePermissions = *permissions;
-	else
-		return failBegin(FailedAction::PreserveFileMetadata, captureNativeError());
+// An unnamed file in the directory (O_TMPFILE), with the staging handle opened onto it through /proc. The descriptor
+// returned is what keeps it alive until publication links it in.
+std::expected<std::pair<int, CEntryPath>, NativeErrorCode> createAnonymousStaging(const CEntryPath& directory, thin_io::file& stagingFile)
+{
+	const auto directoryNative = thinIoPath(directory);
+	const int fd = ::open(nativeCStr(directoryNative), O_TMPFILE | O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR);
+	if (fd < 0)
+		return std::unexpected{ captureNativeError() };
 
-	uint64_t sourceSize = 0;
-	if (const auto size = sourceFile.size(); size) [[likely]]
-		sourceSize = *size;
-	else
-		return failBegin(FailedAction::ReadSource, captureNativeError());
+	// Without /proc there is no path to open it by, nor to publish it with
+	if (auto path = parseOperationPath(QStringLiteral("/proc/self/fd/") % QString::number(fd)))
+	{
+		const auto pathNative = thinIoPath(*path);
+		if (stagingFile.open(nativeCStr(pathNative), thin_io::file::access_mode::Write))
+			return std::pair{ fd, mv(*path) };
+	}
+
+	::close(fd);
+	return std::unexpected{ NativeErrorCode{ EOPNOTSUPP } };
+}
+
+// This kernel or filesystem has no unnamed files, as opposed to the directory refusing a new file. A kernel that
+// predates O_TMPFILE takes it for O_DIRECTORY, and fails opening the directory for writing.
+bool isUnsupportedAnonymousStagingError(const NativeErrorCode code) noexcept
+{
+	return code == EOPNOTSUPP || code == EISDIR || code == EINVAL || code == ENOSYS;
+}
+#endif
+
+} // namespace
+
+std::expected<CStagedFileCopy, StagedCopyBeginFailure> CStagedFileCopy::begin(CEntryPath source, CEntryPath destination, const CopyBackend firstBackend,
+	const PageCachePolicy cachePolicy, const CopyVerification verification, [[maybe_unused]] const StagingLifetime lifetime)
+{
+	assert_debug_only(!destination.isRoot());
+
+	auto captured = openSource(source);
+	if (!captured) [[unlikely]]
+		return failBegin(mv(captured.error()));
+	auto& [sourceFile, sourceTimes, sourcePermissions, sourceSize] = *captured;
 
 	// The exclusive create is the collision check; a (vanishingly unlikely) name collision just means
-	// another attempt with a fresh unique name.
+	// another attempt with a fresh unique name. On Linux the first attempt is an unnamed file, which has no name to
+	// collide with, and the named ones are only for where that is not supported - or for a resumable session, whose
+	// staging file must outlive it.
 	std::optional<CEntryPath> stagingPath;
 	thin_io::file stagingFile;
+	int anonymousStagingFd = -1;
 	static constexpr int maxCreationAttempts = 10;
 	for (int attempt = 0; attempt < maxCreationAttempts; ++attempt)
 	{
-		CEntryPath candidate = destination.parent().child(
-			QStringLiteral(".file-commander-copy-") % QUuid::createUuid().toString(QUuid::WithoutBraces) % QStringLiteral(".tmp"));
-
+#ifdef __linux__
+		const bool anonymous = attempt == 0 && lifetime == StagingLifetime::Session;
+#endif
 		NativeErrorCode errorCode;
 		if (const auto forcedError = fireHook(Point::StagedCopy_CreateStaging_Native))
 			errorCode = *forcedError;
+#ifdef __linux__
+		else if (anonymous)
+		{
+			auto created = createAnonymousStaging(destination.parent(), stagingFile);
+			if (created)
+			{
+				anonymousStagingFd = created->first;
+				stagingPath = mv(created->second);
+				break;
+			}
+			errorCode = created.error();
+		}
+#endif
 		else
 		{
+			CEntryPath candidate = destination.parent().child(
+				QStringLiteral(".file-commander-copy-") % QUuid::createUuid().toString(QUuid::WithoutBraces) % QStringLiteral(".tmp"));
 			const auto candidateNative = thinIoPath(candidate);
 			if (stagingFile.open(nativeCStr(candidateNative), thin_io::file::access_mode::Write, thin_io::file::open_disposition::CreateNew))
 			{
@@ -129,6 +219,10 @@ std::expected<CStagedFileCopy, StagedCopyBeginFailure> CStagedFileCopy::begin(CE
 			errorCode = captureNativeError();
 		}
 
+#ifdef __linux__
+		if (anonymous && isUnsupportedAnonymousStagingError(errorCode))
+			continue;
+#endif
 		if (classifyNativeError(errorCode) != FileErrorCategory::AlreadyExists)
 			return failBegin(FailedAction::PrepareStagingFile, errorCode);
 	}
@@ -144,34 +238,190 @@ std::expected<CStagedFileCopy, StagedCopyBeginFailure> CStagedFileCopy::begin(CE
 
 	const auto failAndDiscardStaging = [&](const FailedAction action, const NativeErrorCode code) {
 		StagedCopyBeginFailure failure{ makeFailure(action, code), {} };
-		if (const auto cleanupErrorCode = discardStagingFile(stagingFile, *stagingPath))
+		if (const auto cleanupErrorCode = discardStagingFile(stagingFile, *stagingPath, anonymousStagingFd))
 			failure.cleanupFailure = makeFailure(FailedAction::CleanupStaging, *cleanupErrorCode);
 		return std::unexpected{ mv(failure) };
 	};
 
 	// The final logical size first, then best-effort physical reservation, so storage exhaustion surfaces
-	// here rather than mid-transfer and the file is less likely to fragment.
+	// here rather than mid-transfer and the file is less likely to fragment. The logical size alone leaves the
+	// whole file a hole, which is what a sparse source's holes are to stay.
 	if (const auto forcedError = fireHook(Point::StagedCopy_ResizeStaging_Native))
 		return failAndDiscardStaging(FailedAction::PrepareStagingFile, *forcedError);
 	if (!stagingFile.resize(sourceSize)) [[unlikely]]
 		return failAndDiscardStaging(FailedAction::PrepareStagingFile, captureNativeError());
 
-	NativeErrorCode preallocationError{};
-	bool preallocationFailed = false;
-	if (const auto forcedError = fireHook(Point::StagedCopy_PreallocateStaging_Native))
+	auto dataExtents = readDataExtents(source, sourceSize);
+	if (!dataExtents)
 	{
-		preallocationError = *forcedError;
-		preallocationFailed = true;
+		NativeErrorCode preallocationError{};
+		bool preallocationFailed = false;
+		if (const auto forcedError = fireHook(Point::StagedCopy_PreallocateStaging_Native))
+		{
+			preallocationError = *forcedError;
+			preallocationFailed = true;
+		}
+		else if (!stagingFile.preallocate(sourceSize))
+		{
+			preallocationError = captureNativeError();
+			preallocationFailed = true;
+		}
+		if (preallocationFailed && !isUnsupportedPreallocationError(preallocationError)) [[unlikely]]
+			return failAndDiscardStaging(FailedAction::PrepareStagingFile, preallocationError);
 	}
-	else if (!stagingFile.preallocate(sourceSize))
+
+	CStagedFileCopy session{ mv(destination), mv(*stagingPath), mv(sourceFile), mv(stagingFile), sourceTimes, sourcePermissions, sourceSize };
+	session._anonymousStagingFd = anonymousStagingFd;
+	session._dataExtents = mv(dataExtents);
+	session.chooseBackends(source, firstBackend, cachePolicy, verification);
+	return session;
+}
+
+std::optional<CStagedFileCopy> CStagedFileCopy::resume(CEntryPath source, CEntryPath destination, CEntryPath stagingPath, const uint64_t sourceSize,
+	const uint64_t stagedBytes, const CopyBackend firstBackend, const PageCachePolicy cachePolicy, const CopyVerification verification)
+{
+	assert_debug_only(!destination.isRoot());
+
+	thin_io::file stagingFile;
+	int noAnonymousStagingFd = -1;
+	const auto discardStaging = [&] {
+		(void)discardStagingFile(stagingFile, stagingPath, noAnonymousStagingFd);
+		return std::nullopt;
+	};
+
+	auto captured = openSource(source);
+	if (!captured || captured->size != sourceSize || stagedBytes > sourceSize)
+		return discardStaging();
+	[[maybe_unused]] auto& [sourceFile, sourceTimes, sourcePermissions, capturedSize] = *captured;
+
+	const auto stagingNative = thinIoPath(stagingPath);
 	{
-		preallocationError = captureNativeError();
-		preallocationFailed = true;
+		// A handle of its own for the check: the staging one is write-only
+		thin_io::file stagingReader;
+		if (!stagingReader.open(nativeCStr(stagingNative), thin_io::file::access_mode::Read))
+			return discardStaging();
+
+		const uint64_t checkLength = std::min(stagedBytes, resumeCheckLength);
+		std::vector<std::byte> sourceTail(checkLength), stagedTail(checkLength);
+		const bool tailsMatch = readFully(sourceFile, stagedBytes - checkLength, sourceTail.data(), checkLength)
+			&& readFully(stagingReader, stagedBytes - checkLength, stagedTail.data(), checkLength)
+			&& sourceTail == stagedTail;
+		(void)stagingReader.close(); // A read-side close failure puts no data at risk
+		if (!tailsMatch)
+			return discardStaging();
 	}
-	if (preallocationFailed && !isUnsupportedPreallocationError(preallocationError)) [[unlikely]]
-		return failAndDiscardStaging(FailedAction::PrepareStagingFile, preallocationError);
 
-	return CStagedFileCopy{ mv(destination), mv(*stagingPath), mv(sourceFile), mv(stagingFile), sourceTimes, sourcePermissions, sourceSize };
+	// The hash covers the whole file, so what was staged before goes into it, too - read from the source, as the
+	// read-back at commit() checks the staging file against the source
+	std::optional<CContentHasher> sourceHasher;
+	if (verification == CopyVerification::ReadBack)
+	{
+		sourceHasher.emplace();
+		std::vector<std::byte> buffer(CStagedCopyPipeline::bufferSize);
+		for (uint64_t position = 0; position < stagedBytes;)
+		{
+			const uint64_t length = std::min<uint64_t>(buffer.size(), stagedBytes - position);
+			if (!readFully(sourceFile, position, buffer.data(), length))
+				return discardStaging();
+			sourceHasher->update(buffer.data(), static_cast<size_t>(length));
+			position += length;
+		}
+	}
+
+	// begin() gave the staging file its final size, and a truncated one is no use
+	if (!stagingFile.open(nativeCStr(stagingNative), thin_io::file::access_mode::Write))
+		return discardStaging();
+	if (const auto stagingSize = stagingFile.size(); !stagingSize || *stagingSize != sourceSize || !stagingFile.seek(stagedBytes))
+		return discardStaging();
+
+	CStagedFileCopy session{ mv(destination), mv(stagingPath), mv(sourceFile), mv(stagingFile), sourceTimes, sourcePermissions, sourceSize };
+	session._bytesTransferred = stagedBytes;
+	session._resumedBytesToReport = stagedBytes;
+	session._writtenBackUpTo = stagedBytes; // Flushed before it was suspended
+	session._dataExtents = readDataExtents(source, sourceSize);
+	session.chooseBackends(source, firstBackend, cachePolicy, verification);
+	session._sourceHasher = sourceHasher;
+	return session;
+}
+
+std::expected<CStagedFileCopy::CapturedSource, FailureDetails> CStagedFileCopy::openSource(const CEntryPath& source)
+{
+	CapturedSource captured;
+	{
+		const auto sourceNative = thinIoPath(source);
+		if (!captured.file.open(nativeCStr(sourceNative), thin_io::file::access_mode::Read)) [[unlikely]]
+			return fail(FailedAction::ReadSource, captureNativeError());
+	}
+
+#ifndef _WIN32
+	const auto sourceIsRegularFile = captured.file.is_regular_file();
+	if (!sourceIsRegularFile) [[unlikely]]
+		return fail(FailedAction::ReadSource, captureNativeError());
+	if (!*sourceIsRegularFile) [[unlikely]]
+	{
+		return std::unexpected{ FailureDetails{ FailedAction::ReadSource,
+			CFileSystemError{ FileErrorCategory::Unsupported, 0, QStringLiteral("The opened source is not a regular file") } } };
+	}
+#endif
+
+	// Metadata comes from the open handle - provably the same effective file that supplies the bytes,
+	// even when the source path is a link being materialized.
+	if (const auto forcedError = fireHook(Point::StagedCopy_CaptureMetadata_Native))
+		return fail(FailedAction::PreserveFileMetadata, *forcedError);
+
+	if (const auto times = captured.file.times(); times) [[likely]]
+		captured.times = *times;
+	else
+		return fail(FailedAction::PreserveFileMetadata, captureNativeError());
+	captured.times.last_access.reset(); // Never transferred: reading the source for this copy already changed it
+
+	if (const auto permissions = captured.file.permissions(); permissions) [[likely]]
+		captured.permissions = *permissions;
+	else
+		return fail(FailedAction::PreserveFileMetadata, captureNativeError());
+
+	if (const auto size = captured.file.size(); size) [[likely]]
+		captured.size = *size;
+	else
+		return fail(FailedAction::ReadSource, captureNativeError());
+
+	return captured;
+}
+
+void CStagedFileCopy::chooseBackends([[maybe_unused]] const CEntryPath& source, const CopyBackend firstBackend,
+	[[maybe_unused]] const PageCachePolicy cachePolicy, const CopyVerification verification)
+{
+	if (!_dataExtents && (firstBackend == CopyBackend::OverlappedWrite
+		|| (firstBackend < CopyBackend::OverlappedWrite && _sourceSize - _bytesTransferred > CStagedCopyPipeline::bufferSize && isOnAnotherDevice(source, _stagingPath))))
+	{
+		_userSpaceBackend = CopyBackend::OverlappedWrite;
+	}
+	else
+		_userSpaceBackend = CopyBackend::MappedWrite;
+	_backend = _userSpaceBackend;
+	if (verification == CopyVerification::ReadBack)
+		_sourceHasher.emplace();
+
+#ifdef __linux__
+	// Best-effort: the kernel-side backends are optimizations, and the user-space ones need neither descriptor
+	if (_sourceSize > 0 && firstBackend < CopyBackend::OverlappedWrite && !_sourceHasher)
+	{
+		_kernelSourceFd = openKernelDescriptor(source, O_RDONLY, _sourceSize);
+		_kernelStagingFd = openKernelDescriptor(_stagingPath, O_WRONLY, _sourceSize);
+		if (_kernelSourceFd >= 0 && _kernelStagingFd >= 0)
+			_backend = firstBackend;
+		else
+			closeKernelDescriptors();
+	}
+
+	// Descriptors of their own, as the kernel-side ones are closed when those backends give up. Best-effort, too:
+	// without them the copy is only cached as usual.
+	if (_sourceSize > 0 && (cachePolicy == PageCachePolicy::DropBehind || (cachePolicy == PageCachePolicy::Automatic && _sourceSize >= dropBehindThreshold)))
+	{
+		_cacheSourceFd = openKernelDescriptor(source, O_RDONLY, _sourceSize);
+		_cacheStagingFd = openKernelDescriptor(_stagingPath, O_WRONLY, _sourceSize);
+	}
+#endif
 }
 
 CStagedFileCopy::CStagedFileCopy(CEntryPath destination, CEntryPath stagingPath, thin_io::file sourceFile, thin_io::file stagingFile,
@@ -195,6 +445,21 @@ CStagedFileCopy::CStagedFileCopy(CStagedFileCopy&& other) noexcept
 	, _sourcePermissions{ other._sourcePermissions }
 	, _sourceSize{ other._sourceSize }
 	, _bytesTransferred{ other._bytesTransferred }
+	, _resumedBytesToReport{ other._resumedBytesToReport }
+	, _dataExtents{ mv(other._dataExtents) }
+	, _currentExtent{ other._currentExtent }
+	, _kernelSourceFd{ std::exchange(other._kernelSourceFd, -1) }
+	, _kernelStagingFd{ std::exchange(other._kernelStagingFd, -1) }
+	, _cacheSourceFd{ std::exchange(other._cacheSourceFd, -1) }
+	, _cacheStagingFd{ std::exchange(other._cacheStagingFd, -1) }
+	, _writtenBackUpTo{ other._writtenBackUpTo }
+	, _anonymousStagingFd{ std::exchange(other._anonymousStagingFd, -1) }
+	, _backend{ other._backend }
+	, _userSpaceBackend{ other._userSpaceBackend }
+	, _pipeline{ mv(other._pipeline) }
+	, _transferPriority{ other._transferPriority }
+	, _sourceHasher{ other._sourceHasher }
+	, _verifiedContentHash{ other._verifiedContentHash }
 	, _state{ other._state }
 {
 	other._state = State::MovedFrom;
@@ -205,6 +470,15 @@ CStagedFileCopy::~CStagedFileCopy()
 	// Safety net only; the executor is expected to commit or abort explicitly.
 	if (_state == State::Transferring || _state == State::ReadyToCommit)
 		(void)abort();
+	closeKernelDescriptors();
+	closeCacheDescriptors();
+}
+
+void CStagedFileCopy::setTransferPriority(const TransferPriority priority) noexcept
+{
+	_transferPriority = priority;
+	if (_pipeline)
+		_pipeline->setPriority(priority);
 }
 
 std::expected<CopyChunkResult, FailureDetails> CStagedFileCopy::writeNext(const uint64_t maxBytes)
@@ -212,99 +486,474 @@ std::expected<CopyChunkResult, FailureDetails> CStagedFileCopy::writeNext(const
 	assert_debug_only(_state == State::Transferring);
 	assert_debug_only(maxBytes > 0);
 
+	const uint64_t resumedBytes = std::exchange(_resumedBytesToReport, 0);
 	const uint64_t remaining = _sourceSize - _bytesTransferred;
 	if (remaining == 0)
 	{
 		_state = State::ReadyToCommit;
-		return CopyChunkResult{ 0, true };
+		return CopyChunkResult{ 0, true, _backend, 0, resumedBytes };
 	}
 
-	const uint64_t chunkSize = std::min(maxBytes, remaining);
-	void* const chunk = _sourceFile.mmap(thin_io::file::mmap_access_mode::ReadOnly, _bytesTransferred, chunkSize);
-	if (chunk == nullptr) [[unlikely]]
-		return fail(FailedAction::ReadSource, captureNativeError());
+	auto holeBytes = skipHole();
+	if (!holeBytes) [[unlikely]]
+		return std::unexpected{ mv(holeBytes.error()) };
+	if (_bytesTransferred == _sourceSize) // The source ends in a hole
+	{
+		_state = State::ReadyToCommit;
+		return CopyChunkResult{ 0, true, _backend, *holeBytes, resumedBytes };
+	}
 
-	std::optional<uint64_t> written;
-	NativeErrorCode writeErrorCode{};
+	uint64_t chunkSize = std::min(maxBytes, _sourceSize - _bytesTransferred);
+	if (_dataExtents) // Up to the next hole at most
+	{
+		const DataExtent& extent = (*_dataExtents)[_currentExtent];
+		chunkSize = std::min(chunkSize, extent.offset + extent.length - _bytesTransferred);
+	}
+
+	// One arrival per chunk, whichever backend ends up writing it
 	if (const auto forcedError = fireHook(Point::StagedCopy_WriteStaging_Native))
-		writeErrorCode = *forcedError;
-	else
+		return fail(FailedAction::WriteDestination, *forcedError);
+
+	const uint64_t chunkStart = _bytesTransferred;
+
+	auto written = transferInKernel(chunkSize);
+	if (!written && _backend == CopyBackend::OverlappedWrite)
+	{
+		written = transferOverlapped(chunkSize);
+		if (!written)
+			_backend = CopyBackend::MappedWrite;
+	}
+	if (!written)
+		written = transferMapped(chunkSize);
+	if (!*written) [[unlikely]]
+		return std::unexpected{ mv(written->error()) };
+
+	const uint64_t bytesWritten = **written;
+	if (bytesWritten == 0) [[unlikely]] // A zero-byte success for a non-empty chunk would stall the executor's loop forever
+		return std::unexpected{ FailureDetails{ FailedAction::WriteDestination,
+			CFileSystemError{ FileErrorCategory::IoFailure, 0, QStringLiteral("Zero bytes written to the staging file") } } };
+
+	_bytesTransferred += bytesWritten;
+	dropBehind(chunkStart);
+	if (_bytesTransferred == _sourceSize)
+	{
+		_state = State::ReadyToCommit;
+		return CopyChunkResult{ bytesWritten, true, _backend, *holeBytes, resumedBytes };
+	}
+	return CopyChunkResult{ bytesWritten, false, _backend, *holeBytes, resumedBytes };
+}
+
+std::expected<uint64_t, FailureDetails> CStagedFileCopy::skipHole()
+{
+	if (!_dataExtents)
+		return 0;
+
+	const std::vector<DataExtent>& extents = *_dataExtents;
+	while (_currentExtent < extents.size() && extents[_currentExtent].offset + extents[_currentExtent].length <= _bytesTransferred)
+		++_currentExtent;
+
+	const uint64_t dataStart = _currentExtent < extents.size() ? extents[_currentExtent].offset : _sourceSize;
+	if (dataStart <= _bytesTransferred)
+		return 0;
+
+	const uint64_t holeBytes = dataStart - _bytesTransferred;
+	_bytesTransferred = dataStart;
+	if (_sourceHasher)
+		_sourceHasher->updateZeros(holeBytes); // What the hole reads back as
+	// The kernel-side backends are given the position with every chunk; the mapped write goes through the handle's own
+	if (_backend == CopyBackend::MappedWrite && !_stagingFile.seek(_bytesTransferred)) [[unlikely]]
+		return fail(FailedAction::WriteDestination, captureNativeError());
+	return holeBytes;
+}
+
+std::optional<std::vector<CStagedFileCopy::DataExtent>> CStagedFileCopy::readDataExtents([[maybe_unused]] const CEntryPath& source,
+	[[maybe_unused]] const uint64_t sourceSize)
+{
+#if defined SEEK_DATA && defined SEEK_HOLE
+	if (sourceSize == 0)
+		return std::nullopt;
+
+	const auto native = thinIoPath(source);
+	const int fd = ::open(nativeCStr(native), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return std::nullopt;
+
+	std::optional<std::vector<DataExtent>> extents;
+	struct stat info;
+	// Taking fewer blocks than its size is what every file with holes has in common, so a dense one isn't walked at all
+	if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && static_cast<uint64_t>(info.st_size) == sourceSize
+		&& static_cast<uint64_t>(info.st_blocks) * 512 < sourceSize)
+	{
+		extents.emplace();
+		uint64_t dataBytes = 0;
+		for (off_t position = 0; static_cast<uint64_t>(position) < sourceSize;)
+		{
+			const off_t dataStart = ::lseek(fd, position, SEEK_DATA);
+			if (dataStart < 0)
+			{
+				if (errno != ENXIO) // ENXIO: nothing but a hole from here to the end
+					extents.reset();
+				break;
+			}
+
+			const off_t holeStart = ::lseek(fd, dataStart, SEEK_HOLE);
+			if (holeStart < 0) [[unlikely]]
+			{
+				extents.reset();
+				break;
+			}
+
+			// Anything past the size captured is not part of this copy
+			const uint64_t dataEnd = std::min(static_cast<uint64_t>(holeStart), sourceSize);
+			if (static_cast<uint64_t>(dataStart) >= dataEnd)
+				break;
+
+			extents->push_back(DataExtent{ static_cast<uint64_t>(dataStart), dataEnd - static_cast<uint64_t>(dataStart) });
+			dataBytes += dataEnd - static_cast<uint64_t>(dataStart);
+			position = holeStart;
+		}
+
+		// Compressed data takes fewer blocks than its size, too, without any holes
+		if (extents && dataBytes == sourceSize)
+			extents.reset();
+	}
+
+	::close(fd);
+	return extents;
+#else
+	return std::nullopt;
+#endif
+}
+
+std::optional<std::expected<uint64_t, FailureDetails>> CStagedFileCopy::transferInKernel([[maybe_unused]] const uint64_t chunkSize)
+{
+#ifdef __linux__
+	if (_backend == CopyBackend::Clone)
+	{
+		// Any refusal just means no sharing here - unaligned, another filesystem, no reflink support, or no space
+		// for the metadata - and the copy below reports whatever is really wrong
+		file_clone_range range{ .src_fd = _kernelSourceFd, .src_offset = _bytesTransferred, .src_length = chunkSize, .dest_offset = _bytesTransferred };
+		if (::ioctl(_kernelStagingFd, FICLONERANGE, &range) == 0)
+			return chunkSize;
+
+		_backend = CopyBackend::KernelCopy;
+	}
+
+	if (_backend == CopyBackend::KernelCopy)
+	{
+		off64_t sourceOffset = static_cast<off64_t>(_bytesTransferred);
+		off64_t stagingOffset = static_cast<off64_t>(_bytesTransferred);
+		const ssize_t copied = ::copy_file_range(_kernelSourceFd, &sourceOffset, _kernelStagingFd, &stagingOffset, chunkSize, 0);
+		if (copied > 0)
+			return static_cast<uint64_t>(copied);
+		else if (copied == 0) // The end of the source came early: it has shrunk since begin()
+		{
+			return std::unexpected{ FailureDetails{ FailedAction::ReadSource,
+				CFileSystemError{ FileErrorCategory::IoFailure, 0, QStringLiteral("The source ended before its size at the start of the copy") } } };
+		}
+
+		const int errorCode = errno;
+		if (!isUnsupportedKernelCopyError(errorCode)) [[unlikely]]
+			return fail(FailedAction::WriteDestination, errorCode);
+
+		// The user-space backends write through the thin_io handle, which is not where the kernel-side writes left off
+		_backend = _userSpaceBackend;
+		closeKernelDescriptors();
+		if (_bytesTransferred > 0 && !_stagingFile.seek(_bytesTransferred)) [[unlikely]]
+			return fail(FailedAction::WriteDestination, captureNativeError());
+	}
+#endif
+
+	return std::nullopt;
+}
+
+std::optional<std::expected<uint64_t, FailureDetails>> CStagedFileCopy::transferOverlapped(const uint64_t chunkSize)
+{
+	if (!_pipeline)
 	{
-		written = _stagingFile.write(chunk, chunkSize);
-		if (!written) [[unlikely]]
-			writeErrorCode = captureNativeError();
+		_pipeline = CStagedCopyPipeline::start(_sourceFile, _bytesTransferred, _sourceSize, _transferPriority);
+		if (!_pipeline) [[unlikely]]
+			return std::nullopt;
 	}
 
+	return _pipeline->drainInto(_stagingFile, chunkSize, _sourceHasher ? &*_sourceHasher : nullptr);
+}
+
+std::expected<uint64_t, FailureDetails> CStagedFileCopy::transferMapped(const uint64_t chunkSize)
+{
+	void* const chunk = _sourceFile.mmap(thin_io::file::mmap_access_mode::ReadOnly, _bytesTransferred, chunkSize);
+	if (chunk == nullptr) [[unlikely]]
+		return fail(FailedAction::ReadSource, captureNativeError());
+
+	const std::optional<uint64_t> written = _stagingFile.write(chunk, chunkSize);
+	const NativeErrorCode writeErrorCode = written ? NativeErrorCode{} : captureNativeError();
+	if (written && _sourceHasher)
+		_sourceHasher->update(chunk, static_cast<size_t>(*written));
+
 	[[maybe_unused]] const bool unmapped = _sourceFile.unmap(chunk);
 	assert_debug_only(unmapped);
 
 	if (!written) [[unlikely]]
 		return fail(FailedAction::WriteDestination, writeErrorCode);
-	if (*written == 0) [[unlikely]] // A zero-byte success for a non-empty chunk would stall the executor's loop forever
-		return std::unexpected{ FailureDetails{ FailedAction::WriteDestination,
-			CFileSystemError{ FileErrorCategory::IoFailure, 0, QStringLiteral("Zero bytes written to the staging file") } } };
+	return *written;
+}
 
-	_bytesTransferred += *written;
-	if (_bytesTransferred == _sourceSize)
+void CStagedFileCopy::dropBehind([[maybe_unused]] const uint64_t chunkStart) noexcept
+{
+#ifdef __linux__
+	// Best-effort throughout: this only decides when the data gets to the disk and when it leaves the cache. A
+	// write-back error is still reported by the flush through the staging handle.
+	// Pages are dropped from the start of the file every time: the cache holds a file in folios of up to a few
+	// megabytes, and one that a range only partly covers is kept. Going over the pages already dropped costs next to
+	// nothing.
+	if (_cacheStagingFd >= 0)
 	{
-		_state = State::ReadyToCommit;
-		return CopyChunkResult{ *written, true };
+		// The chunk just written sets off for the disk now, rather than in a burst at the flush. The ones before it
+		// have had a chunk's time to get there; once they have, their pages can go.
+		(void)::sync_file_range(_cacheStagingFd, static_cast<off64_t>(chunkStart), static_cast<off64_t>(_bytesTransferred - chunkStart), SYNC_FILE_RANGE_WRITE);
+		if (chunkStart > _writtenBackUpTo)
+		{
+			(void)::sync_file_range(_cacheStagingFd, static_cast<off64_t>(_writtenBackUpTo), static_cast<off64_t>(chunkStart - _writtenBackUpTo),
+				SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+			(void)::posix_fadvise(_cacheStagingFd, 0, static_cast<off_t>(chunkStart), POSIX_FADV_DONTNEED);
+			_writtenBackUpTo = chunkStart;
+		}
 	}
-	return CopyChunkResult{ *written, false };
+
+	// The source's pages are clean, so they can go as soon as they are copied
+	if (_cacheSourceFd >= 0)
+		(void)::posix_fadvise(_cacheSourceFd, 0, static_cast<off_t>(_bytesTransferred), POSIX_FADV_DONTNEED);
+#endif
+}
+
+void CStagedFileCopy::closeCacheDescriptors() noexcept
+{
+#ifdef __linux__
+	if (_cacheSourceFd >= 0)
+		::close(std::exchange(_cacheSourceFd, -1));
+	if (_cacheStagingFd >= 0)
+		::close(std::exchange(_cacheStagingFd, -1));
+#endif
+}
+
+void CStagedFileCopy::closeKernelDescriptors() noexcept
+{
+#ifdef __linux__
+	// Read-only, or a second handle onto data the thin_io handle flushes and closes: nothing to report
+	if (_kernelSourceFd >= 0)
+		::close(std::exchange(_kernelSourceFd, -1));
+	if (_kernelStagingFd >= 0)
+		::close(std::exchange(_kernelStagingFd, -1));
+#endif
 }
 
 std::expected<void, FailureDetails> CStagedFileCopy::commit(const ReplacementMode replacement, const CommitDurability durability)
 {
 	assert_debug_only(_state == State::ReadyToCommit);
 
-	if (durability == CommitDurability::FlushBeforePublish)
+	closeKernelDescriptors();
+	_pipeline.reset(); // Closes the source it took over
+
+	// Reading back what is only in the cache would prove nothing about the disk
+	if (durability == CommitDurability::FlushBeforePublish || _sourceHasher)
 	{
-		if (const auto forcedError = fireHook(Point::StagedCopy_FlushStaging_Native))
-			return fail(FailedAction::WriteDestination, *forcedError);
-		if (!_stagingFile.fdatasync()) [[unlikely]]
-			return fail(FailedAction::WriteDestination, captureNativeError());
+		if (auto flushed = flushStaged(); !flushed) [[unlikely]]
+			return std::unexpected{ mv(flushed.error()) };
 	}
 
-	if (const auto forcedError = fireHook(Point::StagedCopy_ApplyMetadata_Native))
-		return fail(FailedAction::PreserveFileMetadata, *forcedError);
-	if (!_stagingFile.set_times(_sourceTimes)) [[unlikely]]
-		return fail(FailedAction::PreserveFileMetadata, captureNativeError());
-	// On Windows this also settles the staging file's temporary hidden attribute to the source's state.
-	if (!_stagingFile.set_permissions(_sourcePermissions)) [[unlikely]]
-		return fail(FailedAction::PreserveFileMetadata, captureNativeError());
+#ifdef __linux__
+	// The last chunks, which are on the disk by now if the durability policy demanded it; dirty ones are only set off
+	// for it
+	if (_cacheStagingFd >= 0)
+		(void)::posix_fadvise(_cacheStagingFd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+	closeCacheDescriptors();
+
+	if (_sourceHasher)
+	{
+		if (auto verified = verifyStagingFile(); !verified) [[unlikely]]
+			return verified;
+	}
 
-	(void)_sourceFile.close(); // A read-side close failure puts no data at risk
+	if (durability != CommitDurability::FlushWithGroup)
+	{
+		if (const auto forcedError = fireHook(Point::StagedCopy_ApplyMetadata_Native))
+			return fail(FailedAction::PreserveFileMetadata, *forcedError);
+		if (!_stagingFile.set_times(_sourceTimes)) [[unlikely]]
+			return fail(FailedAction::PreserveFileMetadata, captureNativeError());
+		// On Windows this also settles the staging file's temporary hidden attribute to the source's state.
+		if (!_stagingFile.set_permissions(_sourcePermissions)) [[unlikely]]
+			return fail(FailedAction::PreserveFileMetadata, captureNativeError());
+	}
+
+	if (_sourceFile.is_open())
+		(void)_sourceFile.close(); // A read-side close failure puts no data at risk
 
 	if (const auto forcedError = fireHook(Point::StagedCopy_CloseStaging_Native))
 		return fail(FailedAction::WriteDestination, *forcedError);
 	if (!_stagingFile.close()) [[unlikely]]
 		return fail(FailedAction::WriteDestination, captureNativeError());
 
-	if (auto published = CFileSystemMutator::renameEntry(_stagingPath, _destinationPath, replacement); !published) [[unlikely]]
+#ifdef __linux__
+	auto published = _anonymousStagingFd >= 0
+		? CFileSystemMutator::linkAnonymousFile(_anonymousStagingFd, _destinationPath, replacement)
+		: CFileSystemMutator::renameEntry(_stagingPath, _destinationPath, replacement);
+#else
+	auto published = CFileSystemMutator::renameEntry(_stagingPath, _destinationPath, replacement);
+#endif
+	if (!published) [[unlikely]]
 		return std::unexpected{ FailureDetails{ FailedAction::PublishDestination, mv(published.error()) } };
 
+#ifdef __linux__
+	if (_anonymousStagingFd >= 0)
+		::close(std::exchange(_anonymousStagingFd, -1)); // The destination's name now holds it
+#endif
 	_state = State::Committed;
 	return {};
 }
 
+std::expected<void, FailureDetails> CStagedFileCopy::verifyStagingFile()
+{
+	if (const auto forcedError = fireHook(Point::StagedCopy_VerifyStaging_Native))
+		return fail(FailedAction::VerifyDestination, *forcedError);
+
+#ifdef __linux__
+	// Flushed, so the pages are clean and can all go: what is read back below comes from the disk
+	if (const int fd = openKernelDescriptor(_stagingPath, O_RDONLY, _sourceSize); fd >= 0)
+	{
+		(void)::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		::close(fd);
+	}
+#endif
+
+	// A handle of its own: the staging one is write-only, and its position is no concern of this
+	thin_io::file stagingFile;
+	{
+		const auto stagingNative = thinIoPath(_stagingPath);
+		if (!stagingFile.open(nativeCStr(stagingNative), thin_io::file::access_mode::Read)) [[unlikely]]
+			return fail(FailedAction::VerifyDestination, captureNativeError());
+	}
+
+	CContentHasher stagedHasher;
+	std::vector<std::byte> buffer(CStagedCopyPipeline::bufferSize);
+	for (uint64_t position = 0; position < _sourceSize;)
+	{
+		const auto read = stagingFile.read(buffer.data(), std::min<uint64_t>(buffer.size(), _sourceSize - position));
+		if (!read) [[unlikely]]
+			return fail(FailedAction::VerifyDestination, captureNativeError());
+		if (*read == 0) [[unlikely]]
+		{
+			return std::unexpected{ FailureDetails{ FailedAction::VerifyDestination,
+				CFileSystemError{ FileErrorCategory::IoFailure, 0, QStringLiteral("The copy is shorter than the source") } } };
+		}
+
+		stagedHasher.update(buffer.data(), static_cast<size_t>(*read));
+		position += *read;
+	}
+	(void)stagingFile.close(); // A read-side close failure puts no data at risk
+
+	const uint64_t sourceHash = _sourceHasher->digest();
+	if (stagedHasher.digest() != sourceHash) [[unlikely]]
+	{
+		return std::unexpected{ FailureDetails{ FailedAction::VerifyDestination,
+			CFileSystemError{ FileErrorCategory::IoFailure, 0, QStringLiteral("The copy is different from the source: its content hash is %1 instead of %2")
+				.arg(stagedHasher.digest(), 16, 16, QChar{ u'0' }).arg(sourceHash, 16, 16, QChar{ u'0' }) } } };
+	}
+
+	_verifiedContentHash = sourceHash;
+	return {};
+}
+
+std::optional<uint64_t> CStagedFileCopy::verifiedContentHash() const noexcept
+{
+	return _verifiedContentHash;
+}
+
+std::optional<thin_io::timestamp> CStagedFileCopy::sourceLastWrite() const noexcept
+{
+	return _sourceTimes.last_write;
+}
+
+const thin_io::entry_times& CStagedFileCopy::sourceTimes() const noexcept
+{
+	return _sourceTimes;
+}
+
+thin_io::file_permissions CStagedFileCopy::sourcePermissions() const noexcept
+{
+	return _sourcePermissions;
+}
+
 std::expected<void, FailureDetails> CStagedFileCopy::abort()
 {
 	assert_debug_only(_state == State::Transferring || _state == State::ReadyToCommit);
 	_state = State::Aborted; // One-shot even on failure: the destructor must not retry a reported cleanup
 
-	(void)_sourceFile.close(); // A read-side close failure puts no data at risk
+	closeKernelDescriptors();
+	closeCacheDescriptors();
+	_pipeline.reset();
+	if (_sourceFile.is_open())
+		(void)_sourceFile.close(); // A read-side close failure puts no data at risk
 
-	if (const auto cleanupErrorCode = discardStagingFile(_stagingFile, _stagingPath)) [[unlikely]]
+	if (const auto cleanupErrorCode = discardStagingFile(_stagingFile, _stagingPath, _anonymousStagingFd)) [[unlikely]]
 		return fail(FailedAction::CleanupStaging, *cleanupErrorCode);
 	return {};
 }
 
-std::optional<NativeErrorCode> CStagedFileCopy::discardStagingFile(thin_io::file& stagingFile, const CEntryPath& stagingPath)
+std::expected<uint64_t, FailureDetails> CStagedFileCopy::flushStaged()
+{
+	assert_debug_only(_state == State::Transferring || _state == State::ReadyToCommit);
+
+	if (const auto forcedError = fireHook(Point::StagedCopy_FlushStaging_Native))
+		return fail(FailedAction::WriteDestination, *forcedError);
+	// The kernel-side backends write through descriptors of their own, but the data is the file's, whichever
+	// descriptor flushes it
+	if (!_stagingFile.fdatasync()) [[unlikely]]
+		return fail(FailedAction::WriteDestination, captureNativeError());
+	return _bytesTransferred;
+}
+
+std::expected<uint64_t, FailureDetails> CStagedFileCopy::suspend()
+{
+	assert_debug_only(_state == State::Transferring || _state == State::ReadyToCommit);
+	assert_debug_only(_anonymousStagingFd < 0);
+
+	auto flushed = flushStaged();
+	if (!flushed) [[unlikely]]
+		return flushed;
+
+	_state = State::Suspended;
+	closeKernelDescriptors();
+	closeCacheDescriptors();
+	_pipeline.reset(); // What it has read ahead is read again by the resumed session
+	if (_sourceFile.is_open())
+		(void)_sourceFile.close(); // A read-side close failure puts no data at risk
+	(void)_stagingFile.close(); // Flushed already, and resume() checks what it gets
+	return flushed;
+}
+
+const CEntryPath& CStagedFileCopy::stagingPath() const noexcept
+{
+	return _stagingPath;
+}
+
+std::optional<NativeErrorCode> CStagedFileCopy::discardStagingFile(thin_io::file& stagingFile, const CEntryPath& stagingPath, int& anonymousStagingFd)
 {
 	std::optional<NativeErrorCode> cleanupErrorCode;
 	if (stagingFile.is_open() && !stagingFile.close()) [[unlikely]]
 		cleanupErrorCode = captureNativeError();
 
+#ifdef __linux__
+	// An unnamed file has nothing to remove: it goes with its last descriptor
+	if (anonymousStagingFd >= 0)
+	{
+		::close(std::exchange(anonymousStagingFd, -1));
+		return cleanupErrorCode;
+	}
+#else
+	assert_debug_only(anonymousStagingFd < 0);
+#endif
+
 	if (const auto removalErrorCode = removeStagingFile(stagingPath)) [[unlikely]]
 		cleanupErrorCode = *removalErrorCode; // Staging data left behind outweighs a close failure in the report
 
@@ -1,11 +1,16 @@
 #pragma once
 
+#include "ccontenthasher.h"
 #include "fileoperationtypes.h"
 
 #include "file.hpp" // thin_io
 
 #include <expected>
+#include <memory>
 #include <optional>
+#include <vector>
+
+class CStagedCopyPipeline;
 
 struct StagedCopyBeginFailure
 {
@@ -15,17 +20,44 @@ struct StagedCopyBeginFailure
 
 // One staged copy of one regular file, or of a materialized file link's target: an exclusively created,
 // hidden temporary sibling of the destination receives the data and the required source metadata, then
-// atomically becomes the destination entry. Move-only; a session that was neither committed nor aborted
-// cleans up best-effort in the destructor. The executor owns paths in diagnostics, prompts, retry, progress,
-// and the durability choice.
+// atomically becomes the destination entry. On Linux the staging file is an unnamed one in the destination
+// directory (O_TMPFILE) where the filesystem supports it, which only ever gets the destination's name, so a crash
+// leaves nothing behind - unless the session is to be resumable (StagingLifetime::Resumable), which takes a named
+// one that suspend() can leave for resume() to carry on with. A sparse source (on POSIX, where SEEK_DATA tells its
+// holes apart) has only its data copied: its holes stay unallocated in the copy. Move-only; a session that was
+// neither committed nor aborted cleans up best-effort in the destructor. The executor owns paths in diagnostics,
+// prompts, retry, progress, and the durability choice.
 class CStagedFileCopy
 {
 public:
+	// Where PageCachePolicy::Automatic starts dropping behind: a file this big is unlikely to be read again soon,
+	// and is big enough to matter to the cache
+	static constexpr uint64_t dropBehindThreshold = 256 * 1024 * 1024;
+
 	// Opens the source (following a link - the opened target then supplies both bytes and metadata),
 	// captures required metadata from that handle, exclusively creates the staging sibling, fixes its
-	// logical size, and best-effort preallocates. If cleanup after a preparation failure also fails, both
-	// failures are returned so policy remains based on the primary one and cleanup is reported separately.
-	[[nodiscard]] static std::expected<CStagedFileCopy, StagedCopyBeginFailure> begin(CEntryPath source, CEntryPath destination);
+	// logical size, and best-effort preallocates - unless the source is sparse, which would make the copy dense.
+	// If cleanup after a preparation failure also fails, both failures are returned so policy remains based on
+	// the primary one and cleanup is reported separately.
+	// firstBackend is the cheapest CopyBackend to try. OverlappedWrite is otherwise only chosen for a source on another
+	// device than the destination, and longer than one pipeline buffer; starting at it uses it regardless.
+	// cachePolicy is only acted on on Linux, which has both posix_fadvise() and sync_file_range().
+	// A verifying session (CopyVerification::ReadBack) only uses the user-space backends, which pass every byte
+	// through the session, where it is hashed.
+	[[nodiscard]] static std::expected<CStagedFileCopy, StagedCopyBeginFailure> begin(CEntryPath source, CEntryPath destination,
+		CopyBackend firstBackend = CopyBackend::Clone, PageCachePolicy cachePolicy = PageCachePolicy::KeepCached,
+		CopyVerification verification = CopyVerification::None, StagingLifetime lifetime = StagingLifetime::Session);
+
+	// Carries on with the staging file a suspended session left behind, stagedBytes of it already durably written.
+	// The source must still have the size it had, and the last resumeCheckLength bytes staged must still be what the
+	// source has there - a cheap check that this is the same source, and that the staging file is intact where a crash
+	// would have hurt it. A verifying session hashes the part of the source staged already. nullopt if the staging
+	// file can't be resumed, which is then removed (best-effort): the caller begins afresh.
+	// The first writeNext() reports the bytes staged already as CopyChunkResult::resumedBytes.
+	[[nodiscard]] static std::optional<CStagedFileCopy> resume(CEntryPath source, CEntryPath destination, CEntryPath stagingPath,
+		uint64_t sourceSize, uint64_t stagedBytes, CopyBackend firstBackend = CopyBackend::Clone,
+		PageCachePolicy cachePolicy = PageCachePolicy::KeepCached, CopyVerification verification = CopyVerification::None);
+	static constexpr uint64_t resumeCheckLength = 1024 * 1024;
 
 	CStagedFileCopy(CStagedFileCopy&& other) noexcept;
 	CStagedFileCopy(const CStagedFileCopy&) = delete;
@@ -33,23 +65,84 @@ public:
 	CStagedFileCopy& operator=(CStagedFileCopy&&) = delete;
 	~CStagedFileCopy();
 
-	// Transfers at most maxBytes more source bytes into the staging file; see CopyChunkResult.
+	// Transfers at most maxBytes more source bytes into the staging file; see CopyChunkResult. Each chunk is
+	// reflinked, else copied by the kernel, else read ahead and written or mapped and written (see CopyBackend) -
+	// the first two on Linux only. A hole of a sparse source ahead is passed over, not written; a sparse source is
+	// never read ahead, because the reader goes straight through the holes.
 	[[nodiscard]] std::expected<CopyChunkResult, FailureDetails> writeNext(uint64_t maxBytes);
+	// The I/O priority of the overlapped backend's reader thread, which doesn't pass the job's throttle; the caller's
+	// own thread is left to the throttle. Takes effect from the reader's next buffer on.
+	void setTransferPriority(TransferPriority priority) noexcept;
 
-	// Flushes per the durability policy, applies the captured metadata through the staging handle, closes
-	// it, and publishes the staging file as the destination entry. The publishing rename is the last
-	// action, so the only two outcomes are failure-before-publication and successful publication.
+	// Flushes per the durability policy - always, for a verifying session, which then reads the staging file back from
+	// the disk (on Linux; elsewhere possibly from the cache) and fails with FailedAction::VerifyDestination if its
+	// hash is not the one of what was copied. Then applies the captured metadata through the staging handle (unless
+	// CommitDurability::FlushWithGroup leaves that to the caller), closes it, and publishes the staging file as the
+	// destination entry. The publishing rename - or link, for an unnamed staging file - is the last action, so the only
+	// two outcomes are failure-before-publication and successful publication.
 	[[nodiscard]] std::expected<void, FailureDetails> commit(ReplacementMode replacement, CommitDurability durability);
 
 	// Removes the staging data of a not-yet-published session; reports what could not be cleaned up.
 	// One-shot: after abort(), the destructor does not retry.
 	[[nodiscard]] std::expected<void, FailureDetails> abort();
 
+	// Gets everything staged so far to the disk; returns how much of the file that is - what resume() can be given.
+	[[nodiscard]] std::expected<uint64_t, FailureDetails> flushStaged();
+	// flushStaged(), then closes everything and leaves the staging file of a StagingLifetime::Resumable session behind,
+	// for resume(). If the flush fails, the session is as it was, and is to be aborted.
+	[[nodiscard]] std::expected<uint64_t, FailureDetails> suspend();
+
+	// Named, unless the staging file is an unnamed one (see StagingLifetime)
+	[[nodiscard]] const CEntryPath& stagingPath() const noexcept;
+
+	// The XXH64 (CContentHasher) of the copied data, once a verifying session has verified the staged copy against it
+	[[nodiscard]] std::optional<uint64_t> verifiedContentHash() const noexcept;
+	// As captured from the source when the session began, and given to the copy
+	[[nodiscard]] std::optional<thin_io::timestamp> sourceLastWrite() const noexcept;
+	// The same, for CommitDurability::FlushWithGroup to apply after the flush (CFileSystemMutator::applyFileMetadata())
+	[[nodiscard]] const thin_io::entry_times& sourceTimes() const noexcept;
+	[[nodiscard]] thin_io::file_permissions sourcePermissions() const noexcept;
+
 private:
 	CStagedFileCopy(CEntryPath destination, CEntryPath stagingPath, thin_io::file sourceFile, thin_io::file stagingFile,
 					const thin_io::entry_times& sourceTimes, thin_io::file_permissions sourcePermissions, uint64_t sourceSize) noexcept;
 
-	[[nodiscard]] static std::optional<NativeErrorCode> discardStagingFile(thin_io::file& stagingFile, const CEntryPath& stagingPath);
+	// The source opened, and the metadata of the opened file captured
+	struct CapturedSource
+	{
+		thin_io::file file;
+		thin_io::entry_times times; // Access time already cleared: it is never transferred
+		thin_io::file_permissions permissions;
+		uint64_t size = 0;
+	};
+	[[nodiscard]] static std::expected<CapturedSource, FailureDetails> openSource(const CEntryPath& source);
+	// The backends, and the descriptors they and the cache policy need; the data extents are known by now.
+	void chooseBackends(const CEntryPath& source, CopyBackend firstBackend, PageCachePolicy cachePolicy, CopyVerification verification);
+
+	// nullopt if the backend cannot take this chunk, and the next one is to be tried instead.
+	[[nodiscard]] std::optional<std::expected<uint64_t, FailureDetails>> transferInKernel(uint64_t chunkSize);
+	// nullopt if the reader thread could not be started
+	[[nodiscard]] std::optional<std::expected<uint64_t, FailureDetails>> transferOverlapped(uint64_t chunkSize);
+	[[nodiscard]] std::expected<uint64_t, FailureDetails> transferMapped(uint64_t chunkSize);
+	void closeKernelDescriptors() noexcept;
+	// PageCachePolicy::DropBehind after a chunk that started at chunkStart
+	void dropBehind(uint64_t chunkStart) noexcept;
+	void closeCacheDescriptors() noexcept;
+	// The read-back half of CopyVerification::ReadBack; the staging file is flushed by now.
+	[[nodiscard]] std::expected<void, FailureDetails> verifyStagingFile();
+
+	struct DataExtent
+	{
+		uint64_t offset;
+		uint64_t length;
+	};
+	// Where the data of a sparse source is, in file order; nullopt for a source without holes, or where holes can't
+	// be told apart from data. A snapshot: data written into a hole later is not copied.
+	[[nodiscard]] static std::optional<std::vector<DataExtent>> readDataExtents(const CEntryPath& source, uint64_t sourceSize);
+	// Moves past a hole at the current position, if there is one; returns its length.
+	[[nodiscard]] std::expected<uint64_t, FailureDetails> skipHole();
+
+	[[nodiscard]] static std::optional<NativeErrorCode> discardStagingFile(thin_io::file& stagingFile, const CEntryPath& stagingPath, int& anonymousStagingFd);
 	[[nodiscard]] static std::optional<NativeErrorCode> removeStagingFile(const CEntryPath& stagingPath);
 
 	enum class State
@@ -58,16 +151,39 @@ private:
 		ReadyToCommit,
 		Committed,
 		Aborted,
+		Suspended,
 		MovedFrom
 	};
 
 	CEntryPath _destinationPath;
-	CEntryPath _stagingPath;
-	thin_io::file _sourceFile;
+	CEntryPath _stagingPath; // The /proc/self/fd path of _anonymousStagingFd for an unnamed staging file
+	thin_io::file _sourceFile; // Handed over to _pipeline once that starts
 	thin_io::file _stagingFile;
 	thin_io::entry_times _sourceTimes; // Access time already cleared: it is never transferred
 	thin_io::file_permissions _sourcePermissions;
 	uint64_t _sourceSize = 0;
-	uint64_t _bytesTransferred = 0;
+	uint64_t _bytesTransferred = 0; // The position in the file, holes passed over included
+	uint64_t _resumedBytesToReport = 0; // By the first writeNext() of a resumed session
+	// The data extents of a sparse source, and the first one not yet fully transferred
+	std::optional<std::vector<DataExtent>> _dataExtents;
+	size_t _currentExtent = 0;
+	// Descriptors of its own onto the same two files for the kernel-side backends, which thin_io doesn't wrap;
+	// -1 where those are not available
+	int _kernelSourceFd = -1;
+	int _kernelStagingFd = -1;
+	// And for dropping behind, -1 where the session keeps the cache; everything before _writtenBackUpTo is on the disk
+	int _cacheSourceFd = -1;
+	int _cacheStagingFd = -1;
+	uint64_t _writtenBackUpTo = 0;
+	// What keeps an unnamed staging file alive until publication links it in; -1 for a named one
+	int _anonymousStagingFd = -1;
+	CopyBackend _backend = CopyBackend::MappedWrite;
+	// Where the session goes once the kernel-side backends are out: OverlappedWrite or MappedWrite
+	CopyBackend _userSpaceBackend = CopyBackend::MappedWrite;
+	std::unique_ptr<CStagedCopyPipeline> _pipeline; // Started by the first overlapped chunk
+	TransferPriority _transferPriority = TransferPriority::Foreground;
+	// Of everything copied so far, holes included, for a verifying session
+	std::optional<CContentHasher> _sourceHasher;
+	std::optional<uint64_t> _verifiedContentHash;
 	State _state = State::Transferring;
 };
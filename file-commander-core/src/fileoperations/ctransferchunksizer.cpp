@@ -0,0 +1,108 @@
+#include "ctransferchunksizer.h"
+#include "thiniobridge.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace
+{
+
+struct RememberedThroughput
+{
+	double bytesPerSecond = 0;
+	uint64_t chunkSize = CTransferChunkSizer::initialChunkSize;
+};
+
+// Process-wide, for every job to start from what the ones before it measured
+struct RememberedThroughputs
+{
+	std::mutex mutex;
+	std::map<std::pair<uint64_t, uint64_t>, RememberedThroughput> byDevicePair;
+};
+
+RememberedThroughputs& rememberedThroughputs()
+{
+	static RememberedThroughputs remembered;
+	return remembered;
+}
+
+// A rate measured over one chunk is only part of the picture - the page cache, the device's own cache and other
+// I/O all come and go - so each new one moves the estimate by this much of the difference.
+constexpr double throughputSmoothing = 0.3;
+
+std::optional<uint64_t> readDevice(const CEntryPath& directory)
+{
+	const auto native = thinIoPath(directory);
+#ifdef _WIN32
+	std::wstring volume(MAX_PATH + 1, L'\0');
+	if (!::GetVolumePathNameW(nativeCStr(native), volume.data(), static_cast<DWORD>(volume.size())))
+		return std::nullopt;
+
+	DWORD serialNumber = 0;
+	if (!::GetVolumeInformationW(volume.c_str(), nullptr, 0, &serialNumber, nullptr, nullptr, nullptr, 0))
+		return std::nullopt;
+	return serialNumber;
+#else
+	struct stat info;
+	if (::stat(nativeCStr(native), &info) != 0)
+		return std::nullopt;
+	return static_cast<uint64_t>(info.st_dev);
+#endif
+}
+
+} // namespace
+
+std::optional<CTransferChunkSizer::DevicePair> CTransferChunkSizer::devicePairOf(const CEntryPath& source, const CEntryPath& destination)
+{
+	const auto deviceOf = [](const CEntryPath& directory, std::optional<DirectoryDevice>& lastLookup) {
+		if (!lastLookup || lastLookup->directory != directory)
+			lastLookup = DirectoryDevice{ directory, readDevice(directory) };
+		return lastLookup->device;
+	};
+
+	const auto sourceDevice = deviceOf(source.isRoot() ? source : source.parent(), _lastSourceDirectory);
+	const auto destinationDevice = deviceOf(destination.parent(), _lastDestinationDirectory);
+	if (!sourceDevice || !destinationDevice)
+		return std::nullopt;
+	return DevicePair{ *sourceDevice, *destinationDevice };
+}
+
+uint64_t CTransferChunkSizer::chunkSize(const std::optional<DevicePair>& devices) const
+{
+	if (!devices)
+		return initialChunkSize;
+
+	RememberedThroughputs& remembered = rememberedThroughputs();
+	std::lock_guard lock{ remembered.mutex };
+	const auto known = remembered.byDevicePair.find({ devices->source, devices->destination });
+	return known != remembered.byDevicePair.end() ? known->second.chunkSize : initialChunkSize;
+}
+
+void CTransferChunkSizer::chunkTransferred(const std::optional<DevicePair>& devices, const uint64_t bytes, const std::chrono::steady_clock::duration elapsed)
+{
+	// Too little to tell a rate by: the tail of a file, or a write the device took only part of
+	if (!devices || bytes < chunkSizeGranularity || elapsed <= std::chrono::steady_clock::duration::zero())
+		return;
+
+	const double bytesPerSecond = static_cast<double>(bytes) / std::chrono::duration<double>(elapsed).count();
+
+	RememberedThroughputs& remembered = rememberedThroughputs();
+	std::lock_guard lock{ remembered.mutex };
+	RememberedThroughput& throughput = remembered.byDevicePair[{ devices->source, devices->destination }];
+	throughput.bytesPerSecond = throughput.bytesPerSecond == 0
+		? bytesPerSecond
+		: throughput.bytesPerSecond + throughputSmoothing * (bytesPerSecond - throughput.bytesPerSecond);
+
+	const double bytesInTargetDuration = throughput.bytesPerSecond * std::chrono::duration<double>(targetChunkDuration).count();
+	const uint64_t unaligned = bytesInTargetDuration >= static_cast<double>(maxChunkSize) ? maxChunkSize : static_cast<uint64_t>(bytesInTargetDuration);
+	throughput.chunkSize = std::clamp(unaligned / chunkSizeGranularity * chunkSizeGranularity, minChunkSize, maxChunkSize);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "centrypath.h"
+
+#include <chrono>
+#include <optional>
+#include <stdint.h>
+
+// Picks the size of each staged-copy chunk from the throughput measured so far between the same two devices:
+// the largest chunk that still takes no longer than targetChunkDuration, so that the executor's checkpoint -
+// progress, pause and cancellation - comes round often enough while each chunk amortizes as much per-call
+// overhead as it can. A USB stick ends up with small chunks and an NVMe drive with large ones.
+// What is learned for a device pair is kept for the lifetime of the process, so a later job starts from it.
+// Not thread-safe on its own; the remembered sizes are shared, and guarded.
+class CTransferChunkSizer
+{
+public:
+	// Chunk sizes are multiples of chunkSizeGranularity - the widest mapping granularity, Windows' - within these bounds
+	static constexpr uint64_t chunkSizeGranularity = 64 * 1024;
+	static constexpr uint64_t minChunkSize = 256 * 1024;
+	static constexpr uint64_t maxChunkSize = 64 * 1024 * 1024;
+	// For a device pair nothing has been measured for yet
+	static constexpr uint64_t initialChunkSize = 4 * 1024 * 1024;
+	// Between a checkpoint every 50 and every 100 ms, which is what a responsive progress display and cancellation need
+	static constexpr std::chrono::milliseconds targetChunkDuration{ 75 };
+
+	// The devices of a source file and of the directory its copy is staged in; st_dev on POSIX, the volume serial
+	// number on Windows.
+	struct DevicePair
+	{
+		uint64_t source = 0;
+		uint64_t destination = 0;
+
+		[[nodiscard]] bool operator==(const DevicePair&) const noexcept = default;
+	};
+
+	// nullopt if either device can't be told: such a transfer is sized as if nothing had been measured for it.
+	// Consecutive files of one directory cost nothing past the first.
+	[[nodiscard]] std::optional<DevicePair> devicePairOf(const CEntryPath& source, const CEntryPath& destination);
+
+	[[nodiscard]] uint64_t chunkSize(const std::optional<DevicePair>& devices) const;
+	// A chunk of `bytes` took `elapsed` to transfer between these devices.
+	void chunkTransferred(const std::optional<DevicePair>& devices, uint64_t bytes, std::chrono::steady_clock::duration elapsed);
+
+private:
+	struct DirectoryDevice
+	{
+		CEntryPath directory;
+		std::optional<uint64_t> device;
+	};
+
+	// One per side: a traversal stays in one directory for all of its files
+	std::optional<DirectoryDevice> _lastSourceDirectory;
+	std::optional<DirectoryDevice> _lastDestinationDirectory;
+};
@@ -5,6 +5,14 @@
 
 #include "assert/advanced_assert.h"
 #include "lang/utils.hpp" // mv()
+#include "threading/cthreadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <utility>
 
 namespace
 {
@@ -18,20 +26,162 @@ EntrySnapshot destinationSnapshotFor(const EntrySnapshot& source, const CEntryPa
 
 } // namespace
 
-CTransferExecutor::CTransferExecutor(COperationExecutionContext& context, const uint64_t transferChunkSize) noexcept
+// Stages and publishes the small file children of one directory ahead of the traversal, on the file-copy workers and
+// no more than a window of files ahead of it. Only a child with no destination entry in the way is attempted, always
+// as a RequireAbsent publication; one that needs any decision - a collision, an uninspectable destination - is left to
+// the executor. The executor takes the results in child order, which is where it accounts them.
+class CTransferExecutor::FileCopyPrefetch
+{
+public:
+	FileCopyPrefetch(CTransferExecutor& executor, const SourceNode& directory, const CEntryPath& destination) :
+		_executor{ executor },
+		_directory{ directory },
+		_destination{ destination },
+		_window{ 2 * static_cast<size_t>(executor._fileCopyWorkers) }
+	{
+		if (!_executor._fileCopyPool)
+			_executor._fileCopyPool = std::make_unique<CThreadPool>(_executor._fileCopyWorkers, "File copy pool");
+	}
+
+	// Waits for every worker still busy with a file of this directory: nothing may be published into it after its
+	// contents are done with, which is when its timestamps are applied.
+	~FileCopyPrefetch()
+	{
+		(void)stop();
+	}
+
+	FileCopyPrefetch(const FileCopyPrefetch&) = delete;
+	FileCopyPrefetch& operator=(const FileCopyPrefetch&) = delete;
+
+	// Called for every child in turn: keeps the window filled from this one on, then waits for its result. nullopt: it
+	// was not attempted ahead, and the executor copies it as usual.
+	[[nodiscard]] std::optional<StagedAttempt> take(const size_t childIndex)
+	{
+		assert_debug_only(childIndex == _taken);
+		for (; _nextToSchedule < _directory.children.size() && _nextToSchedule < childIndex + _window; ++_nextToSchedule)
+			_pending.push_back(schedule(_directory.children[_nextToSchedule]));
+
+		++_taken;
+		std::optional<std::future<std::optional<StagedAttempt>>> next = mv(_pending.front());
+		_pending.pop_front();
+		return next ? next->get() : std::nullopt;
+	}
+
+	// Keeps the workers from starting anything more and waits for the files they are busy with. Returns the attempts
+	// that were made ahead of the executor and not yet taken, by child index - some of them may well be published.
+	[[nodiscard]] std::vector<std::pair<size_t, StagedAttempt>> stop()
+	{
+		_stopRequested->store(true);
+
+		std::vector<std::pair<size_t, StagedAttempt>> remaining;
+		for (; !_pending.empty(); ++_taken)
+		{
+			if (_pending.front())
+			{
+				if (auto attempt = _pending.front()->get())
+					remaining.emplace_back(_taken, mv(*attempt));
+			}
+			_pending.pop_front();
+		}
+		return remaining;
+	}
+
+private:
+	[[nodiscard]] std::optional<std::future<std::optional<StagedAttempt>>> schedule(const SourceNode& child)
+	{
+		const bool fileLike = child.entry.kind == OperationEntryKind::RegularFile || child.entry.kind == OperationEntryKind::FileLink;
+		if (!fileLike || child.entry.size > maxPrefetchedFileSize)
+			return std::nullopt;
+
+		// A std::function the pool can take has to be copyable
+		auto promise = std::make_shared<std::promise<std::optional<StagedAttempt>>>();
+		auto future = promise->get_future();
+		_executor._fileCopyPool->enqueue([promise, stopRequested{ _stopRequested }, context{ &_executor._context }, source{ child.entry },
+			destination{ _destination.child(child.entry.path.name()) }, chunkSize{ _executor._chunkSizer ? maxPrefetchedFileSize : _executor._transferChunkSize },
+			pageCachePolicy{ _executor._pageCachePolicy }, verification{ _executor._verification }, throttle{ _executor._throttle }] {
+			// The job's pause and cancellation hold the workers as they hold the executor: a paused job publishes
+			// nothing, and a cancelled one nothing more than what is already past its last checkpoint.
+			const auto checkpoint = [&] { return !*stopRequested && context->concurrentCheckpoint(); };
+			// The inspection and the opening of the files come before the first pass() of the throttle, and the job's
+			// priority may have changed since this worker last passed it
+			if (throttle)
+				CTransferThrottle::applyPriorityToThisThread(throttle->priority());
+
+			std::optional<StagedAttempt> attempt;
+			if (checkpoint())
+			{
+				// Anything but a clear absence is the executor's to resolve
+				if (const auto existing = inspectEntry(destination); existing && !existing->has_value())
+				{
+					attempt = runStagedAttempt(source, destination, ReplacementMode::RequireAbsent, CommitDurability::NoFlush, pageCachePolicy, verification, chunkSize,
+						nullptr, nullptr, throttle, checkpoint, {});
+				}
+			}
+			promise->set_value(mv(attempt));
+		});
+		return future;
+	}
+
+	CTransferExecutor& _executor;
+	const SourceNode& _directory;
+	const CEntryPath& _destination;
+	const size_t _window;
+
+	// One per child from _taken on, in child order, up to _nextToSchedule; nullopt for a child that is not prefetched
+	std::deque<std::optional<std::future<std::optional<StagedAttempt>>>> _pending;
+	size_t _taken = 0;
+	size_t _nextToSchedule = 0;
+	const std::shared_ptr<std::atomic<bool>> _stopRequested = std::make_shared<std::atomic<bool>>(false);
+};
+
+CTransferExecutor::CTransferExecutor(COperationExecutionContext& context, const uint64_t transferChunkSize, const uint32_t fileCopyWorkers,
+	const PageCachePolicy pageCachePolicy, CTransferThrottle* const throttle) noexcept
 	: _context{ context }
 	, _transferChunkSize{ transferChunkSize }
+	, _fileCopyWorkers{ fileCopyWorkers }
+	, _pageCachePolicy{ pageCachePolicy }
+	, _throttle{ throttle }
 {
-	assert_debug_only(transferChunkSize > 0);
+	if (transferChunkSize == adaptiveTransferChunkSize)
+		_chunkSizer.emplace();
+	assert_debug_only(fileCopyWorkers > 0);
 }
 
+CTransferExecutor::~CTransferExecutor() = default;
+
 OperationSummary CTransferExecutor::run(const TransferRequest& request)
 {
 	_requestKind = request.kind;
+	_verification = request.verification;
+	if (request.verificationManifest && _verification != CopyVerification::None) // Nothing to list otherwise
+	{
+		if (auto manifest = CVerificationManifest::create(*request.verificationManifest))
+			_verificationManifest.emplace(mv(*manifest));
+		else
+		{
+			_context.recordWarning(OperationDiagnostic{ FailureDetails{ FailedAction::WriteVerificationManifest, mv(manifest.error()) },
+				EntrySnapshot{ *request.verificationManifest, OperationEntryKind::RegularFile, 0 }, {} });
+		}
+	}
+
+	_resumeLargeFiles = request.resumeLargeFiles;
+	if (request.journalDirectory && _requestKind == TransferKind::Copy)
+	{
+		if (auto journal = CTransferJournal::open(*request.journalDirectory, request))
+			_journal.emplace(mv(*journal));
+		else
+		{
+			_context.recordWarning(OperationDiagnostic{ FailureDetails{ FailedAction::WriteTransferJournal, mv(journal.error()) },
+				EntrySnapshot{ *request.journalDirectory, OperationEntryKind::Directory, 0 }, {} });
+		}
+	}
 
 	const auto intents = rootTransferIntents(request);
 	_rootsWithUnresolvedTotals = intents.size();
 
+	DurabilityGroup rootsGroup; // Only a move's file roots ever join it
+	_durabilityGroup = &rootsGroup;
+
 	bool anyCancelled = false;
 	bool anyFailed = false;
 	for (const RootTransferIntent& intent : intents)
@@ -45,8 +195,31 @@ OperationSummary CTransferExecutor::run(const TransferRequest& request)
 		anyFailed = anyFailed || outcome == NodeOutcome::Failed;
 	}
 
+	// Cancelled or not: what is in the group is published, and so committed
+	_durabilityGroup = nullptr;
+	const NodeOutcome rootsFlushed = flushDurabilityGroup(rootsGroup);
+	anyCancelled = anyCancelled || rootsFlushed == NodeOutcome::Cancelled;
+	anyFailed = anyFailed || rootsFlushed == NodeOutcome::Failed;
+
+	if (_verificationManifest)
+	{
+		if (auto closed = _verificationManifest->close(); !closed)
+			recordManifestWarning(mv(closed.error()));
+		_verificationManifest.reset();
+	}
+
 	const CompletionStatus status = anyCancelled ? CompletionStatus::Cancelled
 		: anyFailed ? CompletionStatus::Failed : CompletionStatus::Completed;
+
+	if (_journal)
+	{
+		// A run that went to its end, skipped and failed items included, leaves nothing to carry on with; only a
+		// cancelled one does (or a crash, which never gets here)
+		if (auto finished = status != CompletionStatus::Cancelled ? _journal->remove() : _journal->close(); !finished)
+			recordJournalWarning(mv(finished.error()));
+		_journal.reset();
+	}
+
 	return _context.makeSummary(status);
 }
 
@@ -197,14 +370,20 @@ NodeOutcome CTransferExecutor::copyRoot(const RootTransferIntent& intent)
 		return copyNode(leaf, intent.proposedDestination, TransferNodePosition::SelectedRoot);
 	}
 
-	// Root-first resolution: a root skipped at its collision is never scanned.
-	DestinationChoice choice = resolveDirectoryDestination(_context, root, intent.proposedDestination, TransferNodePosition::SelectedRoot);
-	if (std::holds_alternative<SkipNode>(choice))
-		return finishUnscannedRoot(NodeOutcome::Skipped);
-	if (std::holds_alternative<CancelOperation>(choice))
-		return finishUnscannedRoot(NodeOutcome::Cancelled);
-	if (std::holds_alternative<AlreadySatisfied>(choice))
-		return finishUnscannedRoot(NodeOutcome::AlreadySatisfied);
+	// Root-first resolution: a root skipped at its collision is never scanned. One an earlier run of the request got to
+	// has been resolved already.
+	const auto journaled = journaledDirectory(root);
+	std::optional<DestinationChoice> choice;
+	if (!journaled)
+	{
+		choice = resolveDirectoryDestination(_context, root, intent.proposedDestination, TransferNodePosition::SelectedRoot);
+		if (std::holds_alternative<SkipNode>(*choice))
+			return finishUnscannedRoot(NodeOutcome::Skipped);
+		if (std::holds_alternative<CancelOperation>(*choice))
+			return finishUnscannedRoot(NodeOutcome::Cancelled);
+		if (std::holds_alternative<AlreadySatisfied>(*choice))
+			return finishUnscannedRoot(NodeOutcome::AlreadySatisfied);
+	}
 
 	auto built = buildManifestWithRetry(root);
 	if (const auto* endedOutcome = std::get_if<NodeOutcome>(&built))
@@ -213,7 +392,9 @@ NodeOutcome CTransferExecutor::copyRoot(const RootTransferIntent& intent)
 
 	rootTotalsResolved(tree.subtreeBytes, tree.subtreeItems);
 	_context.publishProgressSnapshot(); // Back to Working, with totals possibly exact from here on
-	return runDirectoryNode(tree, TransferNodePosition::SelectedRoot, mv(choice), false);
+	return journaled
+		? copyDirectoryContents(tree, journaled->destination, journaled->operationCreated)
+		: runDirectoryNode(tree, TransferNodePosition::SelectedRoot, mv(*choice), false);
 }
 
 NodeOutcome CTransferExecutor::copyNode(const SourceNode& node, CEntryPath proposedDestination, const TransferNodePosition position)
@@ -234,7 +415,17 @@ NodeOutcome CTransferExecutor::copyNode(const SourceNode& node, CEntryPath propo
 
 	const bool fileLike = node.entry.kind == OperationEntryKind::RegularFile || node.entry.kind == OperationEntryKind::FileLink;
 	if (!fileLike)
+	{
+		if (const auto journaled = journaledDirectory(node.entry))
+			return copyDirectoryContents(node, journaled->destination, journaled->operationCreated);
 		return runDirectoryNode(node, position, resolveDirectoryDestination(_context, node.entry, mv(proposedDestination), position), false);
+	}
+
+	if (journaledFileCopied(node.entry))
+	{
+		accountRenamedSubtree(node);
+		return NodeOutcome::Completed;
+	}
 
 	for (;;)
 	{
@@ -278,6 +469,8 @@ NodeOutcome CTransferExecutor::runDirectoryNode(const SourceNode& node, const Tr
 		}
 		if (const auto* merge = std::get_if<MergeDirectory>(&choice))
 		{
+			if (_journal)
+				journalWritten(_journal->recordDirectory(node.entry.path, CTransferJournal::Directory{ merge->path, false }));
 			return _requestKind == TransferKind::Move
 				? moveDirectoryContents(node, merge->path, false, knownCrossDevice)
 				: copyDirectoryContents(node, merge->path, false);
@@ -289,6 +482,8 @@ NodeOutcome CTransferExecutor::runDirectoryNode(const SourceNode& node, const Tr
 		{
 			if (*created == DirectoryCreationOutcome::CreatedFinalDirectory)
 			{
+				if (_journal)
+					journalWritten(_journal->recordDirectory(node.entry.path, CTransferJournal::Directory{ use.path, true }));
 				return _requestKind == TransferKind::Move
 					? moveDirectoryContents(node, use.path, true, knownCrossDevice)
 					: copyDirectoryContents(node, use.path, true);
@@ -330,15 +525,40 @@ NodeOutcome CTransferExecutor::copyDirectoryContents(const SourceNode& node, con
 			recordTimestampWarning(node.entry, destination, mv(captured.error()));
 	}
 
+	std::optional<FileCopyPrefetch> prefetch;
+	if (_fileCopyWorkers > 1 && !node.children.empty())
+		prefetch.emplace(*this, node, destination);
+
 	NodeOutcome aggregate = NodeOutcome::Completed;
-	for (const SourceNode& child : node.children)
+	for (size_t i = 0; i < node.children.size(); ++i)
 	{
-		const NodeOutcome childOutcome = copyNode(child, destination.child(child.entry.path.name()), TransferNodePosition::Descendant);
+		const SourceNode& child = node.children[i];
+		auto prefetched = prefetch ? prefetch->take(i) : std::nullopt;
+		const NodeOutcome childOutcome = prefetched
+			? copyPrefetchedFileNode(child, destination.child(child.entry.path.name()), mv(*prefetched))
+			: copyNode(child, destination.child(child.entry.path.name()), TransferNodePosition::Descendant);
 		aggregate = aggregateChildOutcome(aggregate, childOutcome);
 		if (childOutcome == NodeOutcome::Cancelled)
 			break;
 	}
 
+	// Only left after a cancellation. What the workers had already published is there to stay, and is accounted as
+	// such; nothing else they did is reported past the cancellation but the cleanup warnings.
+	if (prefetch)
+	{
+		for (auto& [childIndex, attempt] : prefetch->stop())
+		{
+			const SourceNode& child = node.children[childIndex];
+			if (attempt.result == StagedAttempt::Result::Published)
+				(void)stagedFileTransferWithPolicy(child.entry, destination.child(child.entry.path.name()), ReplacementMode::RequireAbsent, PublishedSourceAction::RetainSource, false, mv(attempt));
+			else
+			{
+				for (OperationDiagnostic& warning : attempt.warnings)
+					_context.recordWarning(mv(warning));
+			}
+		}
+	}
+
 	// Post-order, so child mutations cannot disturb the stamp; skipped on cancellation because the
 	// directory's content story did not finish.
 	if (operationCreated && copyableTimes && aggregate != NodeOutcome::Cancelled)
@@ -350,6 +570,63 @@ NodeOutcome CTransferExecutor::copyDirectoryContents(const SourceNode& node, con
 	return aggregate;
 }
 
+NodeOutcome CTransferExecutor::copyPrefetchedFileNode(const SourceNode& node, CEntryPath proposedDestination, StagedAttempt attempt)
+{
+	assert_debug_only(attempt.result != StagedAttempt::Result::Cancelled); // The workers are only stopped once the traversal is
+
+	// The checkpoint copyNode() would have started with; cancelling here cannot undo a publication, which still counts
+	const bool proceed = _context.checkpoint();
+	if (attempt.result == StagedAttempt::Result::Published)
+	{
+		const auto outcome = stagedFileTransferWithPolicy(node.entry, proposedDestination, ReplacementMode::RequireAbsent, PublishedSourceAction::RetainSource, false, mv(attempt));
+		assert_debug_only(outcome == NodeOutcome::Completed);
+		return proceed ? NodeOutcome::Completed : NodeOutcome::Cancelled;
+	}
+
+	if (!proceed)
+	{
+		for (OperationDiagnostic& warning : attempt.warnings)
+			_context.recordWarning(mv(warning));
+		return NodeOutcome::Cancelled;
+	}
+
+	// The failed attempt stands in for the first one after an unprompted resolution, which is all an absent destination gets
+	if (const auto outcome = stagedFileTransferWithPolicy(node.entry, proposedDestination, ReplacementMode::RequireAbsent, PublishedSourceAction::RetainSource, false, mv(attempt)))
+		return *outcome;
+	return copyNode(node, mv(proposedDestination), TransferNodePosition::Descendant); // A new collision appeared at publication: resolve it freshly
+}
+
+std::optional<CTransferJournal::Directory> CTransferExecutor::journaledDirectory(const EntrySnapshot& source) const
+{
+	auto directory = _journal ? _journal->directory(source.path) : std::nullopt;
+	if (!directory)
+		return std::nullopt;
+
+	// Anything else there now is for destination resolution to deal with, as on a first run
+	const auto existing = inspectEntry(directory->destination);
+	if (!existing || !existing->has_value() || (**existing).kind != OperationEntryKind::Directory)
+		return std::nullopt;
+	return directory;
+}
+
+bool CTransferExecutor::journaledFileCopied(const EntrySnapshot& source) const
+{
+	const auto copied = _journal ? _journal->copiedFile(source.path) : std::nullopt;
+	if (!copied || copied->size != source.size)
+		return false;
+
+	const auto existing = inspectEntry(copied->destination);
+	if (!existing || !existing->has_value() || (**existing).kind != OperationEntryKind::RegularFile || (**existing).size != copied->size)
+		return false;
+
+	// An edit that keeps the size is only told apart by the time
+	const auto unchangedSince = [](const CEntryPath& path, const thin_io::timestamp& recorded) {
+		const auto lastWrite = readLastWriteTime(path);
+		return lastWrite && lastWrite->has_value() && (**lastWrite).seconds == recorded.seconds && (**lastWrite).nanoseconds == recorded.nanoseconds;
+	};
+	return unchangedSince(source.path, copied->sourceLastWrite) && unchangedSince(copied->destination, copied->destinationLastWrite);
+}
+
 // --- Move ---
 
 NodeOutcome CTransferExecutor::moveRoot(const RootTransferIntent& intent)
@@ -558,6 +835,9 @@ NodeOutcome CTransferExecutor::moveDirectoryContents(const SourceNode& node, con
 			recordTimestampWarning(node.entry, destination, mv(captured.error()));
 	}
 
+	DurabilityGroup durabilityGroup;
+	DurabilityGroup* const enclosingGroup = std::exchange(_durabilityGroup, &durabilityGroup);
+
 	NodeOutcome aggregate = NodeOutcome::Completed;
 	bool allChildrenCompleted = true;
 	for (const SourceNode& child : node.children)
@@ -569,6 +849,13 @@ NodeOutcome CTransferExecutor::moveDirectoryContents(const SourceNode& node, con
 			break;
 	}
 
+	// Cancelled or not: what is in the group is published, and so committed. The directory's own source removal below
+	// needs every child's to be done.
+	_durabilityGroup = enclosingGroup;
+	const NodeOutcome groupFlushed = flushDurabilityGroup(durabilityGroup);
+	aggregate = aggregateChildOutcome(aggregate, groupFlushed);
+	allChildrenCompleted = allChildrenCompleted && groupFlushed == NodeOutcome::Completed;
+
 	if (operationCreated && copyableTimes && aggregate != NodeOutcome::Cancelled)
 	{
 		if (const auto applied = CFileSystemMutator::applyDirectoryTimes(destination, *copyableTimes); !applied)
@@ -708,6 +995,76 @@ NodeOutcome CTransferExecutor::removePublishedSourceWithPolicy(const EntrySnapsh
 	return NodeOutcome::Completed;
 }
 
+NodeOutcome CTransferExecutor::deferSourceRemoval(const EntrySnapshot& source, const CEntryPath& destination, std::optional<DeferredMetadata> metadata,
+	const bool makeWritableAuthorized)
+{
+	assert_debug_only(_durabilityGroup);
+	DurabilityGroup& group = *_durabilityGroup;
+	group.moves.push_back(DurabilityGroup::PublishedMove{ source, destination, mv(metadata), makeWritableAuthorized });
+	group.bytes += source.size;
+
+	// Transferred, but not moved until its source is removed
+	_context.progress().clearCurrentEntry();
+	_context.publishProgressSnapshot();
+
+	if (group.moves.size() < maxDurabilityGroupFiles && group.bytes < maxDurabilityGroupBytes)
+		return NodeOutcome::Completed;
+	return flushDurabilityGroup(group);
+}
+
+NodeOutcome CTransferExecutor::flushDurabilityGroup(DurabilityGroup& group)
+{
+	const auto moves = std::exchange(group.moves, {});
+	group.bytes = 0;
+	if (moves.empty())
+		return NodeOutcome::Completed;
+
+	std::vector<CEntryPath> destinations;
+	destinations.reserve(moves.size());
+	for (const DurabilityGroup::PublishedMove& move : moves)
+		destinations.push_back(move.destination);
+
+	for (;;)
+	{
+		auto flushed = CFileSystemMutator::flushPublishedFiles(destinations);
+		if (flushed)
+			break;
+
+		// One prompt for the group, naming its first move. Giving up retains both entries of every move in it, as a
+		// failed source removal does.
+		const DurabilityGroup::PublishedMove& first = moves.front();
+		FailureDetails failure{ FailedAction::WriteDestination, mv(flushed.error()) };
+		const auto decision = _context.resolveDecision(OperationIssue{ IssueKind::ActionFailed, first.source,
+			destinationSnapshotFor(first.source, first.destination), failure }, false);
+		if (decision && decision->action == DecisionAction::Retry)
+			continue;
+
+		assert_debug_only(!decision || decision->action == DecisionAction::Skip || decision->action == DecisionAction::Cancel);
+		const NodeOutcome outcome = decision && decision->action == DecisionAction::Skip ? NodeOutcome::Failed : NodeOutcome::Cancelled;
+		for (const DurabilityGroup::PublishedMove& move : moves)
+			(void)recordTerminalCleanupFailure(move.source, move.destination, failure, outcome);
+		return outcome;
+	}
+
+	NodeOutcome aggregate = NodeOutcome::Completed;
+	for (const DurabilityGroup::PublishedMove& move : moves)
+	{
+		// Only now that the data is on the disk may the copy look like its source (a replacement, flushed before it was
+		// published, has its metadata already). The metadata goes to the disk no later than the source's removal does:
+		// a journaling filesystem commits the two in order.
+		if (move.metadata)
+		{
+			if (auto applied = CFileSystemMutator::applyFileMetadata(move.destination, move.metadata->times, move.metadata->permissions); !applied)
+			{
+				_context.recordWarning(OperationDiagnostic{ FailureDetails{ FailedAction::PreserveFileMetadata, mv(applied.error()) },
+					move.source, destinationSnapshotFor(move.source, move.destination) });
+			}
+		}
+		aggregate = aggregateChildOutcome(aggregate, removePublishedSourceWithPolicy(move.source, move.destination, move.makeWritableAuthorized));
+	}
+	return aggregate;
+}
+
 NodeOutcome CTransferExecutor::recordTerminalCleanupFailure(const EntrySnapshot& entry, const CEntryPath& destination,
 	FailureDetails failure, const NodeOutcome outcome)
 {
@@ -729,95 +1086,69 @@ void CTransferExecutor::accountRenamedSubtree(const SourceNode& node)
 // --- Staged transfer (copy, and the copy-based move fallback) ---
 
 std::optional<NodeOutcome> CTransferExecutor::stagedFileTransferWithPolicy(const EntrySnapshot& source, const CEntryPath& destination,
-	const ReplacementMode replacement, const PublishedSourceAction sourceAction, const bool makeWritableAuthorized)
+	const ReplacementMode replacement, const PublishedSourceAction sourceAction, const bool makeWritableAuthorized,
+	std::optional<StagedAttempt> prefetchedAttempt)
 {
+	// The durability contract: nothing is destroyed before what takes its place is on the disk. An authorized
+	// replacement destroys the old destination as it publishes, so it flushes first; an owned-source move destroys its
+	// source only after publication, so it leaves the flush - and its source's metadata - to its durability group.
+	const CommitDurability durability = replacement == ReplacementMode::ReplaceExistingFile ? CommitDurability::FlushBeforePublish
+		: sourceAction == PublishedSourceAction::RemoveOwnedSource ? CommitDurability::FlushWithGroup
+		: CommitDurability::NoFlush;
+
 	for (;;)
 	{
-		if (!_context.checkpoint())
-			return NodeOutcome::Cancelled;
-
-		_context.progress().setCurrentEntry(source.path, source.size);
-		_context.publishProgressSnapshot();
-
-		FailureDetails failure{};
-		bool sessionCompleted = false;
-		bool freshCollisionAtPublication = false;
-
-		auto session = CStagedFileCopy::begin(source.path, destination);
-		if (!session)
+		StagedAttempt attempt;
+		if (prefetchedAttempt)
 		{
-			auto beginFailure = mv(session.error());
-			failure = mv(beginFailure.primaryFailure);
-			if (beginFailure.cleanupFailure)
-				_context.recordWarning(OperationDiagnostic{ mv(*beginFailure.cleanupFailure), source, {} });
+			// Run ahead by a file-copy worker; accounted here, in traversal order, as if it had just run on this thread
+			assert_debug_only(prefetchedAttempt->result != StagedAttempt::Result::Cancelled);
+			attempt = mv(*prefetchedAttempt);
+			prefetchedAttempt.reset();
+
+			_context.progress().setCurrentEntry(source.path, source.size);
+			for (const CopyChunkResult& chunk : attempt.chunks)
+				accountStagedChunk(chunk);
 		}
 		else
 		{
-			bool transferFailed = false;
-			for (;;)
-			{
-				if (!_context.checkpoint())
-				{
-					abortStagedSession(*session, source);
-					_context.progress().currentEntryAbandoned();
-					return NodeOutcome::Cancelled;
-				}
+			if (!_context.checkpoint())
+				return NodeOutcome::Cancelled;
 
-				auto chunk = session->writeNext(_transferChunkSize);
-				if (!chunk)
-				{
-					failure = mv(chunk.error());
-					transferFailed = true;
-					break;
-				}
-				if (chunk->bytesWritten != 0)
-				{
-					_context.progress().fileTransferAdvanced(chunk->bytesWritten);
-					_context.addTransferredBytes(chunk->bytesWritten);
-					_context.publishProgressSnapshot();
-				}
-				if (chunk->readyToCommit)
-					break;
-			}
+			_context.progress().setCurrentEntry(source.path, source.size);
+			_context.publishProgressSnapshot();
 
-			if (!transferFailed)
-			{
-				if (!_context.checkpoint())
-				{
-					abortStagedSession(*session, source);
-					_context.progress().currentEntryAbandoned();
-					return NodeOutcome::Cancelled;
-				}
+			attempt = runStagedAttempt(source, destination, replacement, durability, _pageCachePolicy, _verification, _transferChunkSize,
+				_chunkSizer ? &*_chunkSizer : nullptr, _resumeLargeFiles && _journal ? &*_journal : nullptr, _throttle,
+				[this] { return _context.checkpoint(); },
+				[this](const CopyChunkResult& chunk) { accountStagedChunk(chunk); });
+		}
 
-				// The durability contract: flushing is required exactly where publication destroys the only
-				// other copy - an authorized replacement, and every owned-source move (removal follows).
-				const CommitDurability durability = (sourceAction == PublishedSourceAction::RemoveOwnedSource || replacement == ReplacementMode::ReplaceExistingFile)
-					? CommitDurability::FlushBeforePublish : CommitDurability::NoFlush;
-				if (auto committed = session->commit(replacement, durability); committed)
-					sessionCompleted = true;
-				else
-					failure = mv(committed.error());
-			}
+		for (OperationDiagnostic& warning : attempt.warnings)
+			_context.recordWarning(mv(warning));
+		if (attempt.journalFailure)
+			recordJournalWarning(mv(*attempt.journalFailure));
 
-			if (!sessionCompleted)
-			{
-				abortStagedSession(*session, source);
-				// A publication-time AlreadyExists may re-enter resolution, but only when fresh inspection
-				// proves the new collision really exists (nothing was published either way).
-				if (failure.action == FailedAction::PublishDestination
-					&& failure.filesystemError.category == FileErrorCategory::AlreadyExists)
-				{
-					if (const auto fresh = inspectEntry(destination); fresh && fresh->has_value())
-						freshCollisionAtPublication = true;
-				}
-			}
+		if (attempt.result == StagedAttempt::Result::Cancelled)
+		{
+			_context.progress().currentEntryAbandoned();
+			return NodeOutcome::Cancelled;
 		}
 
-		if (sessionCompleted)
+		if (attempt.result == StagedAttempt::Result::Published)
 		{
-			// Publication is the move's commit point: from here the committed cleanup segment runs to its end.
+			if (_verificationManifest && attempt.verifiedContentHash)
+			{
+				if (auto added = _verificationManifest->add(destination, *attempt.verifiedContentHash); !added)
+					recordManifestWarning(mv(added.error()));
+			}
+			if (_journal)
+				journalCopiedFile(source, destination, attempt.sourceLastWrite);
+
+			// Publication is the move's commit point: from here the committed cleanup segment runs to its end, once the
+			// group's flush has made the destination durable.
 			if (sourceAction == PublishedSourceAction::RemoveOwnedSource)
-				return removePublishedSourceWithPolicy(source, destination, makeWritableAuthorized);
+				return deferSourceRemoval(source, destination, mv(attempt.deferredMetadata), makeWritableAuthorized);
 
 			_context.addCompletedItems(1);
 			_context.progress().itemCompleted();
@@ -827,10 +1158,10 @@ std::optional<NodeOutcome> CTransferExecutor::stagedFileTransferWithPolicy(const
 		}
 
 		_context.progress().currentEntryAbandoned();
-		if (freshCollisionAtPublication)
+		if (attempt.freshCollisionAtPublication)
 			return {};
 
-		const auto decision = _context.resolveDecision(OperationIssue{ IssueKind::ActionFailed, source, {}, mv(failure) });
+		const auto decision = _context.resolveDecision(OperationIssue{ IssueKind::ActionFailed, source, {}, mv(attempt.failure) });
 		if (!decision || decision->action == DecisionAction::Cancel)
 			return NodeOutcome::Cancelled;
 		if (decision->action == DecisionAction::Skip)
@@ -845,10 +1176,170 @@ std::optional<NodeOutcome> CTransferExecutor::stagedFileTransferWithPolicy(const
 	}
 }
 
-void CTransferExecutor::abortStagedSession(CStagedFileCopy& session, const EntrySnapshot& source)
+CTransferExecutor::StagedAttempt CTransferExecutor::runStagedAttempt(const EntrySnapshot& source, const CEntryPath& destination,
+	const ReplacementMode replacement, const CommitDurability durability, const PageCachePolicy pageCachePolicy, const CopyVerification verification,
+	const uint64_t chunkSize, CTransferChunkSizer* const chunkSizer, CTransferJournal* journal, CTransferThrottle* const throttle,
+	const std::function<bool()>& checkpoint, const std::function<void(const CopyChunkResult&)>& chunkStaged)
 {
-	if (auto aborted = session.abort(); !aborted)
-		_context.recordWarning(OperationDiagnostic{ mv(aborted.error()), source, {} });
+	StagedAttempt attempt;
+	const auto abortSession = [&](CStagedFileCopy& session) {
+		if (auto aborted = session.abort(); !aborted)
+			attempt.warnings.push_back(OperationDiagnostic{ mv(aborted.error()), source, {} });
+	};
+
+	// A failed journal write is reported once, and the attempt goes on as if there had been no journal
+	bool resumable = journal && source.size >= CTransferJournal::resumableFileSize;
+	const auto journalWritten = [&](std::expected<void, CFileSystemError> written) {
+		if (written)
+			return true;
+		attempt.journalFailure = mv(written.error());
+		journal = nullptr;
+		resumable = false;
+		return false;
+	};
+	const auto forgetPartialFile = [&] {
+		if (journal && journal->partialFile(source.path))
+			(void)journalWritten(journal->forgetPartialFile(source.path));
+	};
+
+	const auto partial = resumable ? journal->partialFile(source.path) : std::nullopt;
+	std::optional<CStagedFileCopy> session = partial
+		? CStagedFileCopy::resume(source.path, destination, partial->stagingPath, partial->sourceSize, partial->stagedBytes, CopyBackend::Clone, pageCachePolicy, verification)
+		: std::nullopt;
+	if (partial && !session)
+		forgetPartialFile(); // The source has changed, or the staging file is damaged or gone: a fresh copy is the only way
+
+	if (!session)
+	{
+		auto begun = CStagedFileCopy::begin(source.path, destination, CopyBackend::Clone, pageCachePolicy, verification,
+			resumable ? StagingLifetime::Resumable : StagingLifetime::Session);
+		if (!begun)
+		{
+			auto beginFailure = mv(begun.error());
+			attempt.failure = mv(beginFailure.primaryFailure);
+			if (beginFailure.cleanupFailure)
+				attempt.warnings.push_back(OperationDiagnostic{ mv(*beginFailure.cleanupFailure), source, {} });
+			return attempt;
+		}
+		session.emplace(mv(*begun));
+	}
+
+	const auto recordPartialFile = [&](const uint64_t stagedBytes) {
+		return journalWritten(journal->recordPartialFile(source.path, CTransferJournal::PartialFile{ session->stagingPath(), source.size, stagedBytes }));
+	};
+	// A resumable copy leaves its staging file, and the journal the record of it, for the next run of the request to
+	// carry on with. The record comes first: a staging file the journal has no record of would be left for nothing.
+	const auto discardSession = [&] {
+		abortSession(*session);
+		forgetPartialFile();
+	};
+	const auto stop = [&] {
+		attempt.result = StagedAttempt::Result::Cancelled;
+		if (resumable)
+		{
+			if (const auto flushed = session->flushStaged(); flushed && recordPartialFile(*flushed) && session->suspend())
+				return;
+		}
+		discardSession();
+	};
+
+	uint64_t unthrottledBytes = 0;
+	const auto proceed = [&] {
+		return checkpoint() && (!throttle || throttle->pass(std::exchange(unthrottledBytes, 0)));
+	};
+
+	const auto devices = chunkSizer ? chunkSizer->devicePairOf(source.path, destination) : std::nullopt;
+	uint64_t unrecordedBytes = 0;
+	for (;;)
+	{
+		if (!proceed())
+		{
+			stop();
+			return attempt;
+		}
+
+		uint64_t size = chunkSizer ? chunkSizer->chunkSize(devices) : chunkSize;
+		if (const auto maxChunkSize = throttle ? throttle->maxChunkSize() : std::nullopt)
+			size = std::min(size, *maxChunkSize);
+
+		if (throttle)
+			session->setTransferPriority(throttle->priority()); // For an overlapped copy's reader
+		const auto chunkStart = std::chrono::steady_clock::now();
+		auto chunk = session->writeNext(size);
+		// A clone moves no data, and would teach the sizer a throughput no device has
+		if (chunkSizer && chunk && chunk->backend != CopyBackend::Clone)
+			chunkSizer->chunkTransferred(devices, chunk->bytesWritten, std::chrono::steady_clock::now() - chunkStart);
+		if (!chunk)
+		{
+			attempt.failure = mv(chunk.error());
+			discardSession();
+			return attempt;
+		}
+		if (chunk->bytesWritten != 0 || chunk->holeBytes != 0 || chunk->resumedBytes != 0)
+		{
+			if (chunkStaged)
+				chunkStaged(*chunk);
+			else
+				attempt.chunks.push_back(*chunk);
+		}
+		if (chunk->backend != CopyBackend::Clone) // A clone moves no data
+			unthrottledBytes += chunk->bytesWritten;
+		if (chunk->readyToCommit)
+			break;
+
+		// What a crash would lose is bounded by the interval
+		unrecordedBytes += chunk->bytesWritten + chunk->holeBytes;
+		if (resumable && unrecordedBytes >= CTransferJournal::partialFileRecordInterval)
+		{
+			unrecordedBytes = 0;
+			auto flushed = session->flushStaged();
+			if (!flushed)
+			{
+				attempt.failure = mv(flushed.error());
+				discardSession();
+				return attempt;
+			}
+			(void)recordPartialFile(*flushed);
+		}
+	}
+
+	if (!proceed())
+	{
+		stop();
+		return attempt;
+	}
+
+	auto committed = session->commit(replacement, durability);
+	if (committed)
+	{
+		attempt.result = StagedAttempt::Result::Published;
+		attempt.verifiedContentHash = session->verifiedContentHash();
+		attempt.sourceLastWrite = session->sourceLastWrite();
+		if (durability == CommitDurability::FlushWithGroup)
+			attempt.deferredMetadata = DeferredMetadata{ session->sourceTimes(), session->sourcePermissions() };
+		return attempt;
+	}
+
+	attempt.failure = mv(committed.error());
+	discardSession();
+	// A publication-time AlreadyExists may re-enter resolution, but only when fresh inspection
+	// proves the new collision really exists (nothing was published either way).
+	if (attempt.failure.action == FailedAction::PublishDestination
+		&& attempt.failure.filesystemError.category == FileErrorCategory::AlreadyExists)
+	{
+		if (const auto fresh = inspectEntry(destination); fresh && fresh->has_value())
+			attempt.freshCollisionAtPublication = true;
+	}
+	return attempt;
+}
+
+void CTransferExecutor::accountStagedChunk(const CopyChunkResult& chunk)
+{
+	_context.progress().fileTransferAdvanced(chunk.bytesWritten);
+	_context.progress().fileBytesSkipped(chunk.holeBytes + chunk.resumedBytes);
+	_context.progress().setTransferRateLimit(_throttle ? _throttle->effectiveLimit() : std::nullopt);
+	_context.addTransferredBytes(chunk.bytesWritten, chunk.backend); // Only the data: a sparse file's holes stay unwritten
+	_context.publishProgressSnapshot();
 }
 
 void CTransferExecutor::recordTimestampWarning(const EntrySnapshot& source, const CEntryPath& destination, CFileSystemError error)
@@ -857,6 +1348,38 @@ void CTransferExecutor::recordTimestampWarning(const EntrySnapshot& source, cons
 		source, EntrySnapshot{ destination, OperationEntryKind::Directory, 0 } });
 }
 
+void CTransferExecutor::recordManifestWarning(CFileSystemError error)
+{
+	assert_debug_only(_verificationManifest);
+	_context.recordWarning(OperationDiagnostic{ FailureDetails{ FailedAction::WriteVerificationManifest, mv(error) },
+		EntrySnapshot{ _verificationManifest->path(), OperationEntryKind::RegularFile, 0 }, {} });
+	_verificationManifest.reset();
+}
+
+void CTransferExecutor::recordJournalWarning(CFileSystemError error)
+{
+	assert_debug_only(_journal);
+	_context.recordWarning(OperationDiagnostic{ FailureDetails{ FailedAction::WriteTransferJournal, mv(error) },
+		EntrySnapshot{ _journal->path(), OperationEntryKind::RegularFile, 0 }, {} });
+	_journal.reset();
+}
+
+void CTransferExecutor::journalWritten(std::expected<void, CFileSystemError> written)
+{
+	if (!written) [[unlikely]]
+		recordJournalWarning(mv(written.error()));
+}
+
+void CTransferExecutor::journalCopiedFile(const EntrySnapshot& source, const CEntryPath& destination, const std::optional<thin_io::timestamp> sourceLastWrite)
+{
+	assert_debug_only(_journal);
+	const auto destinationLastWrite = readLastWriteTime(destination);
+	if (!sourceLastWrite || !destinationLastWrite || !destinationLastWrite->has_value())
+		return;
+
+	journalWritten(_journal->recordCopiedFile(source.path, CTransferJournal::CopiedFile{ destination, source.size, *sourceLastWrite, **destinationLastWrite }));
+}
+
 void CTransferExecutor::accountSkippedSubtree(const SourceNode& node)
 {
 	_context.addSkippedItems(node.subtreeItems);
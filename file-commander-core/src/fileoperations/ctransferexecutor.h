@@ -2,18 +2,56 @@
 
 #include "cdestinationresolver.h"
 #include "csourcetreebuilder.h"
+#include "ctransferchunksizer.h"
+#include "ctransferjournal.h"
+#include "ctransferthrottle.h"
+#include "cverificationmanifest.h"
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
 
 class COperationExecutionContext;
-class CStagedFileCopy;
+class CThreadPool;
 
-// The synchronous recursive transfer executor for copy and move. Runs entirely on the caller's thread; all
-// environment interaction - checkpoints, decisions, progress, diagnostics - goes through the execution context.
+// The synchronous recursive transfer executor for copy and move. Runs on the caller's thread; all environment
+// interaction - checkpoints, decisions, progress, diagnostics - goes through the execution context.
 // Move is rename-first: native rename is attempted at every useful owned root/subtree boundary, and only a
 // classified CrossDevice result selects the staged-copy fallback with its committed source-cleanup segment.
+// With more than one file-copy worker, a copy also stages and publishes the small files of each directory ahead of
+// the traversal on a pool of that many threads (see FileCopyPrefetch). Only what needs no decision is done ahead, and
+// the executor accounts it when its traversal gets to the file, so that decisions, prompts, progress and the summary
+// come in the same order as without the workers.
+// A verifying request (TransferRequest::verification) has every staged copy verified before it is published; a copy
+// that fails verification goes through the ActionFailed policy like any other failed copy. The manifest lists the
+// verified copies in traversal order; failing to write it is a warning, and the rest of it is given up.
+// A copy with a journal (TransferRequest::journalDirectory) carries on with what an earlier run of the same request
+// left: a directory it created or merged into is copied into again without resolution, a file it published that is
+// still there with both last-write times unchanged is accounted as completed, and - if the request resumes large files
+// (TransferRequest::resumeLargeFiles) - a large file it stopped in the middle of resumes from its staging file. The
+// journal goes once a run is not cancelled; failing to write it is a warning, and the copy goes on without one.
+// A move that falls back to staged copies does not flush each file before publishing it: the files of a directory are
+// published as they are copied, and their sources removed a group at a time, after one flush of the lot has made them
+// durable (see DurabilityGroup). An authorized replacement, which destroys the old destination as it publishes, still
+// flushes its own file first.
 class CTransferExecutor
 {
 public:
-	explicit CTransferExecutor(COperationExecutionContext& context, uint64_t transferChunkSize) noexcept;
+	// Files up to this size are copied ahead by the file-copy workers
+	static constexpr uint64_t maxPrefetchedFileSize = 1024 * 1024;
+	// A durability group is flushed, and its sources removed, once it has this many files or bytes in it. The bigger
+	// the group, the fewer the flushes - and the longer the sources wait, with the progress display standing still
+	// while a big one is flushed.
+	static constexpr size_t maxDurabilityGroupFiles = 256;
+	static constexpr uint64_t maxDurabilityGroupBytes = 64 * 1024 * 1024;
+
+	// transferChunkSize: the size of every staged-copy chunk, or adaptiveTransferChunkSize for CTransferChunkSizer to
+	// pick each one. pageCachePolicy applies to every staged copy. throttle, if set, paces every staged copy, the
+	// file-copy workers' too.
+	explicit CTransferExecutor(COperationExecutionContext& context, uint64_t transferChunkSize, uint32_t fileCopyWorkers = 1,
+		PageCachePolicy pageCachePolicy = PageCachePolicy::Automatic, CTransferThrottle* throttle = nullptr) noexcept;
+	~CTransferExecutor();
 
 	[[nodiscard]] OperationSummary run(const TransferRequest& request);
 
@@ -32,6 +70,56 @@ private:
 		CrossDevice          // The staged-copy fallback takes over for this subtree
 	};
 
+	// What a CommitDurability::FlushWithGroup publication leaves for its group to apply after the flush
+	struct DeferredMetadata
+	{
+		thin_io::entry_times times;
+		thin_io::file_permissions permissions;
+	};
+
+	// One staged-copy session, from begin() to publication or to its failure, including the cleanup after a failure.
+	// Run by the executor as it goes, or ahead of it by a file-copy worker - which records for the executor to
+	// account later what the executor's own attempt accounts right away.
+	struct StagedAttempt
+	{
+		enum class Result
+		{
+			Published,
+			Failed,
+			Cancelled // Stopped at a checkpoint; the staging data is discarded, or suspended for the journal
+		};
+
+		Result result = Result::Failed;
+		FailureDetails failure{};
+		bool freshCollisionAtPublication = false; // The failure is an AlreadyExists at publication that fresh inspection confirmed
+		std::optional<uint64_t> verifiedContentHash; // Of a verified publication
+		std::optional<thin_io::timestamp> sourceLastWrite; // Of a publication: the source's, as the copy got it
+		std::optional<DeferredMetadata> deferredMetadata; // Of a CommitDurability::FlushWithGroup publication
+		std::vector<CopyChunkResult> chunks; // Only of a worker's attempt
+		std::vector<OperationDiagnostic> warnings;
+		std::optional<CFileSystemError> journalFailure; // Writing the journal failed, and the attempt went on without it
+	};
+
+	class FileCopyPrefetch;
+
+	// Owned-source moves published without a flush of their own, into one directory or for the roots of the request,
+	// whose sources wait for flushDurabilityGroup() to remove them: no source goes before its destination is durable.
+	// Neither does a destination get its source's times and permissions: until then it can't pass for a complete copy.
+	// Each one's outcome so far is Completed; the flush adds the rest.
+	struct DurabilityGroup
+	{
+		struct PublishedMove
+		{
+			EntrySnapshot source;
+			CEntryPath destination;
+			std::optional<DeferredMetadata> metadata; // Absent for a replacement, which was flushed before publication
+			bool makeWritableAuthorized;
+		};
+
+		std::vector<PublishedMove> moves;
+		uint64_t bytes = 0;
+	};
+
 	// --- Shared by copy and move ---
 
 	// Fresh root inspection with the local ActionFailed retry policy; the outcome alternative ends the root.
@@ -54,13 +142,35 @@ private:
 	[[nodiscard]] NodeOutcome runDirectoryNode(const SourceNode& node, TransferNodePosition position, DestinationChoice choice, bool knownCrossDevice);
 
 	// One complete staged-copy session per attempt with the local Retry/Skip/Cancel policy; for
-	// RemoveOwnedSource, successful publication continues into the committed cleanup segment.
+	// RemoveOwnedSource, successful publication joins the current durability group on its way to the committed
+	// cleanup segment.
 	// nullopt = a new destination collision appeared at publication; the caller re-enters resolution.
+	// prefetchedAttempt, a worker's attempt at the same transfer, is accounted in place of the first one.
 	[[nodiscard]] std::optional<NodeOutcome> stagedFileTransferWithPolicy(const EntrySnapshot& source, const CEntryPath& destination,
-		ReplacementMode replacement, PublishedSourceAction sourceAction, bool makeWritableAuthorized);
+		ReplacementMode replacement, PublishedSourceAction sourceAction, bool makeWritableAuthorized,
+		std::optional<StagedAttempt> prefetchedAttempt = {});
 
-	void abortStagedSession(CStagedFileCopy& session, const EntrySnapshot& source);
+	// Touches no executor state, so that a worker can run it too: chunkStaged is called for every chunk if set,
+	// otherwise the chunks are recorded in the result. checkpoint returning false cancels the attempt.
+	// chunkSizer, if set, sizes every chunk instead of chunkSize, and is told how long each one took.
+	// With a journal, a file of at least CTransferJournal::resumableFileSize resumes what the journal has of it, records
+	// its progress as it goes, and is suspended rather than discarded when cancelled.
+	// A throttle is passed before every chunk, and before the commit, with the data written since; a cancelled one
+	// cancels the attempt. Under a limit, no chunk is bigger than the throttle's maxChunkSize().
+	[[nodiscard]] static StagedAttempt runStagedAttempt(const EntrySnapshot& source, const CEntryPath& destination,
+		ReplacementMode replacement, CommitDurability durability, PageCachePolicy pageCachePolicy, CopyVerification verification,
+		uint64_t chunkSize, CTransferChunkSizer* chunkSizer, CTransferJournal* journal, CTransferThrottle* throttle,
+		const std::function<bool()>& checkpoint, const std::function<void(const CopyChunkResult&)>& chunkStaged);
+	void accountStagedChunk(const CopyChunkResult& chunk);
 	void recordTimestampWarning(const EntrySnapshot& source, const CEntryPath& destination, CFileSystemError error);
+	// Gives up the manifest with a warning
+	void recordManifestWarning(CFileSystemError error);
+	// Gives up the journal with a warning - the latter only if the write failed
+	void recordJournalWarning(CFileSystemError error);
+	void journalWritten(std::expected<void, CFileSystemError> written);
+	// Records a published copy, with both sides' last-write times; left unrecorded, to be copied again by the next run,
+	// if either time can't be read
+	void journalCopiedFile(const EntrySnapshot& source, const CEntryPath& destination, std::optional<thin_io::timestamp> sourceLastWrite);
 
 	void accountSkippedSubtree(const SourceNode& node);
 	void accountAlreadySatisfiedSubtree(const SourceNode& node);
@@ -71,12 +181,21 @@ private:
 
 	[[nodiscard]] NodeOutcome copyRoot(const RootTransferIntent& intent);
 
+	// The journal's record of a directory an earlier run created or merged into, if the destination still is a directory
+	[[nodiscard]] std::optional<CTransferJournal::Directory> journaledDirectory(const EntrySnapshot& source) const;
+	// Whether an earlier run published a copy of this file that is still there, and neither side has been written to
+	// since: the same size, and the same last-write times
+	[[nodiscard]] bool journaledFileCopied(const EntrySnapshot& source) const;
+
 	// Dispatches one manifest node: Other handling, resolution, file copy or directory recursion.
 	[[nodiscard]] NodeOutcome copyNode(const SourceNode& node, CEntryPath proposedDestination, TransferNodePosition position);
 
 	// Creates/merges done: copies the children and finalizes timestamps for an operation-created directory.
 	[[nodiscard]] NodeOutcome copyDirectoryContents(const SourceNode& node, const CEntryPath& destination, bool operationCreated);
 
+	// copyNode() for a file child a worker has already had an attempt at, to the same destination
+	[[nodiscard]] NodeOutcome copyPrefetchedFileNode(const SourceNode& node, CEntryPath proposedDestination, StagedAttempt attempt);
+
 	// --- Move ---
 
 	[[nodiscard]] NodeOutcome moveRoot(const RootTransferIntent& intent);
@@ -107,16 +226,37 @@ private:
 	// cancellation overrides a prompt). No cancellation checkpoint; every prompt is item-only.
 	[[nodiscard]] NodeOutcome removePublishedSourceWithPolicy(const EntrySnapshot& entry, const CEntryPath& destination, bool makeWritableAuthorized);
 
+	// Adds a move published without a flush to the current durability group, flushing the group once it is full.
+	// Completed, or the flush's outcome.
+	[[nodiscard]] NodeOutcome deferSourceRemoval(const EntrySnapshot& source, const CEntryPath& destination, std::optional<DeferredMetadata> metadata,
+		bool makeWritableAuthorized);
+	// Makes the group's destinations durable in one flush, with the ActionFailed(WriteDestination) policy for a failure,
+	// then gives each its source's times and permissions (a failure is a warning) and runs its committed cleanup
+	// segment; a group that is never flushed removes no source. The outcomes aggregated, Completed for an empty group.
+	// Part of the committed segment: no cancellation checkpoint.
+	[[nodiscard]] NodeOutcome flushDurabilityGroup(DurabilityGroup& group);
+
 	[[nodiscard]] NodeOutcome recordTerminalCleanupFailure(const EntrySnapshot& entry, const CEntryPath& destination,
 		FailureDetails failure, NodeOutcome outcome);
 
-	// A subtree relocated by one native rename: every manifest item completed, no bytes streamed.
+	// A subtree relocated by one native rename, or copied by an earlier run of the request: every manifest item
+	// completed, no bytes streamed.
 	void accountRenamedSubtree(const SourceNode& node);
 
 	COperationExecutionContext& _context;
 	const uint64_t _transferChunkSize;
+	std::optional<CTransferChunkSizer> _chunkSizer; // Only with adaptiveTransferChunkSize
+	const uint32_t _fileCopyWorkers;
+	const PageCachePolicy _pageCachePolicy;
+	CTransferThrottle* const _throttle;
+	std::unique_ptr<CThreadPool> _fileCopyPool; // Created by the first directory with small files to copy ahead
 
 	TransferKind _requestKind = TransferKind::Copy;
+	CopyVerification _verification = CopyVerification::None;
+	std::optional<CVerificationManifest> _verificationManifest;
+	std::optional<CTransferJournal> _journal;
+	bool _resumeLargeFiles = false; // TransferRequest::resumeLargeFiles
+	DurabilityGroup* _durabilityGroup = nullptr; // The innermost directory's being moved into, or the roots'
 	size_t _rootsWithUnresolvedTotals = 0;
 	uint64_t _knownTotalBytes = 0;
 	size_t _knownTotalItems = 0;
@@ -0,0 +1,354 @@
+#include "ctransferjournal.h"
+#include "ccontenthasher.h"
+#include "cfilesystemmutator.h"
+#include "thiniobridge.h"
+
+#include "lang/utils.hpp" // mv()
+
+DISABLE_COMPILER_WARNINGS
+#include <QDateTime>
+#include <QDir>
+#include <QStringList>
+RESTORE_COMPILER_WARNINGS
+
+namespace
+{
+
+// Version 2 added the last-write times to file records; a version 1 journal is started afresh
+const QString journalHeader = QStringLiteral("file-commander transfer journal 2");
+const QString journalSuffix = QStringLiteral(".journal");
+
+const QString directoryRecord = QStringLiteral("directory");
+const QString fileRecord = QStringLiteral("file");
+const QString partialRecord = QStringLiteral("partial");
+const QString discardedRecord = QStringLiteral("discarded");
+
+// Of a directory record
+const QString createdField = QStringLiteral("created");
+const QString mergedField = QStringLiteral("merged");
+
+// What makes two runs the same request, and so share a journal
+QString requestIdentity(const TransferRequest& request)
+{
+	QStringList lines{
+		request.kind == TransferKind::Copy ? QStringLiteral("copy") : QStringLiteral("move"),
+		request.destination.intent == DestinationIntent::IntoDirectory ? QStringLiteral("into") : QStringLiteral("exact"),
+		request.destination.path.value()
+	};
+	for (const CEntryPath& source : request.sources)
+		lines.push_back(source.value());
+	return lines.join(u'\n');
+}
+
+// Fields are tab-separated, and records newline-terminated: neither may appear in a field as is
+QString escapeField(QString field)
+{
+	return field.replace(u'\\', QStringLiteral("\\\\")).replace(u'\t', QStringLiteral("\\t")).replace(u'\n', QStringLiteral("\\n"));
+}
+
+QStringList splitRecord(const QString& line)
+{
+	QStringList fields{ QString{} };
+	for (qsizetype i = 0; i < line.size(); ++i)
+	{
+		const QChar c = line[i];
+		if (c == u'\t')
+			fields.push_back(QString{});
+		else if (c == u'\\' && i + 1 < line.size())
+		{
+			const QChar escaped = line[++i];
+			fields.back().push_back(escaped == u't' ? QChar{ u'\t' } : escaped == u'n' ? QChar{ u'\n' } : escaped);
+		}
+		else
+			fields.back().push_back(c);
+	}
+	return fields;
+}
+
+std::optional<uint64_t> parseSize(const QString& field)
+{
+	bool ok = false;
+	const uint64_t size = field.toULongLong(&ok);
+	return ok ? std::optional{ size } : std::nullopt;
+}
+
+QStringList timestampFields(const thin_io::timestamp& time)
+{
+	return { QString::number(time.seconds), QString::number(time.nanoseconds) };
+}
+
+std::optional<thin_io::timestamp> parseTimestamp(const QString& secondsField, const QString& nanosecondsField)
+{
+	bool secondsOk = false, nanosecondsOk = false;
+	const qlonglong seconds = secondsField.toLongLong(&secondsOk);
+	const qulonglong nanoseconds = nanosecondsField.toULongLong(&nanosecondsOk);
+	if (!secondsOk || !nanosecondsOk)
+		return std::nullopt;
+
+	return thin_io::timestamp{ .seconds = static_cast<decltype(thin_io::timestamp::seconds)>(seconds),
+		.nanoseconds = static_cast<decltype(thin_io::timestamp::nanoseconds)>(nanoseconds) };
+}
+
+// Only ever one of the hidden staging siblings CStagedFileCopy names: a damaged journal must not delete anything else
+bool isStagingFileName(const QString& name)
+{
+	return name.startsWith(QLatin1StringView{ ".file-commander-copy-" }) && name.endsWith(QLatin1StringView{ ".tmp" });
+}
+
+} // namespace
+
+std::expected<CTransferJournal, CFileSystemError> CTransferJournal::open(const CEntryPath& directory, const TransferRequest& request)
+{
+	if (auto created = CFileSystemMutator::createDirectories(directory); !created) [[unlikely]]
+		return std::unexpected{ mv(created.error()) };
+
+	removeStaleJournals(directory);
+
+	CContentHasher hasher;
+	const QByteArray identity = requestIdentity(request).toUtf8();
+	hasher.update(identity.constData(), static_cast<size_t>(identity.size()));
+	CEntryPath path = directory.child(QStringLiteral("%1").arg(hasher.digest(), 16, 16, QChar{ u'0' }) + journalSuffix);
+
+	thin_io::file file;
+	const auto native = thinIoPath(path);
+	if (!file.open(nativeCStr(native), thin_io::file::access_mode::Write)) [[unlikely]]
+		return std::unexpected{ makeFileSystemError(captureNativeError()) };
+
+	CTransferJournal journal{ mv(path), mv(file) };
+	const auto validLength = journal.load();
+	if (!validLength) [[unlikely]]
+		return std::unexpected{ validLength.error() };
+
+	// What follows the last whole record is a record torn by a crash
+	if (!journal._file.resize(*validLength) || !journal._file.seek(*validLength)) [[unlikely]]
+		return std::unexpected{ makeFileSystemError(captureNativeError()) };
+	if (*validLength == 0)
+	{
+		if (auto written = journal.append({ journalHeader }); !written) [[unlikely]]
+			return std::unexpected{ mv(written.error()) };
+	}
+
+	return journal;
+}
+
+CTransferJournal::CTransferJournal(CEntryPath path, thin_io::file file) noexcept
+	: _path{ mv(path) }
+	, _file{ mv(file) }
+{
+}
+
+void CTransferJournal::removeStaleJournals(const CEntryPath& directory)
+{
+	const QDateTime staleBefore = QDateTime::currentDateTime().addDays(-maxAge.count());
+	const QFileInfoList journals = QDir{ directory.value() }.entryInfoList({ u'*' + journalSuffix }, QDir::Files | QDir::Hidden);
+	for (const QFileInfo& journalInfo : journals)
+	{
+		if (journalInfo.lastModified() >= staleBefore)
+			continue;
+
+		auto path = parseOperationPath(journalInfo.absoluteFilePath());
+		if (!path)
+			continue;
+
+		// Only its partial-file records are of interest: the copies the others refer to are the user's now
+		CTransferJournal stale{ mv(*path), thin_io::file{} };
+		if (stale.load())
+		{
+			for (const auto& [source, partial] : stale._partialFiles)
+			{
+				if (!isStagingFileName(partial.stagingPath.name()))
+					continue;
+
+				const auto stagingNative = thinIoPath(partial.stagingPath);
+				(void)thin_io::file::delete_file(nativeCStr(stagingNative));
+			}
+		}
+
+		const auto journalNative = thinIoPath(stale._path);
+		(void)thin_io::file::delete_file(nativeCStr(journalNative));
+	}
+}
+
+std::optional<CTransferJournal::Directory> CTransferJournal::directory(const CEntryPath& source) const
+{
+	const auto directory = _directories.find(source.value());
+	return directory != _directories.end() ? std::optional{ directory->second } : std::nullopt;
+}
+
+std::optional<CTransferJournal::CopiedFile> CTransferJournal::copiedFile(const CEntryPath& source) const
+{
+	const auto file = _copiedFiles.find(source.value());
+	return file != _copiedFiles.end() ? std::optional{ file->second } : std::nullopt;
+}
+
+std::optional<CTransferJournal::PartialFile> CTransferJournal::partialFile(const CEntryPath& source) const
+{
+	const auto file = _partialFiles.find(source.value());
+	return file != _partialFiles.end() ? std::optional{ file->second } : std::nullopt;
+}
+
+std::expected<void, CFileSystemError> CTransferJournal::recordDirectory(const CEntryPath& source, const Directory& directory)
+{
+	if (auto written = append({ directoryRecord, source.value(), directory.destination.value(), directory.operationCreated ? createdField : mergedField }); !written) [[unlikely]]
+		return written;
+	_directories.insert_or_assign(source.value(), directory);
+	return {};
+}
+
+std::expected<void, CFileSystemError> CTransferJournal::recordCopiedFile(const CEntryPath& source, const CopiedFile& file)
+{
+	if (auto written = append(QStringList{ fileRecord, source.value(), file.destination.value(), QString::number(file.size) }
+		+ timestampFields(file.sourceLastWrite) + timestampFields(file.destinationLastWrite)); !written) [[unlikely]]
+	{
+		return written;
+	}
+	_copiedFiles.insert_or_assign(source.value(), file);
+	_partialFiles.erase(source.value());
+	return {};
+}
+
+std::expected<void, CFileSystemError> CTransferJournal::recordPartialFile(const CEntryPath& source, const PartialFile& partial)
+{
+	if (auto written = append({ partialRecord, source.value(), partial.stagingPath.value(), QString::number(partial.sourceSize),
+		QString::number(partial.stagedBytes) }); !written) [[unlikely]]
+	{
+		return written;
+	}
+	// The staged data is on the disk by now; the record of it must be, too, before the copy goes on
+	if (!_file.fdatasync()) [[unlikely]]
+		return std::unexpected{ makeFileSystemError(captureNativeError()) };
+	_partialFiles.insert_or_assign(source.value(), partial);
+	return {};
+}
+
+std::expected<void, CFileSystemError> CTransferJournal::forgetPartialFile(const CEntryPath& source)
+{
+	if (auto written = append({ discardedRecord, source.value() }); !written) [[unlikely]]
+		return written;
+	_partialFiles.erase(source.value());
+	return {};
+}
+
+std::expected<void, CFileSystemError> CTransferJournal::close()
+{
+	if (!_file.close()) [[unlikely]]
+		return std::unexpected{ makeFileSystemError(captureNativeError()) };
+	return {};
+}
+
+std::expected<void, CFileSystemError> CTransferJournal::remove()
+{
+	(void)_file.close(); // Nothing in it is needed any more
+	const auto native = thinIoPath(_path);
+	if (!thin_io::file::delete_file(nativeCStr(native))) [[unlikely]]
+		return std::unexpected{ makeFileSystemError(captureNativeError()) };
+	return {};
+}
+
+const CEntryPath& CTransferJournal::path() const noexcept
+{
+	return _path;
+}
+
+std::expected<uint64_t, CFileSystemError> CTransferJournal::load()
+{
+	// A handle of its own: the journal one is write-only
+	thin_io::file reader;
+	const auto native = thinIoPath(_path);
+	if (!reader.open(nativeCStr(native), thin_io::file::access_mode::Read)) [[unlikely]]
+		return std::unexpected{ makeFileSystemError(captureNativeError()) };
+
+	QByteArray contents;
+	QByteArray buffer(64 * 1024, Qt::Uninitialized);
+	for (;;)
+	{
+		const auto read = reader.read(buffer.data(), static_cast<uint64_t>(buffer.size()));
+		if (!read) [[unlikely]]
+			return std::unexpected{ makeFileSystemError(captureNativeError()) };
+		if (*read == 0)
+			break;
+		contents.append(buffer.constData(), static_cast<qsizetype>(*read));
+	}
+	(void)reader.close(); // A read-side close failure puts no data at risk
+
+	const qsizetype headerEnd = contents.indexOf('\n');
+	if (headerEnd < 0 || QString::fromUtf8(contents.first(headerEnd)) != journalHeader)
+		return 0; // Empty, torn before its first record, or not a journal at all: started afresh
+
+	qsizetype validLength = headerEnd + 1;
+	for (qsizetype lineEnd = contents.indexOf('\n', validLength); lineEnd >= 0; lineEnd = contents.indexOf('\n', validLength))
+	{
+		if (!apply(splitRecord(QString::fromUtf8(contents.sliced(validLength, lineEnd - validLength)))))
+			break; // Garbage past the end of what was written is the same as a torn record
+		validLength = lineEnd + 1;
+	}
+	return static_cast<uint64_t>(validLength);
+}
+
+bool CTransferJournal::apply(const QStringList& fields)
+{
+	if (fields.size() < 2)
+		return false;
+
+	const QString& type = fields[0];
+	const QString& source = fields[1];
+	if (type == directoryRecord && fields.size() == 4)
+	{
+		auto destination = parseOperationPath(fields[2]);
+		if (!destination || (fields[3] != createdField && fields[3] != mergedField))
+			return false;
+
+		_directories.insert_or_assign(source, Directory{ mv(*destination), fields[3] == createdField });
+		return true;
+	}
+	else if (type == fileRecord && fields.size() == 8)
+	{
+		auto destination = parseOperationPath(fields[2]);
+		const auto size = parseSize(fields[3]);
+		const auto sourceLastWrite = parseTimestamp(fields[4], fields[5]);
+		const auto destinationLastWrite = parseTimestamp(fields[6], fields[7]);
+		if (!destination || !size || !sourceLastWrite || !destinationLastWrite)
+			return false;
+
+		_copiedFiles.insert_or_assign(source, CopiedFile{ mv(*destination), *size, *sourceLastWrite, *destinationLastWrite });
+		_partialFiles.erase(source);
+		return true;
+	}
+	else if (type == partialRecord && fields.size() == 5)
+	{
+		auto stagingPath = parseOperationPath(fields[2]);
+		const auto sourceSize = parseSize(fields[3]);
+		const auto stagedBytes = parseSize(fields[4]);
+		if (!stagingPath || !sourceSize || !stagedBytes)
+			return false;
+
+		_partialFiles.insert_or_assign(source, PartialFile{ mv(*stagingPath), *sourceSize, *stagedBytes });
+		return true;
+	}
+	else if (type == discardedRecord && fields.size() == 2)
+	{
+		_partialFiles.erase(source);
+		return true;
+	}
+
+	return false;
+}
+
+std::expected<void, CFileSystemError> CTransferJournal::append(const QStringList& fields)
+{
+	QStringList escaped;
+	for (const QString& field : fields)
+		escaped.push_back(escapeField(field));
+	const QByteArray line = (escaped.join(u'\t') + u'\n').toUtf8();
+
+	for (qsizetype written = 0; written < line.size();)
+	{
+		const auto result = _file.write(line.constData() + written, static_cast<uint64_t>(line.size() - written));
+		if (!result) [[unlikely]]
+			return std::unexpected{ makeFileSystemError(captureNativeError()) };
+		else if (*result == 0) [[unlikely]]
+			return std::unexpected{ CFileSystemError{ FileErrorCategory::IoFailure, 0, QStringLiteral("Zero bytes written to the transfer journal") } };
+		written += static_cast<qsizetype>(*result);
+	}
+	return {};
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "fileoperationtypes.h"
+
+#include "file.hpp" // thin_io
+
+#include <chrono>
+#include <expected>
+#include <map>
+#include <optional>
+
+// What a copy request (TransferRequest::journalDirectory) has done so far, kept on the disk so that the same request
+// run again - after a cancellation, or a crash - carries on where this run stopped: the directories it created or
+// merged into, the files it published, and for a large file still being copied of a request that resumes them
+// (TransferRequest::resumeLargeFiles), the staging file and how much of it is durably written (see
+// CStagedFileCopy::suspend()). One journal per request, named after a hash of the request, and appended to one line
+// per record; a line torn by a crash is dropped when the journal is opened again. Only a partial-file record is
+// flushed right away - it is the one that claims data is on the disk. The executor checks the file system before it
+// relies on any record. A journal that has not been written to for maxAge is dropped, with any staging files it
+// recorded, the next time a journal is opened in its directory. Move-only, and not thread-safe.
+class CTransferJournal
+{
+public:
+	// A file this big is copied resumably, and what it has staged is recorded every partialFileRecordInterval bytes
+	static constexpr uint64_t resumableFileSize = 64 * 1024 * 1024;
+	static constexpr uint64_t partialFileRecordInterval = 256 * 1024 * 1024;
+	// A request not run again for this long is taken to be abandoned
+	static constexpr std::chrono::days maxAge{ 7 };
+
+	struct Directory
+	{
+		CEntryPath destination;
+		bool operationCreated; // Otherwise merged into
+	};
+
+	// Both last-write times as they were right after publication: a same-size edit of either side since shows in them
+	struct CopiedFile
+	{
+		CEntryPath destination;
+		uint64_t size;
+		thin_io::timestamp sourceLastWrite;
+		thin_io::timestamp destinationLastWrite;
+	};
+
+	struct PartialFile
+	{
+		CEntryPath stagingPath;
+		uint64_t sourceSize;
+		uint64_t stagedBytes;
+	};
+
+	// Creates the directory if needed, drops the journals in it that are older than maxAge, and reads the journal of
+	// this request in it if there is one
+	[[nodiscard]] static std::expected<CTransferJournal, CFileSystemError> open(const CEntryPath& directory, const TransferRequest& request);
+
+	// Per source path
+	[[nodiscard]] std::optional<Directory> directory(const CEntryPath& source) const;
+	[[nodiscard]] std::optional<CopiedFile> copiedFile(const CEntryPath& source) const;
+	[[nodiscard]] std::optional<PartialFile> partialFile(const CEntryPath& source) const;
+
+	[[nodiscard]] std::expected<void, CFileSystemError> recordDirectory(const CEntryPath& source, const Directory& directory);
+	// Supersedes a partial-file record of the source
+	[[nodiscard]] std::expected<void, CFileSystemError> recordCopiedFile(const CEntryPath& source, const CopiedFile& file);
+	[[nodiscard]] std::expected<void, CFileSystemError> recordPartialFile(const CEntryPath& source, const PartialFile& partial);
+	// The staging file is gone: the source is to be copied afresh
+	[[nodiscard]] std::expected<void, CFileSystemError> forgetPartialFile(const CEntryPath& source);
+
+	// Keeps the journal for the next run of the request
+	[[nodiscard]] std::expected<void, CFileSystemError> close();
+	// The request is done: nothing left to resume
+	[[nodiscard]] std::expected<void, CFileSystemError> remove();
+
+	[[nodiscard]] const CEntryPath& path() const noexcept;
+
+private:
+	CTransferJournal(CEntryPath path, thin_io::file file) noexcept;
+
+	// Removes the journals in the directory that are older than maxAge, and the staging files they kept, best-effort
+	static void removeStaleJournals(const CEntryPath& directory);
+
+	// Reads what the file has, and returns how much of it is whole records; 0 for a file that is not a journal
+	[[nodiscard]] std::expected<uint64_t, CFileSystemError> load();
+	// false for a record that can't be parsed
+	[[nodiscard]] bool apply(const QStringList& fields);
+	[[nodiscard]] std::expected<void, CFileSystemError> append(const QStringList& fields);
+
+	CEntryPath _path;
+	thin_io::file _file;
+	std::map<QString, Directory> _directories;
+	std::map<QString, CopiedFile> _copiedFiles;
+	std::map<QString, PartialFile> _partialFiles;
+};
@@ -0,0 +1,202 @@
+#include "ctransferthrottle.h"
+
+#include "assert/advanced_assert.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef _WIN32
+#include <Windows.h>
+#elif defined __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined __APPLE__
+#include <sys/resource.h>
+#endif
+
+using namespace std::chrono;
+
+namespace
+{
+
+#ifdef __linux__
+// From <linux/ioprio.h>, which not every libc's headers have
+constexpr int ioprioWhoProcess = 1; // With 0 for the ID: the calling thread
+constexpr int ioprioClassShift = 13;
+constexpr int ioprioClassBestEffort = 2;
+constexpr int ioprioLowestLevel = 7;
+#endif
+
+uint64_t burstBytes(const uint64_t bytesPerSecond) noexcept
+{
+	return std::max(bytesPerSecond * CTransferThrottle::burstDuration.count() / 1000, CTransferThrottle::minBurstBytes);
+}
+
+} // namespace
+
+void CTransferThrottle::applyPriorityToThisThread(const TransferPriority priority) noexcept
+{
+	// Only a change costs a system call; every thread starts at the default
+	thread_local TransferPriority appliedPriority = TransferPriority::Foreground;
+	if (priority == appliedPriority)
+		return;
+	appliedPriority = priority;
+
+	const bool background = priority == TransferPriority::Background;
+#ifdef _WIN32
+	(void)::SetThreadPriority(::GetCurrentThread(), background ? THREAD_MODE_BACKGROUND_BEGIN : THREAD_MODE_BACKGROUND_END);
+#elif defined __linux__
+	// The lowest best-effort level rather than the idle class: the idle class can starve for as long as anything else
+	// on the machine reads or writes. 0 is back to the default, derived from the nice value.
+	const int ioprio = background ? (ioprioClassBestEffort << ioprioClassShift) | ioprioLowestLevel : 0;
+	(void)::syscall(SYS_ioprio_set, ioprioWhoProcess, 0, ioprio);
+#elif defined __APPLE__
+	(void)::setiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_THREAD, background ? IOPOL_THROTTLE : IOPOL_DEFAULT);
+#else
+	(void)background; // Left to the token buckets
+#endif
+}
+
+CTransferThrottle& CTransferThrottle::global()
+{
+	static CTransferThrottle throttle;
+	return throttle;
+}
+
+CTransferThrottle::CTransferThrottle(CTransferThrottle* const shared) noexcept
+	: _shared{ shared }
+{
+}
+
+void CTransferThrottle::setLimit(const std::optional<uint64_t> bytesPerSecond)
+{
+	assert_debug_only(!bytesPerSecond || *bytesPerSecond > 0);
+	{
+		std::lock_guard lock{ _mutex };
+		_bucket.setRate(bytesPerSecond, steady_clock::now());
+	}
+	_changed.notify_all(); // A waiter's debt is paid off at the new rate from now on
+}
+
+std::optional<uint64_t> CTransferThrottle::limit() const
+{
+	std::lock_guard lock{ _mutex };
+	return _bucket.rate();
+}
+
+std::optional<uint64_t> CTransferThrottle::effectiveLimit() const
+{
+	const auto own = limit();
+	const auto shared = _shared ? _shared->limit() : std::nullopt;
+	if (own && shared)
+		return std::min(*own, *shared);
+	return own ? own : shared;
+}
+
+std::optional<uint64_t> CTransferThrottle::maxChunkSize() const
+{
+	const auto limit = effectiveLimit();
+	return limit ? std::optional{ burstBytes(*limit) } : std::nullopt;
+}
+
+void CTransferThrottle::setPriority(const TransferPriority priority) noexcept
+{
+	_priority = priority;
+}
+
+TransferPriority CTransferThrottle::priority() const noexcept
+{
+	return _priority;
+}
+
+bool CTransferThrottle::pass(const uint64_t transferredBytes)
+{
+	applyPriorityToThisThread(_priority);
+
+	// The job's own limit first: what it holds back never reaches the shared bucket, so it costs the other jobs nothing
+	for (CTransferThrottle* const throttle : { this, _shared })
+	{
+		if (!throttle)
+			continue;
+
+		{
+			std::lock_guard lock{ throttle->_mutex };
+			throttle->_bucket.take(transferredBytes, steady_clock::now());
+		}
+		if (!throttle->waitOut([throttle](const steady_clock::time_point now) { return throttle->_bucket.debt(now); }, _cancelled))
+			return false;
+	}
+
+	return !_cancelled;
+}
+
+void CTransferThrottle::cancel()
+{
+	_cancelled = true;
+	wake();
+	if (_shared)
+		_shared->wake(); // Its waiters evaluate this throttle's flag, too
+}
+
+bool CTransferThrottle::waitOut(const std::function<steady_clock::duration(steady_clock::time_point)>& remaining, const std::atomic<bool>& cancelled)
+{
+	std::unique_lock lock{ _mutex };
+	for (;;)
+	{
+		if (cancelled)
+			return false;
+
+		const auto now = steady_clock::now();
+		const auto wait = remaining(now);
+		if (wait <= steady_clock::duration::zero())
+			return true;
+		_changed.wait_until(lock, now + wait);
+	}
+}
+
+void CTransferThrottle::wake()
+{
+	// Taking the lock orders this after whatever the caller changed, so no waiter misses it
+	{
+		std::lock_guard lock{ _mutex };
+	}
+	_changed.notify_all();
+}
+
+void CTransferThrottle::Bucket::setRate(const std::optional<uint64_t> bytesPerSecond, const steady_clock::time_point now) noexcept
+{
+	refill(now); // What has accrued so far, at the old rate
+	_rate = bytesPerSecond;
+	_tokens = _rate ? std::min(_tokens, static_cast<double>(burstBytes(*_rate))) : 0.0; // No debt outlives the limit
+}
+
+void CTransferThrottle::Bucket::take(const uint64_t bytes, const steady_clock::time_point now) noexcept
+{
+	if (!_rate)
+		return;
+
+	refill(now);
+	_tokens -= static_cast<double>(bytes);
+}
+
+steady_clock::duration CTransferThrottle::Bucket::debt(const steady_clock::time_point now) noexcept
+{
+	if (!_rate)
+		return steady_clock::duration::zero();
+
+	refill(now);
+	if (_tokens >= 0.0)
+		return steady_clock::duration::zero();
+	// Rounded up: a wait that ends a hair short of paying off the debt would only have to be waited again
+	return duration_cast<steady_clock::duration>(nanoseconds{ static_cast<int64_t>(std::ceil(-_tokens * 1e9 / static_cast<double>(*_rate))) });
+}
+
+void CTransferThrottle::Bucket::refill(const steady_clock::time_point now) noexcept
+{
+	if (_rate && now > _refilledAt)
+	{
+		const double elapsedSeconds = duration<double>(now - _refilledAt).count();
+		_tokens = std::min(_tokens + static_cast<double>(*_rate) * elapsedSeconds, static_cast<double>(burstBytes(*_rate)));
+	}
+	_refilledAt = now;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "fileoperationtypes.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stdint.h>
+
+// Paces the transfers of one job: a token bucket for the job's own throughput limit, and another for the limit shared
+// by every job on the shared throttle (usually global()). The executor passes the throttle between chunks, from
+// whichever thread copies; a change of either limit takes effect from the next chunk on.
+// A Background job's threads - the ones that pass the throttle, and the helpers that apply its priority themselves -
+// do their I/O at a low priority, so that the disk favors the jobs the user is waiting for.
+// No job holds off for another: the ones that share a device take turns on it anyway (CFileOperationQueue), and the
+// ones on different devices have no reason to. Thread-safe.
+class CTransferThrottle
+{
+public:
+	// What a limited bucket lets through in one go after an idle spell, and so also the largest chunk worth writing
+	// under a limit: a bigger one would be written in a burst, with the progress display standing still after it.
+	static constexpr std::chrono::milliseconds burstDuration{ 100 };
+	static constexpr uint64_t minBurstBytes = 64 * 1024;
+
+	// The one the application shares between all of its jobs
+	[[nodiscard]] static CTransferThrottle& global();
+
+	explicit CTransferThrottle(CTransferThrottle* shared = nullptr) noexcept;
+
+	CTransferThrottle(const CTransferThrottle&) = delete;
+	CTransferThrottle& operator=(const CTransferThrottle&) = delete;
+
+	// In bytes per second, more than 0; nullopt: unlimited
+	void setLimit(std::optional<uint64_t> bytesPerSecond);
+	[[nodiscard]] std::optional<uint64_t> limit() const;
+	// The lower of this throttle's limit and the shared one's
+	[[nodiscard]] std::optional<uint64_t> effectiveLimit() const;
+	// nullopt while the transfer is not limited
+	[[nodiscard]] std::optional<uint64_t> maxChunkSize() const;
+
+	void setPriority(TransferPriority priority) noexcept;
+	[[nodiscard]] TransferPriority priority() const noexcept;
+
+	// Called by a copying thread before each chunk, with what it transferred since its previous call: applies the
+	// priority to the calling thread, and blocks for as long as the limits require. false once the
+	// throttle is cancelled.
+	[[nodiscard]] bool pass(uint64_t transferredBytes);
+	// What pass() does for the priority, for the threads that do a job's I/O without passing its throttle: a staged
+	// copy's reader, and a file-copy worker before its first chunk. Only a change costs a system call.
+	static void applyPriorityToThisThread(TransferPriority priority) noexcept;
+	// Releases every thread blocked in pass(), for good: the job is ending
+	void cancel();
+
+private:
+	// Bytes per second into a bucket that holds burstDuration's worth; what is taken past that is a debt the taker
+	// waits out.
+	class Bucket
+	{
+	public:
+		void setRate(std::optional<uint64_t> bytesPerSecond, std::chrono::steady_clock::time_point now) noexcept;
+		[[nodiscard]] std::optional<uint64_t> rate() const noexcept { return _rate; }
+
+		void take(uint64_t bytes, std::chrono::steady_clock::time_point now) noexcept;
+		// Until the debt is paid off; zero if there is none
+		[[nodiscard]] std::chrono::steady_clock::duration debt(std::chrono::steady_clock::time_point now) noexcept;
+
+	private:
+		void refill(std::chrono::steady_clock::time_point now) noexcept;
+
+		std::optional<uint64_t> _rate;
+		double _tokens = 0.0; // Bytes; negative while in debt
+		std::chrono::steady_clock::time_point _refilledAt;
+	};
+
+	// Blocks, on this throttle, for as long as `remaining` - evaluated under _mutex - returns a positive duration, or
+	// until `cancelled`. false if cancelled.
+	[[nodiscard]] bool waitOut(const std::function<std::chrono::steady_clock::duration(std::chrono::steady_clock::time_point)>& remaining,
+		const std::atomic<bool>& cancelled);
+	void wake();
+
+	CTransferThrottle* const _shared;
+
+	mutable std::mutex _mutex;
+	std::condition_variable _changed;
+	Bucket _bucket;
+
+	std::atomic<TransferPriority> _priority = TransferPriority::Foreground;
+	std::atomic<bool> _cancelled = false;
+};
@@ -0,0 +1,52 @@
+#include "cverificationmanifest.h"
+#include "cfilesystemmutator.h"
+#include "thiniobridge.h"
+
+#include "lang/utils.hpp" // mv()
+
+std::expected<CVerificationManifest, CFileSystemError> CVerificationManifest::create(const CEntryPath& path)
+{
+	thin_io::file file;
+	const auto native = thinIoPath(path);
+	if (!file.open(nativeCStr(native), thin_io::file::access_mode::Write) || !file.resize(0)) [[unlikely]]
+		return std::unexpected{ makeFileSystemError(captureNativeError()) };
+	return CVerificationManifest{ path, mv(file) };
+}
+
+CVerificationManifest::CVerificationManifest(CEntryPath path, thin_io::file file) noexcept
+	: _path{ mv(path) }
+	, _file{ mv(file) }
+{
+}
+
+std::expected<void, CFileSystemError> CVerificationManifest::add(const CEntryPath& file, const uint64_t contentHash)
+{
+	QString name = file.value();
+	const bool escaped = name.contains(u'\\') || name.contains(u'\n');
+	if (escaped)
+		name.replace(u'\\', QStringLiteral("\\\\")).replace(u'\n', QStringLiteral("\\n"));
+
+	const QByteArray line = ((escaped ? QStringLiteral("\\") : QString{}) + QStringLiteral("%1  %2\n").arg(contentHash, 16, 16, QChar{ u'0' }).arg(name)).toUtf8();
+	for (qsizetype written = 0; written < line.size();)
+	{
+		const auto result = _file.write(line.constData() + written, static_cast<uint64_t>(line.size() - written));
+		if (!result) [[unlikely]]
+			return std::unexpected{ makeFileSystemError(captureNativeError()) };
+		else if (*result == 0) [[unlikely]]
+			return std::unexpected{ CFileSystemError{ FileErrorCategory::IoFailure, 0, QStringLiteral("Zero bytes written to the manifest") } };
+		written += static_cast<qsizetype>(*result);
+	}
+	return {};
+}
+
+std::expected<void, CFileSystemError> CVerificationManifest::close()
+{
+	if (!_file.fdatasync() || !_file.close()) [[unlikely]]
+		return std::unexpected{ makeFileSystemError(captureNativeError()) };
+	return {};
+}
+
+const CEntryPath& CVerificationManifest::path() const noexcept
+{
+	return _path;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "fileoperationtypes.h"
+
+#include "file.hpp" // thin_io
+
+#include <expected>
+
+// The hashes a verifying transfer exports (TransferRequest::verificationManifest): one line per file copied, its
+// XXH64 (CContentHasher) in 16 hex digits, two spaces, and the copy's path - the format xxhsum -c checks. A path with a
+// backslash or a line break in it is escaped the way sha256sum and xxhsum do it. Move-only.
+class CVerificationManifest
+{
+public:
+	// Creates the file, or empties an existing one
+	[[nodiscard]] static std::expected<CVerificationManifest, CFileSystemError> create(const CEntryPath& path);
+
+	[[nodiscard]] std::expected<void, CFileSystemError> add(const CEntryPath& file, uint64_t contentHash);
+	// Flushes what was added to the disk, so that the manifest is as durable as the copies it lists
+	[[nodiscard]] std::expected<void, CFileSystemError> close();
+
+	[[nodiscard]] const CEntryPath& path() const noexcept;
+
+private:
+	CVerificationManifest(CEntryPath path, thin_io::file file) noexcept;
+
+	CEntryPath _path;
+	thin_io::file _file;
+};
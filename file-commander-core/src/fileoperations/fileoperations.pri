@@ -8,12 +8,19 @@ HEADERS += \
 	$$PWD/newnamecheck.h \
 	$$PWD/thiniobridge.h \
 	$$PWD/cfilesystemmutator.h \
+	$$PWD/ccontenthasher.h \
 	$$PWD/cstagedfilecopy.h \
+	$$PWD/cstagedcopypipeline.h \
+	$$PWD/ctransferchunksizer.h \
+	$$PWD/cverificationmanifest.h \
+	$$PWD/ctransferjournal.h \
+	$$PWD/ctransferthrottle.h \
 	$$PWD/cdestinationresolver.h \
 	$$PWD/csourcetreebuilder.h \
 	$$PWD/coperationexecutioncontext.h \
 	$$PWD/ctransferexecutor.h \
 	$$PWD/cdeleteexecutor.h \
+	$$PWD/cfileoperationqueue.h \
 	$$PWD/cfileoperationjob.h \
 	$$PWD/inlinerename.h \
 	$$PWD/operationtesthooks.h
@@ -23,12 +30,19 @@ SOURCES += \
 	$$PWD/newnamecheck.cpp \
 	$$PWD/fileoperationtypes.cpp \
 	$$PWD/cfilesystemmutator.cpp \
+	$$PWD/ccontenthasher.cpp \
 	$$PWD/cstagedfilecopy.cpp \
+	$$PWD/cstagedcopypipeline.cpp \
+	$$PWD/ctransferchunksizer.cpp \
+	$$PWD/cverificationmanifest.cpp \
+	$$PWD/ctransferjournal.cpp \
+	$$PWD/ctransferthrottle.cpp \
 	$$PWD/cdestinationresolver.cpp \
 	$$PWD/csourcetreebuilder.cpp \
 	$$PWD/coperationexecutioncontext.cpp \
 	$$PWD/ctransferexecutor.cpp \
 	$$PWD/cdeleteexecutor.cpp \
+	$$PWD/cfileoperationqueue.cpp \
 	$$PWD/cfileoperationjob.cpp \
 	$$PWD/inlinerename.cpp
 
@@ -57,7 +57,10 @@ enum class FailedAction
 	RemoveEntry,
 	RemovePublishedMoveSource,
 	CleanupStaging,
-	PreserveDirectoryTimestamps
+	PreserveDirectoryTimestamps,
+	VerifyDestination, // Reading the staged copy back, or finding it different from the source
+	WriteVerificationManifest,
+	WriteTransferJournal
 };
 
 struct FailureDetails
@@ -102,19 +105,74 @@ enum class ReplacementMode
 };
 
 // Whether staged data must reach storage before publication. The executor owns the choice: flushing is
-// required exactly where publication destroys the only other copy of the data.
+// required exactly where publication destroys something.
 enum class CommitDurability
 {
-	NoFlush,           // Fresh copy: the source still exists, so a crash at worst means re-running the copy
-	FlushBeforePublish // Move or authorized replacement: publication (then source removal) destroys the only other copy
+	NoFlush,            // The source still exists, so a crash at worst means re-running the copy
+	FlushBeforePublish, // Authorized replacement: publication destroys the old destination
+	// An owned-source move, whose source goes only after a flush of its own (see CTransferExecutor): published without
+	// a flush, and without the source's times and permissions, which the caller applies once the flush has succeeded.
+	// A crash before that leaves the copy with its own, current last-write time: never a torn file that looks like the
+	// source by size and time.
+	FlushWithGroup
+};
+
+// How a writeNext() step moved its bytes, cheapest first. A session starts at the cheapest its platform has
+// and drops to the next one for good as soon as the filesystem turns a request down.
+enum class CopyBackend
+{
+	Clone,           // Reflinked (FICLONERANGE): the staging file shares the source's extents, and no data is copied
+	KernelCopy,      // copy_file_range(): copied inside the kernel, or offloaded to the storage, without a trip through user space
+	OverlappedWrite, // Read ahead by a thread of its own while written (see CStagedCopyPipeline): for a source on another device
+	MappedWrite      // The source chunk mapped and written to the staging file: works everywhere
+};
+
+// A transfer chunk size that isn't one: the executor adapts the size of each chunk to the devices involved
+// (see CTransferChunkSizer) instead of using a fixed one.
+inline constexpr uint64_t adaptiveTransferChunkSize = 0;
+
+// What a staged copy leaves in the page cache. A big copy that keeps it all cached pushes out the working set of
+// everything else on the machine.
+enum class PageCachePolicy
+{
+	KeepCached, // As the system caches any file I/O
+	DropBehind, // Written back steadily as the copy goes, and dropped from the cache once on the disk, source and copy alike
+	Automatic   // DropBehind for a file of CStagedFileCopy::dropBehindThreshold or more, KeepCached for a smaller one
+};
+
+// How a job's transfers share the disk with everything else (see CTransferThrottle)
+enum class TransferPriority
+{
+	Foreground, // As any I/O of the process
+	Background  // At a low I/O priority
+};
+
+// What becomes of the staging file of a staged copy that is not published
+enum class StagingLifetime
+{
+	Session,  // Discarded with the session - on Linux an unnamed file, which goes even if the process crashes
+	Resumable // A named file that CStagedFileCopy::suspend() leaves behind for resume() to carry on with
+};
+
+// Whether a staged copy proves itself before it is published
+enum class CopyVerification
+{
+	None,
+	// The source is hashed as it is copied; the staged copy, flushed and out of the cache, is read back and hashed
+	// again before publication, and a copy that differs is never published
+	ReadBack
 };
 
 // One writeNext() step. bytesWritten may be less than requested - partial writes are normal and the next
-// call continues; readyToCommit reports that every source byte is staged.
+// call continues; readyToCommit reports that every source byte is staged. holeBytes is how much of a sparse source
+// the step passed over without writing anything: it counts towards the file's progress, but not as transferred data.
 struct CopyChunkResult
 {
 	uint64_t bytesWritten;
 	bool readyToCommit;
+	CopyBackend backend = CopyBackend::MappedWrite;
+	uint64_t holeBytes = 0;
+	uint64_t resumedBytes = 0; // See CStagedFileCopy::resume(); progress like holeBytes
 };
 
 enum class DirectoryCreationOutcome
@@ -159,6 +217,15 @@ struct TransferRequest
 	TransferKind kind;
 	std::vector<CEntryPath> sources;
 	DestinationSpec destination;
+	CopyVerification verification = CopyVerification::None; // Of every file copied, not of one moved by a rename
+	// Where a verifying transfer lists the hash of every file it copied (see CVerificationManifest); none if nullopt
+	std::optional<CEntryPath> verificationManifest;
+	// Where a copy keeps its CTransferJournal, so that running the same request again carries on where this run
+	// stopped; no journal if nullopt. A move keeps none: what it has moved is gone from its sources already.
+	std::optional<CEntryPath> journalDirectory;
+	// With a journal: a large file cut short keeps its staging file, flushed, for the next run to carry on with
+	// (CTransferJournal::resumableFileSize). Otherwise it is discarded like any other, and copied afresh next time.
+	bool resumeLargeFiles = false;
 };
 
 struct PermanentDeleteRequest
@@ -295,6 +362,7 @@ enum class PrimaryProgressUnit
 
 enum class OperationPhase
 {
+	Queued, // Waiting in CFileOperationQueue for a job on the same device to finish; nothing has been read yet
 	Scanning,
 	Working
 };
@@ -317,6 +385,11 @@ struct ProgressSnapshot
 
 	uint64_t primaryUnitsPerSecond = 0;
 	std::optional<uint32_t> secondsRemaining;
+
+	// Transfers only. The throughput limit in effect (CTransferThrottle), and what to hold against it: the throughput
+	// over the last few seconds - the average above lags far behind a limit changed mid-job.
+	std::optional<uint64_t> bytesPerSecondLimit;
+	std::optional<uint64_t> recentBytesPerSecond;
 };
 
 enum class CompletionStatus
@@ -338,6 +411,11 @@ struct OperationSummary
 	// Running total of bytes actually written: a retried entry's bytes are counted per attempt, so this can
 	// exceed the summed source sizes. It is a throughput tally, not the logical amount moved.
 	uint64_t transferredBytes = 0;
+	// transferredBytes by the CopyBackend that moved them
+	uint64_t clonedBytes = 0;
+	uint64_t kernelCopiedBytes = 0;
+	uint64_t overlappedWriteBytes = 0;
+	uint64_t mappedWriteBytes = 0;
 	size_t warningCount = 0;
 	std::vector<OperationDiagnostic> representativeWarnings;
 	std::vector<OperationDiagnostic> representativeFailures;
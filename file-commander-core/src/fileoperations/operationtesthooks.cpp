@@ -63,12 +63,15 @@ std::string pointName(const Point point)
 	case Point::SetEntryWritable_Native: return "SetEntryWritable_Native";
 	case Point::ApplyDirectoryTimes_Native: return "ApplyDirectoryTimes_Native";
 	case Point::InspectEntry_Native: return "InspectEntry_Native";
+	case Point::FlushPublishedFiles_Native: return "FlushPublishedFiles_Native";
+	case Point::ApplyFileMetadata_Native: return "ApplyFileMetadata_Native";
 	case Point::StagedCopy_CaptureMetadata_Native: return "StagedCopy_CaptureMetadata_Native";
 	case Point::StagedCopy_CreateStaging_Native: return "StagedCopy_CreateStaging_Native";
 	case Point::StagedCopy_ResizeStaging_Native: return "StagedCopy_ResizeStaging_Native";
 	case Point::StagedCopy_PreallocateStaging_Native: return "StagedCopy_PreallocateStaging_Native";
 	case Point::StagedCopy_WriteStaging_Native: return "StagedCopy_WriteStaging_Native";
 	case Point::StagedCopy_FlushStaging_Native: return "StagedCopy_FlushStaging_Native";
+	case Point::StagedCopy_VerifyStaging_Native: return "StagedCopy_VerifyStaging_Native";
 	case Point::StagedCopy_ApplyMetadata_Native: return "StagedCopy_ApplyMetadata_Native";
 	case Point::StagedCopy_CloseStaging_Native: return "StagedCopy_CloseStaging_Native";
 	case Point::StagedCopy_RemoveStaging_Native: return "StagedCopy_RemoveStaging_Native";
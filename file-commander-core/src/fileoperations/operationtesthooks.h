@@ -39,6 +39,8 @@ enum class Point : uint32_t
 	SetEntryWritable_Native,
 	ApplyDirectoryTimes_Native,
 	InspectEntry_Native, // inspectEntry's primary metadata query; a forced code classifies like a real failure
+	FlushPublishedFiles_Native,
+	ApplyFileMetadata_Native,
 
 	// CStagedFileCopy lifecycle boundaries, in lifecycle order, immediately before the corresponding native call.
 	StagedCopy_CaptureMetadata_Native,
@@ -47,6 +49,7 @@ enum class Point : uint32_t
 	StagedCopy_PreallocateStaging_Native,
 	StagedCopy_WriteStaging_Native,
 	StagedCopy_FlushStaging_Native,
+	StagedCopy_VerifyStaging_Native,
 	StagedCopy_ApplyMetadata_Native,
 	StagedCopy_CloseStaging_Native,
 	StagedCopy_RemoveStaging_Native,
@@ -1,8 +1,9 @@
 #pragma once
 
 // Module-private glue between CEntryPath and the thin_io native path and error surfaces.
-// NativePathString must stay small: buildNode() holds one across its recursion, so an inline 32K path buffer
-// would overflow the stack a few directory levels down.
+// NativePathString must stay small: it lives on the stack of whichever thread converts a path, and a secondary thread's
+// stack - buildSourceTree()'s directory scanners, say - can be as small as 512 KB, where a few inline 32K path buffers
+// in nested calls would overflow it.
 
 #include "centrypath.h"
 
@@ -0,0 +1,212 @@
+#include "ccontentencoding.h"
+#include "ctextencodingdetector.h"
+
+#include "assert/advanced_assert.h"
+
+DISABLE_COMPILER_WARNINGS
+#include <QTextCodec>
+#include <QtEndian>
+RESTORE_COMPILER_WARNINGS
+
+#include <algorithm>
+#include <initializer_list>
+
+namespace
+{
+// Text has the odd NUL at most; anything denser than this that isn't laid out like UTF-16 is taken for binary data
+constexpr size_t binaryNulShare = 256; // One byte in
+
+[[nodiscard]] bool startsWith(const std::byte* data, size_t length, std::initializer_list<uint8_t> prefix) noexcept
+{
+	return length >= prefix.size() && std::equal(prefix.begin(), prefix.end(), data, [](uint8_t expected, std::byte actual) {
+		return std::byte{ expected } == actual;
+	});
+}
+
+// A sequence cut short by the end of the sample still counts as valid: the sample ends wherever sampleSize falls.
+[[nodiscard]] bool isValidUtf8(const std::byte* data, size_t length) noexcept
+{
+	const auto* bytes = reinterpret_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < length; )
+	{
+		const uint8_t lead = bytes[i];
+		if (lead < 0x80)
+		{
+			++i;
+			continue;
+		}
+
+		size_t continuationCount = 0;
+		if (lead >= 0xC2 && lead <= 0xDF)
+			continuationCount = 1;
+		else if (lead >= 0xE0 && lead <= 0xEF)
+			continuationCount = 2;
+		else if (lead >= 0xF0 && lead <= 0xF4)
+			continuationCount = 3;
+		else
+			return false;
+
+		for (size_t c = 1; c <= continuationCount && i + c < length; ++c)
+		{
+			if ((bytes[i + c] & 0xC0) != 0x80)
+				return false;
+		}
+
+		i += continuationCount + 1;
+	}
+
+	return true;
+}
+} // namespace
+
+CContentEncoding::CContentEncoding(Kind kind, QTextCodec* codec) noexcept :
+	_kind{ kind },
+	_codec{ codec }
+{
+	assert_debug_only((kind == Kind::Legacy) == (codec != nullptr));
+}
+
+CContentEncoding CContentEncoding::detect(const std::byte* data, size_t length)
+{
+	length = std::min(length, sampleSize);
+
+	if (startsWith(data, length, { 0xEF, 0xBB, 0xBF }))
+		return {};
+	else if (startsWith(data, length, { 0xFF, 0xFE }))
+		return { Kind::Utf16LE, nullptr };
+	else if (startsWith(data, length, { 0xFE, 0xFF }))
+		return { Kind::Utf16BE, nullptr };
+
+	// A branch-free loop over the byte pairs, which the compiler vectorizes
+	size_t evenNuls = 0, oddNuls = 0;
+	for (size_t i = 0; i + 1 < length; i += 2)
+	{
+		evenNuls += data[i] == std::byte{ 0 } ? 1 : 0;
+		oddNuls += data[i + 1] == std::byte{ 0 } ? 1 : 0;
+	}
+
+	// The NULs of UTF-16 text are the high halves of its Latin characters, so they all fall on the same side
+	const size_t pairCount = length / 2;
+	if (oddNuls > 0 && oddNuls >= pairCount / 4 && evenNuls * 16 <= oddNuls)
+		return { Kind::Utf16LE, nullptr };
+	else if (evenNuls > 0 && evenNuls >= pairCount / 4 && oddNuls * 16 <= evenNuls)
+		return { Kind::Utf16BE, nullptr };
+
+	const size_t nulCount = evenNuls + oddNuls + ((length % 2 != 0 && data[length - 1] == std::byte{ 0 }) ? 1 : 0);
+	if (nulCount > length / binaryNulShare)
+		return { Kind::Binary, nullptr };
+
+	if (isValidUtf8(data, length))
+		return {};
+
+	const CTextEncodingDetector::DecodedText detected = CTextEncodingDetector::decode(QByteArray::fromRawData(reinterpret_cast<const char*>(data), static_cast<qsizetype>(length)));
+	if (detected.encoding.startsWith(QLatin1StringView{ "UTF" }, Qt::CaseInsensitive))
+		return {}; // Invalid UTF-8 is still best read as UTF-8, as ever; UTF-16 would have been spotted above
+
+	QTextCodec* codec = detected.encoding.isEmpty() ? nullptr : QTextCodec::codecForName(detected.encoding.toLatin1());
+	if (!codec)
+		codec = QTextCodec::codecForLocale();
+
+	static constexpr int utf8Mib = 106;
+	if (!codec || codec->mibEnum() == utf8Mib)
+		return {};
+
+	return { Kind::Legacy, codec };
+}
+
+CContentEncoding::Kind CContentEncoding::kind() const noexcept
+{
+	return _kind;
+}
+
+size_t CContentEncoding::codeUnitSize() const noexcept
+{
+	return (_kind == Kind::Utf16LE || _kind == Kind::Utf16BE) ? 2 : 1;
+}
+
+QByteArray CContentEncoding::name() const
+{
+	switch (_kind)
+	{
+	case Kind::Binary:
+	case Kind::Utf8:
+		return QByteArrayLiteral("UTF-8");
+	case Kind::Utf16LE:
+		return QByteArrayLiteral("UTF-16LE");
+	case Kind::Utf16BE:
+		return QByteArrayLiteral("UTF-16BE");
+	case Kind::Legacy:
+		return _codec->name();
+	}
+
+	assert_unconditional_r("Unknown CContentEncoding::Kind");
+	return {};
+}
+
+QString CContentEncoding::decode(const std::byte* data, size_t length) const
+{
+	const auto* chars = reinterpret_cast<const char*>(data);
+	switch (_kind)
+	{
+	case Kind::Binary:
+	case Kind::Utf8:
+		return QString::fromUtf8(chars, static_cast<qsizetype>(length));
+	case Kind::Utf16LE:
+	case Kind::Utf16BE:
+	{
+		// A trailing odd byte is half a character, and is dropped
+		QString text{ static_cast<qsizetype>(length / 2), Qt::Uninitialized };
+		if (_kind == Kind::Utf16LE)
+			qFromLittleEndian<char16_t>(chars, text.size(), text.data());
+		else
+			qFromBigEndian<char16_t>(chars, text.size(), text.data());
+		return text;
+	}
+	case Kind::Legacy:
+		return _codec->toUnicode(chars, static_cast<int>(length));
+	}
+
+	assert_unconditional_r("Unknown CContentEncoding::Kind");
+	return {};
+}
+
+QByteArray CContentEncoding::encode(QStringView text) const
+{
+	switch (_kind)
+	{
+	case Kind::Binary:
+	case Kind::Utf8:
+		return text.toUtf8();
+	case Kind::Utf16LE:
+	case Kind::Utf16BE:
+	{
+		QByteArray encoded{ text.size() * 2, Qt::Uninitialized };
+		if (_kind == Kind::Utf16LE)
+			qToLittleEndian<char16_t>(text.utf16(), text.size(), encoded.data());
+		else
+			qToBigEndian<char16_t>(text.utf16(), text.size(), encoded.data());
+		return encoded;
+	}
+	case Kind::Legacy:
+		// The codec would put a substitute in place of what it cannot encode, and then match that
+		return _codec->canEncode(text) ? _codec->fromUnicode(text) : QByteArray{};
+	}
+
+	assert_unconditional_r("Unknown CContentEncoding::Kind");
+	return {};
+}
+
+size_t CContentEncoding::encodedLength(QStringView text) const
+{
+	switch (_kind)
+	{
+	case Kind::Utf16LE:
+	case Kind::Utf16BE:
+		return static_cast<size_t>(text.size()) * 2;
+	case Kind::Legacy:
+		// What the codec could not encode still took up a byte of the file, which it substitutes one character for
+		return static_cast<size_t>(_codec->fromUnicode(text).size());
+	default:
+		return static_cast<size_t>(text.toUtf8().size());
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "compiler/compiler_warnings_control.h"
+
+DISABLE_COMPILER_WARNINGS
+#include <QByteArray>
+#include <QString>
+#include <QStringView>
+RESTORE_COMPILER_WARNINGS
+
+#include <cstddef>
+#include <stdint.h>
+
+class QTextCodec;
+
+// How the text of one file is encoded, as told by its first bytes: a byte order mark if there is one, otherwise the
+// arrangement of the NUL bytes in a short sample, then whether the sample is valid UTF-8. Only what is left after that
+// is handed to the text-encoding-detector library to name a legacy code page, so the common case costs a single pass
+// over sampleSize bytes.
+// UTF-16 without a byte order mark is only recognized by the NUL halves of its Latin characters; text in other
+// scripts needs the mark.
+class CContentEncoding
+{
+public:
+	enum class Kind : uint8_t {
+		Binary,  // More NUL bytes than text has, and not laid out like UTF-16
+		Utf8,    // Also what anything undecided is taken for
+		Utf16LE,
+		Utf16BE,
+		Legacy   // A single- or multi-byte code page other than these
+	};
+
+	static constexpr size_t sampleSize = 4 * 1024;
+
+	// UTF-8, which is what the contents were always taken for before the encoding was looked at.
+	CContentEncoding() noexcept = default;
+
+	// Looks at no more than sampleSize bytes of data - the start of the file.
+	[[nodiscard]] static CContentEncoding detect(const std::byte* data, size_t length);
+
+	[[nodiscard]] Kind kind() const noexcept;
+	// Newlines and matches are only ever found at multiples of this, counting from the start of the file.
+	[[nodiscard]] size_t codeUnitSize() const noexcept;
+	// Identifies the encoding among all those a search meets, e.g. to cache the query transcoded into it.
+	[[nodiscard]] QByteArray name() const;
+
+	// Binary contents are decoded as UTF-8.
+	[[nodiscard]] QString decode(const std::byte* data, size_t length) const;
+	// Empty if any of the text cannot be represented in this encoding.
+	[[nodiscard]] QByteArray encode(QStringView text) const;
+	// How many bytes the text takes up in this encoding.
+	[[nodiscard]] size_t encodedLength(QStringView text) const;
+
+private:
+	CContentEncoding(Kind kind, QTextCodec* codec) noexcept;
+
+private:
+	Kind _kind = Kind::Utf8;
+	// Only for Kind::Legacy. Owned by Qt, which keeps every codec for the lifetime of the application.
+	QTextCodec* _codec = nullptr;
+};
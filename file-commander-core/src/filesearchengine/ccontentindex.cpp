@@ -0,0 +1,882 @@
+#include "ccontentindex.h"
+#include "ccontentencoding.h"
+#include "cstreamdecompressor.h"
+#include "cfilesystemobject.h"
+#include "directoryscanner.h"
+
+#include "file.hpp"
+
+#include "assert/advanced_assert.h"
+#include "threading/cthreadpool.h"
+
+DISABLE_COMPILER_WARNINGS
+#include <QStringList>
+#include <QTemporaryFile>
+RESTORE_COMPILER_WARNINGS
+
+#include <algorithm>
+#include <filesystem>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <string.h>
+#include <string_view>
+#include <system_error>
+#include <thread>
+
+// File layout: the header, then the sections it points to. Every list of numbers - a file's own trigrams in the forward
+// section, a trigram's file ids in the postings section - is ascending and stored as LEB128 deltas from the previous
+// value (the first one from 0).
+struct CContentIndex::Header
+{
+	char magic[8];
+	uint32_t formatVersion;
+	// The index is a cache rather than an interchange format: it is only ever read back on the machine that wrote it
+	uint32_t byteOrderMark;
+	uint32_t fileCount;
+	uint32_t trigramCount;
+	uint64_t forwardOffset;  // Every file's own trigrams, which is what lets the next build carry an unchanged file over
+	uint64_t forwardSize;
+	uint64_t pathsOffset;    // The UTF-8 absolute paths of all files, back to back
+	uint64_t pathsSize;
+	uint64_t filesOffset;    // FileRecord[fileCount], sorted by path bytes
+	uint64_t trigramsOffset; // TrigramRecord[trigramCount], sorted by trigram
+	uint64_t postingsOffset; // Every trigram's file ids
+	uint64_t postingsSize;
+};
+
+struct CContentIndex::FileRecord
+{
+	uint64_t pathOffset; // Relative to the paths section
+	uint64_t size;
+	int64_t modificationTime;
+	uint64_t forwardOffset; // Relative to the forward section
+	uint32_t pathLength;
+	uint32_t forwardLength;
+};
+
+struct CContentIndex::TrigramRecord
+{
+	uint32_t trigram;
+	uint32_t fileCount;
+	uint64_t postingsOffset; // Relative to the postings section; the list ends where the next trigram's begins
+};
+
+namespace
+{
+constexpr char indexMagic[8] = { 'F', 'C', 'T', 'R', 'I', 'G', 'R', 'M' };
+// 2: the trigrams of a file in UTF-16 or a legacy code page are those of its text in UTF-8
+// 3: compressed files are left out
+constexpr uint32_t indexFormatVersion = 3;
+constexpr uint32_t indexByteOrderMark = 0x01020304;
+
+// Three bytes each
+constexpr uint32_t trigramSpace = 1u << 24;
+
+[[nodiscard]] constexpr uint8_t foldAsciiCase(uint8_t c) noexcept
+{
+	return (c >= 'A' && c <= 'Z') ? static_cast<uint8_t>(c + ('a' - 'A')) : c;
+}
+
+[[nodiscard]] constexpr size_t varintSize(uint32_t value) noexcept
+{
+	size_t size = 1;
+	for (; value >= 0x80; value >>= 7)
+		++size;
+	return size;
+}
+
+inline uchar* writeVarint(uchar* out, uint32_t value) noexcept
+{
+	for (; value >= 0x80; value >>= 7)
+		*out++ = static_cast<uchar>(value | 0x80);
+	*out++ = static_cast<uchar>(value);
+	return out;
+}
+
+inline void appendVarint(QByteArray& out, uint32_t value)
+{
+	uchar buffer[5];
+	out.append(reinterpret_cast<const char*>(buffer), writeVarint(buffer, value) - buffer);
+}
+
+// Calls f for every value of one delta-encoded list. False if the list is malformed, which f may have partially seen.
+template <typename F>
+bool forEachInDeltaList(const uchar* data, uint64_t size, F&& f)
+{
+	uint32_t value = 0;
+	for (uint64_t i = 0; i < size; )
+	{
+		uint32_t delta = 0;
+		for (uint32_t shift = 0; ; shift += 7)
+		{
+			if (i >= size || shift > 28) [[unlikely]]
+				return false;
+
+			const uchar byte = data[i++];
+			delta |= static_cast<uint32_t>(byte & 0x7Fu) << shift;
+			if ((byte & 0x80u) == 0)
+				break;
+		}
+
+		value += delta;
+		f(value);
+	}
+
+	return true;
+}
+
+[[nodiscard]] bool isValidTrigramList(const uchar* data, uint64_t size)
+{
+	bool valid = true;
+	return forEachInDeltaList(data, size, [&valid](uint32_t trigram) {
+		valid = valid && trigram < trigramSpace;
+	}) && valid;
+}
+
+// Collects and encodes the distinct trigrams of one file at a time. Meant to be reused by a thread for many files:
+// the seen-set is a 2 MB bitmap that only the trigrams actually found are cleared from.
+class TrigramCollector
+{
+public:
+	[[nodiscard]] QByteArray encode(const uint8_t* data, uint64_t size)
+	{
+		if (_seenBits.empty())
+			_seenBits.resize(trigramSpace / 64);
+
+		_seen.clear();
+		if (size >= 3)
+		{
+			uint32_t trigram = (static_cast<uint32_t>(foldAsciiCase(data[0])) << 8) | foldAsciiCase(data[1]);
+			for (uint64_t i = 2; i < size; ++i)
+			{
+				trigram = ((trigram << 8) | foldAsciiCase(data[i])) & (trigramSpace - 1);
+				uint64_t& word = _seenBits[trigram / 64];
+				const uint64_t bit = uint64_t{1} << (trigram % 64);
+				if ((word & bit) == 0)
+				{
+					word |= bit;
+					_seen.push_back(trigram);
+				}
+			}
+		}
+
+		std::ranges::sort(_seen);
+
+		QByteArray encoded;
+		encoded.reserve(static_cast<qsizetype>(_seen.size()) * 2);
+		uint32_t previous = 0;
+		for (const uint32_t trigram : _seen)
+		{
+			appendVarint(encoded, trigram - previous);
+			previous = trigram;
+			_seenBits[trigram / 64] = 0;
+		}
+
+		return encoded;
+	}
+
+private:
+	std::vector<uint64_t> _seenBits;
+	std::vector<uint32_t> _seen;
+};
+
+struct PendingFile
+{
+	QByteArray path;
+	uint64_t size;
+	int64_t modificationTime;
+	uint64_t forwardOffset = 0;
+	uint32_t forwardLength = 0;
+	bool indexed = false;
+};
+
+[[nodiscard]] inline std::string_view pathBytes(const QByteArray& path) noexcept
+{
+	return { path.constData(), static_cast<size_t>(path.size()) };
+}
+
+// nullopt if the file cannot be read, or if it has changed since it was enumerated: its recorded size and time would
+// then vouch for contents the index has never seen. Also nullopt for a compressed file, which a search may match by
+// either its compressed bytes or its decompressed contents.
+[[nodiscard]] std::optional<QByteArray> readFileTrigrams(const PendingFile& pending, TrigramCollector& collector)
+{
+	thin_io::file file;
+	if (!file.open(pending.path.constData(), thin_io::file::access_mode::Read)) [[unlikely]]
+		return std::nullopt;
+
+	if (file.size().value_or(0) != pending.size) [[unlikely]]
+		return std::nullopt;
+
+	QByteArray trigrams;
+	if (pending.size > 0)
+	{
+		const auto* contents = static_cast<const uint8_t*>(file.mmap(thin_io::file::mmap_access_mode::ReadOnly, 0, pending.size));
+		if (!contents) [[unlikely]]
+			return std::nullopt;
+
+		if (CStreamDecompressor::formatOf(reinterpret_cast<const std::byte*>(contents), pending.size) != CStreamDecompressor::Format::None)
+		{
+			file.unmap(const_cast<uint8_t*>(contents));
+			return std::nullopt;
+		}
+
+		// The search matches such a file in its own encoding against a query transcoded into it, which amounts to
+		// matching its text in UTF-8 - the encoding the query's trigrams are in
+		const CContentEncoding encoding = CContentEncoding::detect(reinterpret_cast<const std::byte*>(contents), pending.size);
+		if (encoding.codeUnitSize() > 1 || encoding.kind() == CContentEncoding::Kind::Legacy)
+		{
+			const QByteArray text = encoding.decode(reinterpret_cast<const std::byte*>(contents), pending.size).toUtf8();
+			trigrams = collector.encode(reinterpret_cast<const uint8_t*>(text.constData()), static_cast<uint64_t>(text.size()));
+		}
+		else
+			trigrams = collector.encode(contents, pending.size);
+		file.unmap(const_cast<uint8_t*>(contents));
+	}
+
+	const CFileSystemObject afterReading{ QString::fromUtf8(pending.path) };
+	if (afterReading.size() != pending.size || afterReading.modificationTime() != pending.modificationTime) [[unlikely]]
+		return std::nullopt;
+
+	return trigrams;
+}
+
+[[nodiscard]] std::filesystem::path toFilesystemPath(const QString& path)
+{
+#ifdef _WIN32
+	return std::filesystem::path{ path.toStdWString() };
+#else
+	return std::filesystem::path{ QFile::encodeName(path).toStdString() };
+#endif
+}
+
+// The literal runs every match of a regex pattern must contain, or nothing if the pattern is beyond this analysis.
+// Deliberately simple and conservative: only runs of plain characters outside any group count, and whatever could
+// make them optional or change how they match - alternation, inline options and verbs, \Q quoting, back references,
+// escapes with arguments - gives up on the whole pattern.
+[[nodiscard]] std::vector<QString> requiredRegexLiterals(QStringView pattern)
+{
+	std::vector<QString> literals;
+	QString run;
+	int groupDepth = 0;
+	// Whether the last token was a character in the current run, which is what a following quantifier applies to
+	bool lastTokenInRun = false;
+
+	const auto endRun = [&] {
+		if (!run.isEmpty())
+			literals.push_back(run);
+		run.clear();
+		lastTokenInRun = false;
+	};
+
+	// The UTF-16 length of the run's last character
+	const auto lastCharacterLength = [&run]() -> qsizetype {
+		return (run.size() >= 2 && run.back().isLowSurrogate() && run[run.size() - 2].isHighSurrogate()) ? 2 : 1;
+	};
+
+	for (qsizetype i = 0; i < pattern.size(); ++i)
+	{
+		const QChar c = pattern[i];
+		bool isQuantifier = false;
+		bool quantifierAllowsZero = false;
+
+		switch (c.unicode())
+		{
+		case '|':
+			return {};
+		case '\\':
+		{
+			if (i + 1 >= pattern.size())
+				return {};
+
+			const QChar escaped = pattern[++i];
+			if (escaped.isLetterOrNumber())
+			{
+				// Shorthand classes and assertions take no arguments and contribute no fixed text; all other
+				// letter and digit escapes are left to the regex engine.
+				if (!QStringView{ u"dDwWsSbB" }.contains(escaped))
+					return {};
+
+				endRun();
+				continue;
+			}
+
+			if (groupDepth == 0)
+			{
+				run += escaped;
+				lastTokenInRun = true;
+			}
+			continue;
+		}
+		case '(':
+			if (i + 1 < pattern.size() && (pattern[i + 1] == '?' || pattern[i + 1] == '*'))
+				return {};
+			endRun();
+			++groupDepth;
+			continue;
+		case ')':
+			if (groupDepth == 0)
+				return {};
+			--groupDepth;
+			continue;
+		case '[':
+		{
+			endRun();
+			qsizetype j = i + 1;
+			if (j < pattern.size() && pattern[j] == '^')
+				++j;
+			if (j < pattern.size() && pattern[j] == ']')
+				++j;
+
+			for (; j < pattern.size() && pattern[j] != ']'; ++j)
+			{
+				if (pattern[j] == '\\')
+					++j;
+				else if (pattern[j] == '[' && j + 1 < pattern.size() && pattern[j + 1] == ':')
+				{
+					// A POSIX class such as [:alpha:] has a ']' of its own
+					const qsizetype classEnd = pattern.indexOf(QStringView{ u":]" }, j + 2);
+					if (classEnd < 0)
+						return {};
+					j = classEnd + 1;
+				}
+			}
+
+			if (j >= pattern.size())
+				return {};
+
+			i = j;
+			continue;
+		}
+		case '.':
+		case '^':
+		case '$':
+			endRun();
+			continue;
+		case '*':
+		case '?':
+			isQuantifier = true;
+			quantifierAllowsZero = true;
+			break;
+		case '+':
+			isQuantifier = true;
+			break;
+		case '{':
+		{
+			// Only the strict {n}, {n,} and {n,m} forms; anything else is not worth second-guessing the engine on
+			qsizetype j = i + 1;
+			const qsizetype minimumStart = j;
+			while (j < pattern.size() && pattern[j].isDigit())
+				++j;
+			if (j == minimumStart)
+				return {};
+
+			const bool minimumIsZero = QStringView{ pattern }.sliced(minimumStart, j - minimumStart).toUInt() == 0;
+			if (j < pattern.size() && pattern[j] == ',')
+			{
+				++j;
+				while (j < pattern.size() && pattern[j].isDigit())
+					++j;
+			}
+
+			if (j >= pattern.size() || pattern[j] != '}')
+				return {};
+
+			i = j;
+			isQuantifier = true;
+			quantifierAllowsZero = minimumIsZero;
+			break;
+		}
+		default:
+			if (groupDepth == 0)
+			{
+				run += c;
+				lastTokenInRun = true;
+			}
+			continue;
+		}
+
+		assert_debug_only(isQuantifier);
+		// Lazy and possessive forms quantify the same way
+		if (i + 1 < pattern.size() && (pattern[i + 1] == '?' || pattern[i + 1] == '+'))
+			++i;
+
+		if (!lastTokenInRun)
+			continue;
+
+		// "ab*c" guarantees only "a" and "c"; "ab+c" guarantees "ab" and "bc", but not "abc".
+		const qsizetype length = lastCharacterLength();
+		const QString quantified = run.right(length);
+		if (quantifierAllowsZero)
+			run.chop(length);
+		endRun();
+		if (!quantifierAllowsZero)
+			run = quantified;
+	}
+
+	if (groupDepth != 0)
+		return {};
+
+	endRun();
+	return literals;
+}
+} // namespace
+
+CContentIndex::~CContentIndex() noexcept
+{
+	if (_data)
+		_file.unmap(const_cast<uchar*>(_data));
+
+	_file.close();
+	if (_removeFileOnClose)
+		_file.remove();
+}
+
+std::shared_ptr<const CContentIndex> CContentIndex::open(const QString& indexFilePath)
+{
+	std::shared_ptr<CContentIndex> index{ new CContentIndex };
+	index->_file.setFileName(indexFilePath);
+	if (!index->mapAndValidate())
+		return {};
+
+	return index;
+}
+
+std::shared_ptr<const CContentIndex> CContentIndex::build(const QString& indexFilePath, const QStringList& roots, const std::atomic<bool>& cancellationRequested)
+{
+	std::vector<PendingFile> files;
+	for (const QString& root : roots)
+	{
+		scanDirectory(CFileSystemObject(root), [&](const CFileSystemObject& item, bool /*reachedThroughLink*/) {
+			if (!cancellationRequested && item.isFile() && item.size() <= maxIndexedFileSize)
+				files.push_back({ item.fullAbsolutePath().toUtf8(), item.size(), static_cast<int64_t>(item.modificationTime()) });
+		}, cancellationRequested);
+	}
+
+	if (cancellationRequested)
+		return {};
+
+	// Overlapping roots report the same file more than once
+	std::ranges::sort(files, {}, [](const PendingFile& file) { return pathBytes(file.path); });
+	const auto duplicates = std::ranges::unique(files, {}, [](const PendingFile& file) { return pathBytes(file.path); });
+	files.erase(duplicates.begin(), duplicates.end());
+	assert_r(files.size() <= std::numeric_limits<uint32_t>::max());
+
+	std::shared_ptr<const CContentIndex> previous = open(indexFilePath);
+
+	QTemporaryFile stagingFile{ indexFilePath + QStringLiteral(".XXXXXX") };
+	stagingFile.setAutoRemove(false);
+	if (!stagingFile.open())
+		return {};
+
+	const auto discardStagingFile = [&stagingFile]() -> std::shared_ptr<const CContentIndex> {
+		stagingFile.remove();
+		return {};
+	};
+
+	const auto writeAll = [&stagingFile](const void* data, uint64_t size) {
+		return stagingFile.write(static_cast<const char*>(data), static_cast<qint64>(size)) == static_cast<qint64>(size);
+	};
+
+	const auto alignTo8 = [&] {
+		static constexpr char padding[8]{};
+		return writeAll(padding, (8 - static_cast<uint64_t>(stagingFile.pos()) % 8) % 8);
+	};
+
+	Header header{};
+	if (!writeAll(&header, sizeof(header)))
+		return discardStagingFile();
+
+	// The forward section: unchanged files are copied over from the previous index, the rest are read in parallel.
+	header.forwardOffset = sizeof(header);
+	const auto appendForwardList = [&](PendingFile& file, const uchar* data, uint64_t size) {
+		if (!writeAll(data, size))
+			return false;
+
+		file.forwardOffset = header.forwardSize;
+		file.forwardLength = static_cast<uint32_t>(size);
+		file.indexed = true;
+		header.forwardSize += size;
+		return true;
+	};
+
+	std::vector<size_t> filesToRead;
+	for (size_t i = 0; i < files.size(); ++i)
+	{
+		PendingFile& file = files[i];
+		if (previous)
+		{
+			const int64_t previousId = previous->findFile(file.path);
+			if (previousId >= 0)
+			{
+				const FileRecord& record = previous->_files[previousId];
+				const uchar* list = previous->_data + previous->_header->forwardOffset + record.forwardOffset;
+				if (record.size == file.size && record.modificationTime == file.modificationTime && isValidTrigramList(list, record.forwardLength))
+				{
+					if (!appendForwardList(file, list, record.forwardLength))
+						return discardStagingFile();
+					continue;
+				}
+			}
+		}
+
+		filesToRead.push_back(i);
+	}
+
+	if (!filesToRead.empty())
+	{
+		std::mutex stagingFileMutex;
+		bool writeFailed = false;
+		std::atomic<size_t> nextFileToRead{ 0 };
+
+		const uint32_t workerCount = std::clamp(std::thread::hardware_concurrency(), 1u, static_cast<uint32_t>(filesToRead.size()));
+		CThreadPool indexingPool(workerCount, "Content index builder thread pool");
+		for (uint32_t worker = 0; worker < workerCount; ++worker)
+		{
+			indexingPool.enqueue([&] {
+				TrigramCollector collector;
+				for (size_t i = nextFileToRead++; i < filesToRead.size() && !cancellationRequested; i = nextFileToRead++)
+				{
+					PendingFile& file = files[filesToRead[i]];
+					const auto trigrams = readFileTrigrams(file, collector);
+					// Left out of the index, so always read by searches
+					if (!trigrams)
+						continue;
+
+					std::lock_guard lock{ stagingFileMutex };
+					if (!writeFailed && !appendForwardList(file, reinterpret_cast<const uchar*>(trigrams->constData()), static_cast<uint64_t>(trigrams->size())))
+						writeFailed = true;
+				}
+			});
+		}
+
+		indexingPool.finishAllThreads(true);
+		if (writeFailed)
+			return discardStagingFile();
+	}
+
+	if (cancellationRequested)
+		return discardStagingFile();
+
+	std::erase_if(files, [](const PendingFile& file) { return !file.indexed; });
+	header.fileCount = static_cast<uint32_t>(files.size());
+
+	// Paths and the file table
+	header.pathsOffset = header.forwardOffset + header.forwardSize;
+	std::vector<FileRecord> fileRecords;
+	fileRecords.reserve(files.size());
+	for (const PendingFile& file : files)
+	{
+		fileRecords.push_back({ header.pathsSize, file.size, file.modificationTime, file.forwardOffset, static_cast<uint32_t>(file.path.size()), file.forwardLength });
+		if (!writeAll(file.path.constData(), static_cast<uint64_t>(file.path.size())))
+			return discardStagingFile();
+		header.pathsSize += static_cast<uint64_t>(file.path.size());
+	}
+
+	if (!alignTo8())
+		return discardStagingFile();
+
+	header.filesOffset = static_cast<uint64_t>(stagingFile.pos());
+	if (!writeAll(fileRecords.data(), fileRecords.size() * sizeof(FileRecord)))
+		return discardStagingFile();
+
+	// Inverting the forward lists takes two passes over them: one to size every posting list, one to fill them in.
+	if (!stagingFile.flush())
+		return discardStagingFile();
+
+	const uchar* forward = header.forwardSize > 0 ? stagingFile.map(static_cast<qint64>(header.forwardOffset), static_cast<qint64>(header.forwardSize)) : nullptr;
+	if (header.forwardSize > 0 && !forward)
+		return discardStagingFile();
+
+	struct TrigramBuildState
+	{
+		uint32_t trigram;
+		uint32_t fileCount = 0;
+		uint32_t lastFileId = 0;
+		uint64_t postingsSize = 0;
+		uint64_t postingsCursor = 0;
+	};
+
+	// Dense, so that the inner loops do not hash; the per-trigram state itself is only kept for trigrams that occur
+	static constexpr uint32_t noSlot = std::numeric_limits<uint32_t>::max();
+	std::vector<uint32_t> slotOfTrigram(trigramSpace, noSlot);
+	std::vector<TrigramBuildState> trigramStates;
+
+	for (uint32_t fileId = 0; fileId < header.fileCount; ++fileId)
+	{
+		if (fileId % 1024 == 0 && cancellationRequested)
+			return discardStagingFile();
+
+		const FileRecord& record = fileRecords[fileId];
+		[[maybe_unused]] const bool valid = forEachInDeltaList(forward + record.forwardOffset, record.forwardLength, [&](uint32_t trigram) {
+			uint32_t& slot = slotOfTrigram[trigram];
+			if (slot == noSlot)
+			{
+				slot = static_cast<uint32_t>(trigramStates.size());
+				trigramStates.push_back({ trigram });
+			}
+
+			TrigramBuildState& state = trigramStates[slot];
+			state.postingsSize += varintSize(fileId - state.lastFileId);
+			state.lastFileId = fileId;
+			++state.fileCount;
+		});
+		assert_debug_only(valid);
+	}
+
+	std::vector<uint32_t> slotsByTrigram(trigramStates.size());
+	std::iota(slotsByTrigram.begin(), slotsByTrigram.end(), 0u);
+	std::ranges::sort(slotsByTrigram, {}, [&](uint32_t slot) { return trigramStates[slot].trigram; });
+
+	std::vector<TrigramRecord> trigramRecords;
+	trigramRecords.reserve(trigramStates.size());
+	for (const uint32_t slot : slotsByTrigram)
+	{
+		TrigramBuildState& state = trigramStates[slot];
+		trigramRecords.push_back({ state.trigram, state.fileCount, header.postingsSize });
+		state.postingsCursor = header.postingsSize;
+		state.lastFileId = 0;
+		header.postingsSize += state.postingsSize;
+	}
+
+	header.trigramCount = static_cast<uint32_t>(trigramRecords.size());
+	if (!alignTo8())
+		return discardStagingFile();
+
+	header.trigramsOffset = static_cast<uint64_t>(stagingFile.pos());
+	if (!writeAll(trigramRecords.data(), trigramRecords.size() * sizeof(TrigramRecord)))
+		return discardStagingFile();
+
+	header.postingsOffset = static_cast<uint64_t>(stagingFile.pos());
+	if (header.postingsSize > 0)
+	{
+		if (!stagingFile.resize(static_cast<qint64>(header.postingsOffset + header.postingsSize)))
+			return discardStagingFile();
+
+		uchar* postings = stagingFile.map(static_cast<qint64>(header.postingsOffset), static_cast<qint64>(header.postingsSize));
+		if (!postings)
+			return discardStagingFile();
+
+		for (uint32_t fileId = 0; fileId < header.fileCount; ++fileId)
+		{
+			const FileRecord& record = fileRecords[fileId];
+			[[maybe_unused]] const bool valid = forEachInDeltaList(forward + record.forwardOffset, record.forwardLength, [&](uint32_t trigram) {
+				TrigramBuildState& state = trigramStates[slotOfTrigram[trigram]];
+				state.postingsCursor = static_cast<uint64_t>(writeVarint(postings + state.postingsCursor, fileId - state.lastFileId) - postings);
+				state.lastFileId = fileId;
+			});
+			assert_debug_only(valid);
+		}
+
+		stagingFile.unmap(postings);
+	}
+
+	if (forward)
+		stagingFile.unmap(const_cast<uchar*>(forward));
+
+	memcpy(header.magic, indexMagic, sizeof(header.magic));
+	header.formatVersion = indexFormatVersion;
+	header.byteOrderMark = indexByteOrderMark;
+	if (!stagingFile.seek(0) || !writeAll(&header, sizeof(header)) || !stagingFile.flush())
+		return discardStagingFile();
+
+	const QString stagingFilePath = stagingFile.fileName();
+	stagingFile.close();
+
+	// Windows will not replace a file that is still mapped
+	previous.reset();
+	std::error_code replaceError;
+	std::filesystem::rename(toFilesystemPath(stagingFilePath), toFilesystemPath(indexFilePath), replaceError);
+
+	// Someone else still has the old index open. The new one is served from its staging file until it is released,
+	// and the next build will try the replacement again.
+	const bool replaced = !replaceError;
+	std::shared_ptr<CContentIndex> index{ new CContentIndex };
+	index->_file.setFileName(replaced ? indexFilePath : stagingFilePath);
+	index->_removeFileOnClose = !replaced;
+	if (!index->mapAndValidate())
+		return {};
+
+	return index;
+}
+
+std::vector<uint32_t> CContentIndex::requiredTrigrams(const QString& contentsToFind, bool isRegex, bool caseSensitive, bool matchedAsDecodedText)
+{
+	const std::vector<QString> literals = isRegex ? requiredRegexLiterals(contentsToFind) : std::vector<QString>{ contentsToFind };
+
+	std::vector<uint32_t> trigrams;
+	for (const QString& literal : literals)
+	{
+		// Undecodable bytes in a file also read as U+FFFD, so its encoding is no guarantee either
+		if (matchedAsDecodedText && literal.contains(QChar::ReplacementCharacter))
+			continue;
+
+		const QByteArray bytes = literal.toUtf8();
+		for (qsizetype i = 0; i + 3 <= bytes.size(); ++i)
+		{
+			const auto* window = reinterpret_cast<const uint8_t*>(bytes.constData() + i);
+			const auto isUnreliable = [&](uint8_t byte) {
+				if (matchedAsDecodedText && byte == ' ')
+					return true;
+
+				// Unicode case folding can match text with different bytes here: non-ASCII letters, and the ASCII
+				// 'k' and 's', which also fold with the Kelvin sign and the long s.
+				const uint8_t folded = foldAsciiCase(byte);
+				return !caseSensitive && (byte >= 0x80 || folded == 'k' || folded == 's');
+			};
+
+			if (isUnreliable(window[0]) || isUnreliable(window[1]) || isUnreliable(window[2]))
+				continue;
+
+			trigrams.push_back((static_cast<uint32_t>(foldAsciiCase(window[0])) << 16) | (static_cast<uint32_t>(foldAsciiCase(window[1])) << 8) | foldAsciiCase(window[2]));
+		}
+	}
+
+	std::ranges::sort(trigrams);
+	const auto duplicates = std::ranges::unique(trigrams);
+	trigrams.erase(duplicates.begin(), duplicates.end());
+	return trigrams;
+}
+
+CContentIndex::CandidateSet CContentIndex::candidates(const std::vector<uint32_t>& trigrams) const
+{
+	assert_debug_only(!trigrams.empty());
+
+	const TrigramRecord* trigramsEnd = _trigrams + _header->trigramCount;
+	std::vector<const TrigramRecord*> postingLists;
+	postingLists.reserve(trigrams.size());
+	for (const uint32_t trigram : trigrams)
+	{
+		const auto* record = std::lower_bound(_trigrams, trigramsEnd, trigram, [](const TrigramRecord& r, uint32_t value) { return r.trigram < value; });
+		// No indexed file has it
+		if (record == trigramsEnd || record->trigram != trigram)
+			return {};
+
+		postingLists.push_back(record);
+	}
+
+	// The shortest list first keeps every following intersection as small as it can be
+	std::ranges::sort(postingLists, {}, &TrigramRecord::fileCount);
+
+	const uchar* postings = _data + _header->postingsOffset;
+	const auto listSize = [&](const TrigramRecord* record) {
+		const uint64_t end = (record + 1 < trigramsEnd) ? record[1].postingsOffset : _header->postingsSize;
+		return end - record->postingsOffset;
+	};
+
+	CandidateSet candidates;
+	candidates.reserve(postingLists.front()->fileCount);
+	if (!forEachInDeltaList(postings + postingLists.front()->postingsOffset, listSize(postingLists.front()), [&](uint32_t fileId) { candidates.push_back(fileId); }))
+		return {};
+
+	for (size_t list = 1; list < postingLists.size() && !candidates.empty(); ++list)
+	{
+		// Intersecting in place: the write position never passes the read position
+		size_t kept = 0, next = 0;
+		const bool valid = forEachInDeltaList(postings + postingLists[list]->postingsOffset, listSize(postingLists[list]), [&](uint32_t fileId) {
+			while (next < candidates.size() && candidates[next] < fileId)
+				++next;
+			if (next < candidates.size() && candidates[next] == fileId)
+				candidates[kept++] = candidates[next++];
+		});
+
+		if (!valid)
+			return {};
+
+		candidates.resize(kept);
+	}
+
+	return candidates;
+}
+
+CContentIndex::Verdict CContentIndex::verdict(const CandidateSet& candidates, const QString& absolutePath, uint64_t size, time_t modificationTime) const
+{
+	const int64_t fileId = findFile(absolutePath.toUtf8());
+	if (fileId < 0)
+		return Verdict::NotIndexed;
+
+	const FileRecord& record = _files[fileId];
+	if (record.size != size || record.modificationTime != static_cast<int64_t>(modificationTime))
+		return Verdict::NotIndexed;
+
+	return std::ranges::binary_search(candidates, static_cast<uint32_t>(fileId)) ? Verdict::Candidate : Verdict::Excluded;
+}
+
+uint32_t CContentIndex::fileCount() const noexcept
+{
+	return _header->fileCount;
+}
+
+uint32_t CContentIndex::trigramCount() const noexcept
+{
+	return _header->trigramCount;
+}
+
+bool CContentIndex::mapAndValidate()
+{
+	// The records are read straight from the mapping
+	static_assert(sizeof(Header) == 88);
+	static_assert(sizeof(FileRecord) == 40);
+	static_assert(sizeof(TrigramRecord) == 16);
+
+	if (!_file.open(QFile::ReadOnly))
+		return false;
+
+	_size = static_cast<uint64_t>(_file.size());
+	if (_size < sizeof(Header))
+		return false;
+
+	_data = _file.map(0, static_cast<qint64>(_size));
+	if (!_data)
+		return false;
+
+	_header = reinterpret_cast<const Header*>(_data);
+	const Header& header = *_header;
+	if (memcmp(header.magic, indexMagic, sizeof(indexMagic)) != 0 || header.formatVersion != indexFormatVersion || header.byteOrderMark != indexByteOrderMark)
+		return false;
+
+	const auto sectionFits = [this](uint64_t offset, uint64_t size) {
+		return offset <= _size && size <= _size - offset;
+	};
+
+	if (!sectionFits(header.forwardOffset, header.forwardSize) || !sectionFits(header.pathsOffset, header.pathsSize) || !sectionFits(header.postingsOffset, header.postingsSize) ||
+		!sectionFits(header.filesOffset, uint64_t{ header.fileCount } * sizeof(FileRecord)) || header.filesOffset % alignof(FileRecord) != 0 ||
+		!sectionFits(header.trigramsOffset, uint64_t{ header.trigramCount } * sizeof(TrigramRecord)) || header.trigramsOffset % alignof(TrigramRecord) != 0)
+		return false;
+
+	_files = reinterpret_cast<const FileRecord*>(_data + header.filesOffset);
+	_trigrams = reinterpret_cast<const TrigramRecord*>(_data + header.trigramsOffset);
+
+	// Every lookup trusts the records from here on
+	for (uint32_t i = 0; i < header.fileCount; ++i)
+	{
+		const FileRecord& record = _files[i];
+		if (record.pathOffset > header.pathsSize || record.pathLength > header.pathsSize - record.pathOffset ||
+			record.forwardOffset > header.forwardSize || record.forwardLength > header.forwardSize - record.forwardOffset)
+			return false;
+	}
+
+	for (uint32_t i = 0; i < header.trigramCount; ++i)
+	{
+		const TrigramRecord& record = _trigrams[i];
+		const uint64_t listEnd = i + 1 < header.trigramCount ? _trigrams[i + 1].postingsOffset : header.postingsSize;
+		if (record.postingsOffset > listEnd || listEnd > header.postingsSize || (i > 0 && _trigrams[i - 1].trigram >= record.trigram))
+			return false;
+	}
+
+	return true;
+}
+
+int64_t CContentIndex::findFile(const QByteArray& utf8Path) const noexcept
+{
+	const char* paths = reinterpret_cast<const char*>(_data + _header->pathsOffset);
+	const auto pathOf = [paths](const FileRecord& record) {
+		return std::string_view{ paths + record.pathOffset, record.pathLength };
+	};
+
+	const std::string_view path = pathBytes(utf8Path);
+	const FileRecord* filesEnd = _files + _header->fileCount;
+	const FileRecord* record = std::lower_bound(_files, filesEnd, path, [&](const FileRecord& r, std::string_view value) { return pathOf(r) < value; });
+	return (record != filesEnd && pathOf(*record) == path) ? record - _files : -1;
+}
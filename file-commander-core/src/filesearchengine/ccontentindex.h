@@ -0,0 +1,85 @@
+#pragma once
+
+#include "compiler/compiler_warnings_control.h"
+
+DISABLE_COMPILER_WARNINGS
+#include <QFile>
+#include <QString>
+#include <qcontainerfwd.h>
+RESTORE_COMPILER_WARNINGS
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+
+// An opt-in index of file contents for repeated content searches over the same trees: for every indexed file, the set
+// of byte trigrams it contains, inverted into one posting list per trigram. A query whose matches must contain certain
+// bytes then only needs to read the files whose posting lists have all of the query's trigrams; the regular matcher
+// still confirms every candidate, so the index can only ever narrow a search, never change its results.
+// Trigrams are taken over ASCII-case-folded bytes, so one index serves case-sensitive and case-insensitive queries.
+// A file in UTF-16 or a legacy code page is indexed by its text transcoded into UTF-8, which is how the search matches it.
+// Compressed files are not indexed at all, so every search reads them.
+// The on-disk form is one compact file that is memory-mapped rather than loaded. Immutable once opened, and safe to
+// query from any number of threads.
+class CContentIndex
+{
+public:
+	// The per-file answer to one query.
+	enum class Verdict {
+		NotIndexed, // Unknown to the index, or changed since it was built: the file has to be read
+		Excluded,   // Indexed, unchanged and lacking at least one of the query's trigrams: it cannot match
+		Candidate   // Indexed, unchanged and containing every trigram: it may match
+	};
+
+	// The ids of the indexed files that contain every trigram of one query, ascending.
+	using CandidateSet = std::vector<uint32_t>;
+
+	// Larger files are left out of the index and always read.
+	static constexpr uint64_t maxIndexedFileSize = 64 * 1024 * 1024;
+
+	~CContentIndex() noexcept;
+
+	// nullptr if there is no index at indexFilePath, or if it is damaged or from a different format version.
+	[[nodiscard]] static std::shared_ptr<const CContentIndex> open(const QString& indexFilePath);
+
+	// Indexes every regular file under roots in parallel and atomically replaces the index at indexFilePath. Files whose
+	// size and modification time match the existing index there are carried over without being read again.
+	// nullptr if cancelled or if the index file could not be written; the existing index is left intact either way.
+	[[nodiscard]] static std::shared_ptr<const CContentIndex> build(const QString& indexFilePath, const QStringList& roots, const std::atomic<bool>& cancellationRequested);
+
+	// The trigrams every match of a content query is guaranteed to contain, folded the same way as the index.
+	// Empty when nothing can be guaranteed (a short query, or a regex beyond the simple literal analysis), in which case
+	// the index cannot narrow the query. matchedAsDecodedText: the query goes through the regex engine, which sees NUL
+	// bytes as spaces, so a space in the query does not guarantee a space in the file.
+	[[nodiscard]] static std::vector<uint32_t> requiredTrigrams(const QString& contentsToFind, bool isRegex, bool caseSensitive, bool matchedAsDecodedText);
+
+	// trigrams must be non-empty, as returned by requiredTrigrams().
+	[[nodiscard]] CandidateSet candidates(const std::vector<uint32_t>& trigrams) const;
+	[[nodiscard]] Verdict verdict(const CandidateSet& candidates, const QString& absolutePath, uint64_t size, time_t modificationTime) const;
+
+	[[nodiscard]] uint32_t fileCount() const noexcept;
+	[[nodiscard]] uint32_t trigramCount() const noexcept;
+
+private:
+	struct Header;
+	struct FileRecord;
+	struct TrigramRecord;
+
+	CContentIndex() noexcept = default;
+
+	[[nodiscard]] bool mapAndValidate();
+	// The id of the file with this UTF-8 path, or -1.
+	[[nodiscard]] int64_t findFile(const QByteArray& utf8Path) const noexcept;
+
+private:
+	QFile _file;
+	const uchar* _data = nullptr;
+	uint64_t _size = 0;
+	const Header* _header = nullptr;
+	const FileRecord* _files = nullptr;
+	const TrigramRecord* _trigrams = nullptr;
+	// Set when the index could not replace the one at its intended path and lives in its staging file instead
+	bool _removeFileOnClose = false;
+};
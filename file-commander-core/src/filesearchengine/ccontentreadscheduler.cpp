@@ -0,0 +1,317 @@
+#include "ccontentreadscheduler.h"
+
+#include "assert/advanced_assert.h"
+#include "qtcore_helpers/qstring_helpers.hpp"
+#include "threading/cthreadpool.h"
+#include "utility/on_scope_exit.hpp"
+
+DISABLE_COMPILER_WARNINGS
+#include <QDir>
+#include <QFile>
+RESTORE_COMPILER_WARNINGS
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <winioctl.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sysmacros.h>
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <chrono>
+#include <limits>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace
+{
+// Where a file's data starts on its device, as far as the filesystem is willing to tell. Files with a known physical
+// position sort by it; the rest follow, by inode number, which most filesystems hand out roughly in allocation order.
+struct ReadOrderKey
+{
+	uint64_t physicalPosition = std::numeric_limits<uint64_t>::max();
+	uint64_t inode = 0;
+
+	[[nodiscard]] auto operator<=>(const ReadOrderKey&) const noexcept = default;
+};
+
+[[nodiscard]] ReadOrderKey readOrderKey(const QString& path)
+{
+	ReadOrderKey key;
+#ifdef _WIN32
+	const HANDLE file = ::CreateFileW(reinterpret_cast<const wchar_t*>(QDir::toNativeSeparators(path).utf16()), FILE_READ_ATTRIBUTES,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, 0, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return key;
+
+	EXEC_ON_SCOPE_EXIT([file] { ::CloseHandle(file); });
+
+	// The first extent is all it takes; ERROR_MORE_DATA only means there are others
+	STARTING_VCN_INPUT_BUFFER start{};
+	RETRIEVAL_POINTERS_BUFFER extents{};
+	DWORD bytesReturned = 0;
+	const BOOL retrieved = ::DeviceIoControl(file, FSCTL_GET_RETRIEVAL_POINTERS, &start, sizeof(start), &extents, sizeof(extents), &bytesReturned, nullptr);
+	if ((retrieved || ::GetLastError() == ERROR_MORE_DATA) && extents.ExtentCount > 0 && extents.Extents[0].Lcn.QuadPart >= 0)
+		key.physicalPosition = static_cast<uint64_t>(extents.Extents[0].Lcn.QuadPart);
+
+	BY_HANDLE_FILE_INFORMATION info;
+	if (::GetFileInformationByHandle(file, &info))
+		key.inode = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+#else
+	const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+	if (fd < 0)
+		return key;
+
+	EXEC_ON_SCOPE_EXIT([fd] { ::close(fd); });
+
+#ifdef __linux__
+	alignas(struct fiemap) std::byte mappingBuffer[sizeof(struct fiemap) + sizeof(struct fiemap_extent)]{};
+	auto* mapping = reinterpret_cast<struct fiemap*>(mappingBuffer);
+	mapping->fm_start = 0;
+	mapping->fm_length = FIEMAP_MAX_OFFSET;
+	mapping->fm_extent_count = 1;
+
+	static constexpr uint32_t positionlessExtent = FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DATA_INLINE | FIEMAP_EXTENT_NOT_ALIGNED;
+	if (::ioctl(fd, FS_IOC_FIEMAP, mapping) == 0 && mapping->fm_mapped_extents > 0 && (mapping->fm_extents[0].fe_flags & positionlessExtent) == 0)
+		key.physicalPosition = mapping->fm_extents[0].fe_physical;
+#endif
+
+	struct stat info;
+	if (::fstat(fd, &info) == 0)
+		key.inode = static_cast<uint64_t>(info.st_ino);
+#endif
+
+	return key;
+}
+} // namespace
+
+CContentReadScheduler::CContentReadScheduler(ReadTask task, const std::atomic<bool>& cancellationRequested) :
+	_task{ std::move(task) },
+	_cancellationRequested{ cancellationRequested }
+{
+}
+
+CContentReadScheduler::~CContentReadScheduler()
+{
+	finish();
+}
+
+CContentReadScheduler::StorageKind CContentReadScheduler::storageKindOf(const QString& path)
+{
+#if defined __linux__
+	struct stat info;
+	if (::stat(QFile::encodeName(path).constData(), &info) != 0)
+		return StorageKind::Unknown;
+
+	// A filesystem without a block device of its own (tmpfs, NFS, btrfs subvolumes) has no such entry at all.
+	// A partition has no queue of its own either, but the disk it is on does.
+	const QString deviceDir = QSL("/sys/dev/block/%1:%2/").arg(major(info.st_dev)).arg(minor(info.st_dev));
+	for (const QString& flagPath : { deviceDir + QSL("queue/rotational"), deviceDir + QSL("../queue/rotational") })
+	{
+		QFile flag{ flagPath };
+		if (!flag.open(QFile::ReadOnly))
+			continue;
+
+		const QByteArray value = flag.readAll().trimmed();
+		if (value == "1")
+			return StorageKind::Rotational;
+		else if (value == "0")
+			return StorageKind::SolidState;
+	}
+
+	return StorageKind::Unknown;
+#elif defined _WIN32
+	wchar_t volumePath[MAX_PATH + 1];
+	if (!::GetVolumePathNameW(reinterpret_cast<const wchar_t*>(QDir::toNativeSeparators(path).utf16()), volumePath, MAX_PATH + 1))
+		return StorageKind::Unknown;
+
+	// Only a drive letter names a device that can be asked; a network share or a folder mount point does not
+	const std::wstring volume{ volumePath };
+	if (volume.size() != 3 || volume[1] != L':')
+		return StorageKind::Unknown;
+
+	const std::wstring device = L"\\\\.\\" + volume.substr(0, 2);
+	const HANDLE handle = ::CreateFileW(device.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0, nullptr);
+	if (handle == INVALID_HANDLE_VALUE)
+		return StorageKind::Unknown;
+
+	EXEC_ON_SCOPE_EXIT([handle] { ::CloseHandle(handle); });
+
+	STORAGE_PROPERTY_QUERY query{};
+	query.PropertyId = StorageDeviceSeekPenaltyProperty;
+	query.QueryType = PropertyStandardQuery;
+
+	DEVICE_SEEK_PENALTY_DESCRIPTOR seekPenalty{};
+	DWORD bytesReturned = 0;
+	if (!::DeviceIoControl(handle, IOCTL_STORAGE_QUERY_PROPERTY, &query, sizeof(query), &seekPenalty, sizeof(seekPenalty), &bytesReturned, nullptr) || bytesReturned < sizeof(seekPenalty))
+		return StorageKind::Unknown;
+
+	return seekPenalty.IncursSeekPenalty ? StorageKind::Rotational : StorageKind::SolidState;
+#else
+	(void)path;
+	return StorageKind::Unknown;
+#endif
+}
+
+uint32_t CContentReadScheduler::readerCount(StorageKind kind) noexcept
+{
+	// Two readers keep a disk busy while one of them is matching what it has read; more only make the heads seek
+	// between the files they read in parallel.
+	if (kind == StorageKind::Rotational)
+		return 2;
+
+	static constexpr uint32_t maximumReaders = 8;
+	return std::clamp(std::thread::hardware_concurrency(), 1u, maximumReaders);
+}
+
+void CContentReadScheduler::setBatchReadTask(BatchReadTask task, uint64_t maxFileSize, size_t batchSize)
+{
+	assert_debug_only(batchSize > 0);
+	assert_debug_only(_pendingBatch.empty() && _smallFiles.empty());
+
+	_batchTask = std::move(task);
+	_batchMaxFileSize = maxFileSize;
+	_batchSize = batchSize;
+}
+
+void CContentReadScheduler::setStorageKind(StorageKind kind)
+{
+	if (kind == _storageKind)
+		return;
+
+	dispatchPendingBatch();
+	dispatchSmallFiles();
+	_storageKind = kind;
+}
+
+void CContentReadScheduler::schedule(QString path, bool reachedThroughLink, uint64_t size)
+{
+	if (_cancellationRequested)
+		return;
+
+	if (_storageKind != StorageKind::Rotational)
+	{
+		dispatch({ std::move(path), reachedThroughLink, size });
+		return;
+	}
+
+	_pendingBatch.push_back({ std::move(path), reachedThroughLink, size });
+	if (_pendingBatch.size() >= rotationalBatchSize)
+		dispatchPendingBatch();
+}
+
+void CContentReadScheduler::finish()
+{
+	if (_finished)
+		return;
+
+	_finished = true;
+	dispatchPendingBatch();
+	dispatchSmallFiles();
+
+	for (ReaderPool& pool : _pools)
+	{
+		if (pool.threads)
+			pool.threads->finishAllThreads(true);
+	}
+}
+
+void CContentReadScheduler::dispatch(FileRead read)
+{
+	if (_batchTask && read.size != unknownSize && read.size <= _batchMaxFileSize)
+	{
+		_smallFiles.push_back(std::move(read));
+		if (_smallFiles.size() >= _batchSize)
+			dispatchSmallFiles();
+		return;
+	}
+
+	enqueue([this, read{ std::move(read) }] {
+		_task(read.path, read.reachedThroughLink);
+	});
+}
+
+void CContentReadScheduler::dispatchSmallFiles()
+{
+	if (_smallFiles.empty())
+		return;
+
+	enqueue([this, files{ std::exchange(_smallFiles, {}) }] {
+		_batchTask(files);
+	});
+}
+
+void CContentReadScheduler::enqueue(std::function<void ()> task)
+{
+	ReaderPool& pool = readerPool(_storageKind);
+
+	// Waiting in slices, so that a cancellation is noticed even while every reader is busy with a huge file
+	for (;;)
+	{
+		if (_cancellationRequested)
+			return;
+
+		if (pool.availableTaskSlots->try_acquire_for(std::chrono::milliseconds{ 20 }))
+			break;
+	}
+
+	if (_cancellationRequested)
+	{
+		pool.availableTaskSlots->release();
+		return;
+	}
+
+	pool.threads->enqueue([this, &pool, task{ std::move(task) }] {
+		EXEC_ON_SCOPE_EXIT([&pool] { pool.availableTaskSlots->release(); });
+		if (!_cancellationRequested)
+			task();
+	});
+}
+
+void CContentReadScheduler::dispatchPendingBatch()
+{
+	if (_pendingBatch.empty())
+		return;
+
+	std::vector<std::pair<ReadOrderKey, FileRead>> batch;
+	batch.reserve(_pendingBatch.size());
+	for (FileRead& read : _pendingBatch)
+	{
+		if (_cancellationRequested)
+			break;
+
+		ReadOrderKey key = readOrderKey(read.path);
+		batch.emplace_back(key, std::move(read));
+	}
+	_pendingBatch.clear();
+
+	// Stable, so that files the filesystem says nothing about stay in traversal order
+	std::ranges::stable_sort(batch, {}, [](const auto& item) { return item.first; });
+	for (auto& [key, read] : batch)
+		dispatch(std::move(read));
+}
+
+CContentReadScheduler::ReaderPool& CContentReadScheduler::readerPool(StorageKind kind)
+{
+	ReaderPool& pool = _pools[static_cast<size_t>(kind)];
+	if (!pool.threads)
+	{
+		const uint32_t readers = readerCount(kind);
+		// Enough queued work for every reader to pick up the next file right away, and no more
+		pool.availableTaskSlots = std::make_unique<std::counting_semaphore<>>(static_cast<std::ptrdiff_t>(readers) * 2);
+		pool.threads = std::make_unique<CThreadPool>(readers, "File search by contents thread pool");
+	}
+
+	return pool;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "compiler/compiler_warnings_control.h"
+
+DISABLE_COMPILER_WARNINGS
+#include <QString>
+RESTORE_COMPILER_WARNINGS
+
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <semaphore>
+#include <stdint.h>
+#include <vector>
+
+class CThreadPool;
+
+// Hands the files whose contents a search has to read to a pool of readers sized for the device they are on.
+// On a solid-state device, or one of unknown kind, every file goes to the readers as soon as it is scheduled. On a
+// rotational one, files are collected into batches and each batch is read in the order the files lie on the disk, so
+// that the heads sweep across it rather than seek back and forth in traversal order; fewer readers compete for it, too.
+// Small files can be handed to a batch task instead, one batch of them per reader task, wherever they are.
+class CContentReadScheduler
+{
+public:
+	enum class StorageKind {
+		Unknown,
+		SolidState,
+		Rotational
+	};
+
+	struct FileRead
+	{
+		QString path;
+		bool reachedThroughLink;
+		uint64_t size;
+	};
+
+	// Runs on a reader thread for every scheduled file.
+	using ReadTask = std::function<void (const QString& path, bool reachedThroughLink)>;
+	// Runs on a reader thread for every batch of small files.
+	using BatchReadTask = std::function<void (const std::vector<FileRead>& files)>;
+
+	static constexpr uint64_t unknownSize = std::numeric_limits<uint64_t>::max();
+
+	CContentReadScheduler(ReadTask task, const std::atomic<bool>& cancellationRequested);
+	// Finishes whatever is still scheduled
+	~CContentReadScheduler();
+
+	CContentReadScheduler(const CContentReadScheduler&) = delete;
+	CContentReadScheduler& operator=(const CContentReadScheduler&) = delete;
+
+	// What the device holding path reports itself to be; Unknown where the platform or the filesystem doesn't say.
+	[[nodiscard]] static StorageKind storageKindOf(const QString& path);
+	[[nodiscard]] static uint32_t readerCount(StorageKind kind) noexcept;
+
+	// Files no larger than maxFileSize are to be handed to task in batches of batchSize, rather than to the ReadTask one
+	// at a time. Must be set before anything is scheduled, as the readers may call it at any time after.
+	void setBatchReadTask(BatchReadTask task, uint64_t maxFileSize, size_t batchSize);
+	// The device the files scheduled from now on are on. Files already scheduled are dispatched first.
+	void setStorageKind(StorageKind kind);
+	// May wait for a reader to become free. Does nothing once the search is cancelled.
+	// A file of unknown size is never batched.
+	void schedule(QString path, bool reachedThroughLink, uint64_t size = unknownSize);
+	// Dispatches what is still pending and waits for the readers to finish it all. Prompt after a cancellation too,
+	// as the readers check for it before each file. Nothing may be scheduled afterwards.
+	void finish();
+
+	static constexpr size_t rotationalBatchSize = 1024;
+
+private:
+	// One per storage kind in use, created on first use
+	struct ReaderPool
+	{
+		// Bounds the queue, so that the traversal doesn't run arbitrarily far ahead of the readers
+		std::unique_ptr<std::counting_semaphore<>> availableTaskSlots;
+		// Declared last so that it is destroyed first: its tasks release the semaphore
+		std::unique_ptr<CThreadPool> threads;
+	};
+
+	void dispatch(FileRead read);
+	void dispatchPendingBatch();
+	void dispatchSmallFiles();
+	// Waits for a free task slot on the current device's pool
+	void enqueue(std::function<void ()> task);
+	[[nodiscard]] ReaderPool& readerPool(StorageKind kind);
+
+private:
+	const ReadTask _task;
+	const std::atomic<bool>& _cancellationRequested;
+
+	StorageKind _storageKind = StorageKind::Unknown;
+	std::vector<FileRead> _pendingBatch;
+
+	BatchReadTask _batchTask;
+	uint64_t _batchMaxFileSize = 0;
+	size_t _batchSize = 0;
+	std::vector<FileRead> _smallFiles;
+
+	bool _finished = false;
+
+	// Indexed by StorageKind
+	ReaderPool _pools[3];
+};
@@ -0,0 +1,219 @@
+#include "cfilecontentreader.h"
+
+#include "assert/advanced_assert.h"
+
+#ifndef _WIN32
+DISABLE_COMPILER_WARNINGS
+#include <QFile>
+RESTORE_COMPILER_WARNINGS
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#if defined __linux__ || defined __FreeBSD__
+#define HAS_POSIX_FADVISE
+#endif
+
+namespace
+{
+// Reused by every file a reader thread reads, rather than allocated for each of them
+[[nodiscard]] std::vector<std::byte>& readBuffer()
+{
+	thread_local std::vector<std::byte> buffer(CFileContentReader::maxReadFileSize);
+	return buffer;
+}
+} // namespace
+
+CFileContentReader::~CFileContentReader()
+{
+#ifndef _WIN32
+	if (_fd >= 0)
+		::close(_fd);
+#endif
+}
+
+CFileContentReader::ReadPolicy CFileContentReader::policyFor(uint64_t fileSize) noexcept
+{
+	if (fileSize <= maxReadFileSize)
+		return { Strategy::Read, 0 };
+	else if (fileSize <= maxWholeMappingSize)
+		return { Strategy::MapWhole, 0 };
+	else
+		return { Strategy::MapWindows, mappingWindowSize };
+}
+
+bool CFileContentReader::open(const QString& path)
+{
+#ifdef _WIN32
+	if (!_file.open(path.toUtf8().constData(), thin_io::file::access_mode::Read)) [[unlikely]]
+		return false;
+
+	_size = _file.size().value_or(0);
+	return true;
+#else
+	assert_debug_only(_fd < 0);
+	_fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+	if (_fd < 0) [[unlikely]]
+		return false;
+
+	struct stat info;
+	if (::fstat(_fd, &info) != 0 || !S_ISREG(info.st_mode)) [[unlikely]]
+		return false;
+
+	_size = static_cast<uint64_t>(info.st_size);
+	return true;
+#endif
+}
+
+uint64_t CFileContentReader::size() const noexcept
+{
+	return _size;
+}
+
+bool CFileContentReader::scan(const WindowScanner& scanner)
+{
+	return scan(policyFor(_size), scanner);
+}
+
+bool CFileContentReader::scan(const ReadPolicy& policy, const WindowScanner& scanner)
+{
+	if (_size == 0)
+		return false;
+
+	switch (policy.strategy)
+	{
+	case Strategy::Read:
+		return scanByReading(scanner);
+	case Strategy::MapWhole:
+		return scanMapped(_size, false, scanner);
+	case Strategy::MapWindows:
+		assert_debug_only(policy.windowSize > 0 && policy.windowSize % (64 * 1024) == 0);
+		return scanMapped(policy.windowSize, true, scanner);
+	}
+
+	assert_unconditional_r("Unknown CFileContentReader::Strategy");
+	return false;
+}
+
+std::optional<size_t> CFileContentReader::readAt(uint64_t offset, std::byte* buffer, size_t length)
+{
+	assert_debug_only(offset % (64 * 1024) == 0);
+	if (offset >= _size)
+		return 0;
+
+	length = static_cast<size_t>(std::min<uint64_t>(length, _size - offset));
+
+#ifdef _WIN32
+	const auto* window = static_cast<const std::byte*>(_file.mmap(thin_io::file::mmap_access_mode::ReadOnly, offset, length));
+	if (!window) [[unlikely]]
+		return std::nullopt;
+
+	::memcpy(buffer, window, length);
+	_file.unmap(const_cast<std::byte*>(window));
+	return length;
+#else
+#ifdef HAS_POSIX_FADVISE
+	if (offset == 0)
+		::posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	size_t bytesRead = 0;
+	while (bytesRead < length)
+	{
+		const ssize_t result = ::pread(_fd, buffer + bytesRead, length - bytesRead, static_cast<off_t>(offset + bytesRead));
+		if (result < 0 && errno == EINTR)
+			continue;
+		else if (result < 0) [[unlikely]]
+			return std::nullopt;
+		else if (result == 0)
+			break;
+
+		bytesRead += static_cast<size_t>(result);
+	}
+
+	return bytesRead;
+#endif
+}
+
+bool CFileContentReader::scanByReading(const WindowScanner& scanner)
+{
+	std::vector<std::byte>& buffer = readBuffer();
+	if (buffer.size() < _size)
+		buffer.resize(_size);
+
+	// A file that has shrunk since open() is scanned as far as it goes; one that has grown, as far as it went then
+	size_t bytesRead = 0;
+#ifdef _WIN32
+	const auto result = _file.read(buffer.data(), _size);
+	if (!result) [[unlikely]]
+		return false;
+
+	bytesRead = static_cast<size_t>(*result);
+#else
+	while (bytesRead < _size)
+	{
+		const ssize_t result = ::pread(_fd, buffer.data() + bytesRead, _size - bytesRead, static_cast<off_t>(bytesRead));
+		if (result < 0 && errno == EINTR)
+			continue;
+		else if (result < 0) [[unlikely]]
+			return false;
+		else if (result == 0)
+			break;
+
+		bytesRead += static_cast<size_t>(result);
+	}
+#endif
+
+	return bytesRead > 0 && scanner(buffer.data(), bytesRead, 0);
+}
+
+bool CFileContentReader::scanMapped(uint64_t windowSize, bool releaseScannedWindows, const WindowScanner& scanner)
+{
+#ifdef HAS_POSIX_FADVISE
+	// Doubles the read-ahead, and lets the kernel drop the pages behind the reader sooner
+	::posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	for (uint64_t offset = 0; offset < _size; offset += windowSize)
+	{
+		const auto length = static_cast<size_t>(std::min(windowSize, _size - offset));
+
+#ifdef _WIN32
+		const auto* window = static_cast<const std::byte*>(_file.mmap(thin_io::file::mmap_access_mode::ReadOnly, offset, length));
+		if (!window) [[unlikely]]
+			return false;
+
+		const bool stop = scanner(window, length, offset);
+		_file.unmap(const_cast<std::byte*>(window));
+#else
+		void* mapping = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, _fd, static_cast<off_t>(offset));
+		if (mapping == MAP_FAILED) [[unlikely]]
+			return false;
+
+		::madvise(mapping, length, MADV_SEQUENTIAL);
+		const bool stop = scanner(static_cast<const std::byte*>(mapping), length, offset);
+		::munmap(mapping, length);
+#endif
+
+		if (stop)
+			return true;
+
+#ifdef HAS_POSIX_FADVISE
+		// The rest of a huge file is better off in the cache than the part already scanned
+		if (releaseScannedWindows)
+			::posix_fadvise(_fd, static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+#else
+		(void)releaseScannedWindows;
+#endif
+	}
+
+	return false;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "compiler/compiler_warnings_control.h"
+
+#ifdef _WIN32
+#include "file.hpp" // thin_io
+#endif
+
+DISABLE_COMPILER_WARNINGS
+#include <QString>
+RESTORE_COMPILER_WARNINGS
+
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <stdint.h>
+
+// Hands a file's contents to a scanner in consecutive windows, having told the kernel they are going to be read once,
+// front to back. How the file is read depends on its size (see policyFor()):
+//  - a small file is read into a buffer that is reused from file to file: one call, and no mapping to set up and tear down;
+//  - a larger one is mapped whole;
+//  - a huge one is mapped one window at a time, and each window is released once scanned - the mapping and, where the
+//    platform allows, the page cache behind it - so that neither the address space nor the cache fills up with a file
+//    that is only ever read once.
+class CFileContentReader
+{
+public:
+	enum class Strategy {
+		Read,
+		MapWhole,
+		MapWindows
+	};
+
+	struct ReadPolicy
+	{
+		Strategy strategy = Strategy::Read;
+		// For MapWindows only: a multiple of 64 KiB, the coarsest mapping granularity of the supported platforms
+		uint64_t windowSize = 0;
+	};
+
+	static constexpr uint64_t maxReadFileSize = 64 * 1024;
+	static constexpr uint64_t maxWholeMappingSize = 256 * 1024 * 1024;
+	static constexpr uint64_t mappingWindowSize = 32 * 1024 * 1024;
+
+	// Takes the data, its length and its offset in the file; returns true to stop scanning.
+	using WindowScanner = std::function<bool (const std::byte* data, size_t length, uint64_t offset)>;
+
+	CFileContentReader() noexcept = default;
+	~CFileContentReader();
+
+	CFileContentReader(const CFileContentReader&) = delete;
+	CFileContentReader& operator=(const CFileContentReader&) = delete;
+
+	[[nodiscard]] static ReadPolicy policyFor(uint64_t fileSize) noexcept;
+
+	[[nodiscard]] bool open(const QString& path);
+	// As of open()
+	[[nodiscard]] uint64_t size() const noexcept;
+
+	// Every window but the last is a whole number of windowSize (or the file itself, if it is read or mapped whole), so
+	// that a scanner working in smaller blocks that divide it sees the same blocks whatever the policy.
+	// Returns true if the scanner stopped the scan, false if it saw the whole file - or if the file could not be read.
+	bool scan(const WindowScanner& scanner);
+	bool scan(const ReadPolicy& policy, const WindowScanner& scanner);
+
+	// Copies up to length bytes from offset, for a caller that consumes the file as a stream rather than in windows.
+	// offset must be a multiple of 64 KiB, which Windows reads through a mapping at. The number of bytes read, 0 past
+	// the end; nullopt on error.
+	[[nodiscard]] std::optional<size_t> readAt(uint64_t offset, std::byte* buffer, size_t length);
+
+private:
+	[[nodiscard]] bool scanByReading(const WindowScanner& scanner);
+	[[nodiscard]] bool scanMapped(uint64_t windowSize, bool releaseScannedWindows, const WindowScanner& scanner);
+
+private:
+#ifdef _WIN32
+	thin_io::file _file;
+#else
+	int _fd = -1;
+#endif
+	uint64_t _size = 0;
+};
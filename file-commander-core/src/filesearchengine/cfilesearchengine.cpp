@@ -1,57 +1,46 @@
 #include "cfilesearchengine.h"
+#include "ccontentencoding.h"
+#include "ccontentindex.h"
+#include "ccontentreadscheduler.h"
+#include "cfilecontentreader.h"
+#include "curingbatchreader.h"
+#include "cnamefiltermatcher.h"
+#include "cstreamdecompressor.h"
 #include "cfilesystemobject.h"
 #include "timing/ctimeelapsed.h"
 #include "directoryscanner.h"
 
 #include "qtcore_helpers/qstring_helpers.hpp"
-#include "file.hpp"
 
 #include "assert/advanced_assert.h"
 #include "compiler/compiler_warnings_control.h"
 #include "threading/thread_helpers.h"
-#include "threading/cthreadpool.h"
-#include "utility/on_scope_exit.hpp"
 #include "utility_functions/memory_functions.h"
 
 DISABLE_COMPILER_WARNINGS
 #include <QRegularExpression>
+#include <QSet>
 #include <QStringView>
 RESTORE_COMPILER_WARNINGS
 
 #include <algorithm>
 #include <atomic>
+#include <bit>
 #include <chrono>
+#include <condition_variable>
+#include <limits>
+#include <map>
 #include <memory>
-#include <semaphore>
-#include <thread>
-
-// The name filter language: literal text, '*' for any run of characters, '?' for exactly one. A leading '^' or a
-// trailing '$' anchors that end of the match to the name's; an end left unanchored matches anywhere.
-[[nodiscard]] static QString nameFilterToRegex(QStringView filter)
-{
-	const bool anchorStart = filter.startsWith('^');
-	if (anchorStart)
-		filter = filter.sliced(1);
-
-	const bool anchorEnd = filter.endsWith('$');
-	if (anchorEnd)
-		filter.chop(1);
-
-	// Escaping everything and restoring only our own two wildcards is what keeps '.', '+' and brackets literal.
-	// Every '*' in the escaped text is preceded by the backslash that escaped it, so neither replacement can match
-	// across two escape sequences.
-	QString pattern = QRegularExpression::escape(filter);
-	pattern.replace(QLatin1StringView{ "\\*" }, QLatin1StringView{ ".*" });
-	pattern.replace(QLatin1StringView{ "\\?" }, QLatin1StringView{ "." });
-
-	// \A and \z rather than ^ and $: '$' also matches immediately before a trailing newline, which a POSIX name may end with.
-	if (anchorStart)
-		pattern.prepend(QLatin1StringView{ "\\A" });
-	if (anchorEnd)
-		pattern.append(QLatin1StringView{ "\\z" });
-
-	return pattern;
-}
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+static constexpr size_t maxLineLength = 4 * 1024;
+// The lines must come out the same however a file is read
+static_assert(CFileContentReader::mappingWindowSize % maxLineLength == 0);
 
 #ifndef __ARM_ARCH_ISA_A64
 
@@ -72,6 +61,47 @@ inline void replace_null(std::byte* array, size_t size) noexcept
 	}
 }
 
+inline size_t count_newlines(const std::byte* data, size_t size) noexcept
+{
+	const __m128i newline_sse = _mm_set1_epi8('\n');
+
+	size_t count = 0, i = 0;
+	for (; i + 16 <= size; i += 16)
+	{
+		const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline_sse))); // A bit per newline
+		count += static_cast<size_t>(std::popcount(mask));
+	}
+
+	for (; i < size; ++i)
+		count += data[i] == std::byte{ '\n' } ? 1 : 0;
+
+	return count;
+}
+
+// Counts the 16-bit units of size bytes of data that equal newline_unit as loaded - byte-swapped, for the other byte order.
+inline size_t count_newlines16(const std::byte* data, size_t size, uint16_t newline_unit) noexcept
+{
+	const __m128i newline_sse = _mm_set1_epi16(static_cast<short>(newline_unit));
+
+	size_t count = 0, i = 0;
+	for (; i + 16 <= size; i += 16)
+	{
+		const __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi16(units, newline_sse))); // Two bits per newline
+		count += static_cast<size_t>(std::popcount(mask)) / 2;
+	}
+
+	for (; i + 2 <= size; i += 2)
+	{
+		uint16_t unit;
+		::memcpy(&unit, data + i, sizeof(unit));
+		count += unit == newline_unit ? 1 : 0;
+	}
+
+	return count;
+}
+
 #else // ARM64
 
 #include <arm_neon.h>
@@ -90,101 +120,685 @@ inline void replace_null(std::byte* array, size_t size)
 		vst1q_u8(reinterpret_cast<uint8_t*>(&array[i]), result);                     // Store the result back
 	}
 }
+
+inline size_t count_newlines(const std::byte* data, size_t size) noexcept
+{
+	const uint8x16_t newline_neon = vdupq_n_u8('\n');
+
+	size_t count = 0, i = 0;
+	for (; i + 16 <= size; i += 16)
+	{
+		const uint8x16_t bytes = vld1q_u8(reinterpret_cast<const uint8_t*>(data + i));
+		count += vaddvq_u8(vshrq_n_u8(vceqq_u8(bytes, newline_neon), 7)); // 1 per newline, so the sum fits in a byte
+	}
+
+	for (; i < size; ++i)
+		count += data[i] == std::byte{ '\n' } ? 1 : 0;
+
+	return count;
+}
+
+// Counts the 16-bit units of size bytes of data that equal newline_unit as loaded - byte-swapped, for the other byte order.
+inline size_t count_newlines16(const std::byte* data, size_t size, uint16_t newline_unit) noexcept
+{
+	const uint16x8_t newline_neon = vdupq_n_u16(newline_unit);
+
+	size_t count = 0, i = 0;
+	for (; i + 16 <= size; i += 16)
+	{
+		const uint16x8_t units = vld1q_u16(reinterpret_cast<const uint16_t*>(data + i));
+		count += vaddvq_u16(vshrq_n_u16(vceqq_u16(units, newline_neon), 15)); // 1 per newline
+	}
+
+	for (; i + 2 <= size; i += 2)
+	{
+		uint16_t unit;
+		::memcpy(&unit, data + i, sizeof(unit));
+		count += unit == newline_unit ? 1 : 0;
+	}
+
+	return count;
+}
 #endif
 
-[[nodiscard]] static bool fileContentsMatches(const QString& path, const QRegularExpression& regex, const QByteArray& memoryPattern, const std::atomic_bool& cancellationRequested)
+namespace
 {
-	if (cancellationRequested)
-		return false;
+// The plain-text query in every encoding a search meets, transcoded once per encoding rather than once per file.
+// Shared by all the threads reading files for one search.
+class EncodedPatterns
+{
+public:
+	explicit EncodedPatterns(QString text) : _text{ std::move(text) }, _utf8{ _text.toUtf8() } {}
 
-	thin_io::file file;
-	if (!file.open(path.toUtf8().constData(), thin_io::file::access_mode::Read)) [[unlikely]]
-		return false;
+	// No encoding takes fewer bytes than this
+	[[nodiscard]] size_t minimumLength() const noexcept
+	{
+		return static_cast<size_t>(_text.size());
+	}
+
+	// Empty if the encoding cannot represent the query, in which case no file in it can match.
+	[[nodiscard]] QByteArray in(const CContentEncoding& encoding)
+	{
+		if (encoding.kind() == CContentEncoding::Kind::Utf8)
+			return _utf8;
+
+		std::lock_guard lock{ _mutex };
+		const auto [pattern, isNew] = _patterns.try_emplace(encoding.name());
+		if (isNew)
+			pattern->second = encoding.encode(_text);
+		return pattern->second;
+	}
 
-	const bool useRawMemoryPattern = !memoryPattern.isEmpty();
+private:
+	const QString _text;
+	const QByteArray _utf8;
+	std::mutex _mutex;
+	std::map<QByteArray, QByteArray> _patterns;
+};
 
-	const uint64_t fileSize = file.size().value_or(0);
-	if (useRawMemoryPattern && fileSize < (uint64_t)memoryPattern.size()) [[unlikely]]
-		return false;
-	if (fileSize == 0) [[unlikely]]
-		return false;
-	if (cancellationRequested)
-		return false;
+// Added to by every thread reading files for one search
+struct ContentCounters
+{
+	std::atomic<uint64_t> bytesSearched{ 0 };
+	std::atomic<uint64_t> bytesDecompressed{ 0 };
+	std::atomic<uint64_t> compressedFilesSearched{ 0 };
+};
 
-	static constexpr auto toBytePtr = [](const void* ptr) -> const std::byte* {
-		return reinterpret_cast<const std::byte*>(ptr);
-	};
+struct ContentQuery
+{
+	const QRegularExpression& regex;
+	// Looked for byte for byte instead of the regex when not null
+	EncodedPatterns* patterns;
+	size_t maxLocations;
+	bool skipBinaryFiles;
+	bool searchCompressedFiles;
+	ContentCounters& counters;
+	const std::atomic_bool& cancellationRequested;
+};
 
-	auto* mappedFile = toBytePtr(file.mmap(thin_io::file::mmap_access_mode::ReadOnly, 0, fileSize));
-	if (!mappedFile) [[unlikely]]
+// Numbers the lines of a file handed over window by window. The newlines are only counted as far as a match needs
+// them, so a file without a match costs nothing extra - unless it comes in more than one window.
+class LineCounter
+{
+public:
+	LineCounter() noexcept = default;
+	explicit LineCounter(const CContentEncoding& encoding) noexcept : _encoding{ encoding.kind() } {}
+
+	// The 1-based line of the byte at offset in the current window. The offsets asked about may not decrease within a window.
+	[[nodiscard]] uint64_t lineAt(const std::byte* window, size_t offset) noexcept
 	{
-		assert_debug_only(mappedFile);
-		return false;
+		assert_debug_only(offset >= _countedUpTo);
+		_newlines += countNewlines(window + _countedUpTo, offset - _countedUpTo);
+		_countedUpTo = offset;
+		return _newlines + 1;
 	}
 
-	for (uint64_t offset = 0; offset < fileSize; )
+	// Before moving on to the next window
+	void finishWindow(const std::byte* window, size_t length) noexcept
 	{
-		if (cancellationRequested)
-			return false;
+		_newlines += countNewlines(window + _countedUpTo, length - _countedUpTo);
+		_countedUpTo = 0;
+	}
+
+private:
+	[[nodiscard]] size_t countNewlines(const std::byte* data, size_t size) const noexcept
+	{
+		// The units are loaded in the little-endian order of every platform this builds for
+		switch (_encoding)
+		{
+		case CContentEncoding::Kind::Utf16LE:
+			return count_newlines16(data, size, 0x000A);
+		case CContentEncoding::Kind::Utf16BE:
+			return count_newlines16(data, size, 0x0A00);
+		default:
+			// Also right for the legacy multi-byte code pages, none of which has '\n' as the trailing byte of a character
+			return count_newlines(data, size);
+		}
+	}
+
+private:
+	CContentEncoding::Kind _encoding = CContentEncoding::Kind::Utf8;
+	uint64_t _newlines = 0;
+	size_t _countedUpTo = 0;
+};
+
+// Matches the contents of one file, handed over window by window from the start of the file.
+class FileMatcher
+{
+public:
+	explicit FileMatcher(const ContentQuery& query) noexcept : _query{ query } {}
+
+	// Searches the window in blocks of maxLineLength, so a match straddling two blocks is not found. Returns true once
+	// there is no point in going on: maxLocations matches have been found, the file cannot match or is binary data to
+	// be skipped, or the search is cancelled.
+	[[nodiscard]] bool scanWindow(const std::byte* window, size_t length, uint64_t windowOffset, bool lastWindow);
+
+	// The matches found so far, in file order
+	[[nodiscard]] std::vector<CFileSearchEngine::MatchLocation> takeLocations() noexcept
+	{
+		return std::move(_locations);
+	}
+
+private:
+	// The first window starts the file, and its start tells the encoding
+	[[nodiscard]] bool startFile(const std::byte* window, size_t length);
+
+	[[nodiscard]] bool findMatches(const std::byte* data, size_t length, uint64_t dataOffset);
+	[[nodiscard]] bool addLocation(const std::byte* data, size_t length, uint64_t dataOffset, size_t matchOffset, size_t matchLength);
+
+	[[nodiscard]] bool isNewlineAt(const std::byte* data, size_t offset) const noexcept;
+	[[nodiscard]] QString matchContext(const std::byte* data, size_t length, size_t matchOffset, size_t matchLength) const;
+
+private:
+	const ContentQuery& _query;
+	CContentEncoding _encoding;
+	QByteArray _pattern;
+	LineCounter _lines;
+	std::vector<CFileSearchEngine::MatchLocation> _locations;
+};
+
+bool FileMatcher::scanWindow(const std::byte* window, size_t length, uint64_t windowOffset, bool lastWindow)
+{
+	_query.counters.bytesSearched.fetch_add(length, std::memory_order_relaxed);
+
+	if (windowOffset == 0 && startFile(window, length))
+		return true;
+
+	if (findMatches(window, length, windowOffset))
+		return true;
+
+	if (!lastWindow)
+		_lines.finishWindow(window, length);
+	return false;
+}
+
+bool FileMatcher::startFile(const std::byte* window, size_t length)
+{
+	_encoding = CContentEncoding::detect(window, length);
+	if (_encoding.kind() == CContentEncoding::Kind::Binary)
+	{
+		if (_query.skipBinaryFiles)
+			return true;
+
+		_encoding = {}; // Matched byte for byte, as any file used to be
+	}
+
+	_lines = LineCounter{ _encoding };
+	if (_query.patterns)
+	{
+		_pattern = _query.patterns->in(_encoding);
+		return _pattern.isEmpty();
+	}
+
+	return false;
+}
+
+bool FileMatcher::findMatches(const std::byte* data, size_t length, uint64_t dataOffset)
+{
+	const bool useRawMemoryPattern = _query.patterns != nullptr;
+	if (useRawMemoryPattern && length < static_cast<size_t>(_pattern.size()))
+		return false;
 
-		static constexpr uint64_t maxLineLength = 4 * 1024;
+	const size_t codeUnitSize = _encoding.codeUnitSize();
+	const bool decodeAsUtf8 = codeUnitSize == 1 && _encoding.kind() != CContentEncoding::Kind::Legacy;
 
-		const auto maxSearchLength = std::min(fileSize - offset, maxLineLength);
-		const auto lineStart = mappedFile + offset;
-		offset += maxSearchLength;
+	for (size_t blockStart = 0; blockStart < length; )
+	{
+		if (_query.cancellationRequested)
+			return true;
+
+		const auto blockLength = std::min(length - blockStart, maxLineLength);
+		const auto block = data + blockStart;
 
 		if (!useRawMemoryPattern) // Match using regex - slow(er)
 		{
-			alignas(4096) std::byte buffer[maxLineLength];
-			static_assert(sizeof(buffer) % 16 == 0);
+			QString line;
+			if (decodeAsUtf8)
+			{
+				alignas(4096) std::byte buffer[maxLineLength];
+				static_assert(sizeof(buffer) % 16 == 0);
+
+				::memcpy(buffer, block, blockLength);
+				// Remove nulls from the contents so that QString ingests all data
+				replace_null(buffer, blockLength);
 
-			::memcpy(buffer, lineStart, maxSearchLength);
-			// Remove nulls from the contents so that QString ingests all data
-			replace_null(buffer, maxSearchLength);
+				line = QString::fromUtf8((const char*)buffer, blockLength);
+			}
+			else
+				line = _encoding.decode(block, blockLength);
 
-			const QString line = QString::fromUtf8((const char*)buffer, maxSearchLength);
-			assert(!line.isEmpty());
-			if (regex.match(line).hasMatch())
-				return true;
+			for (QRegularExpressionMatchIterator matches = _query.regex.globalMatch(line); matches.hasNext(); )
+			{
+				const QRegularExpressionMatch match = matches.next();
+				// Exact for valid input. A UTF-8 byte that isn't became a character of its own, which re-encodes longer.
+				const auto matchOffset = std::min(blockStart + _encoding.encodedLength(QStringView{ line }.first(match.capturedStart())), blockStart + blockLength);
+				if (addLocation(data, length, dataOffset, matchOffset, _encoding.encodedLength(match.capturedView())))
+					return true;
+			}
 		}
 		else // Match the string directly - fast
 		{
-			if (memfind(lineStart, maxSearchLength, memoryPattern.constData(), memoryPattern.size()) != nullptr)
-				return true;
+			const auto patternLength = static_cast<size_t>(_pattern.size());
+			for (size_t from = 0; from + patternLength <= blockLength; )
+			{
+				const auto* found = reinterpret_cast<const std::byte*>(memfind(block + from, blockLength - from, _pattern.constData(), patternLength));
+				if (!found)
+					break;
+
+				const auto matchOffset = static_cast<size_t>(found - data);
+				// Straddles two UTF-16 characters; the windows and blocks all start at even offsets
+				if (matchOffset % codeUnitSize != 0)
+				{
+					from = matchOffset - blockStart + 1;
+					continue;
+				}
+
+				if (addLocation(data, length, dataOffset, matchOffset, patternLength))
+					return true;
+
+				from = matchOffset - blockStart + patternLength;
+			}
 		}
+
+		blockStart += blockLength;
 	}
 
 	return false;
 }
 
+bool FileMatcher::addLocation(const std::byte* data, size_t length, uint64_t dataOffset, size_t matchOffset, size_t matchLength)
+{
+	_locations.push_back({ dataOffset + matchOffset, _lines.lineAt(data, matchOffset), matchContext(data, length, matchOffset, matchLength) });
+	return _locations.size() >= _query.maxLocations;
+}
+
+bool FileMatcher::isNewlineAt(const std::byte* data, size_t offset) const noexcept
+{
+	switch (_encoding.kind())
+	{
+	case CContentEncoding::Kind::Utf16LE:
+		return data[offset] == std::byte{ '\n' } && data[offset + 1] == std::byte{ 0 };
+	case CContentEncoding::Kind::Utf16BE:
+		return data[offset] == std::byte{ 0 } && data[offset + 1] == std::byte{ '\n' };
+	default:
+		return data[offset] == std::byte{ '\n' };
+	}
+}
+
+QString FileMatcher::matchContext(const std::byte* data, size_t length, size_t matchOffset, size_t matchLength) const
+{
+	const size_t unit = _encoding.codeUnitSize();
+	const size_t reach = CFileSearchEngine::contextLength * unit;
+	// Without the odd byte a UTF-16 window may end in
+	length -= length % unit;
+
+	size_t begin = matchOffset;
+	const size_t earliest = matchOffset > reach ? matchOffset - reach : 0;
+	while (begin > earliest && !isNewlineAt(data, begin - unit))
+		begin -= unit;
+
+	size_t end = std::min(matchOffset + matchLength, length);
+	const size_t latest = std::min(end + reach, length);
+	while (end < latest && !isNewlineAt(data, end))
+		end += unit;
+
+	QString context = _encoding.decode(data + begin, end - begin);
+	// A carriage return, a tab or a null would only garble a one-line view
+	for (QChar& ch : context)
+	{
+		if (ch.category() == QChar::Other_Control)
+			ch = u' ';
+	}
+
+	return context.trimmed();
+}
+} // namespace
+
+static void matchDecompressed(CStreamDecompressor::Format format, const CStreamDecompressor::InputSource& input, FileMatcher& matcher, const ContentQuery& query)
+{
+	// The last window is not known until the decompressor runs dry, so every one is taken for the last but one
+	const uint64_t decompressedBytes = CStreamDecompressor::decompress(format, input, [&](const std::byte* window, size_t length, uint64_t offset) {
+		return matcher.scanWindow(window, length, offset, false);
+	}, query.cancellationRequested);
+
+	query.counters.bytesDecompressed.fetch_add(decompressedBytes, std::memory_order_relaxed);
+	query.counters.compressedFilesSearched.fetch_add(1, std::memory_order_relaxed);
+}
+
+[[nodiscard]] static std::vector<CFileSearchEngine::MatchLocation> findMatchesInFile(const QString& path, const ContentQuery& query)
+{
+	if (query.cancellationRequested)
+		return {};
+
+	CFileContentReader reader;
+	if (!reader.open(path)) [[unlikely]]
+		return {};
+
+	const uint64_t fileSize = reader.size();
+	if (fileSize == 0) [[unlikely]]
+		return {};
+	if (query.cancellationRequested)
+		return {};
+
+	FileMatcher matcher{ query };
+	if (query.searchCompressedFiles)
+	{
+		std::byte magic[CStreamDecompressor::magicLength];
+		const auto magicLength = reader.readAt(0, magic, sizeof(magic));
+		if (const auto format = magicLength ? CStreamDecompressor::formatOf(magic, *magicLength) : CStreamDecompressor::Format::None; format != CStreamDecompressor::Format::None)
+		{
+			std::vector<std::byte> chunk(CStreamDecompressor::inputChunkSize);
+			uint64_t inputOffset = 0;
+			matchDecompressed(format, [&]() -> std::optional<std::span<const std::byte>> {
+				const auto bytesRead = reader.readAt(inputOffset, chunk.data(), chunk.size());
+				if (!bytesRead) [[unlikely]]
+					return std::nullopt;
+
+				inputOffset += *bytesRead;
+				return std::span{ chunk.data(), *bytesRead };
+			}, matcher, query);
+
+			return matcher.takeLocations();
+		}
+	}
+
+	if (query.patterns && fileSize < query.patterns->minimumLength()) [[unlikely]]
+		return {};
+
+	reader.scan([&](const std::byte* window, size_t windowLength, uint64_t windowOffset) {
+		return matcher.scanWindow(window, windowLength, windowOffset, windowOffset + windowLength >= fileSize);
+	});
+
+	return matcher.takeLocations();
+}
+
 namespace
 {
-struct ContentSearchContext
+// What a search within results needs of an entry the traversal came across, and no more. A whole CFileSystemObject -
+// its QFileInfo, name parts and all - is several times the size, and a kept traversal runs to maxCachedEntries of these.
+// Mirrors the CFileSystemObject accessors the search uses, so that either can be evaluated.
+class TraversedEntry
 {
-	CFileSearchEngine::FileSearchListener* listener;
-	const QRegularExpression* regex;
-	const QByteArray* plainText;
-	const std::atomic_bool* cancellationRequested;
-	std::counting_semaphore<>* availableTaskSlots = nullptr;
+public:
+	TraversedEntry(const CFileSystemObject& item, uint32_t root, bool reachedThroughLink) :
+		_path{ item.fullAbsolutePath() },
+		_size{ item.size() },
+		_modified{ item.modificationTime() },
+		_created{ item.creationTime() },
+		_permissions{ item.qFileInfo().permissions() },
+		_root{ root },
+		_isFile{ item.isFile() },
+		_isDir{ item.isDir() },
+		_isLink{ item.isLink() },
+		_isHidden{ item.isHidden() },
+		_reachedThroughLink{ reachedThroughLink }
+	{
+		// The name is the last component of the path, which for a directory is followed by a '/'
+		const QString name = item.fullName();
+		const qsizetype nameStart = _path.lastIndexOf(name);
+		assert_r(nameStart >= 0);
+		_nameStart = static_cast<uint32_t>(std::max(nameStart, qsizetype{ 0 }));
+		_nameLength = nameStart >= 0 ? static_cast<uint32_t>(name.size()) : 0;
+	}
+
+	[[nodiscard]] const QString& fullAbsolutePath() const noexcept { return _path; }
+	[[nodiscard]] QStringView fullName() const noexcept { return QStringView{ _path }.sliced(_nameStart, _nameLength); }
+	[[nodiscard]] uint64_t size() const noexcept { return _size; }
+	[[nodiscard]] time_t modificationTime() const noexcept { return _modified; }
+	[[nodiscard]] time_t creationTime() const noexcept { return _created; }
+	[[nodiscard]] QFileDevice::Permissions permissions() const noexcept { return _permissions; }
+	[[nodiscard]] uint32_t root() const noexcept { return _root; }
+	[[nodiscard]] bool isFile() const noexcept { return _isFile; }
+	[[nodiscard]] bool isDir() const noexcept { return _isDir; }
+	[[nodiscard]] bool isLink() const noexcept { return _isLink; }
+	[[nodiscard]] bool isHidden() const noexcept { return _isHidden; }
+	[[nodiscard]] bool reachedThroughLink() const noexcept { return _reachedThroughLink; }
+
+	// Not collected during the traversal, as it takes a lookup of its own: only asked for when the owner predicate is set
+	// and everything else has matched.
+	[[nodiscard]] QString owner() const { return QFileInfo{ _path }.owner(); }
+
+private:
+	QString _path;
+	uint64_t _size;
+	time_t _modified;
+	time_t _created;
+	QFileDevice::Permissions _permissions;
+	uint32_t _nameStart = 0;
+	uint32_t _nameLength = 0;
+	uint32_t _root; // Into the search's roots
+	bool _isFile : 1;
+	bool _isDir : 1;
+	bool _isLink : 1;
+	bool _isHidden : 1;
+	bool _reachedThroughLink : 1;
 };
 
-[[nodiscard]] static bool acquireContentTaskSlotUnlessCancelled(std::counting_semaphore<>& availableTaskSlots, const std::atomic_bool& cancellationRequested)
+[[nodiscard]] QFileDevice::Permissions permissionsOf(const CFileSystemObject& item) { return item.qFileInfo().permissions(); }
+[[nodiscard]] QFileDevice::Permissions permissionsOf(const TraversedEntry& entry) noexcept { return entry.permissions(); }
+[[nodiscard]] QString ownerOf(const CFileSystemObject& item) { return item.qFileInfo().owner(); }
+[[nodiscard]] QString ownerOf(const TraversedEntry& entry) { return entry.owner(); }
+} // namespace
+
+// Every predicate but the owner, which needs a lookup of its own and is left until the name has matched. These only
+// read what the traversal already has - the entry's properties and the stat data its QFileInfo caches - cheapest first.
+template <typename Item>
+[[nodiscard]] static bool matchesMetadataPredicates(const Item& item, const FileSearchPredicates& predicates)
 {
-	while (!cancellationRequested)
+	if (predicates.entryTypes != FileSearchPredicates::AnyType)
 	{
-		if (!availableTaskSlots.try_acquire_for(std::chrono::milliseconds{20}))
-			continue;
+		const bool typeMatches = ((predicates.entryTypes & FileSearchPredicates::Files) && item.isFile())
+			|| ((predicates.entryTypes & FileSearchPredicates::Directories) && item.isDir())
+			|| ((predicates.entryTypes & FileSearchPredicates::Links) && item.isLink());
+		if (!typeMatches)
+			return false;
+	}
 
-		if (!cancellationRequested)
-			return true;
+	if (predicates.minSize || predicates.maxSize)
+	{
+		if (!item.isFile())
+			return false;
 
-		availableTaskSlots.release();
+		const uint64_t size = item.size();
+		if ((predicates.minSize && size < *predicates.minSize) || (predicates.maxSize && size > *predicates.maxSize))
+			return false;
 	}
 
-	return false;
+	if (predicates.hidden && item.isHidden() != *predicates.hidden)
+		return false;
+
+	if (predicates.modifiedAfter || predicates.modifiedBefore)
+	{
+		const time_t modified = item.modificationTime();
+		if ((predicates.modifiedAfter && modified < *predicates.modifiedAfter) || (predicates.modifiedBefore && modified > *predicates.modifiedBefore))
+			return false;
+	}
+
+	if (predicates.createdAfter || predicates.createdBefore)
+	{
+		const time_t created = item.creationTime();
+		if ((predicates.createdAfter && created < *predicates.createdAfter) || (predicates.createdBefore && created > *predicates.createdBefore))
+			return false;
+	}
+
+	if (predicates.requiredPermissions != QFileDevice::Permissions{} && (permissionsOf(item) & predicates.requiredPermissions) != predicates.requiredPermissions)
+		return false;
+
+	return true;
 }
+
+namespace
+{
+// Collects matches from the scanning thread and the content workers alike, and hands them to the listener in batches.
+// A thread of its own hands over a batch that has waited for matchBatchInterval, so that a match found while the
+// traversal is stuck on a slow directory, or while the content readers finish after it, isn't held back until the next.
+class MatchBatcher
+{
+public:
+	// recordPaths: keep the path of every match for takeRecordedPaths(), besides handing it over
+	MatchBatcher(CFileSearchEngine::FileSearchListener* listener, bool recordPaths) noexcept : _listener{ listener }, _recordPaths{ recordPaths }
+	{
+		try
+		{
+			_flusher.start([this](const std::atomic<bool>&) { flushWhenDue(); });
+		}
+		catch (const std::system_error&)
+		{
+			// The batches are then only handed over as they fill, and on the scanning thread's ticks
+		}
+	}
+
+	~MatchBatcher()
+	{
+		stopFlusher();
+	}
+
+	MatchBatcher(const MatchBatcher&) = delete;
+	MatchBatcher& operator=(const MatchBatcher&) = delete;
+
+	void add(QString path, bool reachedThroughLink, std::vector<CFileSearchEngine::MatchLocation> locations = {})
+	{
+		std::vector<CFileSearchEngine::Match> batch;
+		{
+			std::lock_guard lock{ _mutex };
+			if (_recordPaths)
+				_recordedPaths.insert(path);
+
+			const bool firstPending = _pending.empty();
+			if (firstPending)
+				_oldestPendingTime = std::chrono::steady_clock::now();
+
+			_pending.push_back({ std::move(path), reachedThroughLink, std::move(locations) });
+			if (!batchIsDue())
+			{
+				// The flusher only has a deadline to wait for once something is pending
+				if (firstPending)
+					_pendingAdded.notify_one();
+				return;
+			}
+
+			batch = takePending();
+		}
+
+		// Outside the lock, so that the other threads can keep adding while the listener is busy
+		_listener->matchesFound(std::move(batch));
+	}
+
+	// For the scanning thread to call every now and then: with matches few and far between, none of them should wait
+	// for the next one to be delivered.
+	void flushIfDue()
+	{
+		std::vector<CFileSearchEngine::Match> batch;
+		{
+			std::lock_guard lock{ _mutex };
+			if (_pending.empty() || !batchIsDue())
+				return;
+
+			batch = takePending();
+		}
+
+		_listener->matchesFound(std::move(batch));
+	}
+
+	// Hands over whatever is pending, due or not - for the scanning thread once the traversal is over, as the matches
+	// it has found by then are all there is to show until the content readers find more.
+	void flushPending()
+	{
+		std::vector<CFileSearchEngine::Match> batch;
+		{
+			std::lock_guard lock{ _mutex };
+			batch = takePending();
+		}
+
+		if (!batch.empty())
+			_listener->matchesFound(std::move(batch));
+	}
+
+	// Only once every thread that adds matches is done: stops the flusher and hands over the rest
+	void finish()
+	{
+		stopFlusher();
+		flushPending();
+	}
+
+	// Only once every thread that adds matches is done
+	[[nodiscard]] QSet<QString> takeRecordedPaths()
+	{
+		std::lock_guard lock{ _mutex };
+		return std::exchange(_recordedPaths, {});
+	}
+
+private:
+	[[nodiscard]] bool batchIsDue() const noexcept
+	{
+		return _pending.size() >= CFileSearchEngine::matchBatchSize || std::chrono::steady_clock::now() - _oldestPendingTime >= CFileSearchEngine::matchBatchInterval;
+	}
+
+	[[nodiscard]] std::vector<CFileSearchEngine::Match> takePending() noexcept
+	{
+		return std::exchange(_pending, {});
+	}
+
+	// The flusher thread: sleeps until the oldest pending match is matchBatchInterval old, unless a full batch or
+	// another thread's tick has taken it by then.
+	void flushWhenDue() noexcept
+	{
+		std::unique_lock lock{ _mutex };
+		while (!_stopFlusher)
+		{
+			if (_pending.empty())
+			{
+				_pendingAdded.wait(lock, [this] { return !_pending.empty() || _stopFlusher; });
+				continue;
+			}
+
+			_pendingAdded.wait_until(lock, _oldestPendingTime + CFileSearchEngine::matchBatchInterval, [this] { return _pending.empty() || _stopFlusher; });
+			// Taken and added to again meanwhile, the pending batch has a later deadline
+			if (_stopFlusher || _pending.empty() || !batchIsDue())
+				continue;
+
+			auto batch = takePending();
+			lock.unlock();
+			_listener->matchesFound(std::move(batch));
+			lock.lock();
+		}
+	}
+
+	void stopFlusher()
+	{
+		{
+			std::lock_guard lock{ _mutex };
+			if (std::exchange(_stopFlusher, true))
+				return;
+		}
+		_pendingAdded.notify_one();
+		_flusher.join();
+	}
+
+private:
+	CFileSearchEngine::FileSearchListener* const _listener;
+	const bool _recordPaths;
+	std::mutex _mutex;
+	std::condition_variable _pendingAdded;
+	std::vector<CFileSearchEngine::Match> _pending; // Guarded by _mutex, like the three below
+	QSet<QString> _recordedPaths;
+	std::chrono::steady_clock::time_point _oldestPendingTime;
+	bool _stopFlusher = false;
+
+	CInterruptableThread _flusher{ "Search match flusher" };
+};
 } // namespace
 
+struct CFileSearchEngine::SearchSession
+{
+	using Entry = TraversedEntry;
+
+	QStringList roots;
+	// Shared by the searches within results that follow, which all look at this one traversal
+	std::shared_ptr<const std::vector<Entry>> traversed;
+	std::vector<size_t> matches; // Into traversed, in traversal order
+};
+
 bool CFileSearchEngine::searchInProgress() const
 {
 	return _searchInProgress;
@@ -194,22 +808,98 @@ bool CFileSearchEngine::search(
 	const QStringList& filters, bool subjectCaseSensitive,
 	const QStringList& where,
 	const QString& contentsToFind, bool contentsCaseSensitive, bool contentsWholeWords, bool contentsIsRegex,
-	FileSearchListener* listener)
+	FileSearchListener* listener,
+	const FileSearchPredicates& predicates,
+	const ScanExclusions& exclusions,
+	uint32_t matchLocationsPerFile)
 {
 	if (searchInProgress() || where.empty())
 		return false;
 
+	return startSearch(filters, subjectCaseSensitive, where, nullptr, ResultsScope::Matches, contentsToFind, contentsCaseSensitive, contentsWholeWords, contentsIsRegex,
+		listener, predicates, exclusions, matchLocationsPerFile);
+}
+
+bool CFileSearchEngine::searchWithinResults(
+	ResultsScope scope,
+	const QStringList& filters, bool subjectCaseSensitive,
+	const QString& contentsToFind, bool contentsCaseSensitive, bool contentsWholeWords, bool contentsIsRegex,
+	FileSearchListener* listener,
+	const FileSearchPredicates& predicates,
+	uint32_t matchLocationsPerFile)
+{
+	if (searchInProgress())
+		return false;
+
+	std::shared_ptr<const SearchSession> session;
+	{
+		std::lock_guard lock{ _lastSessionMutex };
+		session = _lastSession;
+	}
+
+	if (!session)
+		return false;
+
+	// The session's roots are only for telling what storage its entries are on; exclusions were applied when it was traversed
+	const QStringList roots = session->roots;
+	return startSearch(filters, subjectCaseSensitive, roots, std::move(session), scope, contentsToFind, contentsCaseSensitive, contentsWholeWords, contentsIsRegex,
+		listener, predicates, {}, matchLocationsPerFile);
+}
+
+bool CFileSearchEngine::hasKeptResults() const
+{
+	std::lock_guard lock{ _lastSessionMutex };
+	return _lastSession != nullptr;
+}
+
+void CFileSearchEngine::discardKeptResults()
+{
+	std::lock_guard lock{ _lastSessionMutex };
+	_lastSession.reset();
+}
+
+bool CFileSearchEngine::startSearch(
+	const QStringList& filters, bool subjectCaseSensitive,
+	const QStringList& where, std::shared_ptr<const SearchSession> session, ResultsScope scope,
+	const QString& contentsToFind, bool contentsCaseSensitive, bool contentsWholeWords, bool contentsIsRegex,
+	FileSearchListener* listener, const FileSearchPredicates& predicates, const ScanExclusions& exclusions, uint32_t matchLocationsPerFile)
+{
 	// The previous search reported completion before its thread finished unwinding, and start() requires a joined thread
 	waitForSearchToFinish();
 
+	std::shared_ptr<const CContentIndex> contentIndex;
+	{
+		std::lock_guard lock{ _contentIndexMutex };
+		contentIndex = _contentIndex;
+	}
+
+	const bool skipBinaryFiles = _skipBinaryFiles;
+	const bool searchCompressedFiles = _searchCompressedFiles;
+
 	_searchInProgress = true;
-	_workerThread.start([=, this](const std::atomic<bool>& cancellationRequested) {
-		searchThread(filters, subjectCaseSensitive, where, contentsToFind, contentsCaseSensitive, contentsWholeWords, contentsIsRegex, listener, cancellationRequested);
+	_workerThread.start([=, this, session{ std::move(session) }](const std::atomic<bool>& cancellationRequested) {
+		searchThread(filters, subjectCaseSensitive, where, session, scope, contentsToFind, contentsCaseSensitive, contentsWholeWords, contentsIsRegex, predicates, exclusions, matchLocationsPerFile, skipBinaryFiles, searchCompressedFiles, contentIndex, listener, cancellationRequested);
 	});
 
 	return true;
 }
 
+void CFileSearchEngine::setContentIndex(std::shared_ptr<const CContentIndex> index)
+{
+	std::lock_guard lock{ _contentIndexMutex };
+	_contentIndex = std::move(index);
+}
+
+void CFileSearchEngine::setSkipBinaryFiles(bool skip) noexcept
+{
+	_skipBinaryFiles = skip;
+}
+
+void CFileSearchEngine::setSearchCompressedFiles(bool search) noexcept
+{
+	_searchCompressedFiles = search;
+}
+
 void CFileSearchEngine::stopSearching()
 {
 	_workerThread.requestCancellation();
@@ -220,16 +910,18 @@ void CFileSearchEngine::waitForSearchToFinish()
 	_workerThread.join();
 }
 
-void CFileSearchEngine::notifySearchFinished(FileSearchListener* listener, SearchStatus status, uint64_t itemsScanned, uint64_t msElapsed)
+void CFileSearchEngine::notifySearchFinished(FileSearchListener* listener, SearchStatus status, uint64_t itemsScanned, uint64_t msElapsed, const ContentStatistics& contentStatistics)
 {
 	_searchInProgress = false;
-	listener->searchFinished(status, itemsScanned, msElapsed);
+	listener->searchFinished(status, itemsScanned, msElapsed, contentStatistics);
 }
 
 void CFileSearchEngine::searchThread(
 	const QStringList& filters, bool subjectCaseSensitive,
-	const QStringList& where,
+	const QStringList& where, const std::shared_ptr<const SearchSession>& session, ResultsScope scope,
 	const QString& contentsToFind, bool contentsCaseSensitive, bool contentsWholeWords, bool contentsIsRegex,
+	const FileSearchPredicates& predicates, const ScanExclusions& exclusions, uint32_t matchLocationsPerFile, bool skipBinaryFiles, bool searchCompressedFiles,
+	const std::shared_ptr<const CContentIndex>& contentIndex,
 	FileSearchListener* listener, const std::atomic<bool>& cancellationRequested) noexcept
 {
 	::setThreadName("File search engine thread");
@@ -238,21 +930,11 @@ void CFileSearchEngine::searchThread(
 	CTimeElapsed timer;
 	timer.start();
 
+	const CNameFilterMatcher nameFilter{ filters, subjectCaseSensitive };
 	// The filters are alternatives, so one that matches every name makes name matching redundant altogether.
-	const bool noFileNameFilter = filters.isEmpty() || std::ranges::any_of(filters, [](const QString& filter) { return filter == '*'; });
+	const bool noFileNameFilter = nameFilter.matchesEverything();
 
-	std::vector<QRegularExpression> filterExpressions;
-	if (!noFileNameFilter)
-	{
-		// Our wildcards stand for any character, including the newline a POSIX name may contain.
-		QRegularExpression::PatternOptions patternOptions = QRegularExpression::DotMatchesEverythingOption;
-		if (!subjectCaseSensitive)
-			patternOptions |= QRegularExpression::CaseInsensitiveOption;
-
-		filterExpressions.reserve(filters.size());
-		for (const QString& filterString : filters)
-			filterExpressions.emplace_back(nameFilterToRegex(filterString), patternOptions);
-	}
+	const bool checkMetadataPredicates = !predicates.empty();
 
 	const bool searchByContents = !contentsToFind.isEmpty();
 	// memfind can only look for the byte sequence as given, so case folding and word boundaries both need the regex
@@ -260,7 +942,7 @@ void CFileSearchEngine::searchThread(
 	const bool useRegexEngine = contentsIsRegex || !contentsCaseSensitive || contentsWholeWords;
 
 	QRegularExpression fileContentsRegExp;
-	QByteArray fileContentsPlainText;
+	std::optional<EncodedPatterns> fileContentsPlainText;
 	if (searchByContents)
 	{
 		if (useRegexEngine)
@@ -277,91 +959,246 @@ void CFileSearchEngine::searchThread(
 
 			if (!fileContentsRegExp.isValid())
 			{
-				notifySearchFinished(listener, SearchInvalidPattern, 0, 0);
+				notifySearchFinished(listener, SearchInvalidPattern, 0, 0, {});
 				return;
 			}
 		}
 		else
-			fileContentsPlainText = contentsToFind.toUtf8();
+			fileContentsPlainText.emplace(contentsToFind);
 	}
 
-	ContentSearchContext contentSearchContext{ listener, &fileContentsRegExp, &fileContentsPlainText, &cancellationRequested };
-	std::unique_ptr<std::counting_semaphore<>> availableContentTaskSlots;
-	std::unique_ptr<CThreadPool> contentSearchPool;
-
-	for (const QString& pathToLookIn : where)
+	// The index only ever rules files out; whatever it cannot vouch for is read as usual.
+	std::optional<CContentIndex::CandidateSet> indexCandidates;
+	if (searchByContents && contentIndex)
 	{
-		scanDirectory(CFileSystemObject(pathToLookIn),
-			[&](const CFileSystemObject& item, bool reachedThroughLink) {
-				if (cancellationRequested)
-					return;
+		const auto trigrams = CContentIndex::requiredTrigrams(contentsToFind, contentsIsRegex, contentsCaseSensitive, useRegexEngine);
+		if (!trigrams.empty())
+			indexCandidates = contentIndex->candidates(trigrams);
+	}
 
-				if (itemCounter % 128 == 0)
-				{
-					// No need to report every single item and waste CPU cycles
-					listener->itemScanned(item.fullAbsolutePath());
-				}
+	// What this search leaves for searchWithinResults(): a search of the disk records its traversal as it goes, and a
+	// search within results keeps the one it looked at. Either way, the entries that matched are noted by their index.
+	static constexpr size_t notRecorded = std::numeric_limits<size_t>::max();
+	std::shared_ptr<std::vector<SearchSession::Entry>> traversal;
+	if (!session)
+		traversal = std::make_shared<std::vector<SearchSession::Entry>>();
+	bool keepSession = true;
+	std::vector<size_t> matchedEntries; // By name alone
+	std::vector<size_t> contentCandidates; // To be narrowed down to the paths the content matches were reported for
+
+	MatchBatcher matchBatcher{ listener, searchByContents };
+	ContentCounters contentCounters;
+	const ContentQuery contentQuery{
+		fileContentsRegExp,
+		fileContentsPlainText ? &*fileContentsPlainText : nullptr,
+		std::clamp(matchLocationsPerFile, 1u, maxMatchLocationsPerFile),
+		skipBinaryFiles,
+		searchCompressedFiles,
+		contentCounters,
+		cancellationRequested
+	};
+	const auto readFile = [&](const QString& path, bool reachedThroughLink) {
+		auto locations = findMatchesInFile(path, contentQuery);
+		if (!locations.empty() && !cancellationRequested)
+			matchBatcher.add(path, reachedThroughLink, std::move(locations));
+	};
+
+	// Only ever given work by a content search
+	CContentReadScheduler contentReader{ readFile, cancellationRequested };
+	if (searchByContents && CUringBatchReader::isSupported())
+	{
+		// Opening, mapping and closing a small file costs more than matching it
+		contentReader.setBatchReadTask([&](const std::vector<CContentReadScheduler::FileRead>& files) {
+			// One per reader thread, lasting as long as the thread, for the ring and its buffers are costly to set up
+			thread_local const std::unique_ptr<CUringBatchReader> batchReader = CUringBatchReader::create();
 
-				++itemCounter;
+			std::vector<size_t> unread;
+			if (batchReader)
+			{
+				std::vector<QString> paths;
+				paths.reserve(files.size());
+				for (const auto& file : files)
+					paths.push_back(file.path);
 
-				if (searchByContents && !item.isFile())
-					return;
+				unread = batchReader->read(paths, [&](size_t index, const std::byte* data, size_t length) {
+					if (cancellationRequested)
+						return;
 
-				bool nameMatches = noFileNameFilter;
-				if (!noFileNameFilter)
-				{
-					for (const auto& regexp : filterExpressions)
+					FileMatcher matcher{ contentQuery };
+					if (const auto format = searchCompressedFiles ? CStreamDecompressor::formatOf(data, length) : CStreamDecompressor::Format::None; format != CStreamDecompressor::Format::None)
 					{
-						if (regexp.match(item.fullName()).hasMatch())
-						{
-							nameMatches = true;
-							break;
-						}
+						matchDecompressed(format, [&, inputTaken = false]() mutable {
+							// All of the file at once, then the end of it
+							return std::optional{ std::span{ data, std::exchange(inputTaken, true) ? 0 : length } };
+						}, matcher, contentQuery);
 					}
-				}
+					else
+						(void)matcher.scanWindow(data, length, 0, true);
+					auto locations = matcher.takeLocations();
+					if (!locations.empty() && !cancellationRequested)
+						matchBatcher.add(files[index].path, files[index].reachedThroughLink, std::move(locations));
+				});
+			}
+			else
+			{
+				unread.resize(files.size());
+				std::iota(unread.begin(), unread.end(), size_t{ 0 });
+			}
 
-				if (!nameMatches)
+			for (const size_t index : unread)
+			{
+				if (cancellationRequested)
 					return;
 
-				if (searchByContents)
-				{
+				readFile(files[index].path, files[index].reachedThroughLink);
+			}
+		}, CUringBatchReader::bufferSize - 1, CUringBatchReader::batchSize);
+	}
+
+	// item: a CFileSystemObject the traversal has just found, or a SearchSession::Entry kept from an earlier one
+	const auto evaluate = [&](const auto& item, bool reachedThroughLink, size_t entryIndex) {
+		if (itemCounter % 128 == 0)
+		{
+			// No need to report every single item and waste CPU cycles
+			listener->itemScanned(item.fullAbsolutePath());
+			matchBatcher.flushIfDue();
+		}
+
+		++itemCounter;
+
+		if (searchByContents && !item.isFile())
+			return;
+
+		if (checkMetadataPredicates && !matchesMetadataPredicates(item, predicates))
+			return;
+
+		if (!noFileNameFilter && !nameFilter.matches(item.fullName()))
+			return;
+
+		if (!predicates.owner.isEmpty() && ownerOf(item) != predicates.owner)
+			return;
+
+		if (searchByContents)
+		{
+			if (cancellationRequested)
+				return;
+
+			if (indexCandidates && contentIndex->verdict(*indexCandidates, item.fullAbsolutePath(), item.size(), item.modificationTime()) == CContentIndex::Verdict::Excluded)
+				return;
+
+			if (entryIndex != notRecorded)
+				contentCandidates.push_back(entryIndex);
+			contentReader.schedule(item.fullAbsolutePath(), reachedThroughLink, item.size());
+		}
+		else
+		{
+			if (entryIndex != notRecorded)
+				matchedEntries.push_back(entryIndex);
+			matchBatcher.add(item.fullAbsolutePath(), reachedThroughLink);
+		}
+	};
+
+	if (session)
+	{
+		const std::vector<SearchSession::Entry>& entries = *session->traversed;
+		uint32_t currentRoot = std::numeric_limits<uint32_t>::max();
+		const auto evaluateEntry = [&](size_t index) {
+			const SearchSession::Entry& entry = entries[index];
+			if (searchByContents && entry.root() != currentRoot)
+			{
+				currentRoot = entry.root();
+				contentReader.setStorageKind(CContentReadScheduler::storageKindOf(where[static_cast<qsizetype>(currentRoot)]));
+			}
+
+			evaluate(entry, entry.reachedThroughLink(), index);
+		};
+
+		if (scope == ResultsScope::Matches)
+		{
+			for (size_t i = 0; i < session->matches.size() && !cancellationRequested; ++i)
+				evaluateEntry(session->matches[i]);
+		}
+		else
+		{
+			for (size_t i = 0; i < entries.size() && !cancellationRequested; ++i)
+				evaluateEntry(i);
+		}
+	}
+	else
+	{
+		for (qsizetype root = 0; root < where.size(); ++root)
+		{
+			const QString& pathToLookIn = where[root];
+			if (searchByContents)
+				contentReader.setStorageKind(CContentReadScheduler::storageKindOf(pathToLookIn));
+
+			scanDirectory(CFileSystemObject(pathToLookIn),
+				[&](const CFileSystemObject& item, bool reachedThroughLink) {
 					if (cancellationRequested)
 						return;
 
-					if (!contentSearchPool)
+					size_t entryIndex = notRecorded;
+					if (keepSession)
 					{
-						static constexpr uint32_t maximumContentWorkers = 8;
-						const uint32_t contentWorkerCount = std::clamp(std::thread::hardware_concurrency(), 1u, maximumContentWorkers);
-						availableContentTaskSlots = std::make_unique<std::counting_semaphore<>>(contentWorkerCount * 2);
-						contentSearchContext.availableTaskSlots = availableContentTaskSlots.get();
-						contentSearchPool = std::make_unique<CThreadPool>(contentWorkerCount, "File search by contents thread pool");
+						if (traversal->size() < maxCachedEntries)
+						{
+							entryIndex = traversal->size();
+							traversal->emplace_back(item, static_cast<uint32_t>(root), reachedThroughLink);
+						}
+						else
+						{
+							// Too much to hold on to; the search itself goes on as usual
+							keepSession = false;
+							traversal.reset();
+							matchedEntries = {};
+							contentCandidates = {};
+						}
 					}
 
-					if (!acquireContentTaskSlotUnlessCancelled(*contentSearchContext.availableTaskSlots, cancellationRequested))
-						return;
+					evaluate(item, reachedThroughLink, entryIndex);
+				}, cancellationRequested, true, exclusions);
+		}
+	}
 
-					contentSearchPool->enqueue([path{item.fullAbsolutePath()}, reachedThroughLink, &contentSearchContext] {
-						EXEC_ON_SCOPE_EXIT([&contentSearchContext] { contentSearchContext.availableTaskSlots->release(); });
-						if (*contentSearchContext.cancellationRequested)
-							return;
+	// Whatever the traversal has matched by name is complete; the readers may take a while over the rest
+	matchBatcher.flushPending();
 
-						if (fileContentsMatches(path, *contentSearchContext.regex, *contentSearchContext.plainText, *contentSearchContext.cancellationRequested) &&
-							!*contentSearchContext.cancellationRequested)
-							contentSearchContext.listener->matchFound(path, reachedThroughLink);
-					});
-				}
-				else
-					listener->matchFound(item.fullAbsolutePath(), reachedThroughLink);
+	// The queue is bounded and every read observes cancellation, so the same drain path is prompt on both normal and canceled exits.
+	contentReader.finish();
 
-			}, cancellationRequested);
-	}
+	matchBatcher.finish();
 
-	if (contentSearchPool)
 	{
-		// The queue is bounded and every task observes cancellation, so the same drain path is prompt on both normal and canceled exits.
-		contentSearchPool->finishAllThreads(true);
+		std::shared_ptr<SearchSession> completedSession;
+		if (keepSession && !cancellationRequested)
+		{
+			completedSession = std::make_shared<SearchSession>();
+			completedSession->roots = where;
+			completedSession->traversed = session ? session->traversed : std::move(traversal);
+			if (searchByContents)
+			{
+				const QSet<QString> matchedPaths = matchBatcher.takeRecordedPaths();
+				for (const size_t index : contentCandidates)
+				{
+					if (matchedPaths.contains((*completedSession->traversed)[index].fullAbsolutePath()))
+						completedSession->matches.push_back(index);
+				}
+			}
+			else
+				completedSession->matches = std::move(matchedEntries);
+		}
+
+		// Before reporting, so that the listener can search within the results as soon as it hears of them
+		std::lock_guard lock{ _lastSessionMutex };
+		_lastSession = std::move(completedSession);
 	}
 
+	const ContentStatistics contentStatistics{
+		.bytesSearched = contentCounters.bytesSearched,
+		.bytesDecompressed = contentCounters.bytesDecompressed,
+		.compressedFilesSearched = contentCounters.compressedFilesSearched
+	};
+
 	const auto elapsedMs = timer.elapsed();
-	notifySearchFinished(listener, cancellationRequested ? SearchCancelled : SearchFinished, itemCounter, elapsedMs);
+	notifySearchFinished(listener, cancellationRequested ? SearchCancelled : SearchFinished, itemCounter, elapsedMs, contentStatistics);
 }
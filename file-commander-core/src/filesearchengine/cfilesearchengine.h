@@ -1,13 +1,24 @@
 #pragma once
 
+#include "filesearchpredicates.h"
+#include "directoryscanner.h"
+
 #include "threading/cinterruptablethread.h"
+#include "compiler/compiler_warnings_control.h"
 
+DISABLE_COMPILER_WARNINGS
+#include <QString>
 #include <qcontainerfwd.h>
+RESTORE_COMPILER_WARNINGS
 
 #include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
 #include <stdint.h>
+#include <vector>
 
-class QString;
+class CContentIndex;
 
 class CFileSearchEngine
 {
@@ -18,42 +29,142 @@ public:
 		SearchInvalidPattern // The contents query was given as a regex and did not compile, so nothing was scanned
 	};
 
+	struct MatchLocation {
+		uint64_t offset = 0; // In bytes, from the start of the file - of its decompressed contents, for a compressed file
+		uint64_t line = 0; // 1-based
+		// The line the match is on, or as much of it as fits in contextLength code units either side of the match,
+		// decoded from the file's encoding, with control characters blanked out
+		QString context;
+	};
+
+	struct Match {
+		QString path;
+		// The item was found by traversing a directory link, so the same file may also be reported under its direct
+		// path if that one is within the search roots as well.
+		bool reachedThroughLink = false;
+		// A content search's matches in this file, in file order; empty for a search by name alone
+		std::vector<MatchLocation> locations;
+	};
+
+	// How much a content search went through, for a throughput figure; all zero for a search by name alone.
+	struct ContentStatistics {
+		uint64_t bytesSearched = 0; // Decompressed contents included
+		uint64_t bytesDecompressed = 0; // The part of bytesSearched that came out of a decompressor
+		uint64_t compressedFilesSearched = 0;
+	};
+
+	// What searchWithinResults() looks at
+	enum class ResultsScope {
+		Matches, // The last search's matches: for a query that narrows it down
+		Traversed // Every entry the last search came across: for one that may match more, such as a different name filter
+	};
+
+	static constexpr size_t contextLength = 120;
+	static constexpr uint32_t maxMatchLocationsPerFile = 1000;
+	// A search that traverses more entries than this is not kept for searchWithinResults(). Each kept entry is its path
+	// and the metadata the predicates read, well under a hundred bytes on top of the path itself.
+	static constexpr size_t maxCachedEntries = 500'000;
+
+	// A batch is handed over once it holds matchBatchSize matches or its oldest match is matchBatchInterval old,
+	// whichever comes first, so that a listener marshalling results to another thread isn't called for every one.
+	static constexpr size_t matchBatchSize = 512;
+	static constexpr std::chrono::milliseconds matchBatchInterval{ 50 };
+
 	struct FileSearchListener {
 		virtual ~FileSearchListener() noexcept = default;
 
 		virtual void itemScanned(const QString& currentItem) = 0;
-		// reachedThroughLink: the item was found by traversing a directory link, so the same file may also be
-		// reported under its direct path if that one is within the search roots as well.
-		virtual void matchFound(const QString& path, bool reachedThroughLink) = 0;
-		virtual void searchFinished(SearchStatus status, uint64_t itemsScanned, uint64_t msElapsed) = 0;
+		// Never called with an empty batch, and the last batch always arrives before searchFinished. Called from
+		// whichever of the search threads completes a batch, so the calls may come from different threads.
+		virtual void matchesFound(std::vector<Match> matches) = 0;
+		virtual void searchFinished(SearchStatus status, uint64_t itemsScanned, uint64_t msElapsed, const ContentStatistics& contentStatistics) = 0;
 	};
 
 	bool searchInProgress() const;
 	// An empty filter list matches any name, and an empty contentsToFind leaves the contents unexamined; only "where" is required.
+	// predicates further narrow the results by metadata, and are checked before the name and the contents.
+	// Excluded subtrees are not searched at all.
+	// A content search reports where in each file the contents matched: the first matchLocationsPerFile matches, up to
+	// maxMatchLocationsPerFile. Matches do not overlap.
+	// Each file is matched in the encoding its first bytes tell (see CContentEncoding): UTF-8, UTF-16 or a legacy code
+	// page. A plain-text query is transcoded into that encoding rather than the file out of it.
+	// A search that runs to completion is kept, with the metadata of every entry it traversed, for searchWithinResults();
+	// a cancelled one leaves nothing kept.
 	// Returns false having done nothing if there is nowhere to look, or if a search is already running - stopping that one is the caller's call.
 	[[nodiscard]] bool search(
 		const QStringList& filters, bool subjectCaseSensitive,
 		const QStringList& where,
 		const QString& contentsToFind, bool contentsCaseSensitive, bool contentsWholeWords, bool contentsIsRegex,
-		FileSearchListener* listener);
+		FileSearchListener* listener,
+		const FileSearchPredicates& predicates = {},
+		const ScanExclusions& exclusions = {},
+		uint32_t matchLocationsPerFile = 1);
+
+	// Runs a query like search() does, only over the entries the last completed search kept instead of the disk, and with
+	// the metadata it collected then: nothing is enumerated or stat'ed again, and only contents - and owners, for the
+	// owner predicate - are read anew. Its own result replaces the last search's matches but keeps its traversed entries,
+	// so a query can be narrowed step by step with ResultsScope::Matches and then changed more broadly with
+	// ResultsScope::Traversed.
+	// Returns false having done nothing if there are no kept results, or if a search is already running.
+	[[nodiscard]] bool searchWithinResults(
+		ResultsScope scope,
+		const QStringList& filters, bool subjectCaseSensitive,
+		const QString& contentsToFind, bool contentsCaseSensitive, bool contentsWholeWords, bool contentsIsRegex,
+		FileSearchListener* listener,
+		const FileSearchPredicates& predicates = {},
+		uint32_t matchLocationsPerFile = 1);
+	// Whether there are results for searchWithinResults() to look at
+	[[nodiscard]] bool hasKeptResults() const;
+	void discardKeptResults();
+
+	// Content searches started from now on use this index to skip the files it proves cannot match; nullptr reads every file.
+	void setContentIndex(std::shared_ptr<const CContentIndex> index);
+	// Content searches started from now on pass over files whose first bytes look like binary data rather than text,
+	// instead of matching their bytes as UTF-8. On by default.
+	void setSkipBinaryFiles(bool skip) noexcept;
+	// Content searches started from now on search gzip, xz and zstd files - those of the formats this was built with
+	// support for, recognized by their magic numbers - by their decompressed contents. Off by default.
+	void setSearchCompressedFiles(bool search) noexcept;
 
 	void stopSearching();
 	// The worker holds the listener pointer, so anything that owns the listener must wait here before tearing it down
 	void waitForSearchToFinish();
 
 private:
+	struct SearchSession;
+
+	// The part of search() and searchWithinResults() that is the same: session is what to look at instead of the disk, or nullptr
+	[[nodiscard]] bool startSearch(
+		const QStringList& filters, bool subjectCaseSensitive,
+		const QStringList& where, std::shared_ptr<const SearchSession> session, ResultsScope scope,
+		const QString& contentsToFind, bool contentsCaseSensitive, bool contentsWholeWords, bool contentsIsRegex,
+		FileSearchListener* listener, const FileSearchPredicates& predicates, const ScanExclusions& exclusions, uint32_t matchLocationsPerFile);
+
 	void searchThread(
 		const QStringList& filters, bool subjectCaseSensitive,
-		const QStringList& where,
+		const QStringList& where, const std::shared_ptr<const SearchSession>& session, ResultsScope scope,
 		const QString& contentsToFind, bool contentsCaseSensitive, bool contentsWholeWords, bool contentsIsRegex,
+		const FileSearchPredicates& predicates, const ScanExclusions& exclusions, uint32_t matchLocationsPerFile, bool skipBinaryFiles, bool searchCompressedFiles,
+		const std::shared_ptr<const CContentIndex>& contentIndex,
 		FileSearchListener* listener, const std::atomic<bool>& cancellationRequested) noexcept;
 
 	// Clears the in-progress state before notifying, so the listener never sees "finished" while the engine still reports a search
-	void notifySearchFinished(FileSearchListener* listener, SearchStatus status, uint64_t itemsScanned, uint64_t msElapsed);
+	void notifySearchFinished(FileSearchListener* listener, SearchStatus status, uint64_t itemsScanned, uint64_t msElapsed, const ContentStatistics& contentStatistics);
 
 private:
 	CInterruptableThread _workerThread{ "File search thread" };
 	// The worker outlives the search it reports: it is still unwinding after the listener has been told the search is over
 	std::atomic<bool> _searchInProgress {false};
+
+	// Replaceable while a search runs, which keeps using the index it started with
+	std::shared_ptr<const CContentIndex> _contentIndex;
+	mutable std::mutex _contentIndexMutex;
+
+	// The last search that completed, written by the worker just before it reports so
+	std::shared_ptr<const SearchSession> _lastSession;
+	mutable std::mutex _lastSessionMutex;
+
+	std::atomic<bool> _skipBinaryFiles {true};
+	std::atomic<bool> _searchCompressedFiles {false};
 };
 
@@ -0,0 +1,231 @@
+#include "cnamefiltermatcher.h"
+
+DISABLE_COMPILER_WARNINGS
+#include <QStringList>
+RESTORE_COMPILER_WARNINGS
+
+#include <algorithm>
+#include <array>
+
+[[nodiscard]] static inline char32_t fold(char32_t c, bool caseSensitive) noexcept
+{
+	return caseSensitive ? c : QChar::toCaseFolded(c);
+}
+
+// A surrogate pair is one code point, as it is to the regex engine. A lone surrogate, which a Windows name may contain,
+// is passed on as it is.
+template <typename Sink>
+static void forEachCodePoint(QStringView text, Sink&& sink)
+{
+	for (qsizetype i = 0, size = text.size(); i < size; ++i)
+	{
+		const char16_t unit = text[i].unicode();
+		if (QChar::isHighSurrogate(unit) && i + 1 < size && QChar::isLowSurrogate(text[i + 1].unicode()))
+			sink(QChar::surrogateToUcs4(unit, text[++i].unicode()));
+		else
+			sink(static_cast<char32_t>(unit));
+	}
+}
+
+CNameFilterMatcher::CNameFilterMatcher(const QStringList& filters, bool caseSensitive) :
+	_caseSensitive{ caseSensitive }
+{
+	// No filters at all don't restrict anything either
+	_matchesEverything = filters.isEmpty();
+	for (const QString& filter : filters)
+	{
+		if (_matchesEverything)
+			break;
+
+		addFilter(filter);
+	}
+}
+
+bool CNameFilterMatcher::matchesEverything() const noexcept
+{
+	return _matchesEverything;
+}
+
+bool CNameFilterMatcher::matches(QStringView name) const
+{
+	if (_matchesEverything)
+		return true;
+
+	// No file system allows a name longer than 255 UTF-16 units, so the buffer on the heap is only ever there as a fallback
+	std::array<char32_t, 256> nameBuffer;
+	std::u32string longName;
+	char32_t* folded = nameBuffer.data();
+	if (static_cast<size_t>(name.size()) > nameBuffer.size())
+	{
+		longName.resize(static_cast<size_t>(name.size()));
+		folded = longName.data();
+	}
+
+	size_t length = 0;
+	forEachCodePoint(name, [&](char32_t c) {
+		folded[length++] = fold(c, _caseSensitive);
+	});
+
+	const std::u32string_view foldedName{ folded, length };
+	if (!_exactNames.empty() && _exactNames.contains(foldedName))
+		return true;
+
+	if (matchesAnyOfLength(_suffixes, foldedName, false) || matchesAnyOfLength(_prefixes, foldedName, true))
+		return true;
+
+	if (std::ranges::any_of(_substrings, [&](const std::u32string& substring) { return foldedName.find(substring) != std::u32string_view::npos; }))
+		return true;
+
+	return std::ranges::any_of(_globs, [&](const Glob& glob) { return globMatches(glob, foldedName); });
+}
+
+void CNameFilterMatcher::addFilter(QStringView filter)
+{
+	// Only the very first and the very last character can be anchors; anywhere else, '^' and '$' are literal.
+	const bool anchorStart = filter.startsWith('^');
+	if (anchorStart)
+		filter = filter.sliced(1);
+
+	const bool anchorEnd = filter.endsWith('$');
+	if (anchorEnd)
+		filter.chop(1);
+
+	Glob glob{ .parts = std::vector<std::u32string>(1), .anchorStart = anchorStart, .anchorEnd = anchorEnd };
+	bool hasAnyCharacterWildcard = false;
+	forEachCodePoint(filter, [&](char32_t c) {
+		if (c == '*')
+			glob.parts.emplace_back();
+		else if (c == '?')
+		{
+			glob.parts.back() += anyCharacter;
+			hasAnyCharacterWildcard = true;
+		}
+		else
+			glob.parts.back() += fold(c, _caseSensitive);
+	});
+
+	if (glob.parts.size() > 1)
+	{
+		// Next to a '*', an empty part matches trivially - and an end anchored to one is not anchored at all: "^*.log" is "*.log".
+		if (glob.parts.front().empty())
+			glob.anchorStart = false;
+		if (glob.parts.back().empty())
+			glob.anchorEnd = false;
+
+		std::erase_if(glob.parts, [](const std::u32string& part) { return part.empty(); });
+		if (glob.parts.empty())
+		{
+			_matchesEverything = true;
+			return;
+		}
+	}
+	else if (glob.parts.front().empty() && !(glob.anchorStart && glob.anchorEnd))
+	{
+		// "", "^" and "$" match any name; only "^$" does not
+		_matchesEverything = true;
+		return;
+	}
+
+	if (hasAnyCharacterWildcard || glob.parts.size() > 1)
+	{
+		_globs.push_back(std::move(glob));
+		return;
+	}
+
+	std::u32string& literal = glob.parts.front();
+	if (glob.anchorStart && glob.anchorEnd)
+		_exactNames.insert(std::move(literal));
+	else if (glob.anchorStart)
+		addLiteral(_prefixes, std::move(literal));
+	else if (glob.anchorEnd)
+		addLiteral(_suffixes, std::move(literal));
+	else if (std::ranges::find(_substrings, literal) == _substrings.end())
+		_substrings.push_back(std::move(literal));
+}
+
+void CNameFilterMatcher::addLiteral(std::vector<LiteralsOfLength>& group, std::u32string literal)
+{
+	// Kept sorted by length, so that the lookup can stop at the first length longer than the name
+	auto position = std::ranges::lower_bound(group, literal.size(), {}, &LiteralsOfLength::length);
+	if (position == group.end() || position->length != literal.size())
+		position = group.insert(position, LiteralsOfLength{ .length = literal.size(), .literals = {} });
+
+	position->literals.insert(std::move(literal));
+}
+
+[[nodiscard]] static inline bool partMatchesAt(std::u32string_view part, std::u32string_view name, size_t position, char32_t anyCharacter) noexcept
+{
+	for (size_t i = 0; i < part.size(); ++i)
+	{
+		if (part[i] != anyCharacter && part[i] != name[position + i])
+			return false;
+	}
+
+	return true;
+}
+
+bool CNameFilterMatcher::globMatches(const Glob& glob, std::u32string_view name) noexcept
+{
+	const auto& parts = glob.parts;
+	if (parts.size() == 1 && glob.anchorStart && glob.anchorEnd)
+		return name.size() == parts.front().size() && partMatchesAt(parts.front(), name, 0, anyCharacter);
+
+	// The parts between the anchored ones float: each one is placed at its leftmost occurrence after the previous one,
+	// which leaves the most room for the rest, so no placement ever needs to be reconsidered.
+	size_t from = 0, to = name.size();
+	size_t firstFloating = 0, endFloating = parts.size();
+	if (glob.anchorStart)
+	{
+		const auto& head = parts.front();
+		if (head.size() > name.size() || !partMatchesAt(head, name, 0, anyCharacter))
+			return false;
+
+		from = head.size();
+		firstFloating = 1;
+	}
+
+	if (glob.anchorEnd && endFloating > firstFloating)
+	{
+		const auto& tail = parts.back();
+		if (tail.size() > to - from || !partMatchesAt(tail, name, to - tail.size(), anyCharacter))
+			return false;
+
+		to -= tail.size();
+		--endFloating;
+	}
+
+	for (size_t i = firstFloating; i < endFloating; ++i)
+	{
+		const auto& part = parts[i];
+		bool found = false;
+		for (; part.size() <= to - from; ++from)
+		{
+			if (partMatchesAt(part, name, from, anyCharacter))
+			{
+				found = true;
+				break;
+			}
+		}
+
+		if (!found)
+			return false;
+
+		from += part.size();
+	}
+
+	return true;
+}
+
+bool CNameFilterMatcher::matchesAnyOfLength(const std::vector<LiteralsOfLength>& group, std::u32string_view name, bool atStart) noexcept
+{
+	for (const auto& [length, literals] : group)
+	{
+		if (length > name.size())
+			break;
+
+		if (literals.contains(atStart ? name.substr(0, length) : name.substr(name.size() - length)))
+			return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "compiler/compiler_warnings_control.h"
+
+DISABLE_COMPILER_WARNINGS
+#include <QStringView>
+#include <qcontainerfwd.h>
+RESTORE_COMPILER_WARNINGS
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+// The name filter language, compiled: literal text, '*' for any run of characters, '?' for exactly one. A leading '^'
+// or a trailing '$' anchors that end of the match to the name's; an end left unanchored matches anywhere. A list of
+// filters matches a name if any one of them does.
+// Matching works on the UTF-16 name directly, one code point at a time - '?' takes a whole surrogate pair - and does
+// not allocate for any name of a realistic length. Case-insensitive matching uses simple Unicode case folding, as the
+// regex engine does. The wildcards match any character, including the newline a POSIX name may contain.
+// The most common shapes - a literal name, prefix, suffix (such as an extension) or substring - never reach the
+// general glob matcher: every filter of one such shape is merged into a single lookup for the whole list.
+class CNameFilterMatcher
+{
+public:
+	CNameFilterMatcher(const QStringList& filters, bool caseSensitive);
+
+	// Some filter matches every name, so matching can be skipped altogether.
+	[[nodiscard]] bool matchesEverything() const noexcept;
+	[[nodiscard]] bool matches(QStringView name) const;
+
+private:
+	// Beyond the Unicode range, so it never equals a folded name character
+	static constexpr char32_t anyCharacter = 0xFFFF'FFFF;
+
+	// A filter with '?' or with '*' between literal parts, which no single lookup can answer.
+	struct Glob
+	{
+		// Split at the '*'s: the first part is pinned to the start if anchorStart, the last to the end if anchorEnd,
+		// and the rest float in order. '?' is stored as anyCharacter.
+		std::vector<std::u32string> parts;
+		bool anchorStart = false;
+		bool anchorEnd = false;
+	};
+
+	// Lets a set of strings be searched by a view into the name, with nothing to allocate per lookup
+	struct LiteralHash
+	{
+		using is_transparent = void;
+		[[nodiscard]] size_t operator()(std::u32string_view literal) const noexcept { return std::hash<std::u32string_view>{}(literal); }
+	};
+
+	using LiteralSet = std::unordered_set<std::u32string, LiteralHash, std::equal_to<>>;
+
+	// Literals of one length, so that a single hash lookup answers all of them for a given name.
+	struct LiteralsOfLength
+	{
+		size_t length = 0;
+		LiteralSet literals;
+	};
+
+	void addFilter(QStringView filter);
+	static void addLiteral(std::vector<LiteralsOfLength>& group, std::u32string literal);
+
+	[[nodiscard]] static bool globMatches(const Glob& glob, std::u32string_view name) noexcept;
+	[[nodiscard]] static bool matchesAnyOfLength(const std::vector<LiteralsOfLength>& group, std::u32string_view name, bool atStart) noexcept;
+
+private:
+	LiteralSet _exactNames;
+	std::vector<LiteralsOfLength> _prefixes;
+	std::vector<LiteralsOfLength> _suffixes;
+	std::vector<std::u32string> _substrings;
+	std::vector<Glob> _globs;
+
+	bool _caseSensitive;
+	bool _matchesEverything = false;
+};
@@ -0,0 +1,280 @@
+#include "cstreamdecompressor.h"
+
+#include "assert/advanced_assert.h"
+
+#ifdef FC_HAS_ZLIB
+#include <zlib.h>
+#endif
+#ifdef FC_HAS_LZMA
+#include <lzma.h>
+#endif
+#ifdef FC_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+#include <algorithm>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+
+namespace
+{
+struct Step
+{
+	size_t consumed = 0;
+	size_t produced = 0;
+	bool finished = false; // The last stream of the input is complete
+	bool failed = false;
+};
+
+// One decompressor's state for one file
+class Codec
+{
+public:
+	virtual ~Codec() = default;
+
+	// Decompresses as much of the input as fits into the output. inputEnded: no more input is coming after this.
+	[[nodiscard]] virtual Step step(std::span<const std::byte> input, std::byte* output, size_t outputCapacity, bool inputEnded) = 0;
+};
+
+#ifdef FC_HAS_ZLIB
+class GzipCodec final : public Codec
+{
+public:
+	GzipCodec() noexcept
+	{
+		// 16: a gzip header and trailer rather than zlib's
+		_initialized = ::inflateInit2(&_stream, MAX_WBITS + 16) == Z_OK;
+	}
+
+	~GzipCodec() override
+	{
+		if (_initialized)
+			::inflateEnd(&_stream);
+	}
+
+	[[nodiscard]] Step step(std::span<const std::byte> input, std::byte* output, size_t outputCapacity, bool inputEnded) override
+	{
+		if (!_initialized) [[unlikely]]
+			return { .failed = true };
+
+		// Never more than a window or an input chunk at a time, so the sizes always fit zlib's
+		_stream.next_in = reinterpret_cast<Bytef*>(const_cast<std::byte*>(input.data()));
+		_stream.avail_in = static_cast<uInt>(input.size());
+		_stream.next_out = reinterpret_cast<Bytef*>(output);
+		_stream.avail_out = static_cast<uInt>(outputCapacity);
+
+		const int result = ::inflate(&_stream, Z_NO_FLUSH);
+		Step step{ .consumed = input.size() - _stream.avail_in, .produced = outputCapacity - _stream.avail_out };
+		if (result == Z_STREAM_END)
+		{
+			// Another member may follow, as in a file that was appended to or compressed in parallel
+			if (_stream.avail_in > 0 || !inputEnded)
+				step.failed = ::inflateReset(&_stream) != Z_OK;
+			else
+				step.finished = true;
+		}
+		else if (result != Z_OK && result != Z_BUF_ERROR) // The latter only means there was nothing to go on
+			step.failed = true;
+
+		return step;
+	}
+
+private:
+	z_stream _stream{};
+	bool _initialized = false;
+};
+#endif
+
+#ifdef FC_HAS_LZMA
+class XzCodec final : public Codec
+{
+public:
+	XzCodec() noexcept
+	{
+		_initialized = ::lzma_stream_decoder(&_stream, UINT64_MAX, LZMA_CONCATENATED) == LZMA_OK;
+	}
+
+	~XzCodec() override
+	{
+		::lzma_end(&_stream);
+	}
+
+	[[nodiscard]] Step step(std::span<const std::byte> input, std::byte* output, size_t outputCapacity, bool inputEnded) override
+	{
+		if (!_initialized) [[unlikely]]
+			return { .failed = true };
+
+		_stream.next_in = reinterpret_cast<const uint8_t*>(input.data());
+		_stream.avail_in = input.size();
+		_stream.next_out = reinterpret_cast<uint8_t*>(output);
+		_stream.avail_out = outputCapacity;
+
+		// With LZMA_CONCATENATED, only being told that the input is over lets the decoder finish
+		const lzma_ret result = ::lzma_code(&_stream, inputEnded ? LZMA_FINISH : LZMA_RUN);
+		Step step{ .consumed = input.size() - _stream.avail_in, .produced = outputCapacity - _stream.avail_out };
+		if (result == LZMA_STREAM_END)
+			step.finished = true;
+		else if (result != LZMA_OK && result != LZMA_BUF_ERROR)
+			step.failed = true;
+
+		return step;
+	}
+
+private:
+	lzma_stream _stream = LZMA_STREAM_INIT;
+	bool _initialized = false;
+};
+#endif
+
+#ifdef FC_HAS_ZSTD
+class ZstdCodec final : public Codec
+{
+public:
+	ZstdCodec() noexcept : _stream{ ::ZSTD_createDStream() } {}
+
+	~ZstdCodec() override
+	{
+		::ZSTD_freeDStream(_stream);
+	}
+
+	[[nodiscard]] Step step(std::span<const std::byte> input, std::byte* output, size_t outputCapacity, bool inputEnded) override
+	{
+		if (!_stream) [[unlikely]]
+			return { .failed = true };
+
+		ZSTD_inBuffer in{ input.data(), input.size(), 0 };
+		ZSTD_outBuffer out{ output, outputCapacity, 0 };
+		const size_t result = ::ZSTD_decompressStream(_stream, &out, &in);
+		if (::ZSTD_isError(result)) [[unlikely]]
+			return { .failed = true };
+
+		// 0: a frame is complete and flushed. Any further input is the next frame.
+		return { .consumed = in.pos, .produced = out.pos, .finished = result == 0 && inputEnded && in.pos == input.size() };
+	}
+
+private:
+	ZSTD_DStream* const _stream;
+};
+#endif
+
+[[nodiscard]] std::unique_ptr<Codec> createCodec(CStreamDecompressor::Format format)
+{
+	switch (format)
+	{
+#ifdef FC_HAS_ZLIB
+	case CStreamDecompressor::Format::Gzip:
+		return std::make_unique<GzipCodec>();
+#endif
+#ifdef FC_HAS_LZMA
+	case CStreamDecompressor::Format::Xz:
+		return std::make_unique<XzCodec>();
+#endif
+#ifdef FC_HAS_ZSTD
+	case CStreamDecompressor::Format::Zstd:
+		return std::make_unique<ZstdCodec>();
+#endif
+	default:
+		return nullptr;
+	}
+}
+
+[[nodiscard]] bool startsWith(const std::byte* data, size_t length, std::initializer_list<uint8_t> magic) noexcept
+{
+	return length >= magic.size() && std::equal(magic.begin(), magic.end(), data, [](uint8_t expected, std::byte actual) {
+		return std::byte{ expected } == actual;
+	});
+}
+
+// Reused by every compressed file a reader thread decompresses, rather than allocated for each of them
+[[nodiscard]] std::vector<std::byte>& windowBuffer()
+{
+	thread_local std::vector<std::byte> buffer(CStreamDecompressor::windowSize);
+	return buffer;
+}
+} // namespace
+
+CStreamDecompressor::Format CStreamDecompressor::formatOf(const std::byte* data, size_t length) noexcept
+{
+	Format format = Format::None;
+	if (startsWith(data, length, { 0x1F, 0x8B }))
+		format = Format::Gzip;
+	else if (startsWith(data, length, { 0xFD, '7', 'z', 'X', 'Z', 0x00 }))
+		format = Format::Xz;
+	else if (startsWith(data, length, { 0x28, 0xB5, 0x2F, 0xFD }))
+		format = Format::Zstd;
+
+	return isAvailable(format) ? format : Format::None;
+}
+
+bool CStreamDecompressor::isAvailable(Format format) noexcept
+{
+	switch (format)
+	{
+#ifdef FC_HAS_ZLIB
+	case Format::Gzip:
+		return true;
+#endif
+#ifdef FC_HAS_LZMA
+	case Format::Xz:
+		return true;
+#endif
+#ifdef FC_HAS_ZSTD
+	case Format::Zstd:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+uint64_t CStreamDecompressor::decompress(Format format, const InputSource& input, const WindowScanner& scanner, const std::atomic_bool& cancellationRequested)
+{
+	const std::unique_ptr<Codec> codec = createCodec(format);
+	assert_and_return_r(codec, 0);
+
+	std::vector<std::byte>& window = windowBuffer();
+	size_t filled = 0;
+	uint64_t offset = 0;
+
+	const auto handOverWindow = [&] {
+		const bool stop = scanner(window.data(), filled, offset);
+		offset += filled;
+		filled = 0;
+		return stop;
+	};
+
+	std::span<const std::byte> pendingInput;
+	bool inputEnded = false;
+	while (!cancellationRequested)
+	{
+		if (pendingInput.empty() && !inputEnded)
+		{
+			const auto chunk = input();
+			if (!chunk) [[unlikely]]
+				break;
+
+			pendingInput = *chunk;
+			inputEnded = chunk->empty();
+		}
+
+		const Step step = codec->step(pendingInput, window.data() + filled, windowSize - filled, inputEnded);
+		pendingInput = pendingInput.subspan(step.consumed);
+		filled += step.produced;
+
+		if (filled == windowSize && handOverWindow())
+			return offset;
+
+		if (step.finished || step.failed)
+			break;
+		// A truncated stream: the input is over, and the decompressor can make nothing more of what it has had
+		else if (inputEnded && step.consumed == 0 && step.produced == 0)
+			break;
+	}
+
+	// Whatever was decompressed of a corrupt or truncated file is still searched
+	if (filled > 0 && !cancellationRequested)
+		(void)handOverWindow();
+
+	return offset;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <span>
+#include <stdint.h>
+
+// Streams the contents of a gzip, xz or zstd file out of its decompressor, one fixed-size window at a time, for the
+// content search to match as it would a plain file's - with no temporary copy on disk or whole in memory.
+// A format is only available if its library was found when building (see decompression.pri).
+class CStreamDecompressor
+{
+public:
+	enum class Format : uint8_t {
+		None,
+		Gzip,
+		Xz,
+		Zstd
+	};
+
+	// The longest of the magic numbers, which is as many bytes as formatOf() looks at
+	static constexpr size_t magicLength = 6;
+	// The matcher sees every window but the last one whole, the same as a mapped file's, so that it divides into the
+	// same blocks however the contents come
+	static constexpr size_t windowSize = 256 * 1024;
+	// How much compressed input to read at a time
+	static constexpr size_t inputChunkSize = 64 * 1024;
+
+	// The next piece of compressed input, or an empty span at the end of it; nullopt if it could not be read.
+	using InputSource = std::function<std::optional<std::span<const std::byte>> ()>;
+	// Takes the data, its length and its offset in the decompressed contents; returns true to stop.
+	using WindowScanner = std::function<bool (const std::byte* data, size_t length, uint64_t offset)>;
+
+	// None unless the data starts with the magic number of a format that is available.
+	[[nodiscard]] static Format formatOf(const std::byte* data, size_t length) noexcept;
+	[[nodiscard]] static bool isAvailable(Format format) noexcept;
+
+	// Decompresses until the input ends or turns out to be corrupt, the scanner stops it or the search is cancelled,
+	// which is checked after every step of the decompressor - a step never produces more than a window.
+	// Concatenated gzip members, xz streams and zstd frames are all read.
+	// Returns how many decompressed bytes the scanner was given.
+	static uint64_t decompress(Format format, const InputSource& input, const WindowScanner& scanner, const std::atomic_bool& cancellationRequested);
+};
@@ -0,0 +1,337 @@
+#include "curingbatchreader.h"
+
+#include "assert/advanced_assert.h"
+#include "utility/on_scope_exit.hpp"
+
+#ifdef __linux__
+DISABLE_COMPILER_WARNINGS
+#include <QFile>
+RESTORE_COMPILER_WARNINGS
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#endif
+
+#include <algorithm>
+
+#ifdef __linux__
+
+struct CUringBatchReader::Ring
+{
+	// A read and a close per file in flight
+	static constexpr unsigned entries = batchSize * 2;
+
+	~Ring();
+
+	[[nodiscard]] bool setUp();
+
+	[[nodiscard]] io_uring_sqe* nextSubmission() noexcept;
+	// Submits what nextSubmission() has queued and waits for completionCount completions, handing each to onCompletion.
+	// False if the ring stopped working, in which case it must not be used again.
+	[[nodiscard]] bool submitAndWait(unsigned completionCount, const std::function<void (const io_uring_cqe&)>& onCompletion);
+
+	[[nodiscard]] std::byte* buffer(size_t index) const noexcept { return buffers + index * bufferSize; }
+
+	int fd = -1;
+
+	void* sqRing = MAP_FAILED;
+	size_t sqRingSize = 0;
+	void* cqRing = MAP_FAILED;
+	size_t cqRingSize = 0;
+	void* sqes = MAP_FAILED;
+	size_t sqesSize = 0;
+
+	unsigned* sqTail = nullptr;
+	unsigned* sqMask = nullptr;
+	unsigned* sqArray = nullptr;
+	unsigned* cqHead = nullptr;
+	unsigned* cqTail = nullptr;
+	unsigned* cqMask = nullptr;
+	io_uring_cqe* cqes = nullptr;
+
+	unsigned queuedSubmissions = 0;
+
+	std::byte* buffers = nullptr;
+	// Registered buffers spare the kernel pinning the pages for every read; registering fails beyond RLIMIT_MEMLOCK
+	bool buffersRegistered = false;
+	bool broken = false;
+};
+
+CUringBatchReader::Ring::~Ring()
+{
+	if (sqes != MAP_FAILED)
+		::munmap(sqes, sqesSize);
+	if (cqRing != MAP_FAILED && cqRing != sqRing)
+		::munmap(cqRing, cqRingSize);
+	if (sqRing != MAP_FAILED)
+		::munmap(sqRing, sqRingSize);
+	if (fd >= 0)
+		::close(fd);
+
+	std::free(buffers);
+}
+
+bool CUringBatchReader::Ring::setUp()
+{
+	io_uring_params params{};
+	fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+	if (fd < 0)
+		return false;
+
+	// The operations that appeared last of those used here, in 5.6, together with the probe itself
+	alignas(io_uring_probe) std::byte probeBuffer[sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op)]{};
+	auto* probe = reinterpret_cast<io_uring_probe*>(probeBuffer);
+	if (::syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+		return false;
+
+	for (const unsigned operation : { IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_READ_FIXED, IORING_OP_CLOSE })
+	{
+		if (operation > probe->last_op || (probe->ops[operation].flags & IO_URING_OP_SUPPORTED) == 0)
+			return false;
+	}
+
+	sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	const bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (singleMapping)
+		sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+	sqRing = ::mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (sqRing == MAP_FAILED)
+		return false;
+
+	cqRing = singleMapping ? sqRing : ::mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+	if (cqRing == MAP_FAILED)
+		return false;
+
+	sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	sqes = ::mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED)
+		return false;
+
+	static constexpr auto field = [](void* ring, uint32_t offset) {
+		return reinterpret_cast<unsigned*>(static_cast<std::byte*>(ring) + offset);
+	};
+
+	sqTail = field(sqRing, params.sq_off.tail);
+	sqMask = field(sqRing, params.sq_off.ring_mask);
+	sqArray = field(sqRing, params.sq_off.array);
+	cqHead = field(cqRing, params.cq_off.head);
+	cqTail = field(cqRing, params.cq_off.tail);
+	cqMask = field(cqRing, params.cq_off.ring_mask);
+	cqes = reinterpret_cast<io_uring_cqe*>(static_cast<std::byte*>(cqRing) + params.cq_off.cqes);
+
+	buffers = static_cast<std::byte*>(std::aligned_alloc(4096, batchSize * bufferSize));
+	if (!buffers)
+		return false;
+
+	iovec bufferRanges[batchSize];
+	for (size_t i = 0; i < batchSize; ++i)
+		bufferRanges[i] = { buffer(i), bufferSize };
+
+	buffersRegistered = ::syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, bufferRanges, batchSize) == 0;
+	return true;
+}
+
+io_uring_sqe* CUringBatchReader::Ring::nextSubmission() noexcept
+{
+	assert_debug_only(queuedSubmissions < entries);
+
+	// Only this thread moves the tail; the kernel only has to see the entry before the tail that covers it
+	const unsigned tail = *sqTail;
+	const unsigned index = tail & *sqMask;
+	auto* entry = static_cast<io_uring_sqe*>(sqes) + index;
+	::memset(entry, 0, sizeof(io_uring_sqe));
+	sqArray[index] = index;
+	std::atomic_ref{ *sqTail }.store(tail + 1, std::memory_order_release);
+
+	++queuedSubmissions;
+	return entry;
+}
+
+bool CUringBatchReader::Ring::submitAndWait(unsigned completionCount, const std::function<void (const io_uring_cqe&)>& onCompletion)
+{
+	for (unsigned completed = 0; completed < completionCount; )
+	{
+		const int result = static_cast<int>(::syscall(__NR_io_uring_enter, fd, queuedSubmissions, completionCount - completed, IORING_ENTER_GETEVENTS, nullptr, 0));
+		if (result < 0 && errno == EINTR)
+			continue;
+		else if (result < 0)
+		{
+			broken = true;
+			return false;
+		}
+
+		queuedSubmissions -= std::min(static_cast<unsigned>(result), queuedSubmissions);
+
+		unsigned head = *cqHead;
+		const unsigned tail = std::atomic_ref{ *cqTail }.load(std::memory_order_acquire);
+		for (; head != tail; ++head, ++completed)
+			onCompletion(cqes[head & *cqMask]);
+
+		std::atomic_ref{ *cqHead }.store(head, std::memory_order_release);
+	}
+
+	return true;
+}
+
+CUringBatchReader::CUringBatchReader(std::unique_ptr<Ring> ring) noexcept :
+	_ring{ std::move(ring) }
+{
+}
+
+CUringBatchReader::~CUringBatchReader() = default;
+
+std::unique_ptr<CUringBatchReader> CUringBatchReader::create()
+{
+	auto ring = std::make_unique<Ring>();
+	if (!ring->setUp())
+		return nullptr;
+
+	return std::unique_ptr<CUringBatchReader>{ new CUringBatchReader{ std::move(ring) } };
+}
+
+void CUringBatchReader::readBatch(const std::vector<QString>& paths, size_t first, size_t count, const ContentsHandler& onContents, std::vector<size_t>& unread)
+{
+	assert_debug_only(count <= batchSize);
+
+	std::array<QByteArray, batchSize> encodedPaths;
+	std::array<int, batchSize> fds;
+	fds.fill(-1);
+	std::array<int, batchSize> readResults;
+	readResults.fill(-1);
+
+	EXEC_ON_SCOPE_EXIT([&] {
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (readResults[i] >= 0 && static_cast<size_t>(readResults[i]) < bufferSize)
+				continue;
+
+			unread.push_back(first + i);
+		}
+	});
+
+	if (_ring->broken)
+		return;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		encodedPaths[i] = QFile::encodeName(paths[first + i]);
+
+		io_uring_sqe* openEntry = _ring->nextSubmission();
+		openEntry->opcode = IORING_OP_OPENAT;
+		openEntry->fd = AT_FDCWD;
+		openEntry->addr = reinterpret_cast<uintptr_t>(encodedPaths[i].constData());
+		openEntry->open_flags = O_RDONLY | O_CLOEXEC;
+		openEntry->user_data = i;
+	}
+
+	const bool opened = _ring->submitAndWait(static_cast<unsigned>(count), [&](const io_uring_cqe& completion) {
+		if (completion.res >= 0)
+			fds[completion.user_data] = completion.res;
+	});
+
+	if (!opened)
+	{
+		for (const int fd : fds)
+		{
+			if (fd >= 0)
+				::close(fd);
+		}
+		return;
+	}
+
+	// Each close is hard-linked to its read, so that it runs after the read whether or not that succeeded
+	static constexpr uint64_t closeTag = uint64_t{ 1 } << 63;
+	unsigned expectedCompletions = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (fds[i] < 0)
+			continue;
+
+		io_uring_sqe* readEntry = _ring->nextSubmission();
+		readEntry->opcode = _ring->buffersRegistered ? IORING_OP_READ_FIXED : IORING_OP_READ;
+		readEntry->fd = fds[i];
+		readEntry->addr = reinterpret_cast<uintptr_t>(_ring->buffer(i));
+		readEntry->len = bufferSize;
+		readEntry->off = 0;
+		readEntry->buf_index = static_cast<uint16_t>(i);
+		readEntry->flags = IOSQE_IO_HARDLINK;
+		readEntry->user_data = i;
+
+		io_uring_sqe* closeEntry = _ring->nextSubmission();
+		closeEntry->opcode = IORING_OP_CLOSE;
+		closeEntry->fd = fds[i];
+		closeEntry->user_data = closeTag | i;
+
+		expectedCompletions += 2;
+	}
+
+	// Should this fail, whether the descriptors got closed is unknown, and closing them again could close someone else's
+	const bool readAndClosed = _ring->submitAndWait(expectedCompletions, [&](const io_uring_cqe& completion) {
+		if ((completion.user_data & closeTag) == 0)
+			readResults[completion.user_data] = completion.res;
+	});
+
+	if (!readAndClosed)
+	{
+		readResults.fill(-1);
+		return;
+	}
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (readResults[i] >= 0 && static_cast<size_t>(readResults[i]) < bufferSize)
+			onContents(first + i, _ring->buffer(i), static_cast<size_t>(readResults[i]));
+	}
+}
+
+#else
+
+struct CUringBatchReader::Ring {};
+
+CUringBatchReader::CUringBatchReader(std::unique_ptr<Ring> ring) noexcept :
+	_ring{ std::move(ring) }
+{
+}
+
+CUringBatchReader::~CUringBatchReader() = default;
+
+std::unique_ptr<CUringBatchReader> CUringBatchReader::create()
+{
+	return nullptr;
+}
+
+void CUringBatchReader::readBatch(const std::vector<QString>& /*paths*/, size_t first, size_t count, const ContentsHandler& /*onContents*/, std::vector<size_t>& unread)
+{
+	for (size_t i = 0; i < count; ++i)
+		unread.push_back(first + i);
+}
+
+#endif
+
+bool CUringBatchReader::isSupported()
+{
+	static const bool supported = create() != nullptr;
+	return supported;
+}
+
+std::vector<size_t> CUringBatchReader::read(const std::vector<QString>& paths, const ContentsHandler& onContents)
+{
+	std::vector<size_t> unread;
+	for (size_t first = 0; first < paths.size(); first += batchSize)
+		readBatch(paths, first, std::min(batchSize, paths.size() - first), onContents, unread);
+
+	return unread;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "compiler/compiler_warnings_control.h"
+
+DISABLE_COMPILER_WARNINGS
+#include <QString>
+RESTORE_COMPILER_WARNINGS
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Reads many small files with a handful of system calls instead of several per file, through a Linux io_uring: the
+// opens of a whole batch are submitted at once, then the reads - each into a buffer of its own, registered with the
+// kernel up front where the memory lock limit allows - together with the closes.
+// Not available on other platforms, on kernels older than 5.6, or where io_uring is disabled or filtered out.
+class CUringBatchReader
+{
+public:
+	static constexpr size_t batchSize = 32;
+	static constexpr size_t bufferSize = 64 * 1024;
+
+	// Takes the file's index among the paths passed to read(), and its contents; the data is only valid during the call.
+	using ContentsHandler = std::function<void (size_t index, const std::byte* data, size_t length)>;
+
+	// nullptr if io_uring, or one of the operations this needs, is not available.
+	[[nodiscard]] static std::unique_ptr<CUringBatchReader> create();
+	// Whether create() can succeed here; checked once.
+	[[nodiscard]] static bool isSupported();
+
+	~CUringBatchReader();
+
+	CUringBatchReader(const CUringBatchReader&) = delete;
+	CUringBatchReader& operator=(const CUringBatchReader&) = delete;
+
+	// Calls onContents for every file smaller than bufferSize, on the calling thread. Returns the indexes of the other
+	// files - larger, or not readable this way - for the caller to read by other means.
+	[[nodiscard]] std::vector<size_t> read(const std::vector<QString>& paths, const ContentsHandler& onContents);
+
+private:
+	struct Ring;
+
+	explicit CUringBatchReader(std::unique_ptr<Ring> ring) noexcept;
+
+	void readBatch(const std::vector<QString>& paths, size_t first, size_t count, const ContentsHandler& onContents, std::vector<size_t>& unread);
+
+private:
+	std::unique_ptr<Ring> _ring;
+};
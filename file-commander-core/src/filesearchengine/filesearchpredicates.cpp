@@ -0,0 +1,83 @@
+#include "filesearchpredicates.h"
+
+DISABLE_COMPILER_WARNINGS
+#include <QDateTime>
+RESTORE_COMPILER_WARNINGS
+
+#include <cmath>
+
+std::optional<uint64_t> parseSizeFilter(QString text)
+{
+	text = text.trimmed().toUpper();
+	if (text.endsWith(QLatin1StringView{ "IB" }))
+		text.chop(2);
+	else if (text.endsWith('B'))
+		text.chop(1);
+
+	static constexpr QLatin1StringView units{ "KMGT" };
+	double multiplier = 1.0;
+	if (const qsizetype unit = text.isEmpty() ? -1 : units.indexOf(text.back()); unit >= 0)
+	{
+		multiplier = std::pow(1024.0, static_cast<double>(unit + 1));
+		text.chop(1);
+	}
+
+	bool isNumber = false;
+	const double value = text.trimmed().toDouble(&isNumber);
+	if (!isNumber || value < 0.0 || !std::isfinite(value))
+		return std::nullopt;
+
+	const double bytes = std::round(value * multiplier);
+	if (bytes >= 18446744073709551616.0) // 2^64
+		return std::nullopt;
+	return static_cast<uint64_t>(bytes);
+}
+
+std::optional<FileSearchPredicates> searchPredicatesFromFields(const SearchFilterFields& fields)
+{
+	FileSearchPredicates predicates;
+
+	if (!fields.minSize.trimmed().isEmpty())
+	{
+		predicates.minSize = parseSizeFilter(fields.minSize);
+		if (!predicates.minSize)
+			return std::nullopt;
+	}
+	if (!fields.maxSize.trimmed().isEmpty())
+	{
+		predicates.maxSize = parseSizeFilter(fields.maxSize);
+		if (!predicates.maxSize)
+			return std::nullopt;
+	}
+
+	// A day is whole from its first second to its last, in the time zone the user picked it in
+	const auto startOf = [](const std::optional<QDate>& day) -> std::optional<time_t> {
+		return day ? std::optional<time_t>{ day->startOfDay().toSecsSinceEpoch() } : std::nullopt;
+	};
+	const auto endOf = [](const std::optional<QDate>& day) -> std::optional<time_t> {
+		return day ? std::optional<time_t>{ day->endOfDay().toSecsSinceEpoch() } : std::nullopt;
+	};
+	predicates.modifiedAfter = startOf(fields.modifiedFrom);
+	predicates.modifiedBefore = endOf(fields.modifiedTo);
+	predicates.createdAfter = startOf(fields.createdFrom);
+	predicates.createdBefore = endOf(fields.createdTo);
+
+	if (fields.files)
+		predicates.entryTypes |= FileSearchPredicates::Files;
+	if (fields.directories)
+		predicates.entryTypes |= FileSearchPredicates::Directories;
+	if (fields.links)
+		predicates.entryTypes |= FileSearchPredicates::Links;
+
+	predicates.hidden = fields.hidden;
+
+	if (fields.readable)
+		predicates.requiredPermissions |= QFileDevice::ReadUser;
+	if (fields.writable)
+		predicates.requiredPermissions |= QFileDevice::WriteUser;
+	if (fields.executable)
+		predicates.requiredPermissions |= QFileDevice::ExeUser;
+
+	predicates.owner = fields.owner.trimmed();
+	return predicates;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "compiler/compiler_warnings_control.h"
+
+DISABLE_COMPILER_WARNINGS
+#include <QDate>
+#include <QFileDevice>
+#include <QString>
+RESTORE_COMPILER_WARNINGS
+
+#include <optional>
+#include <stdint.h>
+#include <time.h>
+
+// Conditions on an entry's metadata that a search result has to meet on top of the name and contents filters. Every
+// condition left at its default accepts everything. All of them are answered from what the traversal has already
+// read about the entry, and they are checked before the entry's name and contents.
+struct FileSearchPredicates
+{
+	enum EntryType : uint8_t {
+		AnyType     = 0,
+		Files       = 1 << 0,
+		Directories = 1 << 1,
+		Links       = 1 << 2  // Symlinks and junctions; a link to a file is also a file, and a link to a directory a directory
+	};
+
+	// A combination of EntryType flags; an entry matches if it is of any of the listed types.
+	uint8_t entryTypes = AnyType;
+
+	// Inclusive. A size range only ever matches files: directory sizes are not known during traversal.
+	std::optional<uint64_t> minSize;
+	std::optional<uint64_t> maxSize;
+
+	// Inclusive, in seconds since the epoch, as CFileSystemObject reports them.
+	std::optional<time_t> modifiedAfter;
+	std::optional<time_t> modifiedBefore;
+	std::optional<time_t> createdAfter;
+	std::optional<time_t> createdBefore;
+
+	// nullopt: hidden and visible entries alike.
+	std::optional<bool> hidden;
+
+	// Every one of these permission bits has to be set.
+	QFileDevice::Permissions requiredPermissions;
+
+	// The owning user's name, exactly; empty for any owner. The only condition that may take a lookup of its own.
+	QString owner;
+
+	[[nodiscard]] bool empty() const noexcept
+	{
+		return entryTypes == AnyType && !minSize && !maxSize && !modifiedAfter && !modifiedBefore && !createdAfter && !createdBefore
+			&& !hidden && requiredPermissions == QFileDevice::Permissions{} && owner.isEmpty();
+	}
+};
+
+// The search window's filter controls, as the user filled them in. Kept apart from the widgets so that what a search
+// is narrowed by can be worked out - and tested - without them.
+struct SearchFilterFields
+{
+	// A byte count, optionally with a K, M, G or T suffix (1024-based, an "iB" or "B" after it allowed), e.g. "64K" or
+	// "1.5 MiB". Empty for no bound.
+	QString minSize;
+	QString maxSize;
+
+	// Whole local days, inclusive at both ends
+	std::optional<QDate> modifiedFrom;
+	std::optional<QDate> modifiedTo;
+	std::optional<QDate> createdFrom;
+	std::optional<QDate> createdTo;
+
+	// None of them checked: any type
+	bool files = false;
+	bool directories = false;
+	bool links = false;
+
+	std::optional<bool> hidden;
+
+	// The current user's permissions, as QFileDevice::ReadUser and its siblings report them
+	bool readable = false;
+	bool writable = false;
+	bool executable = false;
+
+	QString owner;
+};
+
+// nullopt if the text is not a size SearchFilterFields accepts; an empty text is not one either
+[[nodiscard]] std::optional<uint64_t> parseSizeFilter(QString text);
+
+// nullopt if either size field holds something other than a size
+[[nodiscard]] std::optional<FileSearchPredicates> searchPredicatesFromFields(const SearchFilterFields& fields);
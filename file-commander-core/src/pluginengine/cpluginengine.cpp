@@ -69,11 +69,25 @@ void CPluginEngine::viewCurrentFile()
 void CPluginEngine::viewCurrentFileInTextViewer()
 {
 	// Unlike F3, restrict the candidates to text viewer plugin(s) instead of auto-detecting across all viewers; canViewFile still applies (so e. g. folders are rejected).
-	auto* viewer = viewerForCurrentFile(ViewerCategory::Text);
+	const QString currentFile = _proxy.currentItemPath();
+	auto* viewer = viewerForFile(currentFile, ViewerCategory::Text);
+	if (!viewer)
+		return;
+
+	showViewerWindow(viewer->viewFile(currentFile));
+}
+
+void CPluginEngine::viewFileInTextViewer(const QString& path, uint64_t line)
+{
+	auto* viewer = viewerForFile(path, ViewerCategory::Text);
 	if (!viewer)
 		return;
 
-	showViewerWindow(viewer->viewFile(_proxy.currentItemPath()));
+	auto window = viewer->viewFile(path);
+	if (window)
+		window->goToLine(line);
+
+	showViewerWindow(std::move(window));
 }
 
 void CPluginEngine::showViewerWindow(CFileCommanderViewerPlugin::WindowPtr<CPluginWindow> window)
@@ -90,21 +104,21 @@ void CPluginEngine::showViewerWindow(CFileCommanderViewerPlugin::WindowPtr<CPlug
 
 CFileCommanderViewerPlugin::WindowPtr<CPluginWindow> CPluginEngine::createViewerWindowForCurrentFile()
 {
-	auto* viewer = viewerForCurrentFile({}); // Empty category: accept any viewer, i. e. auto-detect by file type
+	const QString currentFile = _proxy.currentItemPath();
+	auto* viewer = viewerForFile(currentFile, {}); // Empty category: accept any viewer, i. e. auto-detect by file type
 	if (!viewer)
 		return {};
 
-	return viewer->viewFile(_proxy.currentItemPath());
+	return viewer->viewFile(currentFile);
 }
 
-CFileCommanderViewerPlugin* CPluginEngine::viewerForCurrentFile(const QString& requiredCategory)
+CFileCommanderViewerPlugin* CPluginEngine::viewerForFile(const QString& file, const QString& requiredCategory)
 {
-	const QString currentFile = _proxy.currentItemPath();
-	if (currentFile.isEmpty())
+	if (file.isEmpty())
 		return nullptr;
 
-	const auto type = QMimeDatabase().mimeTypeForFile(currentFile, QMimeDatabase::MatchContent);
-	qInfo() << "Selecting a viewer plugin for" << currentFile;
+	const auto type = QMimeDatabase().mimeTypeForFile(file, QMimeDatabase::MatchContent);
+	qInfo() << "Selecting a viewer plugin for" << file;
 	qInfo() << "File type:" << type.name() << ", aliases:" << type.aliases();
 
 	// The text viewer is omnivorous (its canViewFile accepts any file), so it must not shadow a specialized viewer: defer any text-category viewer and use it only if nothing more specific claims the file. This keeps selection independent of _plugins order.
@@ -123,7 +137,7 @@ CFileCommanderViewerPlugin* CPluginEngine::viewerForCurrentFile(const QString& r
 		if (!requiredCategory.isEmpty() && category != requiredCategory)
 			continue;
 
-		if (!viewer->canViewFile(currentFile, type))
+		if (!viewer->canViewFile(file, type))
 			continue;
 
 		if (category == ViewerCategory::Text)
@@ -3,6 +3,7 @@
 #include "plugininterface/cfilecommanderviewerplugin.h"
 
 #include <memory>
+#include <stdint.h>
 #include <vector>
 
 class QLibrary;
@@ -23,11 +24,13 @@ public:
 // Operations
 	void viewCurrentFile();
 	void viewCurrentFileInTextViewer();
+	// Scrolled to the 1-based line
+	void viewFileInTextViewer(const QString& path, uint64_t line);
 	CFileCommanderViewerPlugin::WindowPtr<CPluginWindow> createViewerWindowForCurrentFile();
 
 private:
 	// An empty requiredCategory matches any viewer (auto-detect by file type, with the text viewer as fallback); a non-empty one restricts to viewers of that category().
-	CFileCommanderViewerPlugin* viewerForCurrentFile(const QString& requiredCategory);
+	CFileCommanderViewerPlugin* viewerForFile(const QString& file, const QString& requiredCategory);
 
 	static void showViewerWindow(CFileCommanderViewerPlugin::WindowPtr<CPluginWindow> window);
 
@@ -23,3 +23,7 @@ void CPluginWindow::setAutoDeleteOnClose(bool autoDelete)
 {
 	setAttribute(Qt::WA_DeleteOnClose, autoDelete);
 }
+
+void CPluginWindow::goToLine(uint64_t /*line*/)
+{
+}
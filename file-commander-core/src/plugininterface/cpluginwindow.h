@@ -3,6 +3,8 @@
 #include "plugin_export.h"
 #include "compiler/compiler_warnings_control.h"
 
+#include <stdint.h>
+
 DISABLE_COMPILER_WARNINGS
 #include <QMainWindow>
 RESTORE_COMPILER_WARNINGS
@@ -14,4 +16,7 @@ public:
 
 	[[nodiscard]] bool autoDeleteOnClose() const;
 	void setAutoDeleteOnClose(bool autoDelete);
+
+	// Scrolls to the 1-based line and selects it. Only a viewer that shows text as lines does anything.
+	virtual void goToLine(uint64_t line);
 };
@@ -0,0 +1,9 @@
+#include "settings.h"
+#include "directoryscanner.h"
+#include "settings/csettings.h"
+
+ScanExclusions scanExclusionsFromSettings()
+{
+	CSettings settings;
+	return ScanExclusions{ settings.value(KEY_OTHER_SCAN_EXCLUSION_PATTERNS).toStringList(), settings.value(KEY_OTHER_SCAN_USE_IGNORE_FILES, false).toBool() };
+}
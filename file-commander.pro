@@ -16,7 +16,9 @@ textviewerplugin.depends = file_commander_core text_encoding_detector qtutils th
 filecomparisonplugin.subdir = plugins/tools/filecomparisonplugin
 filecomparisonplugin.depends = qtutils file_commander_core thin_io
 
+# Core's content search names legacy code pages with text_encoding_detector; the app links both
 file_commander_core.subdir = file-commander-core
+file_commander_core.depends = text_encoding_detector
 
 qt_app.subdir  = qt-app
-qt_app.depends = file_commander_core qtutils imageviewerplugin textviewerplugin autoupdater image-processing filecomparisonplugin thin_io
+qt_app.depends = file_commander_core text_encoding_detector qtutils imageviewerplugin textviewerplugin autoupdater image-processing filecomparisonplugin thin_io
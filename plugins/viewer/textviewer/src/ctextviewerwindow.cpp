@@ -28,10 +28,12 @@ DISABLE_COMPILER_WARNINGS
 #include <QShortcut>
 #include <QStringBuilder>
 #include <QStyleHints>
+#include <QTextBlock>
 #include <QTextCodec>
 RESTORE_COMPILER_WARNINGS
 
 #include <algorithm>
+#include <limits>
 #include <type_traits>
 
 inline bool isNonAscii(char16_t c)
@@ -187,6 +189,22 @@ bool CTextViewerWindow::loadTextFile(const QString& file)
 	}
 }
 
+void CTextViewerWindow::goToLine(uint64_t line)
+{
+	if (!_textView || line == 0)
+		return;
+
+	// A block is a line of the source text, however many lines wrapping makes of it on screen
+	const QTextBlock block = _textView->document()->findBlockByNumber(static_cast<int>(std::min<uint64_t>(line - 1, std::numeric_limits<int>::max())));
+	if (!block.isValid())
+		return;
+
+	QTextCursor cursor{ block };
+	cursor.movePosition(QTextCursor::EndOfBlock, QTextCursor::KeepAnchor);
+	_textView->setTextCursor(cursor);
+	_textView->ensureCursorVisible();
+}
+
 bool CTextViewerWindow::asDetectedAutomatically(const QByteArray& fileData, bool useFastMode)
 {
 	const auto result = decodeText(fileData);
@@ -27,6 +27,8 @@ public:
 	~CTextViewerWindow() override;
 
 	bool loadTextFile(const QString& file);
+	// Not in the fast mode, which doesn't keep track of lines
+	void goToLine(uint64_t line) override;
 
 private:
 	bool asDetectedAutomatically(const QByteArray& fileData, bool useFastMode);
@@ -3,6 +3,7 @@
 
 #include "fileoperationguitesthelpers.h"
 
+#include "filesystemhelperfunctions.h"
 #include "progressdialogs/cfileoperationdialog.h"
 
 #include "fileoperations/operationtesthooks.h"
@@ -106,6 +107,20 @@ TEST_CASE("dialog: renders the scanning, byte, and item phases", "[fileoperation
 			.primaryUnitsPerSecond = 5000 });
 		CHECK(!label(dialog, "_lblStatus")->text().contains(QStringLiteral("remaining")));
 	}
+
+	SECTION("a limited transfer shows its recent throughput against the limit")
+	{
+		dialog.renderProgress(ProgressSnapshot{ .phase = OperationPhase::Working, .bytesProcessed = 100, .bytesTotal = 1000,
+			.primaryUnitsPerSecond = 5000 });
+		CHECK(!label(dialog, "_lblStatus")->text().contains(QStringLiteral("limit")));
+
+		dialog.renderProgress(ProgressSnapshot{ .phase = OperationPhase::Working, .bytesProcessed = 100, .bytesTotal = 1000,
+			.primaryUnitsPerSecond = 5000, .bytesPerSecondLimit = 1024 * 1024, .recentBytesPerSecond = 1000 * 1024 });
+		const QString status = label(dialog, "_lblStatus")->text();
+		CHECK(status.contains(QStringLiteral("limit")));
+		CHECK(status.contains(fileSizeToString(1024 * 1024)));
+		CHECK(status.contains(fileSizeToString(1000 * 1024)));
+	}
 }
 
 TEST_CASE("dialog: a delete configures the item unit and hides the per-file bar", "[fileoperationdialog]")
@@ -342,6 +357,52 @@ TEST_CASE("dialog: two operations run simultaneously", "[fileoperationdialog]")
 	CHECK(QFile::exists(tempB.path() % "/dest/b.bin"));
 }
 
+TEST_CASE("dialog: a queued operation can be moved up and started next", "[fileoperationdialog]")
+{
+	QTemporaryDir tempDir;
+	REQUIRE(tempDir.isValid());
+	const QString base = tempDir.path();
+	writeFile(base % "/src.bin", blob(1000));
+
+	const TransferRequest request = copyInto(base % "/src.bin", base);
+	CFileOperationQueue queue;
+	// Stand for an operation running on the same disk, and for two more waiting for it
+	const std::vector<uint64_t> devices = CFileOperationQueue::devicesOf(request);
+	REQUIRE(!devices.empty());
+	const CFileOperationQueue::JobId running = queue.enqueue(devices);
+	const CFileOperationQueue::JobId first = queue.enqueue(devices);
+	const CFileOperationQueue::JobId second = queue.enqueue(devices);
+
+	ScriptedDialog dialog{ request, {}, nullptr, 8 * 1024 * 1024, &queue };
+	auto* startNext = dialog.findChild<QPushButton*>(QStringLiteral("_btnStartNext"));
+	auto* moveUp = dialog.findChild<QPushButton*>(QStringLiteral("_btnMoveUp"));
+	REQUIRE(startNext != nullptr);
+	REQUIRE(moveUp != nullptr);
+	CHECK(startNext->isHidden());
+
+	dialog.start();
+	REQUIRE(pumpUntil([&] { return !startNext->isHidden(); }));
+	CHECK(!moveUp->isHidden());
+	REQUIRE(queue.queuedJobs().size() == 3);
+
+	moveUp->click();
+	CHECK(queue.queuedJobs()[0].id == first);
+	CHECK(queue.queuedJobs()[2].id == second);
+
+	startNext->click();
+	CHECK(queue.queuedJobs()[1].id == first);
+	CHECK(queue.queuedJobs()[2].id == second);
+	CHECK(!dialog.result().has_value()); // Next, but the running one is not preempted
+
+	queue.remove(running);
+	REQUIRE(pumpUntil([&] { return dialog.result().has_value(); }));
+	CHECK(dialog.result()->status == CompletionStatus::Completed);
+	CHECK(startNext->isHidden());
+	CHECK(moveUp->isHidden());
+	queue.remove(first);
+	queue.remove(second);
+}
+
 TEST_CASE("dialog: only a diagnostic outcome needs the user's attention", "[fileoperationdialog]")
 {
 	CHECK(!CFileOperationDialog::outcomeNeedsAttention(OperationSummary{ .status = CompletionStatus::Completed, .completedItems = 3 }));
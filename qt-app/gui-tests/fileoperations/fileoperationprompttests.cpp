@@ -468,7 +468,7 @@ TEST_CASE("prompt: wording", "[fileoperationprompt]")
 		int actionCount = 0;
 		for (const FailedAction action : { InspectSource, InspectDestination, ReadSource, CreateDestinationDirectory,
 			PrepareStagingFile, WriteDestination, PreserveFileMetadata, PublishDestination, RenameEntry, MakeWritable,
-			RemoveEntry, RemovePublishedMoveSource, CleanupStaging, PreserveDirectoryTimestamps })
+			RemoveEntry, RemovePublishedMoveSource, CleanupStaging, PreserveDirectoryTimestamps, VerifyDestination, WriteVerificationManifest, WriteTransferJournal })
 		{
 			CFileOperationPrompt prompt{ makeRequest(IssueKind::ActionFailed, snapshot("src.bin", OperationEntryKind::RegularFile),
 				{}, ioFailure(action)), PromptOperation::Move };
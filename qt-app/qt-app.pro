@@ -12,10 +12,16 @@ QT = core gui widgets network
 lessThan(QT_MAJOR_VERSION, 6) {
 	win*:QT += winextras
 }
+# QTextCodec, for core's content search in legacy code pages
+greaterThan(QT_MAJOR_VERSION, 5) {
+	QT += core5compat
+}
 
 CONFIG += strict_c++
 
 include(../global.pri)
+# Core links against whichever decompression libraries it was built with
+include(../file-commander-core/decompression.pri)
 
 contains(QT_ARCH, x86_64) {
 	ARCHITECTURE = x64
@@ -74,6 +80,7 @@ SOURCES += \
 	src/favoritelocationseditor/cnewfavoritelocationdialog.cpp \
 	src/panel/filelistwidget/cfilelistfilterdialog.cpp \
 	src/filessearchdialog/cfilessearchwindow.cpp \
+	src/filessearchdialog/csearchresultsmodel.cpp \
 	src/aboutdialog/caboutdialog.cpp \
 	src/progressdialogs/progressdialoghelpers.cpp \
 	src/panel/cpaneldisplaycontroller.cpp \
@@ -101,6 +108,7 @@ HEADERS += \
 	src/favoritelocationseditor/cnewfavoritelocationdialog.h \
 	src/panel/filelistwidget/cfilelistfilterdialog.h \
 	src/filessearchdialog/cfilessearchwindow.h \
+	src/filessearchdialog/csearchresultsmodel.h \
 	src/tools/CFileStatsWindow.h \
 	src/tools/cfoldercomparisonwindow.h \
 	src/tools/csortbydatatreeitem.h \
@@ -127,7 +135,7 @@ FORMS += \
 
 DEFINES += _SCL_SECURE_NO_WARNINGS
 
-LIBS += -L$${DESTDIR} -lautoupdater -lcore -lqtutils -lcpputils
+LIBS += -L$${DESTDIR} -lautoupdater -lcore -ltext_encoding_detector -lqtutils -lcpputils
 LIBS += -L$${DESTDIR_NOARCH} -lthin_io
 
 win*{
@@ -171,7 +179,7 @@ win32*:!*msvc2012:*msvc* {
 
 mac*|linux*|freebsd{
 	PRE_TARGETDEPS += $${DESTDIR_NOARCH}/libthin_io.a $${DESTDIR_NOARCH}/libcpputils.a $${DESTDIR_NOARCH}/libqtutils.a
-	PRE_TARGETDEPS += $${DESTDIR}/libcore.a
+	PRE_TARGETDEPS += $${DESTDIR}/libcore.a $${DESTDIR}/libtext_encoding_detector.a
 }
 
 RESOURCES += \
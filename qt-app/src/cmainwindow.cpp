@@ -4,6 +4,7 @@
 #include "progressdialogs/cfileoperationdialog.h"
 #include "progressdialogs/fileoperationlaunch.h"
 #include "progressdialogs/progressdialoghelpers.h"
+#include "fileoperations/cfileoperationqueue.h"
 #include "fileoperations/fileoperationtypes.h"
 #include "fileoperations/newnamecheck.h"
 #include "settings.h"
@@ -55,6 +56,7 @@ DISABLE_COMPILER_WARNINGS
 #include <QScreen>
 #include <QShortcut>
 #include <QSortFilterProxyModel>
+#include <QStandardPaths>
 #include <QTimer>
 #include <QUrl>
 #include <QVBoxLayout>
@@ -348,11 +350,29 @@ bool CMainWindow::launchFileTransfer(TransferKind kind, std::vector<CFileSystemO
 	const QString label = (kind == TransferKind::Copy ? tr("Copy %1 %2 to") : tr("Move %1 %2 to"))
 		.arg(sources.size()).arg(sources.size() > 1 ? tr("files") : tr("file"));
 
+	CSettings s;
+	bool verify = s.value(KEY_OPERATIONS_VERIFY_COPIES, false).toBool();
+	bool writeManifest = s.value(KEY_OPERATIONS_WRITE_VERIFICATION_MANIFEST, false).toBool();
+	bool resumeLargeFiles = kind == TransferKind::Copy && s.value(KEY_OPERATIONS_RESUME_LARGE_FILES, false).toBool();
+
 	CFileOperationConfirmationPrompt prompt(caption, label, toNativeSeparators(prefill), this);
-	if (CSettings().value(KEY_OPERATIONS_ASK_FOR_COPY_MOVE_CONFIRMATION, true).toBool())
+	prompt.setVerificationOptions(verify, writeManifest);
+	if (kind == TransferKind::Copy)
+		prompt.setResumeOption(resumeLargeFiles);
+	if (s.value(KEY_OPERATIONS_ASK_FOR_COPY_MOVE_CONFIRMATION, true).toBool())
 	{
 		if (prompt.exec() != QDialog::Accepted)
 			return false;
+
+		verify = prompt.verify();
+		writeManifest = prompt.writeManifest();
+		s.setValue(KEY_OPERATIONS_VERIFY_COPIES, verify);
+		s.setValue(KEY_OPERATIONS_WRITE_VERIFICATION_MANIFEST, writeManifest);
+		if (kind == TransferKind::Copy)
+		{
+			resumeLargeFiles = prompt.resumeLargeFiles();
+			s.setValue(KEY_OPERATIONS_RESUME_LARGE_FILES, resumeLargeFiles);
+		}
 	}
 
 	auto request = makeUiTransferRequest(kind, sourcePaths, toPosixSeparators(prompt.text()));
@@ -362,7 +382,25 @@ bool CMainWindow::launchFileTransfer(TransferKind kind, std::vector<CFileSystemO
 		return false;
 	}
 
-	auto* dialog = new CFileOperationDialog(std::move(*request), [this](QSize dialogFrameSize) { return nextBackgroundDialogPosition(dialogFrameSize); }, this);
+	// The checksum file goes next to the copies it lists
+	if (verify)
+	{
+		request->verification = CopyVerification::ReadBack;
+		if (writeManifest)
+		{
+			const CEntryPath& destination = request->destination.path;
+			const CEntryPath directory = request->destination.intent == DestinationIntent::IntoDirectory || destination.isRoot() ? destination : destination.parent();
+			request->verificationManifest = directory.child(QStringLiteral("file-commander-checksums.xxh64"));
+		}
+	}
+
+	// So that a copy cancelled or cut short can be run again, and carry on where it stopped. Only on request does that
+	// include the large file it stopped in: its staging file is kept, and may be big.
+	request->journalDirectory = parseOperationPath(QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + QStringLiteral("/transfer journals"));
+	request->resumeLargeFiles = resumeLargeFiles;
+
+	auto* dialog = new CFileOperationDialog(std::move(*request), [this](QSize dialogFrameSize) { return nextBackgroundDialogPosition(dialogFrameSize); }, this,
+		adaptiveTransferChunkSize, &CFileOperationQueue::get(), &CTransferThrottle::global());
 	registerFileOperationDialog(dialog);
 	dialog->start(); // Shows itself once the operation proves long enough to be worth a window
 	return true;
@@ -586,7 +624,8 @@ void CMainWindow::performDeletion(const bool toTrash)
 		return;
 	}
 
-	auto* dialog = new CFileOperationDialog(std::move(*request), [this](QSize dialogFrameSize) { return nextBackgroundDialogPosition(dialogFrameSize); }, this);
+	auto* dialog = new CFileOperationDialog(std::move(*request), [this](QSize dialogFrameSize) { return nextBackgroundDialogPosition(dialogFrameSize); }, this,
+		adaptiveTransferChunkSize, &CFileOperationQueue::get(), &CTransferThrottle::global());
 	registerFileOperationDialog(dialog);
 	dialog->start(); // Shows itself once the operation proves long enough to be worth a window
 }
@@ -671,6 +710,11 @@ void CMainWindow::viewFileInTextViewer()
 	_pluginEngine.viewCurrentFileInTextViewer();
 }
 
+void CMainWindow::viewFileAtLine(const QString& path, uint64_t line)
+{
+	_pluginEngine.viewFileInTextViewer(path, line);
+}
+
 void CMainWindow::editFile()
 {
 #ifdef _WIN32
@@ -47,6 +47,9 @@ public:
 	// the panel selection and edited destination into a typed request and drives one CFileOperationDialog.
 	bool launchFileTransfer(TransferKind kind, std::vector<CFileSystemObject>&& sources, const QString& destinationDirectory);
 
+	// Opens the file in the text viewer, scrolled to the 1-based line, whatever the current item is
+	void viewFileAtLine(const QString& path, uint64_t line);
+
 	// Returns the position that a new dialog should move() to (top left)
 	[[nodiscard]] QPoint nextBackgroundDialogPosition(QSize dialogFrameSize) const;
 
@@ -1,10 +1,12 @@
 #include "cfilessearchwindow.h"
+#include "csearchresultsmodel.h"
 #include "cfilesystemobject.h"
 #include "ccontroller.h"
 #include "../cmainwindow.h"
 #include "settings/csettings.h"
+#include "settings.h"
 #include "filesystemhelperfunctions.h"
-#include "iconprovider/ciconprovider.h"
+#include "filesearchengine/ccontentindex.h"
 
 #include "qtcore_helpers/qstring_helpers.hpp"
 #include "widgets/cpersistentwindow.h"
@@ -13,19 +15,33 @@ DISABLE_COMPILER_WARNINGS
 #include "ui_cfilessearchwindow.h"
 
 #include <QClipboard>
+#include <QDateEdit>
+#include <QDir>
 #include <QFileDialog>
-#include <QFont>
 #include <QLineEdit>
 #include <QMessageBox>
+#include <QShortcut>
+#include <QStandardPaths>
 RESTORE_COMPILER_WARNINGS
 
+#include <utility>
+
 #define SETTINGS_NAME_TO_FIND            QSL("FileSearchDialog/Ui/NameToFind")
 #define SETTINGS_NAME_CASE_SENSITIVE     QSL("FileSearchDialog/Ui/CaseSensitiveName")
 #define SETTINGS_NAME_PARTIAL_MATCH      QSL("FileSearchDialog/Ui/NamePartialMatch")
 #define SETTINGS_CONTENTS_TO_FIND        QSL("FileSearchDialog/Ui/ContentsToFind")
 #define SETTINGS_CONTENTS_CASE_SENSITIVE QSL("FileSearchDialog/Ui/CaseSensitiveContents")
 #define SETTINGS_CONTENTS_IS_REGEX       QSL("FileSearchDialog/Ui/ContentsIsRegex")
+#define SETTINGS_ALL_MATCHES_IN_FILE     QSL("FileSearchDialog/Ui/AllMatchesInFile")
+#define SETTINGS_SKIP_BINARY_FILES       QSL("FileSearchDialog/Ui/SkipBinaryFiles")
+#define SETTINGS_SEARCH_COMPRESSED_FILES QSL("FileSearchDialog/Ui/SearchCompressedFiles")
 #define SETTINGS_ROOT_FOLDER             QSL("FileSearchDialog/Ui/RootFolder")
+#define SETTINGS_RESULTS_SORT_ORDER      QSL("FileSearchDialog/Ui/ResultsSortOrder")
+
+static QString contentIndexFilePath()
+{
+	return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + QSL("/content index/content.index");
+}
 
 CFilesSearchWindow::CFilesSearchWindow(const std::vector<QString>& targets, QWidget* parent) :
 	QMainWindow(parent),
@@ -62,18 +78,50 @@ CFilesSearchWindow::CFilesSearchWindow(const std::vector<QString>& targets, QWid
 	ui->cbNamePartialMatch->setChecked(s.value(SETTINGS_NAME_PARTIAL_MATCH, true).toBool());
 	ui->cbContentsCaseSensitive->setChecked(s.value(SETTINGS_CONTENTS_CASE_SENSITIVE, false).toBool());
 	ui->cbRegexFileContents->setChecked(s.value(SETTINGS_CONTENTS_IS_REGEX, false).toBool());
+	ui->cbAllMatchesInFile->setChecked(s.value(SETTINGS_ALL_MATCHES_IN_FILE, false).toBool());
+	ui->cbSkipBinaryFiles->setChecked(s.value(SETTINGS_SKIP_BINARY_FILES, true).toBool());
+	ui->cbSearchCompressedFiles->setChecked(s.value(SETTINGS_SEARCH_COMPRESSED_FILES, false).toBool());
+
+	// "Hidden" is tri-state, and its third state - either - is the one that filters nothing
+	ui->cbFilterHidden->setCheckState(Qt::PartiallyChecked);
+	for (const auto& [checkBox, dateEdit] : { std::pair{ ui->cbModifiedFrom, ui->filterModifiedFrom }, std::pair{ ui->cbModifiedTo, ui->filterModifiedTo },
+		std::pair{ ui->cbCreatedFrom, ui->filterCreatedFrom }, std::pair{ ui->cbCreatedTo, ui->filterCreatedTo } })
+	{
+		dateEdit->setDate(QDate::currentDate());
+		connect(checkBox, &QCheckBox::toggled, dateEdit, &QDateEdit::setEnabled);
+	}
 
 	connect(ui->nameToFind, &CHistoryComboBox::itemActivated, ui->btnSearch, &QPushButton::click);
 	connect(ui->fileContentsToFind, &CHistoryComboBox::itemActivated, ui->btnSearch, &QPushButton::click);
 
 	connect(ui->btnSaveResults, &QPushButton::clicked, this, &CFilesSearchWindow::saveResults);
 	connect(ui->btnLoadResults, &QPushButton::clicked, this, &CFilesSearchWindow::loadResults);
+	connect(ui->btnUpdateIndex, &QPushButton::clicked, this, &CFilesSearchWindow::updateContentIndex);
+
+	// Opening maps the index file and checks its header, which is cheap; an index that is out of date still narrows
+	// correctly, it just has to read the files that changed since
+	const bool contentIndexEnabled = s.value(KEY_OTHER_CONTENT_INDEX_ENABLED, false).toBool() && !s.value(KEY_OTHER_CONTENT_INDEX_ROOTS).toStringList().isEmpty();
+	ui->btnUpdateIndex->setVisible(contentIndexEnabled);
+	if (contentIndexEnabled)
+		_engine.setContentIndex(CContentIndex::open(contentIndexFilePath()));
 
-	connect(ui->resultsList, &QListWidget::itemActivated, [](QListWidgetItem* item) {
-		CController::get().activePanel().goToItem(CFileSystemObject(item->data(Qt::UserRole).toString()));
+	_results = new CSearchResultsModel(this);
+	ui->resultsList->setModel(_results);
+
+	connect(ui->resultsList, &QListView::activated, [](const QModelIndex& index) {
+		CController::get().activePanel().goToItem(CFileSystemObject(index.data(CSearchResultsModel::PathRole).toString()));
 		CMainWindow::get()->activateWindow();
 	});
-	connect(ui->resultsList, &QListWidget::customContextMenuRequested, this, &CFilesSearchWindow::showContextMenu);
+	connect(ui->resultsList, &QListView::customContextMenuRequested, this, &CFilesSearchWindow::showContextMenu);
+	new QShortcut(QKeySequence(QSL("F3")), ui->resultsList, this, [this] { viewMatch(ui->resultsList->currentIndex()); }, Qt::WidgetShortcut);
+
+	connect(ui->resultsFilter, &QLineEdit::textChanged, _results, &CSearchResultsModel::setFilter);
+	connect(ui->resultsSortOrder, &QComboBox::currentIndexChanged, this, [this](int index) {
+		if (index >= 0)
+			_results->setSortOrder(static_cast<CSearchResultsModel::SortOrder>(index));
+	});
+	// The combo box items are listed in the order of CSearchResultsModel::SortOrder
+	ui->resultsSortOrder->setCurrentIndex(s.value(SETTINGS_RESULTS_SORT_ORDER, 0).toInt());
 
 	QMetaObject::invokeMethod(this, [this](){
 		ui->nameToFind->setFocus();
@@ -86,12 +134,18 @@ CFilesSearchWindow::~CFilesSearchWindow()
 	// The worker calls back into this listener, so it must be gone before `ui` and the rest of this window are
 	_engine.stopSearching();
 	_engine.waitForSearchToFinish();
+	_contentIndexBuilder.requestCancellation();
+	_contentIndexBuilder.join();
 
 	CSettings s;
 	s.setValue(SETTINGS_NAME_CASE_SENSITIVE, ui->cbNameCaseSensitive->isChecked());
 	s.setValue(SETTINGS_NAME_PARTIAL_MATCH, ui->cbNamePartialMatch->isChecked());
 	s.setValue(SETTINGS_CONTENTS_CASE_SENSITIVE, ui->cbContentsCaseSensitive->isChecked());
 	s.setValue(SETTINGS_CONTENTS_IS_REGEX, ui->cbRegexFileContents->isChecked());
+	s.setValue(SETTINGS_ALL_MATCHES_IN_FILE, ui->cbAllMatchesInFile->isChecked());
+	s.setValue(SETTINGS_SKIP_BINARY_FILES, ui->cbSkipBinaryFiles->isChecked());
+	s.setValue(SETTINGS_SEARCH_COMPRESSED_FILES, ui->cbSearchCompressedFiles->isChecked());
+	s.setValue(SETTINGS_RESULTS_SORT_ORDER, ui->resultsSortOrder->currentIndex());
 
 	delete ui;
 }
@@ -105,20 +159,22 @@ void CFilesSearchWindow::itemScanned(const QString& currentItem)
 	);
 }
 
-void CFilesSearchWindow::matchFound(const QString& path, bool reachedThroughLink)
+void CFilesSearchWindow::matchesFound(std::vector<CFileSearchEngine::Match> matches)
 {
-	QMetaObject::invokeMethod(this, [=, this] {
-			_matches.push_back(path);
-			addResultToUi(path, reachedThroughLink);
+	QMetaObject::invokeMethod(this, [this, matches{ std::move(matches) }] {
+			_results->append(matches);
 		},
 		Qt::QueuedConnection
 	);
 }
 
-void CFilesSearchWindow::searchFinished(CFileSearchEngine::SearchStatus status, uint64_t itemsScanned, uint64_t msElapsed)
+void CFilesSearchWindow::searchFinished(CFileSearchEngine::SearchStatus status, uint64_t itemsScanned, uint64_t msElapsed, const CFileSearchEngine::ContentStatistics& contentStatistics)
 {
 	QMetaObject::invokeMethod(this, [=, this]{
 			ui->btnSearch->setText(tr("Start"));
+			ui->cbWithinResults->setEnabled(_engine.hasKeptResults());
+			if (!ui->cbWithinResults->isEnabled())
+				ui->cbWithinResults->setChecked(false);
 
 			if (status == CFileSearchEngine::SearchInvalidPattern)
 			{
@@ -128,8 +184,8 @@ void CFilesSearchWindow::searchFinished(CFileSearchEngine::SearchStatus status,
 			}
 
 			QString message = (status == CFileSearchEngine::SearchCancelled ? tr("Search aborted") : tr("Search completed"));
-			if (!_matches.empty())
-				message = message % ", " % tr("%1 items found").arg(_matches.size());
+			if (_results->resultCount() > 0)
+				message = message % ", " % tr("%1 items found").arg(_results->resultCount());
 
 			message = message % ": " % tr("%1 items scanned in %2 sec").arg(itemsScanned).arg((double)msElapsed * 1e-3, 0, 'f', 1);
 
@@ -137,13 +193,26 @@ void CFilesSearchWindow::searchFinished(CFileSearchEngine::SearchStatus status,
 			{
 				const uint64_t itemsPerSecond = itemsScanned * 1000ULL / msElapsed;
 				message = message % ", " % tr("search speed: %1 items/sec").arg(itemsPerSecond);
+
+				if (contentStatistics.bytesSearched > 0)
+				{
+					const double mibPerSecond = (double)contentStatistics.bytesSearched / (1024.0 * 1024.0) * 1000.0 / (double)msElapsed;
+					message = message % ", " % tr("%1 MiB/sec of contents").arg(mibPerSecond, 0, 'f', 1);
+				}
+			}
+
+			if (contentStatistics.compressedFilesSearched > 0)
+			{
+				message = message % ", " % tr("%1 MiB decompressed from %2 compressed files")
+					.arg((double)contentStatistics.bytesDecompressed / (1024.0 * 1024.0), 0, 'f', 1)
+					.arg(contentStatistics.compressedFilesSearched);
 			}
 
 			ui->progressLabel->setText(message);
 
 			ui->resultsList->setFocus();
-			if (ui->resultsList->count() > 0)
-				ui->resultsList->item(0)->setSelected(true);
+			if (_results->rowCount() > 0 && !ui->resultsList->currentIndex().isValid())
+				ui->resultsList->setCurrentIndex(_results->index(0));
 		},
 		Qt::QueuedConnection
 	);
@@ -157,8 +226,6 @@ void CFilesSearchWindow::search()
 		return;
 	}
 
-	_matches.clear();
-
 	const QString filtersString = ui->nameToFind->currentText();
 	const QString withText = ui->fileContentsToFind->currentText();
 
@@ -175,19 +242,59 @@ void CFilesSearchWindow::search()
 		}
 	}
 
-	if (_engine.search(
-		filters,
-		ui->cbNameCaseSensitive->isChecked(),
-		ui->searchRoot->currentText().split(QSL("; ")),
-		withText,
-		ui->cbContentsCaseSensitive->isChecked(),
-		ui->cbContentsWholeWords->isChecked(),
-		ui->cbRegexFileContents->isChecked(),
-		this /* listener */)
-	)
+	const auto predicates = searchPredicatesFromFields(filterFields());
+	if (!predicates)
+	{
+		ui->progressLabel->setText(tr("The size filter is not a valid size, such as 1500, 64K or 1.5 MiB"));
+		return;
+	}
+
+	const ScanExclusions exclusions = scanExclusionsFromSettings();
+	_engine.setSkipBinaryFiles(ui->cbSkipBinaryFiles->isChecked());
+	_engine.setSearchCompressedFiles(ui->cbSearchCompressedFiles->isChecked());
+
+	const bool nameCaseSensitive = ui->cbNameCaseSensitive->isChecked();
+	const uint32_t matchLocationsPerFile = ui->cbAllMatchesInFile->isChecked() ? matchesListedPerFile : 1;
+	bool started = false;
+	if (ui->cbWithinResults->isChecked())
+	{
+		// The results were picked by the last name query, so a different one has to look at all that was traversed
+		const auto scope = (filters == _lastFilters && nameCaseSensitive == _lastFiltersCaseSensitive) ? CFileSearchEngine::ResultsScope::Matches : CFileSearchEngine::ResultsScope::Traversed;
+		started = _engine.searchWithinResults(scope,
+			filters,
+			nameCaseSensitive,
+			withText,
+			ui->cbContentsCaseSensitive->isChecked(),
+			ui->cbContentsWholeWords->isChecked(),
+			ui->cbRegexFileContents->isChecked(),
+			this /* listener */,
+			*predicates,
+			matchLocationsPerFile);
+	}
+	else
+	{
+		started = _engine.search(
+			filters,
+			nameCaseSensitive,
+			ui->searchRoot->currentText().split(QSL("; ")),
+			withText,
+			ui->cbContentsCaseSensitive->isChecked(),
+			ui->cbContentsWholeWords->isChecked(),
+			ui->cbRegexFileContents->isChecked(),
+			this /* listener */,
+			*predicates,
+			exclusions,
+			matchLocationsPerFile);
+	}
+
+	if (started)
 	{
+		_lastFilters = filters;
+		_lastFiltersCaseSensitive = nameCaseSensitive;
+		ui->cbWithinResults->setEnabled(false);
+
 		ui->btnSearch->setText(tr("Stop"));
-		ui->resultsList->clear();
+		_results->clear();
 
 		QString title = filtersString;
 		if (!withText.isEmpty())
@@ -201,45 +308,67 @@ void CFilesSearchWindow::search()
 	}
 }
 
-void CFilesSearchWindow::addResultToUi(const QString& path, bool reachedThroughLink)
+SearchFilterFields CFilesSearchWindow::filterFields() const
 {
-	ui->resultsList->setUpdatesEnabled(false);
-
-	const CFileSystemObject object{ path };
-	const bool isDir = object.isDir();
-
-	QString name = toNativeSeparators(path);
-	if (isDir)
-	{
-		if (name.endsWith(nativeSeparator()))
-			name.chop(1);
-		name.prepend('[').append(']');
-	}
-
-	auto* item = new QListWidgetItem;
-	item->setText(name);
-	item->setIcon(CIconProvider::iconForFilesystemObject(object, true));
-	item->setData(Qt::UserRole, path);
-
-	if (reachedThroughLink)
-	{
-		// The same file can also be listed under its direct path; marking this one keeps the pair from reading as
-		// a duplicate the search shouldn't have produced.
-		item->setToolTip(tr("Found by following a directory link"));
-		// The item's own font is still the default one until it joins the list, so italicize the list's font instead
-		QFont font = ui->resultsList->font();
-		font.setItalic(true);
-		item->setFont(font);
-	}
+	const auto dateIfChecked = [](const QCheckBox* checkBox, const QDateEdit* dateEdit) {
+		return checkBox->isChecked() ? std::optional<QDate>{ dateEdit->date() } : std::nullopt;
+	};
+
+	SearchFilterFields fields;
+	fields.minSize = ui->filterMinSize->text();
+	fields.maxSize = ui->filterMaxSize->text();
+	fields.modifiedFrom = dateIfChecked(ui->cbModifiedFrom, ui->filterModifiedFrom);
+	fields.modifiedTo = dateIfChecked(ui->cbModifiedTo, ui->filterModifiedTo);
+	fields.createdFrom = dateIfChecked(ui->cbCreatedFrom, ui->filterCreatedFrom);
+	fields.createdTo = dateIfChecked(ui->cbCreatedTo, ui->filterCreatedTo);
+	fields.files = ui->cbFilterFiles->isChecked();
+	fields.directories = ui->cbFilterDirectories->isChecked();
+	fields.links = ui->cbFilterLinks->isChecked();
+	if (const Qt::CheckState hidden = ui->cbFilterHidden->checkState(); hidden != Qt::PartiallyChecked)
+		fields.hidden = hidden == Qt::Checked;
+	fields.readable = ui->cbFilterReadable->isChecked();
+	fields.writable = ui->cbFilterWritable->isChecked();
+	fields.executable = ui->cbFilterExecutable->isChecked();
+	fields.owner = ui->filterOwner->text();
+	return fields;
+}
 
-	ui->resultsList->addItem(item);
+void CFilesSearchWindow::updateContentIndex()
+{
+	const QStringList roots = CSettings{}.value(KEY_OTHER_CONTENT_INDEX_ROOTS).toStringList();
+	const QString indexFilePath = contentIndexFilePath();
+	if (roots.isEmpty() || !QDir{}.mkpath(QFileInfo{ indexFilePath }.absolutePath()))
+		return;
 
-	ui->resultsList->setUpdatesEnabled(true);
+	// The previous build has reported back by the time the button is enabled again, but its thread may still be unwinding
+	_contentIndexBuilder.join();
+	ui->btnUpdateIndex->setEnabled(false);
+	ui->progressLabel->setText(tr("Updating the content index..."));
+
+	_contentIndexBuilder.start([this, roots, indexFilePath](const std::atomic<bool>& cancellationRequested) {
+		auto index = CContentIndex::build(indexFilePath, roots, cancellationRequested);
+		if (cancellationRequested)
+			return;
+
+		QMetaObject::invokeMethod(this, [this, index{ std::move(index) }] {
+				ui->btnUpdateIndex->setEnabled(true);
+				if (!index)
+				{
+					ui->progressLabel->setText(tr("Failed to write the content index"));
+					return;
+				}
+
+				_engine.setContentIndex(index);
+				ui->progressLabel->setText(tr("Content index updated: %1 files indexed").arg(index->fileCount()));
+			},
+			Qt::QueuedConnection
+		);
+	});
 }
 
 void CFilesSearchWindow::saveResults()
 {
-	if (_matches.empty())
+	if (_results->resultCount() == 0)
 		return;
 
 	const QString path = QFileDialog::getSaveFileName(this, {}, ui->searchRoot->currentText().split(';').front(), QSL("*.searchresult"));
@@ -253,11 +382,10 @@ void CFilesSearchWindow::saveResults()
 		return;
 	}
 
-	for (const auto& match : _matches)
-	{
+	_results->forEachPath([&file](const QString& match) {
 		file.write(match.toUtf8());
 		file.write("\n", 1);
-	}
+	});
 }
 
 void CFilesSearchWindow::loadResults()
@@ -276,22 +404,47 @@ void CFilesSearchWindow::loadResults()
 	QTextStream stream{ &file };
 	stream.setEncoding(QStringConverter::Utf8);
 
+	// The list no longer holds only what the last search found
+	_engine.discardKeptResults();
+	ui->cbWithinResults->setChecked(false);
+	ui->cbWithinResults->setEnabled(false);
+
+	// The saved file is a plain list of paths, with no record of how each was reached
+	std::vector<CFileSearchEngine::Match> batch;
 	QString line;
 	while (stream.readLineInto(&line))
 	{
-		_matches.push_back(line);
-		addResultToUi(line, false); // The saved file is a plain list of paths, with no record of how each was reached
+		batch.push_back({ line, false });
+		if (batch.size() == CFileSearchEngine::matchBatchSize)
+			_results->append(std::exchange(batch, {}));
 	}
+
+	_results->append(batch);
 }
 
 void CFilesSearchWindow::showContextMenu(const QPoint& pos)
 {
-	QListWidgetItem *clickedItem = ui->resultsList->itemAt(pos);
+	const QModelIndex clickedItem = ui->resultsList->indexAt(pos);
+	if (!clickedItem.isValid())
+		return;
 
 	QMenu menu(this);
 	const QAction *copyAction = menu.addAction("Copy path to clipboard");
+	const QAction *viewAction = clickedItem.data(CSearchResultsModel::LineRole).toULongLong() != 0 ? menu.addAction(tr("View at this line") + '\t' + QSL("F3")) : nullptr;
 	const QAction *selectedAction = menu.exec(ui->resultsList->mapToGlobal(pos));
 
 	if (selectedAction == copyAction)
-		QApplication::clipboard()->setText(escapedPath(toNativeSeparators(clickedItem->data(Qt::UserRole).toString())));
+		QApplication::clipboard()->setText(escapedPath(toNativeSeparators(clickedItem.data(CSearchResultsModel::PathRole).toString())));
+	else if (selectedAction && selectedAction == viewAction)
+		viewMatch(clickedItem);
+}
+
+void CFilesSearchWindow::viewMatch(const QModelIndex& index)
+{
+	if (!index.isValid())
+		return;
+
+	const uint64_t line = index.data(CSearchResultsModel::LineRole).toULongLong();
+	if (line != 0)
+		CMainWindow::get()->viewFileAtLine(index.data(CSearchResultsModel::PathRole).toString(), line);
 }
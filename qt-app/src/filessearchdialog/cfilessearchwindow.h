@@ -2,9 +2,11 @@
 
 #include "compiler/compiler_warnings_control.h"
 #include "filesearchengine/cfilesearchengine.h"
+#include "threading/cinterruptablethread.h"
 
 DISABLE_COMPILER_WARNINGS
 #include <QMainWindow>
+#include <QStringList>
 RESTORE_COMPILER_WARNINGS
 
 #include <vector>
@@ -13,7 +15,8 @@ namespace Ui {
 class CFilesSearchWindow;
 }
 
-class QLabel;
+class CSearchResultsModel;
+class QModelIndex;
 
 class CFilesSearchWindow final : public QMainWindow, public CFileSearchEngine::FileSearchListener
 {
@@ -22,22 +25,36 @@ public:
 	~CFilesSearchWindow() override;
 
 	void itemScanned(const QString& currentItem) override;
-	void matchFound(const QString& path, bool reachedThroughLink) override;
-	void searchFinished(CFileSearchEngine::SearchStatus status, uint64_t itemsScanned, uint64_t msElapsed) override;
+	void matchesFound(std::vector<CFileSearchEngine::Match> matches) override;
+	void searchFinished(CFileSearchEngine::SearchStatus status, uint64_t itemsScanned, uint64_t msElapsed, const CFileSearchEngine::ContentStatistics& contentStatistics) override;
 
 private:
 	void search();
+	// What the filter controls hold
+	[[nodiscard]] SearchFilterFields filterFields() const;
 
-	void addResultToUi(const QString& path, bool reachedThroughLink);
+	// Builds the content index for the folders chosen in the settings, or brings it up to date, in the background
+	void updateContentIndex();
 
 	void saveResults();
 	void loadResults();
 
 	void showContextMenu(const QPoint &pos);
+	// Opens the text viewer at the row's match, if the row has a location
+	void viewMatch(const QModelIndex& index);
 
 private:
+	// With "All matches in a file" checked; a file with more than this is a poor fit for a list anyway
+	static constexpr uint32_t matchesListedPerFile = 100;
+
 	CFileSearchEngine _engine;
-	std::vector<QString> _matches;
+	// Hands the finished index over to this window through its event queue, so it is joined before anything else goes
+	CInterruptableThread _contentIndexBuilder{ "Content index builder" };
+	CSearchResultsModel* _results = nullptr;
+
+	// The name query of the last search, which picked the results a search within them starts from
+	QStringList _lastFilters;
+	bool _lastFiltersCaseSensitive = false;
 
 	Ui::CFilesSearchWindow *ui = nullptr;
 };
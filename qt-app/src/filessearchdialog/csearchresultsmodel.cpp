@@ -0,0 +1,282 @@
+#include "csearchresultsmodel.h"
+#include "cfilesystemobject.h"
+#include "filesystemhelperfunctions.h"
+#include "iconprovider/ciconprovider.h"
+
+#include "assert/advanced_assert.h"
+#include "qtcore_helpers/qstring_helpers.hpp"
+
+DISABLE_COMPILER_WARNINGS
+#include <QDir>
+#include <QFont>
+#include <QIcon>
+#include <QStringList>
+RESTORE_COMPILER_WARNINGS
+
+#include <algorithm>
+#include <limits>
+
+void CSearchResultsModel::append(const std::vector<CFileSearchEngine::Match>& matches)
+{
+	if (matches.empty())
+		return;
+
+	const auto firstNewResult = static_cast<uint32_t>(_results.size());
+	_results.reserve(_results.size() + matches.size());
+	for (const auto& match : matches)
+	{
+		const QString& path = match.path;
+		const bool isDir = path.endsWith('/'); // The engine reports directories with the trailing separator
+		const qsizetype nameEnd = isDir ? path.size() - 1 : path.size();
+		const qsizetype lastSeparator = QStringView{ path }.first(nameEnd).lastIndexOf('/');
+
+		const Result result{
+			.pathOffset = _pathArena.size(),
+			.pathLength = static_cast<uint32_t>(path.size()),
+			.nameOffset = static_cast<uint32_t>(lastSeparator + 1),
+			.isDir = isDir,
+			.reachedThroughLink = match.reachedThroughLink
+		};
+
+		_pathArena.insert(_pathArena.end(), path.utf16(), path.utf16() + path.size());
+		++_fileCount;
+
+		if (match.locations.empty())
+		{
+			_results.push_back(result);
+			continue;
+		}
+
+		for (const auto& location : match.locations)
+		{
+			Result& locationResult = _results.emplace_back(result);
+			locationResult.line = location.line;
+			locationResult.offset = location.offset;
+			locationResult.contextOffset = _contextArena.size();
+			locationResult.contextLength = static_cast<uint32_t>(location.context.size());
+			_contextArena.insert(_contextArena.end(), location.context.utf16(), location.context.utf16() + location.context.size());
+		}
+	}
+
+	std::vector<uint32_t> newRows;
+	newRows.reserve(_results.size() - firstNewResult);
+	for (auto i = firstNewResult, end = static_cast<uint32_t>(_results.size()); i < end; ++i)
+	{
+		if (passesFilter(i))
+			newRows.push_back(i);
+	}
+
+	if (newRows.empty())
+		return;
+
+	if (_sortOrder != SortOrder::FoundOrder)
+		std::ranges::sort(newRows, [this](uint32_t l, uint32_t r) { return rowLessThan(l, r); });
+
+	// In the order found, and often when sorted too, the new rows simply go after the existing ones
+	if (_rows.empty() || !rowLessThan(newRows.front(), _rows.back()))
+	{
+		const int first = static_cast<int>(_rows.size());
+		beginInsertRows({}, first, first + static_cast<int>(newRows.size()) - 1);
+		_rows.insert(_rows.end(), newRows.begin(), newRows.end());
+		endInsertRows();
+		return;
+	}
+
+	changeLayout([&] {
+		const auto middle = static_cast<std::ptrdiff_t>(_rows.size());
+		_rows.insert(_rows.end(), newRows.begin(), newRows.end());
+		std::inplace_merge(_rows.begin(), _rows.begin() + middle, _rows.end(), [this](uint32_t l, uint32_t r) { return rowLessThan(l, r); });
+	});
+}
+
+void CSearchResultsModel::clear()
+{
+	beginResetModel();
+	_pathArena = {};
+	_contextArena = {};
+	_results = {};
+	_fileCount = 0;
+	_rows = {};
+	endResetModel();
+}
+
+void CSearchResultsModel::setFilter(const QString& text)
+{
+	const QString filter = QDir::fromNativeSeparators(text);
+	if (filter == _filter)
+		return;
+
+	// A longer filter can only narrow what is shown, so only the rows already shown need checking - and they are already in order
+	const bool narrowing = filter.contains(_filter, Qt::CaseInsensitive);
+	_filter = filter;
+
+	beginResetModel();
+	if (narrowing)
+		std::erase_if(_rows, [this](uint32_t result) { return !passesFilter(result); });
+	else
+	{
+		_rows.clear();
+		for (uint32_t i = 0, end = static_cast<uint32_t>(_results.size()); i < end; ++i)
+		{
+			if (passesFilter(i))
+				_rows.push_back(i);
+		}
+
+		if (_sortOrder != SortOrder::FoundOrder)
+			std::ranges::sort(_rows, [this](uint32_t l, uint32_t r) { return rowLessThan(l, r); });
+	}
+	endResetModel();
+}
+
+void CSearchResultsModel::setSortOrder(SortOrder order)
+{
+	if (order == _sortOrder)
+		return;
+
+	_sortOrder = order;
+	changeLayout([this] {
+		std::ranges::sort(_rows, [this](uint32_t l, uint32_t r) { return rowLessThan(l, r); });
+	});
+}
+
+size_t CSearchResultsModel::resultCount() const noexcept
+{
+	return _fileCount;
+}
+
+void CSearchResultsModel::forEachPath(const std::function<void(const QString&)>& visitor) const
+{
+	// The rows of one file's locations are consecutive, and share the path
+	const Result* previous = nullptr;
+	for (const Result& result : _results)
+	{
+		if (!previous || previous->pathOffset != result.pathOffset)
+			visitor(pathView(result).toString());
+		previous = &result;
+	}
+}
+
+int CSearchResultsModel::rowCount(const QModelIndex& parent) const
+{
+	return parent.isValid() ? 0 : static_cast<int>(_rows.size());
+}
+
+QVariant CSearchResultsModel::data(const QModelIndex& index, int role) const
+{
+	if (!index.isValid() || index.row() >= static_cast<int>(_rows.size()))
+		return {};
+
+	const Result& result = _results[_rows[static_cast<size_t>(index.row())]];
+	switch (role)
+	{
+	case Qt::DisplayRole:
+	{
+		QStringView path = pathView(result);
+		if (result.line != 0)
+			return QSL("%1:%2: %3").arg(toNativeSeparators(path.toString())).arg(result.line).arg(contextView(result));
+		else if (!result.isDir)
+			return toNativeSeparators(path.toString());
+
+		path.chop(1);
+		QString name = toNativeSeparators(path.toString());
+		name.prepend('[').append(']');
+		return name;
+	}
+	case Qt::DecorationRole:
+		return CIconProvider::iconForFilesystemObject(CFileSystemObject{ pathView(result).toString() }, true);
+	case Qt::ToolTipRole:
+	{
+		QStringList lines;
+		if (result.line != 0)
+			lines.push_back(tr("Line %1, byte offset %2").arg(result.line).arg(result.offset));
+		// The same file can also be listed under its direct path; marking this one keeps the pair from reading as
+		// a duplicate the search shouldn't have produced.
+		if (result.reachedThroughLink)
+			lines.push_back(tr("Found by following a directory link"));
+		return lines.isEmpty() ? QVariant{} : QVariant{ lines.join('\n') };
+	}
+	case Qt::FontRole:
+		if (result.reachedThroughLink)
+		{
+			QFont font;
+			font.setItalic(true);
+			return font;
+		}
+		return {};
+	case PathRole:
+		return pathView(result).toString();
+	case LineRole:
+		return QVariant::fromValue(result.line);
+	case OffsetRole:
+		return QVariant::fromValue(result.offset);
+	default:
+		return {};
+	}
+}
+
+QStringView CSearchResultsModel::pathView(const Result& result) const noexcept
+{
+	return QStringView{ _pathArena.data() + result.pathOffset, static_cast<qsizetype>(result.pathLength) };
+}
+
+QStringView CSearchResultsModel::contextView(const Result& result) const noexcept
+{
+	return QStringView{ _contextArena.data() + result.contextOffset, static_cast<qsizetype>(result.contextLength) };
+}
+
+QStringView CSearchResultsModel::nameView(const Result& result) const noexcept
+{
+	return pathView(result).sliced(result.nameOffset);
+}
+
+bool CSearchResultsModel::passesFilter(uint32_t resultIndex) const noexcept
+{
+	return _filter.isEmpty() || pathView(_results[resultIndex]).contains(_filter, Qt::CaseInsensitive);
+}
+
+bool CSearchResultsModel::rowLessThan(uint32_t left, uint32_t right) const noexcept
+{
+	const Result& l = _results[left];
+	const Result& r = _results[right];
+
+	int order = 0;
+	if (_sortOrder == SortOrder::ByName)
+		order = nameView(l).compare(nameView(r), Qt::CaseInsensitive);
+	if (order == 0 && _sortOrder != SortOrder::FoundOrder)
+		order = pathView(l).compare(pathView(r), Qt::CaseInsensitive);
+
+	// Equal keys stay in the order found, which also makes the order the same however the rows got there
+	return order != 0 ? order < 0 : left < right;
+}
+
+void CSearchResultsModel::changeLayout(const std::function<void()>& reorderRows)
+{
+	emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+
+	const QModelIndexList persistentIndexes = persistentIndexList();
+	std::vector<uint32_t> persistentResults;
+	persistentResults.reserve(static_cast<size_t>(persistentIndexes.size()));
+	for (const QModelIndex& index : persistentIndexes)
+		persistentResults.push_back(_rows[static_cast<size_t>(index.row())]);
+
+	reorderRows();
+
+	if (!persistentIndexes.isEmpty())
+	{
+		std::vector<uint32_t> rowOfResult(_results.size(), std::numeric_limits<uint32_t>::max());
+		for (uint32_t row = 0, rowCount = static_cast<uint32_t>(_rows.size()); row < rowCount; ++row)
+			rowOfResult[_rows[row]] = row;
+
+		QModelIndexList updatedIndexes;
+		updatedIndexes.reserve(persistentIndexes.size());
+		for (const uint32_t result : persistentResults)
+		{
+			assert_debug_only(rowOfResult[result] != std::numeric_limits<uint32_t>::max()); // Reordering neither adds nor removes rows that were shown
+			updatedIndexes.push_back(index(static_cast<int>(rowOfResult[result])));
+		}
+
+		changePersistentIndexList(persistentIndexes, updatedIndexes);
+	}
+
+	emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "filesearchengine/cfilesearchengine.h"
+
+#include "compiler/compiler_warnings_control.h"
+
+DISABLE_COMPILER_WARNINGS
+#include <QAbstractListModel>
+#include <QString>
+RESTORE_COMPILER_WARNINGS
+
+#include <functional>
+#include <stdint.h>
+#include <vector>
+
+// The results of a file search, for a view to show however many there are. The paths are packed back to back into one
+// buffer, so a result costs its characters and a few bytes of bookkeeping rather than a string and a widget item of its
+// own; the text, icon and font of a row are only made when the view asks for that row.
+// The rows can be narrowed by a filter and sorted. Results that arrive meanwhile are filtered and sorted on their own
+// and merged in, without revisiting the rows already in place.
+// A content search match that comes with its locations in the file takes a row per location, showing the line number
+// and the text around the match; the rows of one file share its path.
+class CSearchResultsModel final : public QAbstractListModel
+{
+public:
+	enum class SortOrder {
+		FoundOrder,
+		ByPath,
+		ByName
+	};
+
+	enum Role {
+		PathRole = Qt::UserRole + 1,
+		LineRole, // 1-based; 0 for a row without a location
+		OffsetRole
+	};
+
+	using QAbstractListModel::QAbstractListModel;
+
+	void append(const std::vector<CFileSearchEngine::Match>& matches);
+	void clear();
+
+	// Only the results whose path contains this text, in any letter case, are shown; an empty filter shows them all.
+	void setFilter(const QString& text);
+	void setSortOrder(SortOrder order);
+
+	// Every file or folder found, including the ones the filter hides, however many rows each takes.
+	[[nodiscard]] size_t resultCount() const noexcept;
+	// In the order found, regardless of the sort order and the filter, and once per file.
+	void forEachPath(const std::function<void(const QString& path)>& visitor) const;
+
+	[[nodiscard]] int rowCount(const QModelIndex& parent = {}) const override;
+	[[nodiscard]] QVariant data(const QModelIndex& index, int role) const override;
+
+private:
+	struct Result
+	{
+		uint64_t pathOffset;
+		uint32_t pathLength;
+		uint32_t nameOffset; // From the path's start: the name is what follows the last separator, except a directory's trailing one
+		bool isDir;
+		bool reachedThroughLink;
+
+		uint64_t line = 0;
+		uint64_t offset = 0;
+		uint64_t contextOffset = 0; // Into _contextArena
+		uint32_t contextLength = 0;
+	};
+
+	[[nodiscard]] QStringView pathView(const Result& result) const noexcept;
+	[[nodiscard]] QStringView contextView(const Result& result) const noexcept;
+	[[nodiscard]] QStringView nameView(const Result& result) const noexcept;
+
+	[[nodiscard]] bool passesFilter(uint32_t resultIndex) const noexcept;
+	[[nodiscard]] bool rowLessThan(uint32_t left, uint32_t right) const noexcept;
+
+	// Reorders the rows within a layout change, keeping the persistent indexes - the selection, the current item -
+	// pointing at the same results.
+	void changeLayout(const std::function<void()>& reorderRows);
+
+private:
+	std::vector<char16_t> _pathArena;
+	std::vector<char16_t> _contextArena;
+	std::vector<Result> _results;
+	size_t _fileCount = 0;
+	// The results shown, as indexes into _results, in display order
+	std::vector<uint32_t> _rows;
+
+	QString _filter;
+	SortOrder _sortOrder = SortOrder::FoundOrder;
+};
@@ -12,6 +12,9 @@ CFileOperationConfirmationPrompt::CFileOperationConfirmationPrompt(const QString
 	ui->_label->setText(labelText);
 	ui->_editField->setText(editText);
 	ui->_editField->selectAll();
+	ui->_cbVerify->setVisible(false);
+	ui->_cbWriteManifest->setVisible(false);
+	ui->_cbResumeLargeFiles->setVisible(false);
 	setWindowTitle(caption);
 }
 
@@ -24,3 +27,33 @@ QString CFileOperationConfirmationPrompt::text() const
 {
 	return ui->_editField->text();
 }
+
+void CFileOperationConfirmationPrompt::setVerificationOptions(const bool verify, const bool writeManifest)
+{
+	ui->_cbVerify->setVisible(true);
+	ui->_cbWriteManifest->setVisible(true);
+	ui->_cbVerify->setChecked(verify);
+	ui->_cbWriteManifest->setChecked(writeManifest);
+	ui->_cbWriteManifest->setEnabled(verify);
+}
+
+bool CFileOperationConfirmationPrompt::verify() const
+{
+	return ui->_cbVerify->isChecked();
+}
+
+bool CFileOperationConfirmationPrompt::writeManifest() const
+{
+	return ui->_cbVerify->isChecked() && ui->_cbWriteManifest->isChecked();
+}
+
+void CFileOperationConfirmationPrompt::setResumeOption(const bool resumeLargeFiles)
+{
+	ui->_cbResumeLargeFiles->setVisible(true);
+	ui->_cbResumeLargeFiles->setChecked(resumeLargeFiles);
+}
+
+bool CFileOperationConfirmationPrompt::resumeLargeFiles() const
+{
+	return ui->_cbResumeLargeFiles->isChecked();
+}
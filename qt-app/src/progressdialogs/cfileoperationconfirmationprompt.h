@@ -18,6 +18,14 @@ public:
 
 	[[nodiscard]] QString text() const;
 
+	// The copy verification options (TransferRequest::verification and verificationManifest); hidden unless set up
+	void setVerificationOptions(bool verify, bool writeManifest);
+	[[nodiscard]] bool verify() const;
+	[[nodiscard]] bool writeManifest() const;
+	// TransferRequest::resumeLargeFiles, for copies only; hidden unless set up
+	void setResumeOption(bool resumeLargeFiles);
+	[[nodiscard]] bool resumeLargeFiles() const;
+
 private:
 	Ui::CFileOperationConfirmationPrompt *ui;
 };
@@ -12,8 +12,10 @@
 DISABLE_COMPILER_WARNINGS
 #include "ui_cfileoperationdialog.h"
 
+#include <QActionGroup>
 #include <QCloseEvent>
 #include <QDir>
+#include <QMenu>
 #include <QMessageBox>
 #include <QTimer>
 RESTORE_COMPILER_WARNINGS
@@ -52,6 +54,16 @@ QString operationVerb(const PromptOperation operation)
 	return {};
 }
 
+// What the speed limit menu offers, in bytes per second
+constexpr uint64_t speedLimitChoices[] {
+	1 * 1024 * 1024,
+	5 * 1024 * 1024,
+	10 * 1024 * 1024,
+	25 * 1024 * 1024,
+	50 * 1024 * 1024,
+	100 * 1024 * 1024
+};
+
 // The primary-unit rate, formatted for its unit: bytes per second, or whole items per second.
 QString speedText(const uint64_t primaryUnitsPerSecond, const PrimaryProgressUnit unit)
 {
@@ -63,13 +75,14 @@ QString speedText(const uint64_t primaryUnitsPerSecond, const PrimaryProgressUni
 } // namespace
 
 CFileOperationDialog::CFileOperationDialog(FileOperationRequest request, std::function<QPoint(QSize)> backgroundAnchorProvider,
-	QWidget* parent, const uint64_t transferChunkSize) :
+	QWidget* parent, const uint64_t transferChunkSize, CFileOperationQueue* const queue, CTransferThrottle* const sharedThrottle) :
 	QWidget(parent, Qt::Window),
 	ui(new Ui::CFileOperationDialog),
 	_operation(operationFromRequest(request)),
 	_primaryUnit(unitFromRequest(request)),
 	_backgroundAnchorProvider(mv(backgroundAnchorProvider)),
-	_job(mv(request), transferChunkSize)
+	_job(mv(request), transferChunkSize, CFileOperationJob::interactiveFileCopyWorkers, queue, PageCachePolicy::Automatic, sharedThrottle),
+	_sharedThrottle(sharedThrottle)
 {
 	ui->setupUi(this);
 
@@ -89,14 +102,23 @@ CFileOperationDialog::CFileOperationDialog(FileOperationRequest request, std::fu
 	ui->_lblCurrentFile->clear();
 	ui->_lblStatus->clear();
 	ui->_lblSummary->hide();
+	ui->_btnStartNext->hide();
+	ui->_btnMoveUp->hide();
 	setWindowTitle(operationVerb(_operation) % QSL("..."));
 	ui->_lblOperationName->setText(windowTitle());
 
-	// The per-file byte bar is meaningful only for byte-unit transfers; delete tracks whole items.
+	// The per-file byte bar and the speed limit are meaningful only for byte-unit transfers; delete tracks whole items.
 	if (_primaryUnit != PrimaryProgressUnit::Bytes)
 	{
 		ui->_fileProgress->hide();
 		ui->_fileProgressText->hide();
+		ui->_btnSpeedLimit->hide();
+	}
+	else
+	{
+		_speedLimitMenu = new QMenu{ this };
+		ui->_btnSpeedLimit->setMenu(_speedLimitMenu);
+		connect(_speedLimitMenu, &QMenu::aboutToShow, this, &CFileOperationDialog::populateSpeedLimitMenu);
 	}
 
 	// While running this button cancels (and the dialog lives on until the job reports); once finished it
@@ -109,6 +131,9 @@ CFileOperationDialog::CFileOperationDialog(FileOperationRequest request, std::fu
 	});
 	connect(ui->_btnPause, &QPushButton::clicked, this, &CFileOperationDialog::togglePause);
 	connect(ui->_btnBackground, &QPushButton::clicked, this, &CFileOperationDialog::switchToBackground);
+	// Only shown while the job waits in the queue. Neither overtakes a running job: the queue never preempts one.
+	connect(ui->_btnStartNext, &QPushButton::clicked, this, [this] { (void)_job.prioritize(); });
+	connect(ui->_btnMoveUp, &QPushButton::clicked, this, [this] { (void)_job.moveUp(); });
 
 	_eventTimer = new QTimer{ this };
 	_eventTimer->setObjectName(QSL("eventTimer")); // Named so a test can find and stop it unambiguously
@@ -166,6 +191,18 @@ void CFileOperationDialog::renderProgress(const ProgressSnapshot& snapshot)
 	if (snapshot.currentEntry)
 		ui->_lblCurrentFile->setText(QDir::toNativeSeparators(snapshot.currentEntry->value()));
 
+	ui->_btnStartNext->setVisible(snapshot.phase == OperationPhase::Queued);
+	ui->_btnMoveUp->setVisible(snapshot.phase == OperationPhase::Queued);
+
+	if (snapshot.phase == OperationPhase::Queued)
+	{
+		ui->_overallProgress->setMaximum(0);
+		ui->_overallProgressText->clear();
+		ui->_lblStatus->setText(tr("Waiting for other operations on the same disk to finish..."));
+		ui->_lblOperationName->setText(tr("Queued"));
+		return;
+	}
+
 	if (snapshot.phase == OperationPhase::Scanning)
 	{
 		// Indeterminate overall bar plus the running discovered count; no total, no ETA yet.
@@ -202,6 +239,12 @@ void CFileOperationDialog::renderProgress(const ProgressSnapshot& snapshot)
 	}
 
 	QString status = operationVerb(_operation) % QSL("  ") % speedText(snapshot.primaryUnitsPerSecond, _primaryUnit);
+	// The average lags behind a limit changed mid-operation; what is held against the limit is the recent throughput
+	if (bytes && snapshot.bytesPerSecondLimit)
+	{
+		const uint64_t recent = snapshot.recentBytesPerSecond.value_or(snapshot.primaryUnitsPerSecond);
+		status += tr(" (now %1 of a %2 limit)").arg(speedText(recent, _primaryUnit), speedText(*snapshot.bytesPerSecondLimit, _primaryUnit));
+	}
 	if (snapshot.secondsRemaining)
 		status += QSL(", ") % secondsToTimeIntervalString(*snapshot.secondsRemaining) % QSL(" remaining");
 	ui->_lblStatus->setText(status);
@@ -233,6 +276,9 @@ void CFileOperationDialog::handleCompletion(const OperationSummary& summary)
 	ui->_lblStatus->clear();
 	ui->_lblOperationName->hide();
 	ui->_btnPause->hide();
+	ui->_btnStartNext->hide();
+	ui->_btnMoveUp->hide();
+	ui->_btnSpeedLimit->hide();
 	ui->_btnBackground->hide();
 	ui->_btnCancel->setText(tr("Close"));
 	ui->_btnCancel->setEnabled(true);
@@ -332,6 +378,12 @@ void CFileOperationDialog::setPaused(const bool paused)
 	ui->_overallProgress->setState(_paused ? psPaused : psNormal);
 }
 
+void CFileOperationDialog::setTransferRateLimit(const std::optional<uint64_t> bytesPerSecond)
+{
+	_transferRateLimit = bytesPerSecond;
+	_job.setTransferRateLimit(bytesPerSecond);
+}
+
 void CFileOperationDialog::togglePause()
 {
 	setPaused(!_paused);
@@ -339,6 +391,9 @@ void CFileOperationDialog::togglePause()
 
 void CFileOperationDialog::switchToBackground()
 {
+	// Out of sight, the operation makes way for the ones the user is watching
+	_job.setTransferPriority(TransferPriority::Background);
+
 	ui->_lblCurrentFile->hide();
 	ui->_fileProgress->hide();
 	ui->_fileProgressText->hide();
@@ -365,6 +420,36 @@ void CFileOperationDialog::switchToBackground()
 	}, Qt::QueuedConnection);
 }
 
+void CFileOperationDialog::populateSpeedLimitMenu()
+{
+	_speedLimitMenu->clear(); // Deletes the actions, but not their groups
+	qDeleteAll(_speedLimitMenu->findChildren<QActionGroup*>(Qt::FindDirectChildrenOnly));
+
+	// One exclusive group of choices per limit, the current one checked
+	const auto addChoices = [this](const std::optional<uint64_t> current, const std::function<void(std::optional<uint64_t>)>& apply) {
+		auto* const group = new QActionGroup{ _speedLimitMenu };
+		const auto addChoice = [&](const QString& text, const std::optional<uint64_t> limit) {
+			QAction* const action = _speedLimitMenu->addAction(text, this, [apply, limit] { apply(limit); });
+			action->setCheckable(true);
+			action->setChecked(current == limit);
+			group->addAction(action);
+		};
+
+		addChoice(tr("Unlimited"), std::nullopt);
+		for (const uint64_t limit : speedLimitChoices)
+			addChoice(speedText(limit, PrimaryProgressUnit::Bytes), limit);
+	};
+
+	_speedLimitMenu->addSection(tr("This operation"));
+	addChoices(_transferRateLimit, [this](const std::optional<uint64_t> limit) { setTransferRateLimit(limit); });
+
+	if (_sharedThrottle)
+	{
+		_speedLimitMenu->addSection(tr("All operations"));
+		addChoices(_sharedThrottle->limit(), [throttle{ _sharedThrottle }](const std::optional<uint64_t> limit) { throttle->setLimit(limit); });
+	}
+}
+
 bool CFileOperationDialog::confirmCancellation()
 {
 	if (_result) // Already finished: the button now means Close
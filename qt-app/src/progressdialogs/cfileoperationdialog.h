@@ -16,6 +16,7 @@ namespace Ui {
 class CFileOperationDialog;
 }
 
+class QMenu;
 class QTimer;
 
 // The one internal-operation dialog for copy, move, and permanent delete. Owns one CFileOperationJob,
@@ -29,9 +30,12 @@ class CFileOperationDialog : public QWidget, private CFileOperationListener
 {
 public:
 	// backgroundAnchorProvider maps this dialog's frame size to the frame top-left it should occupy in background
-	// mode; empty is allowed (background mode then keeps the current position).
+	// mode; empty is allowed (background mode then keeps the current position). queue and sharedThrottle: see
+	// CFileOperationJob. The speed limit menu sets this operation's own limit, and the shared one if there is one.
+	// Sending the dialog to the background sends the job there, too (TransferPriority::Background).
 	CFileOperationDialog(FileOperationRequest request, std::function<QPoint(QSize)> backgroundAnchorProvider,
-		QWidget* parent = nullptr, uint64_t transferChunkSize = 8 * 1024 * 1024);
+		QWidget* parent = nullptr, uint64_t transferChunkSize = adaptiveTransferChunkSize, CFileOperationQueue* queue = nullptr,
+		CTransferThrottle* sharedThrottle = nullptr);
 	~CFileOperationDialog() override;
 
 	CFileOperationDialog(const CFileOperationDialog&) = delete;
@@ -59,6 +63,8 @@ public:
 	void requestCancellation();
 
 	void setPaused(bool paused);
+	// This operation's own throughput limit, in bytes per second; nullopt: unlimited
+	void setTransferRateLimit(std::optional<uint64_t> bytesPerSecond);
 
 	[[nodiscard]] bool isInBackgroundMode() const noexcept { return _isInBackgroundMode; }
 
@@ -91,9 +97,12 @@ private:
 
 	void togglePause();
 	void switchToBackground();
+	// Rebuilt every time it is shown: another dialog may have changed the shared limit since
+	void populateSpeedLimitMenu();
 	[[nodiscard]] bool confirmCancellation();
 
 	Ui::CFileOperationDialog* ui;
+	QMenu* _speedLimitMenu = nullptr;
 
 	// Declared before _job: their initializers read the request that _job's initializer then moves from.
 	const PromptOperation _operation;
@@ -101,6 +110,8 @@ private:
 	const std::function<QPoint(QSize)> _backgroundAnchorProvider;
 
 	CFileOperationJob _job;
+	CTransferThrottle* const _sharedThrottle;
+	std::optional<uint64_t> _transferRateLimit;
 
 	QTimer* _eventTimer = nullptr;
 	bool _draining = false; // A modal prompt spins a nested loop; the timer must not re-enter the drain
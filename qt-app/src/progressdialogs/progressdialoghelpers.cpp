@@ -66,6 +66,9 @@ QString fileOperationFailedActionText(const FailedAction action)
 	case RemovePublishedMoveSource: return QObject::tr("Removing the moved entry's source");
 	case CleanupStaging: return QObject::tr("Removing the temporary destination file");
 	case PreserveDirectoryTimestamps: return QObject::tr("Preserving the folder's timestamps");
+	case VerifyDestination: return QObject::tr("Verifying the destination file against the source");
+	case WriteVerificationManifest: return QObject::tr("Writing the list of verified files");
+	case WriteTransferJournal: return QObject::tr("Recording the progress of the copy");
 	}
 	return {};
 }
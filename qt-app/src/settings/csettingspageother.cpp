@@ -21,6 +21,10 @@ CSettingsPageOther::CSettingsPageOther(QWidget *parent) :
 
 	ui->_shellCommandName->setText(s.value(KEY_OTHER_SHELL_COMMAND_NAME, shellCommandLine).toString());
 	ui->_cbCheckForUpdatesAutomatically->setChecked(s.value(KEY_OTHER_CHECK_FOR_UPDATES_AUTOMATICALLY, true).toBool());
+	ui->_scanExclusionPatterns->setText(s.value(KEY_OTHER_SCAN_EXCLUSION_PATTERNS).toStringList().join(QSL("; ")));
+	ui->_cbUseIgnoreFiles->setChecked(s.value(KEY_OTHER_SCAN_USE_IGNORE_FILES, false).toBool());
+	ui->_cbContentIndex->setChecked(s.value(KEY_OTHER_CONTENT_INDEX_ENABLED, false).toBool());
+	ui->_contentIndexRoots->setText(s.value(KEY_OTHER_CONTENT_INDEX_ROOTS).toStringList().join(QSL("; ")));
 }
 
 CSettingsPageOther::~CSettingsPageOther()
@@ -33,4 +37,18 @@ void CSettingsPageOther::acceptSettings()
 	CSettings s;
 	s.setValue(KEY_OTHER_SHELL_COMMAND_NAME, ui->_shellCommandName->text());
 	s.setValue(KEY_OTHER_CHECK_FOR_UPDATES_AUTOMATICALLY, ui->_cbCheckForUpdatesAutomatically->isChecked());
+
+	QStringList exclusionPatterns = ui->_scanExclusionPatterns->text().split(';', Qt::SkipEmptyParts);
+	for (QString& pattern : exclusionPatterns)
+		pattern = pattern.trimmed();
+	exclusionPatterns.removeAll(QString{});
+	s.setValue(KEY_OTHER_SCAN_EXCLUSION_PATTERNS, exclusionPatterns);
+	s.setValue(KEY_OTHER_SCAN_USE_IGNORE_FILES, ui->_cbUseIgnoreFiles->isChecked());
+
+	QStringList contentIndexRoots = ui->_contentIndexRoots->text().split(';', Qt::SkipEmptyParts);
+	for (QString& root : contentIndexRoots)
+		root = root.trimmed();
+	contentIndexRoots.removeAll(QString{});
+	s.setValue(KEY_OTHER_CONTENT_INDEX_ENABLED, ui->_cbContentIndex->isChecked());
+	s.setValue(KEY_OTHER_CONTENT_INDEX_ROOTS, contentIndexRoots);
 }
@@ -3,6 +3,7 @@
 #include "ccontroller.h"
 #include "cpanel.h"
 #include "filesystemhelperfunctions.h"
+#include "settings.h"
 
 #include "dialogs/csimpleprogressdialog.h"
 
@@ -56,6 +57,8 @@ std::optional<FolderComparisonResult> runFolderComparison(QWidget* parent, const
 	std::atomic<bool> abort{ false };
 	QObject::connect(&progressDialog, &QDialog::rejected, [&abort]() { abort = true; });
 
+	const ScanExclusions exclusions = scanExclusionsFromSettings();
+
 	FolderComparisonResult result;
 	std::thread worker{ [&]() {
 		// Folded pairing: the two panels routinely sit on filesystems that disagree on case or Unicode normalization.
@@ -64,7 +67,7 @@ std::optional<FolderComparisonResult> runFolderComparison(QWidget* parent, const
 				progressDialog.setLabelText(QObject::tr("Comparing file contents..."));
 				progressDialog.setValue(percent);
 			}, Qt::QueuedConnection);
-		});
+		}, exclusions);
 
 		QMetaObject::invokeMethod(&progressDialog, [&progressDialog]() { progressDialog.accept(); }, Qt::QueuedConnection);
 	} };